@@ -317,6 +317,31 @@ void dStr_append (Dstr *ds, const char *s)
    dStr_append_l(ds, s, strlen(s));
 }
 
+/**
+ * Make room for at least 'l' more bytes at the end of a Dstr, and return
+ * a pointer to them. They become part of the string with dStr_extend().
+ * (This allows reading data straight into the string)
+ */
+char *dStr_reserve (Dstr *ds, int l)
+{
+   int n_sz;
+
+   for (n_sz = ds->sz; ds->len + l >= n_sz; n_sz *= 2);
+   if (n_sz > ds->sz) {
+      dStr_resize(ds, n_sz, (ds->len > 0) ? 1 : 0);
+   }
+   return ds->str + ds->len;
+}
+
+/**
+ * Append 'l' bytes that were written in the space given by dStr_reserve().
+ */
+void dStr_extend (Dstr *ds, int l)
+{
+   ds->len += l;
+   ds->str[ds->len] = 0;
+}
+
 /**
  * Create a new string.
  * Initialized to 's' or empty if 's == NULL'
@@ -47,6 +47,7 @@ class ResourceFactory;
 
 #include "tools.hh"
 #include "types.hh"
+#include "pixel.hh"
 #include "events.hh"
 #include "imgbuf.hh"
 #include "imgrenderer.hh"
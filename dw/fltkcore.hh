@@ -13,6 +13,7 @@ class FltkResource;
 } // namespace fltk
 } // namespace dw
 
+#include <FL/Fl.H>
 #include <FL/Fl_Widget.H>
 
 #include "core.hh"
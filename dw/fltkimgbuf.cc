@@ -40,7 +40,9 @@ const enum ScaleMode { SIMPLE, BEAUTIFUL, BEAUTIFUL_GAMMA }
 Vector <FltkImgbuf::GammaCorrectionTable> *FltkImgbuf::gammaCorrectionTables
    = new Vector <FltkImgbuf::GammaCorrectionTable> (true, 2);
 
-uchar *FltkImgbuf::findGammaCorrectionTable (double gamma)
+unsigned long FltkImgbuf::drawCount = 0;
+
+unsigned *FltkImgbuf::findGammaCorrectionTable (double gamma)
 {
    // Since the number of possible keys is low, a linear search is
    // sufficiently fast.
@@ -137,9 +139,7 @@ void FltkImgbuf::init (Type type, int width, int height, double gamma,
       }
       _MSG("FltkImgbuf::init this=%p width=%d height=%d bpp=%d gamma=%g\n",
            this, width, height, bpp, gamma);
-      rawdata = new uchar[bpp * width * height];
-      // Set light-gray as interim background color.
-      memset(rawdata, 222, width*height*bpp);
+      allocData ();
 
       refCount = 1;
       deleteOnUnref = true;
@@ -156,12 +156,24 @@ void FltkImgbuf::init (Type type, int width, int height, double gamma,
          scaledBuffers = new lout::container::typed::List <FltkImgbuf> (true);
       else
          scaledBuffers = NULL;
+      vectorSource = NULL;
+      rootWidth = width;
+      rootHeight = height;
+      reloader = NULL;
+      lastDrawn = 0;
+      tooSmall = false;
+      reloadTarget = NULL;
 
       if (!isRoot()) {
-         // Scaling
-         for (int row = 0; row < root->height; row++) {
-            if (root->copiedRows->get (row))
-               scaleRow (row, root->rawdata + row*root->width*root->bpp);
+         if (root->vectorSource) {
+            // Vector image: draw it at this size
+            drawFromSource ();
+         } else {
+            // Scaling
+            for (int row = 0; row < root->height; row++) {
+               if (root->copiedRows->get (row))
+                  scaleRow (row, root->rawdata + row*root->width*root->bpp);
+            }
          }
       }
    }
@@ -179,6 +191,9 @@ FltkImgbuf::~FltkImgbuf ()
 
    if (scaledBuffers)
       delete scaledBuffers;
+   delete vectorSource;
+   delete reloader;
+   delete reloadTarget;
 
    DBG_OBJ_DELETE ();
 }
@@ -205,6 +220,156 @@ void FltkImgbuf::setCMap (int *colors, int num_colors)
 {
 }
 
+/**
+ * \brief Draw a scaled buffer of a vector image, at its size, from the
+ *    source of the root buffer.
+ */
+void FltkImgbuf::drawFromSource ()
+{
+   root->vectorSource->draw (rawdata, width, height);
+   for (int row = 0; row < height; row++)
+      copiedRows->set (row, true);
+}
+
+void FltkImgbuf::setVectorSource (core::Imgbuf::VectorSource *source)
+{
+   assert (isRoot());
+
+   delete vectorSource;
+   vectorSource = source;
+
+   // Scaled buffers that already exist are drawn again
+   if (vectorSource) {
+      for (Iterator <FltkImgbuf> it = scaledBuffers->iterator();
+           it.hasNext(); )
+         it.getNext()->drawFromSource ();
+   }
+}
+
+void FltkImgbuf::setRootSize (int width, int height)
+{
+   assert (isRoot());
+
+   rootWidth = width;
+   rootHeight = height;
+}
+
+void FltkImgbuf::setReloader (core::Imgbuf::Reloader *reloader)
+{
+   assert (isRoot());
+
+   delete this->reloader;
+   this->reloader = reloader;
+}
+
+/**
+ * \brief Allocate the image data, filled with the interim background color.
+ */
+void FltkImgbuf::allocData ()
+{
+   rawdata = new uchar[bpp * width * height];
+   // Set light-gray as interim background color.
+   memset(rawdata, 222, width*height*bpp);
+}
+
+void FltkImgbuf::reclaim ()
+{
+   assert (isRoot() && reloader && !vectorSource);
+
+   if (rawdata) {
+      delete[] rawdata;
+      rawdata = NULL;
+      copiedRows->clear ();
+
+      for (Iterator <FltkImgbuf> it = scaledBuffers->iterator();
+           it.hasNext(); ) {
+         FltkImgbuf *sb = it.getNext ();
+         delete[] sb->rawdata;
+         sb->rawdata = NULL;
+         sb->copiedRows->clear ();
+      }
+   }
+}
+
+/**
+ * \brief If the image data was reclaimed, allocate it again, and let the
+ *    reloader copy the rows.
+ *
+ * Scaled buffers created in the meantime already have their data. When
+ * the reloader copies the rows later, 'target' (if any) is drawn again
+ * then, see reloadDone().
+ */
+void FltkImgbuf::reload (Fl_Widget *target)
+{
+   if (!isRoot()) {
+      root->reload (target);
+   } else {
+      if (tooSmall)
+         unreduce ();
+      if (rawdata == NULL) {
+         allocData ();
+         for (Iterator <FltkImgbuf> it = scaledBuffers->iterator();
+              it.hasNext(); ) {
+            FltkImgbuf *sb = it.getNext ();
+            if (sb->rawdata == NULL)
+               sb->allocData ();
+         }
+         if (!reloader->reload () && target) {
+            delete reloadTarget;
+            reloadTarget = new Fl_Widget_Tracker (target);
+         }
+      }
+   }
+}
+
+void FltkImgbuf::reloadDone ()
+{
+   assert (isRoot());
+
+   if (reloadTarget) {
+      if (reloadTarget->exists ())
+         reloadTarget->widget()->redraw ();
+      delete reloadTarget;
+      reloadTarget = NULL;
+   }
+}
+
+/**
+ * \brief Grow a root buffer holding a reduced copy of the image to the size
+ *    of the image, if the reloader can copy the whole image now.
+ *
+ * The data is freed, and the rows are copied again when it is drawn.
+ * Otherwise, it is tried again the next time it is drawn.
+ */
+void FltkImgbuf::unreduce ()
+{
+   if (reloader && !vectorSource &&
+       reloader->unreduce (rootWidth, rootHeight)) {
+      reclaim ();
+      width = rootWidth;
+      height = rootHeight;
+      delete copiedRows;
+      copiedRows = new lout::misc::BitSet (height);
+      tooSmall = false;
+   }
+}
+
+void FltkImgbuf::requireSize (int width, int height)
+{
+   if (!isRoot()) {
+      root->requireSize (width, height);
+   } else if ((width > this->width || height > this->height) &&
+              (this->width < rootWidth || this->height < rootHeight)) {
+      tooSmall = true;
+      unreduce ();
+   }
+}
+
+unsigned long FltkImgbuf::getLastDrawn ()
+{
+   return isRoot() ? lastDrawn : root->lastDrawn;
+}
+
 inline void FltkImgbuf::scaleRow (int row, const core::byte *data)
 {
    if (row < root->height) {
@@ -308,49 +473,23 @@ inline void FltkImgbuf::scaleRowBeautiful (int row, const core::byte *data)
  * If scaleMode is set to BEAUTIFUL_GAMMA, gamma correction is
  * considered, see <http://www.4p8.com/eric.brasseur/gamma.html>.
  *
- * TODO Could be optimized as in scaleRowSimple: when the destination
- * image is larger, calculate only one row/column, and copy it to the
- * other rows/columns.
+ * The work is done by dw::core::pixel::scaleBox, which uses the vector
+ * instructions of the CPU when available.
  */
 inline void FltkImgbuf::scaleBuffer (const core::byte *src, int srcWidth,
                                      int srcHeight, core::byte *dest,
                                      int destWidth, int destHeight, int bpp,
                                      double gamma)
 {
-   uchar *gammaMap1, *gammaMap2;
+   unsigned *gammaMap1 = NULL, *gammaMap2 = NULL;
 
    if (scaleMode == BEAUTIFUL_GAMMA) {
       gammaMap1 = findGammaCorrectionTable (gamma);
       gammaMap2 = findGammaCorrectionTable (1 / gamma);
    }
 
-   int *v = new int[bpp];
-   for(int x = 0; x < destWidth; x++) {
-      for(int y = 0; y < destHeight; y++) {
-         int xo1 = x * srcWidth / destWidth;
-         int xo2 = lout::misc::max ((x + 1) * srcWidth / destWidth, xo1 + 1);
-         int yo1 = y * srcHeight / destHeight;
-         int yo2 = lout::misc::max ((y + 1) * srcHeight / destHeight, yo1 + 1);
-         int n = (xo2 - xo1) * (yo2 - yo1);
-
-         for(int i = 0; i < bpp; i++)
-            v[i] = 0;
-
-         for(int xo = xo1; xo < xo2; xo++)
-            for(int yo = yo1; yo < yo2; yo++) {
-               const core::byte *ps = src + bpp * (yo * srcWidth + xo);
-               for(int i = 0; i < bpp; i++)
-                  v[i] +=
-                     (scaleMode == BEAUTIFUL_GAMMA ? gammaMap2[ps[i]] : ps[i]);
-            }
-
-         core::byte *pd = dest + bpp * (y * destWidth + x);
-         for(int i = 0; i < bpp; i++)
-            pd[i] =
-               scaleMode == BEAUTIFUL_GAMMA ? gammaMap1[v[i] / n] : v[i] / n;
-      }
-   }
-   delete[] v;
+   core::pixel::scaleBox (src, srcWidth, srcHeight, dest, destWidth,
+                          destHeight, bpp, gammaMap2, gammaMap1);
 }
 
 void FltkImgbuf::copyRow (int row, const core::byte *data)
@@ -369,9 +508,10 @@ void FltkImgbuf::copyRow (int row, const core::byte *data)
 
       memcpy(rawdata + row * width * bpp, data, width * bpp);
 
-      // Update all the scaled buffers of this root image.
+      // Update all the scaled buffers of this root image. Those of a
+      // vector image are complete already.
       for (Iterator <FltkImgbuf> it = scaledBuffers->iterator();
-           it.hasNext(); ) {
+           !vectorSource && it.hasNext(); ) {
          FltkImgbuf *sb = it.getNext ();
          sb->scaleRow (row, data);
       }
@@ -380,7 +520,7 @@ void FltkImgbuf::copyRow (int row, const core::byte *data)
 
 void FltkImgbuf::newScan ()
 {
-   if (isRoot()) {
+   if (isRoot() && !vectorSource) {
       for (Iterator<FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext();){
          FltkImgbuf *sb = it.getNext ();
          sb->copiedRows->clear();
@@ -472,12 +612,12 @@ void FltkImgbuf::getRowArea (int row, dw::core::Rectangle *area)
 
 int FltkImgbuf::getRootWidth ()
 {
-   return root ? root->width : width;
+   return root ? root->rootWidth : rootWidth;
 }
 
 int FltkImgbuf::getRootHeight ()
 {
-   return root ? root->height : height;
+   return root ? root->rootHeight : rootHeight;
 }
 
 core::Imgbuf *FltkImgbuf::createSimilarBuf (int width, int height)
@@ -491,6 +631,8 @@ void FltkImgbuf::copyTo (Imgbuf *dest, int xDestRoot, int yDestRoot,
    FltkImgbuf *fDest = (FltkImgbuf*)dest;
    assert (bpp == fDest->bpp);
 
+   reload (NULL);
+
    int xSrc2 = lout::misc::min (xSrc + widthSrc, fDest->width - xDestRoot);
    int ySrc2 = lout::misc::min (ySrc + heightSrc, fDest->height - yDestRoot);
 
@@ -593,6 +735,9 @@ void FltkImgbuf::draw (Fl_Widget *target, int xRoot, int yRoot,
         "        this->width=%d this->height=%d\n",
         xRoot, x, yRoot, y, width, height, this->width, this->height);
 
+   reload (target);
+   (isRoot() ? this : root)->lastDrawn = ++drawCount;
+
    if (x > this->width || y > this->height) {
       return;
    }
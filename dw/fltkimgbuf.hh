@@ -15,13 +15,19 @@ private:
    {
    public:
       double gamma;
-      uchar map[256];
+      unsigned map[256];
    };
 
    FltkImgbuf *root;
    int refCount;
    bool deleteOnUnref;
    lout::container::typed::List <FltkImgbuf> *scaledBuffers;
+   core::Imgbuf::VectorSource *vectorSource; // only for root buffers
+   int rootWidth, rootHeight; // size of the image, only for root buffers
+   core::Imgbuf::Reloader *reloader; // only for root buffers
+   unsigned long lastDrawn; // only for root buffers
+   bool tooSmall; // holds a reduced copy drawn larger, only for root buffers
+   Fl_Widget_Tracker *reloadTarget; // drawn while reloading, only for roots
 
    int width, height;
    Type type;
@@ -38,8 +44,9 @@ private:
 
    static lout::container::typed::Vector <GammaCorrectionTable>
       *gammaCorrectionTables;
+   static unsigned long drawCount;
 
-   static uchar *findGammaCorrectionTable (double gamma);
+   static unsigned *findGammaCorrectionTable (double gamma);
    static bool excessiveImageDimensions (int width, int height);
 
    FltkImgbuf (Type type, int width, int height, double gamma,
@@ -49,6 +56,10 @@ private:
    int backscaledY(int yScaled);
    int isRoot() { return (root == NULL); }
    void detachScaledBuf (FltkImgbuf *scaledBuf);
+   void drawFromSource ();
+   void allocData ();
+   void reload (Fl_Widget *target);
+   void unreduce ();
 
 protected:
    ~FltkImgbuf ();
@@ -69,6 +80,13 @@ public:
 
    void newScan ();
    void copyRow (int row, const core::byte *data);
+   void setVectorSource (core::Imgbuf::VectorSource *source);
+   void setRootSize (int width, int height);
+   void setReloader (core::Imgbuf::Reloader *reloader);
+   void reclaim ();
+   void reloadDone ();
+   unsigned long getLastDrawn ();
+   void requireSize (int width, int height);
    core::Imgbuf* getScaledBuf (int width, int height);
    void getRowArea (int row, dw::core::Rectangle *area);
    int  getRootWidth ();
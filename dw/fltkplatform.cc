@@ -44,6 +44,33 @@ namespace fltk {
 
 using namespace lout;
 
+/*
+ * The glyph after the one at 'idx'. fl_utf8fwd() only decodes the
+ * character it lands in, so there is no need to pass the whole string
+ * (and find its end) when it lands in the middle of one; when it lands
+ * at the start of one, there is nothing to decode at all.
+ */
+static int utf8Next (const char *text, int idx)
+{
+   const char *p = &text[idx + 1];
+
+   if ((*p & 0xc0) != 0x80)
+      return idx + 1;
+   return fl_utf8fwd (p, text, p + strnlen (p, 4)) - text;
+}
+
+/*
+ * The glyph before the one at 'idx', see utf8Next().
+ */
+static int utf8Prev (const char *text, int idx)
+{
+   const char *p = &text[idx - 1];
+
+   if ((*p & 0xc0) != 0x80)
+      return idx - 1;
+   return fl_utf8back (p, text, p + strnlen (p, 4)) - text;
+}
+
 /**
  * \todo Distinction between italics and oblique would be nice.
  */
@@ -57,6 +84,8 @@ container::typed::HashTable <lout::object::ConstString,
                              FltkFont::FontFamily> *FltkFont::systemFonts =
                              NULL;
 
+bool FltkFont::widthCacheEnabled = true;
+
 FltkFont::FontFamily FltkFont::standardFontFamily (FL_HELVETICA,
                                                    FL_HELVETICA_BOLD,
                                                    FL_HELVETICA_ITALIC,
@@ -116,6 +145,9 @@ FltkFont::FltkFont (core::style::FontAttrs *attrs)
 
    font = family->get (fa);
 
+   memset (asciiWidth, -1, sizeof (asciiWidth));
+   widthCache = NULL;
+
    fl_font(font, size);
    // WORKAROUND: A bug with fl_width(uint_t) on non-xft X was present in
    // 1.3.0 (STR #2688).
@@ -131,6 +163,7 @@ FltkFont::FltkFont (core::style::FontAttrs *attrs)
 FltkFont::~FltkFont ()
 {
    fontsTable->remove (this);
+   delete[] widthCache;
 }
 
 static void strstrip(char *big, const char *little)
@@ -223,6 +256,159 @@ FltkFont::create (core::style::FontAttrs *attrs)
    return font;
 }
 
+/**
+ * \brief Enable or disable the width caches of all fonts.
+ *
+ * Only useful to compare the speed with and without them; the widths are
+ * the same either way.
+ */
+void FltkFont::setWidthCacheEnabled (bool enabled)
+{
+   widthCacheEnabled = enabled;
+}
+
+int FltkFont::smallCapsSize ()
+{
+   return misc::roundInt (size * 0.78);
+}
+
+/**
+ * \brief Return the entry of the hashed cache where the width of a text
+ *    is, or would be stored.
+ *
+ * The cache is direct-mapped: a text replaces whatever had the same hash,
+ * so the caller has to compare the entry with the text.
+ */
+FltkFont::CachedWidth *FltkFont::findWidth (WidthKind kind, const char *text,
+                                            int len)
+{
+   if (widthCache == NULL) {
+      widthCache = new CachedWidth[WIDTH_CACHE_SIZE];
+      for (int i = 0; i < WIDTH_CACHE_SIZE; i++)
+         widthCache[i].len = 0;
+   }
+
+   // FNV-1a
+   unsigned int h = 2166136261u ^ kind;
+   for (int i = 0; i < len; i++)
+      h = (h ^ (unsigned char) text[i]) * 16777619u;
+
+   return &widthCache[h & (WIDTH_CACHE_SIZE - 1)];
+}
+
+int FltkFont::measureGlyph (bool small, const char *glyph, int len)
+{
+   fl_font (font, small ? smallCapsSize () : size);
+   return (int) fl_width (glyph, len);
+}
+
+/**
+ * \brief Return the width of a single glyph, at the font size or, if
+ *    \em small is set, at the size of lowercase letters in small caps.
+ *
+ * This does not include the letter spacing. ASCII characters are looked
+ * up in a table, other glyphs in the hashed cache.
+ */
+int FltkFont::glyphWidth (bool small, const char *glyph, int len)
+{
+   if (!widthCacheEnabled || len <= 0 || len > CACHED_WIDTH_MAX_LEN)
+      return measureGlyph (small, glyph, len);
+
+   if (len == 1 && (unsigned char) glyph[0] < 0x80) {
+      int *w = &asciiWidth[small][(unsigned char) glyph[0]];
+      if (*w < 0)
+         *w = measureGlyph (small, glyph, len);
+      return *w;
+   }
+
+   WidthKind kind = small ? WIDTH_GLYPH_SMALL : WIDTH_GLYPH;
+   CachedWidth *cw = findWidth (kind, glyph, len);
+   if (cw->kind != kind || cw->len != len || memcmp (cw->text, glyph, len)) {
+      cw->width = measureGlyph (small, glyph, len);
+      cw->kind = kind;
+      cw->len = len;
+      memcpy (cw->text, glyph, len);
+   }
+   return cw->width;
+}
+
+/*
+ * The measurement itself, done glyph by glyph for small caps.
+ */
+int FltkFont::measureText (const char *text, int len)
+{
+   char chbuf[4];
+   int c, cu;
+   int width = 0;
+   int curr = 0, next = 0, nb;
+
+   if (fontVariant == core::style::FONT_VARIANT_SMALL_CAPS) {
+      for (curr = 0; next < len; curr = next) {
+         next = utf8Next (text, curr);
+         c = fl_utf8decode(text + curr, text + next, &nb);
+         if ((cu = fl_toupper(c)) == c) {
+            /* already uppercase, just draw the character */
+            if (fl_nonspacing(cu) == 0) {
+               width += letterSpacing;
+               width += glyphWidth (false, text + curr, next - curr);
+            }
+         } else {
+            /* make utf8 string for converted char */
+            nb = fl_utf8encode(cu, chbuf);
+            if (fl_nonspacing(cu) == 0) {
+               width += letterSpacing;
+               width += glyphWidth (true, chbuf, nb);
+            }
+         }
+      }
+   } else {
+      if (len == 1 && (unsigned char) text[0] < 0x80) {
+         width = glyphWidth (false, text, len);
+      } else {
+         fl_font (font, size);
+         width = (int) fl_width (text, len);
+      }
+
+      if (letterSpacing) {
+         while (next < len) {
+            next = utf8Next (text, curr);
+            if ((unsigned char) text[curr] < 0x80)
+               c = text[curr];
+            else
+               c = fl_utf8decode(text + curr, text + next, &nb);
+            if (fl_nonspacing(c) == 0)
+               width += letterSpacing;
+            curr = next;
+         }
+      }
+   }
+
+   return width;
+}
+
+/**
+ * \brief Return the width of a text, including the letter spacing and the
+ *    effect of small caps.
+ *
+ * Words and parts of words are measured many times while a page is laid
+ * out, so short texts are kept in the hashed cache.
+ */
+int FltkFont::textWidth (const char *text, int len)
+{
+   if (!widthCacheEnabled || len <= 1 || len > CACHED_WIDTH_MAX_LEN)
+      return measureText (text, len);
+
+   CachedWidth *cw = findWidth (WIDTH_TEXT, text, len);
+   if (cw->kind != WIDTH_TEXT || cw->len != len ||
+       memcmp (cw->text, text, len)) {
+      cw->width = measureText (text, len);
+      cw->kind = WIDTH_TEXT;
+      cw->len = len;
+      memcpy (cw->text, text, len);
+   }
+   return cw->width;
+}
+
 container::typed::HashTable <dw::core::style::ColorAttrs,
                              FltkColor>
    *FltkColor::colorsTable =
@@ -520,52 +706,7 @@ void FltkPlatform::detachView (core::View *view)
 int FltkPlatform::textWidth (core::style::Font *font, const char *text,
                              int len)
 {
-   char chbuf[4];
-   int c, cu;
-   int width = 0;
-   FltkFont *ff = (FltkFont*) font;
-   int curr = 0, next = 0, nb;
-
-   if (font->fontVariant == core::style::FONT_VARIANT_SMALL_CAPS) {
-      int sc_fontsize = lout::misc::roundInt(ff->size * 0.78);
-      for (curr = 0; next < len; curr = next) {
-         next = nextGlyph(text, curr);
-         c = fl_utf8decode(text + curr, text + next, &nb);
-         if ((cu = fl_toupper(c)) == c) {
-            /* already uppercase, just draw the character */
-            fl_font(ff->font, ff->size);
-            if (fl_nonspacing(cu) == 0) {
-               width += font->letterSpacing;
-               width += (int)fl_width(text + curr, next - curr);
-            }
-         } else {
-            /* make utf8 string for converted char */
-            nb = fl_utf8encode(cu, chbuf);
-            fl_font(ff->font, sc_fontsize);
-            if (fl_nonspacing(cu) == 0) {
-               width += font->letterSpacing;
-               width += (int)fl_width(chbuf, nb);
-            }
-         }
-      }
-   } else {
-      fl_font (ff->font, ff->size);
-      width = (int) fl_width (text, len);
-
-      if (font->letterSpacing) {
-         int curr = 0, next = 0;
-
-         while (next < len) {
-            next = nextGlyph(text, curr);
-            c = fl_utf8decode(text + curr, text + next, &nb);
-            if (fl_nonspacing(c) == 0)
-               width += font->letterSpacing;
-            curr = next;
-         }
-      }
-   }
-
-   return width;
+   return ((FltkFont*) font)->textWidth (text, len);
 }
 
 char *FltkPlatform::textToUpper (const char *text, int len)
@@ -600,12 +741,12 @@ char *FltkPlatform::textToLower (const char *text, int len)
 
 int FltkPlatform::nextGlyph (const char *text, int idx)
 {
-   return fl_utf8fwd (&text[idx + 1], text, &text[strlen (text)]) - text;
+   return utf8Next (text, idx);
 }
 
 int FltkPlatform::prevGlyph (const char *text, int idx)
 {
-   return fl_utf8back (&text[idx - 1], text, &text[strlen (text)]) - text;
+   return utf8Prev (text, idx);
 }
 
 float FltkPlatform::dpiX ()
@@ -50,17 +50,54 @@ class FltkFont: public core::style::Font
    static lout::container::typed::HashTable <dw::core::style::FontAttrs,
                                        FltkFont> *fontsTable;
 
+   /**
+    * \brief What a dw::fltk::FltkFont::CachedWidth is the width of.
+    */
+   enum WidthKind {
+      WIDTH_TEXT,        ///< a whole text, as returned by textWidth
+      WIDTH_GLYPH,       ///< one glyph, at the font size
+      WIDTH_GLYPH_SMALL  ///< one glyph, at the small caps size
+   };
+
+   enum {
+      CACHED_WIDTH_MAX_LEN = 22, ///< longer texts are measured every time
+      WIDTH_CACHE_SIZE = 1024    ///< entries, must be a power of 2
+   };
+
+   /**
+    * \brief A width remembered in the hashed cache.
+    */
+   struct CachedWidth {
+      int width;
+      unsigned char kind, len; ///< len is 0 for an unused entry
+      char text[CACHED_WIDTH_MAX_LEN];
+   };
+
+   static bool widthCacheEnabled;
+
+   int asciiWidth[2][128];   ///< glyph widths (normal, small caps), or -1
+   CachedWidth *widthCache;
+
    FltkFont (core::style::FontAttrs *attrs);
    ~FltkFont ();
 
    static void initSystemFonts ();
 
+   CachedWidth *findWidth (WidthKind kind, const char *text, int len);
+   int measureGlyph (bool small, const char *glyph, int len);
+   int measureText (const char *text, int len);
+
 public:
    Fl_Font font;
 
    static FltkFont *create (core::style::FontAttrs *attrs);
    static bool fontExists (const char *name);
    static Fl_Font get (const char *name, int attrs);
+   static void setWidthCacheEnabled (bool enabled);
+
+   int smallCapsSize ();
+   int glyphWidth (bool small, const char *glyph, int len);
+   int textWidth (const char *text, int len);
 };
 
 
@@ -635,14 +635,14 @@ void FltkWidgetView::drawText (core::style::Font *font,
       int c, cu, width;
 
       if (font->fontVariant == core::style::FONT_VARIANT_SMALL_CAPS) {
-         int sc_fontsize = lout::misc::roundInt(ff->size * 0.78);
+         int sc_fontsize = ff->smallCapsSize();
          for (curr = 0; next < len; curr = next) {
             next = theLayout->nextGlyph(text, curr);
             c = fl_utf8decode(text + curr, text + next, &nb);
             if ((cu = fl_toupper(c)) == c) {
                /* already uppercase, just draw the character */
                fl_font(ff->font, ff->size);
-               width = (int)fl_width(text + curr, next - curr);
+               width = ff->glyphWidth(false, text + curr, next - curr);
                if (curr && width)
                   viewX += font->letterSpacing;
                fl_draw(text + curr, next - curr, viewX, viewY);
@@ -651,7 +651,7 @@ void FltkWidgetView::drawText (core::style::Font *font,
                /* make utf8 string for converted char */
                nb = fl_utf8encode(cu, chbuf);
                fl_font(ff->font, sc_fontsize);
-               width = (int)fl_width(chbuf, nb);
+               width = ff->glyphWidth(true, chbuf, nb);
                if (curr && width)
                   viewX += font->letterSpacing;
                fl_draw(chbuf, nb, viewX, viewY);
@@ -661,7 +661,7 @@ void FltkWidgetView::drawText (core::style::Font *font,
       } else {
          while (next < len) {
             next = theLayout->nextGlyph(text, curr);
-            width = (int)fl_width(text + curr, next - curr);
+            width = ff->glyphWidth(false, text + curr, next - curr);
             if (curr && width)
                viewX += font->letterSpacing;
             fl_draw(text + curr, next - curr, viewX, viewY);
@@ -313,6 +313,9 @@ void Image::sizeAllocateImpl (core::Allocation *allocation)
             newBufWidth, newBufHeight);
 
       core::Imgbuf *oldBuffer = buffer;
+      // When it grows larger than a reduced copy of the image, the whole
+      // image is decoded again
+      oldBuffer->requireSize (newBufWidth, newBufHeight);
       buffer = oldBuffer->getScaledBuf (newBufWidth, newBufHeight);
       oldBuffer->unref ();
 
@@ -514,6 +517,8 @@ core::Iterator *Image::iterator (core::Content::Type mask, bool atEnd)
 void Image::setBuffer (core::Imgbuf *buffer, bool resize)
 {
    core::Imgbuf *oldBuf = this->buffer;
+   int rootWidth = buffer->getRootWidth (), drawWidth;
+   int rootHeight = buffer->getRootHeight (), drawHeight;
 
    if (wasAllocated () && needsResize () &&
       getContentWidth () > 0 && getContentHeight () > 0) {
@@ -522,11 +527,25 @@ void Image::setBuffer (core::Imgbuf *buffer, bool resize)
 
       bufWidth = getContentWidth ();
       bufHeight = getContentHeight ();
+      buffer->requireSize (bufWidth, bufHeight);
+      this->buffer = buffer->getScaledBuf (bufWidth, bufHeight);
+   } else if (rootWidth > 0 && rootHeight > 0 &&
+              getDrawSize (&drawWidth, &drawHeight)) {
+      // The size it is drawn at is known, and the root buffer may hold a
+      // copy reduced to about that size: scale it to that size already,
+      // instead of to the size of the image.
+      if (drawWidth == -1)
+         drawWidth = lout::misc::max (drawHeight * rootWidth / rootHeight, 1);
+      if (drawHeight == -1)
+         drawHeight = lout::misc::max (drawWidth * rootHeight / rootWidth, 1);
+      bufWidth = drawWidth;
+      bufHeight = drawHeight;
+      buffer->requireSize (bufWidth, bufHeight);
       this->buffer = buffer->getScaledBuf (bufWidth, bufHeight);
    } else {
       this->buffer = buffer;
-      bufWidth = buffer->getRootWidth ();
-      bufHeight = buffer->getRootHeight ();
+      bufWidth = rootWidth;
+      bufHeight = rootHeight;
       buffer->ref ();
    }
    queueResize (0, true);
@@ -554,6 +573,20 @@ void Image::drawRow (int row)
                      area.height);
 }
 
+bool Image::getDrawSize (int *width, int *height)
+{
+   core::style::Style *style = getStyle ();
+
+   *width = *height = -1;
+   if (style) {
+      if (core::style::isAbsLength (style->width))
+         *width = core::style::absLengthVal (style->width);
+      if (core::style::isAbsLength (style->height))
+         *height = core::style::absLengthVal (style->height);
+   }
+   return *width != -1 || *height != -1;
+}
+
 void Image::finish ()
 {
    // Nothing to do; images are always drawn line by line.
@@ -192,6 +192,7 @@ public:
 
    void finish ();
    void fatal ();
+   bool getDrawSize (int *width, int *height);
 
    void setIsMap ();
    void setUseMap (ImageMapsList *list, Object *key);
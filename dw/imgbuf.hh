@@ -132,6 +132,42 @@ namespace core {
  * since a scaled buffer is left. After calling dw::core::Imgbuf::unref for
  * the scaled buffer, it is deleted, and after it, the root buffer.
  *
+ * <h3>Vector Images</h3>
+ *
+ * Images that are not made of pixels (like SVG) can be drawn at any size
+ * without losing quality. For them, a dw::core::Imgbuf::VectorSource is
+ * attached to the root buffer with dw::core::Imgbuf::setVectorSource, and
+ * scaled buffers are then drawn by it at their own size, instead of being
+ * scaled from the rows of the root buffer.
+ *
+ * <h3>Reduced Root Buffers</h3>
+ *
+ * A decoder may fill the root buffer with a smaller copy of the image
+ * (e.g. a JPEG decoded at 1/8 of its size, when it is only drawn that
+ * small), and tell the size of the image with
+ * dw::core::Imgbuf::setRootSize. dw::core::Imgbuf::getRootWidth and
+ * dw::core::Imgbuf::getRootHeight then return the size of the image, while
+ * rows are copied in the size of the buffer; dw::Image draws it through a
+ * scaled buffer.
+ *
+ * When it is later drawn larger than the copy (e.g. after zooming),
+ * dw::Image calls dw::core::Imgbuf::requireSize, and the root buffer
+ * grows to the size of the image. Its rows are then copied again by the
+ * dw::core::Imgbuf::Reloader (see below), now for the whole image.
+ *
+ * <h3>Reclaiming Memory</h3>
+ *
+ * The image data of a root buffer, and of its scaled buffers, can be
+ * freed with dw::core::Imgbuf::reclaim, while the buffers themselves are
+ * still used. This needs a dw::core::Imgbuf::Reloader, set with
+ * dw::core::Imgbuf::setReloader, which copies the rows again (as the
+ * decoder did) the next time one of the buffers is drawn. When the rows
+ * are copied later (e.g. decoded in another thread), the reloader calls
+ * dw::core::Imgbuf::reloadDone at the end, and the view the buffer was
+ * drawn in is drawn again.
+ * dw::core::Imgbuf::getLastDrawn tells which images have not been drawn
+ * for the longest time.
+ *
  * <h3>Drawing</h3>
  *
  * dw::core::Imgbuf provides no methods for drawing, instead, this is
@@ -163,6 +199,40 @@ class Imgbuf: public lout::object::Object, public lout::signal::ObservedObject
 public:
    enum Type { RGB, RGBA, GRAY, INDEXED, INDEXED_ALPHA };
 
+   /**
+    * \brief Draws an image at any size, see "Vector Images" above.
+    */
+   class VectorSource: public lout::object::Object
+   {
+   public:
+      /**
+       * Draw the whole image into 'data', which has 'width' x 'height'
+       * pixels in the format of the buffer type.
+       */
+      virtual void draw (byte *data, int width, int height) = 0;
+   };
+
+   /**
+    * \brief Copies the rows again, see "Reclaiming Memory" above.
+    */
+   class Reloader: public lout::object::Object
+   {
+   public:
+      /**
+       * Copy all the rows into the root buffer, with
+       * dw::core::Imgbuf::copyRow. Return false when they are copied
+       * later, and dw::core::Imgbuf::reloadDone is called then.
+       */
+      virtual bool reload () = 0;
+
+      /**
+       * Copy the rows of the whole image ('width' x 'height') from now
+       * on, instead of a reduced copy. Return false when that can't be
+       * done now (e.g. the image is still being decoded).
+       */
+      virtual bool unreduce (int width, int height) = 0;
+   };
+
    inline Imgbuf () {
       DBG_OBJ_CREATE ("dw::core::Imgbuf");
       DBG_OBJ_BASECLASS (lout::object::Object);
@@ -181,10 +251,54 @@ public:
    virtual void copyRow (int row, const byte *data) = 0;
    virtual void newScan () = 0;
 
+   /**
+    * Set the source of a vector image (root buffers only). The buffer
+    * takes ownership of it.
+    */
+   virtual void setVectorSource (VectorSource *source) = 0;
+
+   /**
+    * Set the size of the image, when the root buffer holds a reduced copy
+    * of it (root buffers only).
+    */
+   virtual void setRootSize (int width, int height) = 0;
+
+   /**
+    * Set what copies the rows again after dw::core::Imgbuf::reclaim (root
+    * buffers only). The buffer takes ownership of it.
+    */
+   virtual void setReloader (Reloader *reloader) = 0;
+
+   /**
+    * Free the image data of the root buffer and its scaled buffers, until
+    * they are drawn again (root buffers only, and only when a reloader is
+    * set).
+    */
+   virtual void reclaim () = 0;
+
+   /**
+    * Tell that the reloader is done copying the rows, when it did not
+    * copy them at once (root buffers only).
+    */
+   virtual void reloadDone () = 0;
+
+   /**
+    * When the image was last drawn, in any of its sizes, as a number that
+    * grows with every buffer drawn (0 if never).
+    */
+   virtual unsigned long getLastDrawn () = 0;
+
    /*
     * Methods called from dw::Image
     */
 
+   /**
+    * Tell that the image is drawn at 'width' x 'height'. If the root
+    * buffer holds a reduced copy of the image that is smaller, it grows to
+    * the size of the image, see "Reduced Root Buffers" above.
+    */
+   virtual void requireSize (int width, int height) = 0;
+
    virtual Imgbuf* getScaledBuf (int width, int height) = 0;
    virtual void getRowArea (int row, dw::core::Rectangle *area) = 0;
    virtual int getRootWidth () = 0;
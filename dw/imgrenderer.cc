@@ -62,6 +62,25 @@ void ImgRendererDist::fatal ()
    }
 }
 
+/**
+ * The largest size of the children; known only if it is for all of them.
+ */
+bool ImgRendererDist::getDrawSize (int *width, int *height)
+{
+   int w, h;
+
+   *width = *height = -1;
+   for (typed::Iterator <TypedPointer <ImgRenderer> > it =
+           children->iterator (); it.hasNext (); ) {
+      TypedPointer <ImgRenderer> *tp = it.getNext ();
+      if (!tp->getTypedValue()->getDrawSize (&w, &h))
+         return false;
+      *width = lout::misc::max (*width, w);
+      *height = lout::misc::max (*height, h);
+   }
+   return *width != -1 || *height != -1;
+}
+
 
 } // namespace core
 } // namespace dw
@@ -47,6 +47,16 @@ public:
     * The implementation may use this to indicate an error.
     */
    virtual void fatal () = 0;
+
+   /**
+    * \brief Return the size the image will be drawn at, when it is known
+    *    before the image data (e.g. from CSS).
+    *
+    * A dimension that is not known is set to -1; false is returned if
+    * none is. Decoders may use this to decode large images at a lower
+    * resolution.
+    */
+   virtual bool getDrawSize (int *width, int *height) { return false; }
 };
 
 /**
@@ -71,6 +81,7 @@ public:
    void drawRow (int row);
    void finish ();
    void fatal ();
+   bool getDrawSize (int *width, int *height);
 
    void put (ImgRenderer *child)
    { children->put (new lout::object::TypedPointer <ImgRenderer> (child)); }
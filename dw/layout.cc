@@ -27,6 +27,9 @@
 #include "../lout/debug.hh"
 #include "../lout/misc.hh"
 
+#include <limits.h>
+#include <time.h>
+
 using namespace lout;
 using namespace lout::container;
 using namespace lout::object;
@@ -263,6 +266,7 @@ Layout::Layout (Platform *platform, bool limit)
    widgetAtPoint = NULL;
 
    queueResizeList = new typed::Vector<Widget> (4, false);
+   lazyResizeList = new typed::Vector<Widget> (1, false);
 
    DBG_OBJ_CREATE ("dw::core::Layout");
 
@@ -291,6 +295,10 @@ Layout::Layout (Platform *platform, bool limit)
       new container::typed::HashTable <object::String, Anchor> (true, true);
 
    resizeIdleId = -1;
+   lazyResizeIdleId = -1;
+   lazyResizeY = lazyResizeStep = 0;
+   resizeBudget = 16;
+   resetResizeStats ();
 
    textZone = new misc::ZoneAllocator (16 * 1024);
 
@@ -325,6 +333,8 @@ Layout::~Layout ()
       platform->removeIdle (scrollIdleId);
    if (resizeIdleId != -1)
       platform->removeIdle (resizeIdleId);
+   if (lazyResizeIdleId != -1)
+      platform->removeIdle (lazyResizeIdleId);
    if (bgColor)
       bgColor->unref ();
    if (bgImage)
@@ -337,6 +347,7 @@ Layout::~Layout ()
    }
 
    delete queueResizeList;
+   delete lazyResizeList;
    delete platform;
    delete view;
    delete anchorsTable;
@@ -389,6 +400,8 @@ void Layout::addWidget (Widget *widget)
    DBG_OBJ_SET_PTR_O (widget, "container", widget->container);
 
    queueResizeList->clear ();
+   lazyResizeList->clear ();
+   lazyResizeY = lazyResizeStep = 0;
    widget->notifySetAsTopLevel ();
 
    findtextState.setWidget (widget);
@@ -410,6 +423,7 @@ void Layout::removeWidget ()
     */
    topLevel = NULL;
    queueResizeList->clear ();
+   lazyResizeList->clear ();
    widgetAtPoint = NULL;
    canvasWidth = canvasAscent = canvasDescent = 0;
    scrollX = scrollY = 0;
@@ -448,6 +462,7 @@ void Layout::setWidget (Widget *widget)
    /* Reset the resizeCounter when we change the top level widget, as we are
     * changing to another page */
    resizeCounter = 0;
+   resetResizeStats ();
 }
 
 /**
@@ -745,6 +760,15 @@ void Layout::setAnchor (const char *anchor)
    updateAnchor ();
 }
 
+/**
+ * Return whether the view is to be scrolled to this anchor, once its
+ * position is known.
+ */
+bool Layout::isAnchorRequested (const char *anchor)
+{
+   return requestedAnchor && strcmp (requestedAnchor, anchor) == 0;
+}
+
 /**
  * Used, when the widget is not allocated yet.
  */
@@ -867,12 +891,26 @@ void Layout::setBgImage (style::StyleImage *bgImage,
 }
 
 
+/**
+ * \brief Return a monotonic time, in milliseconds.
+ */
+static double getTime ()
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
 void Layout::resizeIdle ()
 {
    DBG_OBJ_ENTER0 ("resize", 0, "resizeIdle");
 
    enterResizeIdle ();
 
+   double sliceStart = getTime ();
+   resizeStats.slices++;
+
    // There are two commits, 2863:b749629fbfc9 and 4645:ab70f9ce4353, the second
    // reverting the former. Interrestingly, the second fixes a bug. However, it
    // should still examined what happens here, and what happens the other calls
@@ -890,13 +928,18 @@ void Layout::resizeIdle ()
          break;
       }
 
-      /* Only allow 100 iterations before returning to redraw the screen. */
-      if (i >= 100) {
-         MSG_WARN("Stopping layout loop after %d iterations\n", resizeCounter);
+      /* Return to the main loop to handle input and redraw the screen,
+       * once the time budget is spent. Each iteration ends with a
+       * consistent allocation, and the idle function is still queued, so
+       * the layout continues there. */
+      if (i > 0 && resizeBudget > 0 &&
+          getTime () - sliceStart >= resizeBudget) {
+         DBG_OBJ_MSGF ("resize", 1, "budget spent after %d iterations", i);
          break;
       }
 
       resizeCounter++;
+      double iterationStart = getTime ();
 
       for (typed::Iterator <Widget> it = queueResizeList->iterator();
            it.hasNext (); ) {
@@ -983,9 +1026,22 @@ void Layout::resizeIdle ()
 
          // views are redrawn via Widget::resizeDrawImpl ()
       }
+
+      double iterationTime = getTime () - iterationStart;
+      resizeStats.iterations++;
+      resizeStats.totalTime += iterationTime;
+      resizeStats.lastIterationTime = iterationTime;
+      resizeStats.maxIterationTime =
+         misc::max (resizeStats.maxIterationTime, iterationTime);
    }
    updateAnchor ();
 
+   resizeStats.maxSliceTime =
+      misc::max (resizeStats.maxSliceTime, getTime () - sliceStart);
+   DBG_OBJ_MSGF ("resize", 1, "%d iterations in %.1f ms, longest: %.1f ms",
+                 resizeStats.iterations, resizeStats.totalTime,
+                 resizeStats.maxIterationTime);
+
    DBG_OBJ_MSGF ("resize", 1,
                  "after resizeIdle: resizeIdleId = %d", resizeIdleId);
    DBG_OBJ_LEAVE ();
@@ -1046,6 +1102,132 @@ void Layout::queueResize (bool extremesChanged)
    DBG_OBJ_LEAVE ();
 }
 
+/**
+ * \brief Return down to which y position (canvas coordinates) widgets
+ *    should lay out their content, when they do it lazily.
+ *
+ * This is what is visible, plus one viewport height, or more, after
+ * lazyResizeIdle() has been called. Without a viewport, everything is laid
+ * out at once.
+ */
+int Layout::getLazyResizeLimit ()
+{
+   if (!usesViewport || viewportHeight <= 0)
+      return INT_MAX;
+   return misc::max (lazyResizeY, scrollY + 2 * viewportHeight);
+}
+
+/**
+ * \brief Called by a widget which has not laid out all of its content
+ *    (see getLazyResizeLimit()), so that it is resized again later, with
+ *    a larger limit.
+ */
+void Layout::queueLazyResize (Widget *widget)
+{
+   DBG_OBJ_ENTER ("resize", 0, "queueLazyResize", "%p", widget);
+
+   for (int i = 0; i < lazyResizeList->size (); i++)
+      if (lazyResizeList->get (i) == widget) {
+         DBG_OBJ_LEAVE ();
+         return;
+      }
+
+   lazyResizeList->put (widget);
+   if (lazyResizeIdleId == -1)
+      lazyResizeIdleId = platform->addIdle (&Layout::lazyResizeIdle);
+
+   DBG_OBJ_LEAVE ();
+}
+
+/**
+ * \brief Must be called when a widget passed to queueLazyResize() is
+ *    destroyed.
+ */
+void Layout::cancelLazyResize (Widget *widget)
+{
+   for (int i = 0; i < lazyResizeList->size (); i++)
+      if (lazyResizeList->get (i) == widget) {
+         lazyResizeList->remove (i);
+         break;
+      }
+}
+
+/**
+ * \brief Set the time, in milliseconds, after which resizeIdle() returns to
+ *    the main loop, even if the layout is not finished yet.
+ *
+ * At least one iteration (sizeRequest() and sizeAllocate() of the toplevel
+ * widget) is done each time. A value of 0 or less means no limit. The
+ * default is 16, about one frame.
+ */
+void Layout::setResizeBudget (int ms)
+{
+   resizeBudget = ms;
+}
+
+/**
+ * \brief Reset the statistics returned by getResizeStats(). This is done
+ *    automatically by setWidget().
+ */
+void Layout::resetResizeStats ()
+{
+   resizeStats.iterations = resizeStats.slices = 0;
+   resizeStats.totalTime = resizeStats.lastIterationTime =
+      resizeStats.maxIterationTime = resizeStats.maxSliceTime = 0;
+}
+
+/**
+ * \brief Extend the limit of getLazyResizeLimit(), and resize the widgets
+ *    which have been passed to queueLazyResize().
+ *
+ * The content down to the new limit is laid out by a single iteration of
+ * resizeIdle(), which cannot be interrupted, so the limit grows by a step
+ * which does not depend on the size of the content: four viewport heights
+ * at first, then doubled or halved (between LAZY_RESIZE_MIN_STEP and
+ * LAZY_RESIZE_MAX_STEP viewport heights) so that the last iteration fits
+ * in the time budget (see setResizeBudget()). This needs the widgets to
+ * only do the new part in each step, as dw::Textblock does (see "Lazy Line
+ * Breaking" there). The widgets, which are still not done, call
+ * queueLazyResize() again in sizeAllocate.
+ */
+void Layout::lazyResizeIdle ()
+{
+   DBG_OBJ_ENTER0 ("resize", 0, "lazyResizeIdle");
+
+   lazyResizeIdleId = -1;
+
+   int limit = getLazyResizeLimit ();
+   if (limit != INT_MAX) {
+      int minStep = LAZY_RESIZE_MIN_STEP * viewportHeight,
+         maxStep = LAZY_RESIZE_MAX_STEP * viewportHeight;
+      double lastTime = resizeStats.lastIterationTime;
+
+      if (lazyResizeStep == 0)
+         lazyResizeStep = 4 * viewportHeight;
+      else if (resizeBudget > 0 && lastTime > resizeBudget)
+         lazyResizeStep = misc::max (minStep, lazyResizeStep / 2);
+      else if (resizeBudget > 0 && lastTime < resizeBudget / 2.0)
+         lazyResizeStep = misc::min (maxStep, lazyResizeStep * 2);
+
+      int newY = limit > INT_MAX - lazyResizeStep ?
+         INT_MAX : limit + lazyResizeStep;
+
+      // The iterations of each step are a new layout, not a loop, as far as
+      // the emergency stop in resizeIdle() is concerned.
+      if (newY > lazyResizeY)
+         resizeCounter = 0;
+      lazyResizeY = newY;
+   }
+   DBG_OBJ_MSGF ("resize", 1, "lazyResizeY = %d", lazyResizeY);
+
+   while (lazyResizeList->size () > 0) {
+      Widget *widget = lazyResizeList->get (lazyResizeList->size () - 1);
+      lazyResizeList->remove (lazyResizeList->size () - 1);
+      widget->queueResize (-1, false);
+   }
+
+   DBG_OBJ_LEAVE ();
+}
 
 // Views
 
@@ -1335,6 +1517,7 @@ void Layout::viewportSizeChanged (View *view, int width, int height)
       viewportWidth = width;
       viewportHeight = height;
       resizeCounter = 0;
+      lazyResizeY = lazyResizeStep = 0;
       containerSizeChanged ();
 
       DBG_OBJ_SET_SYM ("canvasHeightGreater",
@@ -143,6 +143,21 @@ public:
 
    LinkEmitter linkEmitter;
 
+   /**
+    * \brief Statistics about the layout work done in resizeIdle().
+    *
+    * An iteration is one sizeRequest() and sizeAllocate() of the toplevel
+    * widget. A slice is one call of resizeIdle(), i.e. the time between
+    * two returns to the main loop, which cannot handle any input or
+    * redraw the screen meanwhile. All times are in milliseconds.
+    */
+   struct ResizeStats
+   {
+      int iterations, slices;
+      double totalTime, lastIterationTime, maxIterationTime;
+      double maxSliceTime; /* The longest stall. */
+   };
+
 private:
    class Emitter: public lout::signal::Emitter
    {
@@ -176,6 +191,7 @@ private:
    View *view;
    Widget *topLevel, *widgetAtPoint;
    lout::container::typed::Vector<Widget> *queueResizeList;
+   lout::container::typed::Vector<Widget> *lazyResizeList;
 
    /* The state, which must be projected into the view. */
    style::Color *bgColor;
@@ -197,9 +213,22 @@ private:
    int scrollTargetX, scrollTargetY, scrollTargetWidth, scrollTargetHeight;
 
    char *requestedAnchor;
-   int scrollIdleId, resizeIdleId;
+   int scrollIdleId, resizeIdleId, lazyResizeIdleId;
    bool scrollIdleNotInterrupted;
 
+   /* Time in milliseconds after which resizeIdle() returns to the main
+      loop, even if there is more to do; see setResizeBudget(). */
+   int resizeBudget;
+   ResizeStats resizeStats;
+
+   /* How far (canvas coordinates) widgets, which lay out their content
+      lazily, should do it; see getLazyResizeLimit(). lazyResizeStep is
+      how much lazyResizeIdle() extends it (0 before the first step). */
+   int lazyResizeY, lazyResizeStep;
+
+   /* Bounds of lazyResizeStep, in viewport heights. */
+   enum { LAZY_RESIZE_MIN_STEP = 1, LAZY_RESIZE_MAX_STEP = 16 };
+
    /* Anchors of the widget tree */
    lout::container::typed::HashTable <lout::object::String, Anchor>
                                      *anchorsTable;
@@ -232,6 +261,7 @@ private:
                      int numPressed, int x, int y, ButtonState state,
                      int button);
    void resizeIdle ();
+   void lazyResizeIdle ();
    void setSizeHints ();
    void draw (View *view, Rectangle *area);
 
@@ -308,12 +338,21 @@ public:
    inline int getScrollPosX ()  { return scrollX; }
    inline int getScrollPosY ()  { return scrollY; }
 
+   int getLazyResizeLimit ();
+   void queueLazyResize (Widget *widget);
+   void cancelLazyResize (Widget *widget);
+
+   void setResizeBudget (int ms);
+   inline const ResizeStats *getResizeStats () { return &resizeStats; }
+   void resetResizeStats ();
+
    /* public */
 
    void scrollTo (HPosition hpos, VPosition vpos,
                   int x, int y, int width, int height);
    void scroll (ScrollCommand);
    void setAnchor (const char *anchor);
+   bool isAnchorRequested (const char *anchor);
 
    /* View */
 
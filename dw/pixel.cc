@@ -0,0 +1,501 @@
+/*
+ * Dillo Widget
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "core.hh"
+#include "../lout/misc.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define PIXEL_X86
+#  include <immintrin.h>
+#endif
+
+namespace dw {
+namespace core {
+namespace pixel {
+
+/**
+ * \brief The kernels of one implementation.
+ *
+ * Those without a vector version use the scalar one.
+ */
+struct Kernels
+{
+   void (*grayToRgb) (byte *dest, const byte *src, int n);
+   void (*indexedToRgb) (byte *dest, const byte *src, int n,
+                         const byte *cmap);
+   void (*cmykInvToRgb) (byte *dest, const byte *src, int n);
+   void (*blendRgba) (byte *dest, const byte *src, int n, int bgColor);
+   void (*accumulate) (unsigned *acc, const byte *src, int n,
+                       const unsigned *map);
+};
+
+static const Kernels *kernels = NULL;
+static unsigned identityMap[256];
+
+// ----------------------------------------------------------------------
+//    Scalar reference implementation
+// ----------------------------------------------------------------------
+
+static void grayToRgbScalar (byte *dest, const byte *src, int n)
+{
+   for (int i = 0; i < n; i++)
+      dest[3 * i] = dest[3 * i + 1] = dest[3 * i + 2] = src[i];
+}
+
+static void indexedToRgbScalar (byte *dest, const byte *src, int n,
+                                const byte *cmap)
+{
+   for (int i = 0; i < n; i++)
+      memcpy (dest + 3 * i, cmap + 3 * src[i], 3);
+}
+
+/*
+ * Adobe CMYK is stored inverted, so it is taken as "RGBW".
+ */
+static void cmykInvToRgbScalar (byte *dest, const byte *src, int n)
+{
+   for (int i = 0; i < n; i++) {
+      unsigned white = src[4 * i + 3];
+      dest[3 * i] = src[4 * i] * white / 0x100;
+      dest[3 * i + 1] = src[4 * i + 1] * white / 0x100;
+      dest[3 * i + 2] = src[4 * i + 2] * white / 0x100;
+   }
+}
+
+static void blendRgbaScalar (byte *dest, const byte *src, int n, int bgColor)
+{
+   unsigned bg[3] = { (unsigned) (bgColor >> 16) & 0xff,
+                      (unsigned) (bgColor >> 8) & 0xff,
+                      (unsigned) bgColor & 0xff };
+
+   for (int i = 0; i < n; i++) {
+      unsigned alpha = src[4 * i + 3];
+      for (int c = 0; c < 3; c++)
+         dest[3 * i + c] =
+            (src[4 * i + c] * alpha + bg[c] * (0xff - alpha)) / 0xff;
+   }
+}
+
+/*
+ * Add the values of a row, through 'map', to the sums in 'acc'.
+ */
+static void accumulateScalar (unsigned *acc, const byte *src, int n,
+                              const unsigned *map)
+{
+   for (int i = 0; i < n; i++)
+      acc[i] += map[src[i]];
+}
+
+static const Kernels scalarKernels = {
+   grayToRgbScalar, indexedToRgbScalar, cmykInvToRgbScalar, blendRgbaScalar,
+   accumulateScalar
+};
+
+#ifdef PIXEL_X86
+
+// ----------------------------------------------------------------------
+//    SSE2: 4 pixels per step. There is no byte shuffle, so the 4-byte
+//    pixels are stored one by one, each one overwriting the 4th byte of
+//    the previous one; the last pixel is left to the scalar code.
+// ----------------------------------------------------------------------
+
+__attribute__((target("sse2")))
+static inline void storeRgb4Sse2 (byte *dest, __m128i v)
+{
+   for (int k = 0; k < 4; k++) {
+      uint32_t p = _mm_cvtsi128_si32 (v);
+      memcpy (dest + 3 * k, &p, 4);
+      v = _mm_srli_si128 (v, 4);
+   }
+}
+
+/*
+ * x / 255 for 0 <= x <= 255 * 255, in 16-bit lanes
+ */
+__attribute__((target("sse2")))
+static inline __m128i div255Sse2 (__m128i x)
+{
+   return _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (x, _mm_set1_epi16 (1)),
+                                         _mm_srli_epi16 (x, 8)), 8);
+}
+
+/*
+ * Copy the 4th 16-bit value of each pixel to the other three.
+ */
+__attribute__((target("sse2")))
+static inline __m128i alphaSse2 (__m128i v)
+{
+   return _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (v, 0xff), 0xff);
+}
+
+__attribute__((target("sse2")))
+static void grayToRgbSse2 (byte *dest, const byte *src, int n)
+{
+   int i;
+
+   for (i = 0; i + 5 <= n; i += 4) {
+      uint32_t g;
+      memcpy (&g, src + i, 4);
+      __m128i v = _mm_cvtsi32_si128 (g);
+      v = _mm_unpacklo_epi8 (v, v);
+      storeRgb4Sse2 (dest + 3 * i, _mm_unpacklo_epi16 (v, v));
+   }
+   grayToRgbScalar (dest + 3 * i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void cmykInvToRgbSse2 (byte *dest, const byte *src, int n)
+{
+   const __m128i zero = _mm_setzero_si128 ();
+   int i;
+
+   for (i = 0; i + 5 <= n; i += 4) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + 4 * i));
+      __m128i lo = _mm_unpacklo_epi8 (v, zero), hi = _mm_unpackhi_epi8 (v, zero);
+      lo = _mm_srli_epi16 (_mm_mullo_epi16 (lo, alphaSse2 (lo)), 8);
+      hi = _mm_srli_epi16 (_mm_mullo_epi16 (hi, alphaSse2 (hi)), 8);
+      storeRgb4Sse2 (dest + 3 * i, _mm_packus_epi16 (lo, hi));
+   }
+   cmykInvToRgbScalar (dest + 3 * i, src + 4 * i, n - i);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i blendSse2 (__m128i v, __m128i bg)
+{
+   __m128i alpha = alphaSse2 (v);
+   __m128i inv = _mm_sub_epi16 (_mm_set1_epi16 (0xff), alpha);
+
+   return div255Sse2 (_mm_add_epi16 (_mm_mullo_epi16 (v, alpha),
+                                     _mm_mullo_epi16 (bg, inv)));
+}
+
+__attribute__((target("sse2")))
+static void blendRgbaSse2 (byte *dest, const byte *src, int n, int bgColor)
+{
+   const __m128i zero = _mm_setzero_si128 ();
+   const short r = (bgColor >> 16) & 0xff, g = (bgColor >> 8) & 0xff,
+               b = bgColor & 0xff;
+   const __m128i bg = _mm_setr_epi16 (r, g, b, 0, r, g, b, 0);
+   int i;
+
+   for (i = 0; i + 5 <= n; i += 4) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + 4 * i));
+      __m128i lo = blendSse2 (_mm_unpacklo_epi8 (v, zero), bg);
+      __m128i hi = blendSse2 (_mm_unpackhi_epi8 (v, zero), bg);
+      storeRgb4Sse2 (dest + 3 * i, _mm_packus_epi16 (lo, hi));
+   }
+   blendRgbaScalar (dest + 3 * i, src + 4 * i, n - i, bgColor);
+}
+
+static const Kernels sse2Kernels = {
+   grayToRgbSse2, indexedToRgbScalar, cmykInvToRgbSse2, blendRgbaSse2,
+   accumulateScalar
+};
+
+// ----------------------------------------------------------------------
+//    AVX2: byte shuffles to pack pixels, and gathers for table lookups.
+//    The packing shuffles work within 128-bit lanes, each lane is stored
+//    with 4 bytes to spare, which the next store overwrites.
+// ----------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+static inline void storeRgb8Avx2 (byte *dest, __m256i v)
+{
+   const __m256i pack = _mm256_setr_epi8 (0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13,
+                                          14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13,
+                                          14, -1, -1, -1, -1);
+
+   v = _mm256_shuffle_epi8 (v, pack);
+   _mm_storeu_si128 ((__m128i *) dest, _mm256_castsi256_si128 (v));
+   _mm_storeu_si128 ((__m128i *) (dest + 12),
+                     _mm256_extracti128_si256 (v, 1));
+}
+
+__attribute__((target("avx2")))
+static void grayToRgbAvx2 (byte *dest, const byte *src, int n)
+{
+   const __m128i m0 = _mm_setr_epi8 (0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3,
+                                     4, 4, 4, 5),
+                 m1 = _mm_setr_epi8 (5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9,
+                                     9, 9, 10, 10),
+                 m2 = _mm_setr_epi8 (10, 11, 11, 11, 12, 12, 12, 13, 13, 13,
+                                     14, 14, 14, 15, 15, 15);
+   int i;
+
+   for (i = 0; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (src + i));
+      _mm_storeu_si128 ((__m128i *) (dest + 3 * i), _mm_shuffle_epi8 (v, m0));
+      _mm_storeu_si128 ((__m128i *) (dest + 3 * i + 16),
+                        _mm_shuffle_epi8 (v, m1));
+      _mm_storeu_si128 ((__m128i *) (dest + 3 * i + 32),
+                        _mm_shuffle_epi8 (v, m2));
+   }
+   grayToRgbScalar (dest + 3 * i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i alphaAvx2 (__m256i v)
+{
+   return _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (v, 0xff), 0xff);
+}
+
+__attribute__((target("avx2")))
+static void cmykInvToRgbAvx2 (byte *dest, const byte *src, int n)
+{
+   const __m256i zero = _mm256_setzero_si256 ();
+   int i;
+
+   for (i = 0; i + 10 <= n; i += 8) {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (src + 4 * i));
+      __m256i lo = _mm256_unpacklo_epi8 (v, zero),
+              hi = _mm256_unpackhi_epi8 (v, zero);
+      lo = _mm256_srli_epi16 (_mm256_mullo_epi16 (lo, alphaAvx2 (lo)), 8);
+      hi = _mm256_srli_epi16 (_mm256_mullo_epi16 (hi, alphaAvx2 (hi)), 8);
+      storeRgb8Avx2 (dest + 3 * i, _mm256_packus_epi16 (lo, hi));
+   }
+   cmykInvToRgbScalar (dest + 3 * i, src + 4 * i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i blendAvx2 (__m256i v, __m256i bg)
+{
+   __m256i alpha = alphaAvx2 (v);
+   __m256i inv = _mm256_sub_epi16 (_mm256_set1_epi16 (0xff), alpha);
+   __m256i x = _mm256_add_epi16 (_mm256_mullo_epi16 (v, alpha),
+                                 _mm256_mullo_epi16 (bg, inv));
+
+   // x / 255, exact for x <= 255 * 255
+   return _mm256_srli_epi16 (
+             _mm256_add_epi16 (_mm256_add_epi16 (x, _mm256_set1_epi16 (1)),
+                               _mm256_srli_epi16 (x, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void blendRgbaAvx2 (byte *dest, const byte *src, int n, int bgColor)
+{
+   const __m256i zero = _mm256_setzero_si256 ();
+   const short r = (bgColor >> 16) & 0xff, g = (bgColor >> 8) & 0xff,
+               b = bgColor & 0xff;
+   const __m256i bg = _mm256_setr_epi16 (r, g, b, 0, r, g, b, 0,
+                                         r, g, b, 0, r, g, b, 0);
+   int i;
+
+   for (i = 0; i + 10 <= n; i += 8) {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (src + 4 * i));
+      __m256i lo = blendAvx2 (_mm256_unpacklo_epi8 (v, zero), bg);
+      __m256i hi = blendAvx2 (_mm256_unpackhi_epi8 (v, zero), bg);
+      storeRgb8Avx2 (dest + 3 * i, _mm256_packus_epi16 (lo, hi));
+   }
+   blendRgbaScalar (dest + 3 * i, src + 4 * i, n - i, bgColor);
+}
+
+__attribute__((target("avx2")))
+static void accumulateAvx2 (unsigned *acc, const byte *src, int n,
+                            const unsigned *map)
+{
+   int i;
+
+   for (i = 0; i + 8 <= n; i += 8) {
+      __m256i idx = _mm256_cvtepu8_epi32 (
+                       _mm_loadl_epi64 ((const __m128i *) (src + i)));
+      __m256i v = _mm256_i32gather_epi32 ((const int *) map, idx, 4);
+      __m256i a = _mm256_loadu_si256 ((const __m256i *) (acc + i));
+      _mm256_storeu_si256 ((__m256i *) (acc + i), _mm256_add_epi32 (a, v));
+   }
+   accumulateScalar (acc + i, src + i, n - i, map);
+}
+
+static const Kernels avx2Kernels = {
+   grayToRgbAvx2, indexedToRgbScalar, cmykInvToRgbAvx2, blendRgbaAvx2,
+   accumulateAvx2
+};
+
+#endif // PIXEL_X86
+
+// ----------------------------------------------------------------------
+//    Dispatch
+// ----------------------------------------------------------------------
+
+/**
+ * \brief Tell whether the running CPU can execute \em impl.
+ */
+static bool supported (Impl impl)
+{
+   switch (impl) {
+   case SCALAR:
+      return true;
+#ifdef PIXEL_X86
+   case SSE2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("sse2");
+   case AVX2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("sse2") &&
+         __builtin_cpu_supports ("avx2");
+#endif
+   default:
+      return false;
+   }
+}
+
+/**
+ * \brief Use \em impl if the CPU supports it, otherwise the best one below
+ *    it. Return the implementation actually selected.
+ */
+Impl select (Impl impl)
+{
+   for (int i = 0; i < 256; i++)
+      identityMap[i] = i;
+
+   while (impl > SCALAR && !supported (impl))
+      impl = (Impl) (impl - 1);
+
+   switch (impl) {
+#ifdef PIXEL_X86
+   case AVX2:
+      kernels = &avx2Kernels;
+      break;
+   case SSE2:
+      kernels = &sse2Kernels;
+      break;
+#endif
+   default:
+      impl = SCALAR;
+      kernels = &scalarKernels;
+      break;
+   }
+   return impl;
+}
+
+const char *implName (Impl impl)
+{
+   switch (impl) {
+   case AVX2:
+      return "avx2";
+   case SSE2:
+      return "sse2";
+   default:
+      return "scalar";
+   }
+}
+
+static inline const Kernels *getKernels ()
+{
+   if (kernels == NULL)
+      select (AVX2);
+   return kernels;
+}
+
+// ----------------------------------------------------------------------
+//    Kernels
+// ----------------------------------------------------------------------
+
+/**
+ * \brief Expand \em n gray values to RGB.
+ */
+void grayToRgb (byte *dest, const byte *src, int n)
+{
+   getKernels()->grayToRgb (dest, src, n);
+}
+
+/**
+ * \brief Look up \em n color indexes in \em cmap (3 bytes per color).
+ */
+void indexedToRgb (byte *dest, const byte *src, int n, const byte *cmap)
+{
+   getKernels()->indexedToRgb (dest, src, n, cmap);
+}
+
+/**
+ * \brief Convert \em n inverted CMYK pixels (as libjpeg gives them) to RGB.
+ */
+void cmykInvToRgb (byte *dest, const byte *src, int n)
+{
+   getKernels()->cmykInvToRgb (dest, src, n);
+}
+
+/**
+ * \brief Blend \em n RGBA pixels over \em bgColor (0xrrggbb), giving RGB.
+ */
+void blendRgba (byte *dest, const byte *src, int n, int bgColor)
+{
+   getKernels()->blendRgba (dest, src, n, bgColor);
+}
+
+/**
+ * \brief Scale an image with a box filter.
+ *
+ * Each pixel of \em dest is the average of the rectangle of pixels of
+ * \em src it covers (or of the one pixel it falls in, when scaling up).
+ * The values are averaged after mapping them through \em toLinear, and
+ * the average is mapped back through \em fromLinear (both 256 entries),
+ * which allows gamma correction; either may be NULL.
+ *
+ * The columns of a destination row are summed first, so that the source
+ * rows are read in order, and with the vector kernels.
+ */
+void scaleBox (const byte *src, int srcWidth, int srcHeight,
+               byte *dest, int destWidth, int destHeight, int bpp,
+               const unsigned *toLinear, const unsigned *fromLinear)
+{
+   const Kernels *k = getKernels ();
+   int rowLen = srcWidth * bpp, yo1 = -1, yo2 = -1;
+   unsigned *acc = new unsigned[rowLen];
+
+   if (toLinear == NULL)
+      toLinear = identityMap;
+
+   for (int y = 0; y < destHeight; y++) {
+      int y1 = y * srcHeight / destHeight;
+      int y2 = lout::misc::max ((y + 1) * srcHeight / destHeight, y1 + 1);
+
+      // When scaling up, consecutive rows have the same sums.
+      if (y1 != yo1 || y2 != yo2) {
+         yo1 = y1;
+         yo2 = y2;
+         memset (acc, 0, rowLen * sizeof (unsigned));
+         for (int yo = yo1; yo < yo2; yo++)
+            k->accumulate (acc, src + yo * rowLen, rowLen, toLinear);
+      }
+
+      byte *pd = dest + y * destWidth * bpp;
+      for (int x = 0; x < destWidth; x++) {
+         int xo1 = x * srcWidth / destWidth;
+         int xo2 = lout::misc::max ((x + 1) * srcWidth / destWidth, xo1 + 1);
+         unsigned n = (xo2 - xo1) * (yo2 - yo1);
+
+         for (int i = 0; i < bpp; i++) {
+            unsigned v = 0;
+            for (int xo = xo1; xo < xo2; xo++)
+               v += acc[xo * bpp + i];
+            *pd++ = fromLinear ? fromLinear[v / n] : v / n;
+         }
+      }
+   }
+
+   delete[] acc;
+}
+
+} // namespace pixel
+} // namespace core
+} // namespace dw
@@ -0,0 +1,45 @@
+#ifndef __DW_PIXEL_HH__
+#define __DW_PIXEL_HH__
+
+#ifndef __INCLUDED_FROM_DW_CORE_HH__
+#   error Do not include this file directly, use "core.hh" instead.
+#endif
+
+namespace dw {
+namespace core {
+
+/**
+ * \brief Pixel kernels for image decoding and scaling.
+ *
+ * These are the loops that touch every pixel of an image: the conversion
+ * of decoded rows to RGB, and the box filter of dw::fltk::FltkImgbuf.
+ * Each one has a scalar version, which is the reference, and SSE2 or AVX2
+ * versions for the CPUs that have them. All of them give exactly the same
+ * result. The implementation is chosen at runtime, the first time a kernel
+ * is used, unless dw::core::pixel::select was called before.
+ */
+namespace pixel {
+
+/**
+ * \brief Kernel implementations, in increasing order of preference.
+ */
+enum Impl { SCALAR, SSE2, AVX2 };
+
+Impl select (Impl impl);
+const char *implName (Impl impl);
+
+void grayToRgb (byte *dest, const byte *src, int n);
+void indexedToRgb (byte *dest, const byte *src, int n, const byte *cmap);
+void cmykInvToRgb (byte *dest, const byte *src, int n);
+void blendRgba (byte *dest, const byte *src, int n, int bgColor);
+
+void scaleBox (const byte *src, int srcWidth, int srcHeight,
+               byte *dest, int destWidth, int destHeight, int bpp,
+               const unsigned *toLinear, const unsigned *fromLinear);
+
+} // namespace pixel
+
+} // namespace core
+} // namespace dw
+
+#endif // __DW_PIXEL_HH__
@@ -220,6 +220,8 @@ Textblock::Textblock (bool limitTextWidth, bool treatAsInline)
    DBG_OBJ_SET_NUM ("redrawY", redrawY);
    lastWordDrawn = -1;
    DBG_OBJ_SET_NUM ("lastWordDrawn", lastWordDrawn);
+   allocatedLines = 0;
+   allocatedLinesWidth = -1;
 
    DBG_OBJ_ASSOC_CHILD (&sizeRequestParams);
         
@@ -235,7 +237,15 @@ Textblock::Textblock (bool limitTextWidth, bool treatAsInline)
    paragraphs = new misc::SimpleVector <Paragraph> (1);
    lines = new misc::SimpleVector <Line> (1);
    nonTemporaryLines = 0;
+   lazyWrapWord = -1;
+   lazyWrapAllowed = true;
+   lazyWrapUpTo = -1;
+   linesBreakWidth = -1;
+   DBG_OBJ_SET_NUM ("lazyWrapWord", lazyWrapWord);
    words = new misc::NotSoSimpleVector <Word> (1);
+   wrapData = new misc::SimpleVector <WordWrapData> (1);
+   wrapDataFirst = 0;
+   imgRenderers = new misc::SimpleVector <WordImgRenderers> (1);
    anchors = new misc::SimpleVector <Anchor> (1);
 
    wrapRefLines = wrapRefParagraphs = -1;
@@ -280,6 +290,9 @@ Textblock::~Textblock ()
    /* make sure not to call a free'd tooltip (very fast overkill) */
    hoverTooltip = NULL;
 
+   if (layout && lazyWrapWord != -1)
+      layout->cancelLazyResize (this);
+
    for (int i = 0; i < words->size(); i++)
       cleanupWord (i);
 
@@ -289,9 +302,14 @@ Textblock::~Textblock ()
       removeAnchor(anchor->name);
    }
 
+   for (int i = 0; i < paragraphs->size(); i++)
+      delete paragraphs->getRef(i)->breakCache;
+
    delete paragraphs;
    delete lines;
    delete words;
+   delete wrapData;
+   delete imgRenderers;
    delete anchors;
  
    /* Make sure we don't own widgets anymore. Necessary before call of
@@ -376,6 +394,16 @@ void Textblock::sizeRequestImpl (core::Requisition *requisition, int numPos,
                              getStyle()->borderWidth.bottom,
                              getStyle()->margin.bottom + extraSpace.bottom,
                              lastLine->borderDescent, lastLine->marginDescent);
+
+      if (lazyWrapWord != -1) {
+         // Estimate the height of the lines which are not built yet, from
+         // the average height per word so far.
+         int wrappedHeight = lastLine->top + lastLine->borderAscent +
+            lastLine->borderDescent;
+         requisition->descent += (int) ((double) wrappedHeight *
+                                        (words->size () - lazyWrapWord) /
+                                        lazyWrapWord);
+      }
    } else {
       requisition->width = leftInnerPadding + boxDiffWidth ();
       requisition->ascent = boxOffsetY ();
@@ -584,16 +612,32 @@ void Textblock::sizeAllocateImpl (core::Allocation *allocation)
    core::Allocation childAllocation;
    core::Allocation *oldChildAllocation;
 
+   int offsetWidth = misc::min (allocation->width, lineBreakWidth);
    if (allocation->x != this->allocation.x ||
        allocation->y != this->allocation.y ||
        allocation->width != this->allocation.width) {
       redrawY = 0;
       DBG_OBJ_SET_NUM ("redrawY", redrawY);
+      allocatedLines = 0;
+   }
+   if (offsetWidth != allocatedLinesWidth)
+      allocatedLines = 0;
+
+   // Without widgets, the lines allocated before are still right, see
+   // "Lazy Line Breaking" in textblock.hh. The last one may have grown.
+   int firstLine = 0;
+   if (lazyWrapAllowed && misc::min (allocatedLines, lines->size ()) > 1) {
+      firstLine = misc::min (allocatedLines, lines->size ()) - 1;
+      if (lastWordDrawn + 1 < lines->getRef(firstLine)->firstWord) {
+         line = lines->getRef (findLineOfWord (lastWordDrawn + 1));
+         redrawY = misc::min (redrawY, lineYOffsetWidget (line, allocation));
+         DBG_OBJ_SET_NUM ("redrawY", redrawY);
+      }
    }
 
    DBG_OBJ_MSG_START ();
 
-   for (lineIndex = 0; lineIndex < lines->size (); lineIndex++) {
+   for (lineIndex = firstLine; lineIndex < lines->size (); lineIndex++) {
       DBG_OBJ_MSGF ("resize", 1, "line %d", lineIndex);
       DBG_OBJ_MSG_START ();
 
@@ -606,7 +650,7 @@ void Textblock::sizeAllocateImpl (core::Allocation *allocation)
       //
       // TODO: test case?
       
-      calcTextOffset (lineIndex, misc::min (allocation->width, lineBreakWidth));
+      calcTextOffset (lineIndex, offsetWidth);
 
       line = lines->getRef (lineIndex);
       xCursor = line->textOffset;
@@ -711,16 +755,25 @@ void Textblock::sizeAllocateImpl (core::Allocation *allocation)
 
    DBG_OBJ_MSG_END ();
 
+   allocatedLines = lines->size ();
+   allocatedLinesWidth = offsetWidth;
+
    sizeAllocateEnd ();
       
    for (int i = 0; i < anchors->size(); i++) {
       Anchor *anchor = anchors->getRef(i);
       int y;
 
-      if (anchor->wordIndex >= words->size() ||
-          // Also regard not-yet-existing lines.
-          lines->size () <= 0 ||
-          anchor->wordIndex > lines->getLastRef()->lastWord) {
+      if (lazyWrapWord != -1 && anchor->wordIndex >= lazyWrapWord) {
+         // Not known before the line is built. If the view is to be
+         // scrolled there, it is built in the next lazy step.
+         y = -1;
+         if (layout->isAnchorRequested (anchor->name))
+            lazyWrapUpTo = misc::max (lazyWrapUpTo, anchor->wordIndex);
+      } else if (anchor->wordIndex >= words->size() ||
+                 // Also regard not-yet-existing lines.
+                 lines->size () <= 0 ||
+                 anchor->wordIndex > lines->getLastRef()->lastWord) {
          y = allocation->y + allocation->ascent + allocation->descent;
       } else {
          Line *line = lines->getRef(findLineOfWord (anchor->wordIndex));
@@ -729,6 +782,9 @@ void Textblock::sizeAllocateImpl (core::Allocation *allocation)
       changeAnchor (anchor->name, y);
    }
 
+   if (lazyWrapWord != -1)
+      layout->queueLazyResize (this);
+
    DBG_OBJ_LEAVE ();
 }
 
@@ -1803,8 +1859,7 @@ void Textblock::initWord (int wordNo)
    Word *word = words->getRef (wordNo);
 
    word->style = word->spaceStyle = NULL;
-   word->wordImgRenderer = NULL;
-   word->spaceImgRenderer = NULL;
+   word->imgRenderers = -1;
 }
 
 void Textblock::cleanupWord (int wordNo)
@@ -1824,15 +1879,40 @@ void Textblock::cleanupWord (int wordNo)
    word->spaceStyle->unref ();
 }
 
+/**
+ * Return the image renderers of a word, or NULL, if it has none. With
+ * create, an entry in imgRenderers is added for the word, when needed.
+ * Entries are not removed again, but a word keeps its entry.
+ */
+Textblock::WordImgRenderers *Textblock::getImgRenderers (int wordNo,
+                                                        bool create)
+{
+   Word *word = words->getRef (wordNo);
+
+   if (word->imgRenderers == -1) {
+      if (!create)
+         return NULL;
+
+      imgRenderers->increase ();
+      word->imgRenderers = imgRenderers->size () - 1;
+      WordImgRenderers *renderers = imgRenderers->getLastRef ();
+      renderers->word = NULL;
+      renderers->space = NULL;
+   }
+
+   return imgRenderers->getRef (word->imgRenderers);
+}
+
 void Textblock::removeWordImgRenderer (int wordNo)
 {
    Word *word = words->getRef (wordNo);
+   WordImgRenderers *renderers = getImgRenderers (wordNo, false);
 
-   if (word->style && word->wordImgRenderer) {
+   if (word->style && renderers && renderers->word) {
       word->style->backgroundImage->removeExternalImgRenderer
-         (word->wordImgRenderer);
-      delete word->wordImgRenderer;
-      word->wordImgRenderer = NULL;
+         (renderers->word);
+      delete renderers->word;
+      renderers->word = NULL;
    }
 }
 
@@ -1841,22 +1921,24 @@ void Textblock::setWordImgRenderer (int wordNo)
    Word *word = words->getRef (wordNo);
 
    if (word->style->backgroundImage) {
-      word->wordImgRenderer = new WordImgRenderer (this, wordNo);
+      WordImgRenderers *renderers = getImgRenderers (wordNo, true);
+      renderers->word = new WordImgRenderer (this, wordNo);
       word->style->backgroundImage->putExternalImgRenderer
-         (word->wordImgRenderer);
-   } else
-      word->wordImgRenderer = NULL;
+         (renderers->word);
+   } else if (word->imgRenderers != -1)
+      getImgRenderers(wordNo, false)->word = NULL;
 }
 
 void Textblock::removeSpaceImgRenderer (int wordNo)
 {
    Word *word = words->getRef (wordNo);
+   WordImgRenderers *renderers = getImgRenderers (wordNo, false);
 
-   if (word->spaceStyle && word->spaceImgRenderer) {
+   if (word->spaceStyle && renderers && renderers->space) {
       word->spaceStyle->backgroundImage->removeExternalImgRenderer
-         (word->spaceImgRenderer);
-      delete word->spaceImgRenderer;
-      word->spaceImgRenderer = NULL;
+         (renderers->space);
+      delete renderers->space;
+      renderers->space = NULL;
    }
 }
 
@@ -1865,11 +1947,12 @@ void Textblock::setSpaceImgRenderer (int wordNo)
    Word *word = words->getRef (wordNo);
 
    if (word->spaceStyle->backgroundImage) {
-      word->spaceImgRenderer = new SpaceImgRenderer (this, wordNo);
+      WordImgRenderers *renderers = getImgRenderers (wordNo, true);
+      renderers->space = new SpaceImgRenderer (this, wordNo);
       word->spaceStyle->backgroundImage->putExternalImgRenderer
-         (word->spaceImgRenderer);
-   } else
-      word->spaceImgRenderer = NULL;
+         (renderers->space);
+   } else if (word->imgRenderers != -1)
+      getImgRenderers(wordNo, false)->space = NULL;
 }
 
 void Textblock::fillWord (int wordNo, int width, int ascent, int descent,
@@ -1883,7 +1966,7 @@ void Textblock::fillWord (int wordNo, int width, int ascent, int descent,
    DBG_SET_WORD_SIZE (wordNo);
    word->origSpace = word->effSpace = 0;
    word->hyphenWidth = 0;
-   word->badnessAndPenalty.setPenalty (PENALTY_PROHIBIT_BREAK);
+   word->penalties.setPenalty (PENALTY_PROHIBIT_BREAK);
    word->content.space = false;
    word->flags = flags;
 
@@ -2482,6 +2565,8 @@ void Textblock::addWidget (core::Widget *widget, core::style::Style *style)
 {
    DBG_OBJ_ENTER ("construct.word", 0, "addWidget", "%p, %p", widget, style);
 
+   wrapLazyWords ();
+
    /* We first assign -1 as parent_ref, since the call of widget->size_request
     * will otherwise let this Textblock be rewrapped from the beginning.
     * (parent_ref is actually undefined, but likely has the value 0.) At the,
@@ -2570,7 +2655,7 @@ bool Textblock::addAnchor (const char *name, core::style::Style *style)
 
    // Since an anchor does not take any space, it is safe to call
    // addAnchor already here.
-   if (wasAllocated ()) {
+   if (wasAllocated () && lazyWrapWord == -1) {
       if (lines->size () == 0)
          y = allocation.y;
       else
@@ -2708,11 +2793,11 @@ void Textblock::setBreakOption (Word *word, core::style::Style *style,
 
    // TODO: lineMustBeBroken should be independent of the penalty
    // index? Otherwise, examine the last line.
-   if (!word->badnessAndPenalty.lineMustBeBroken(0)) {
+   if (!word->penalties.lineMustBeBroken(0)) {
       if (forceBreak || isBreakAllowed (style))
-         word->badnessAndPenalty.setPenalties (breakPenalty1, breakPenalty2);
+         word->penalties.setPenalties (breakPenalty1, breakPenalty2);
       else
-         word->badnessAndPenalty.setPenalty (PENALTY_PROHIBIT_BREAK);
+         word->penalties.setPenalty (PENALTY_PROHIBIT_BREAK);
    }
 
    DBG_OBJ_LEAVE ();
@@ -2805,21 +2890,24 @@ void Textblock::addParbreak (int space, core::style::Style *style)
    /* Another break before? */
    if ((word = words->getRef(words->size () - 1)) &&
        word->content.type == core::Content::BREAK) {
-      Line *lastLine = lines->getRef (lines->size () - 1);
-
       word->content.breakSpace =
          misc::max (word->content.breakSpace, space);
-      lastLine->breakSpace =
-         misc::max (word->content.breakSpace,
-                    lastLine->marginDescent - lastLine->borderDescent,
-                    lastLine->breakSpace);
+
+      // With lazy line breaking, the break is not yet part of a line.
+      if (lazyWrapWord == -1) {
+         Line *lastLine = lines->getRef (lines->size () - 1);
+         lastLine->breakSpace =
+            misc::max (word->content.breakSpace,
+                       lastLine->marginDescent - lastLine->borderDescent,
+                       lastLine->breakSpace);
+      }
       return;
    }
 
    word = addWord (0, 0, 0, 0, style);
    DBG_OBJ_ASSOC_CHILD (style);
    word->content.type = core::Content::BREAK;
-   word->badnessAndPenalty.setPenalty (PENALTY_FORCE_BREAK);
+   word->penalties.setPenalty (PENALTY_FORCE_BREAK);
    word->content.breakSpace = space;
 
    DBG_SET_WORD (words->size () - 1);
@@ -2850,7 +2938,7 @@ void Textblock::addLinebreak (core::style::Style *style)
    DBG_OBJ_ASSOC_CHILD (style);
 
    word->content.type = core::Content::BREAK;
-   word->badnessAndPenalty.setPenalty (PENALTY_FORCE_BREAK);
+   word->penalties.setPenalty (PENALTY_FORCE_BREAK);
    word->content.breakSpace = 0;
 
    DBG_SET_WORD (words->size () - 1);
@@ -2880,7 +2968,7 @@ void Textblock::breakAdded ()
    // (Notice the space between <input> and <button>, and also that
    // the HTML parser will insert a BREAK between them.) The <input>
    // would be given the available width ("width: 100%"), but the
-   // actual width (Word::totalWidth) would include the space, so that
+   // actual width (WordWrapData::totalWidth) would include the space, so that
    // the width of the line is larger than the available width.
 
    if (words->size () >= 2)
@@ -2955,15 +3043,20 @@ core::Widget *Textblock::getWidgetAtPointLevel (int x, int y, int level,
  */
 void Textblock::handOverBreak (core::style::Style *style)
 {
-   if (lines->size() > 0) {
-      Widget *parent;
-      Line *lastLine = lines->getRef (lines->size () - 1);
+   Widget *parent = getParent();
 
-      if (lastLine->breakSpace != 0 && (parent = getParent()) &&
-          parent->instanceOf (Textblock::CLASS_ID) &&
-          parent->getStyle()->display != core::style::DISPLAY_BLOCK) {
-         Textblock *textblock2 = (Textblock*) parent;
-         textblock2->addParbreak(lastLine->breakSpace, style);
+   if (parent && parent->instanceOf (Textblock::CLASS_ID) &&
+       parent->getStyle()->display != core::style::DISPLAY_BLOCK) {
+      // The last line is needed.
+      wrapLazyWords ();
+
+      if (lines->size() > 0) {
+         Line *lastLine = lines->getRef (lines->size () - 1);
+
+         if (lastLine->breakSpace != 0) {
+            Textblock *textblock2 = (Textblock*) parent;
+            textblock2->addParbreak(lastLine->breakSpace, style);
+         }
       }
    }
 }
@@ -195,6 +195,54 @@ namespace dw {
  * dw::Textblock, which has the value -1 if no rewrapping of lines
  * necessary, or otherwise the line from which a rewrap is necessary.
  *
+ * <h3>Lazy Line Breaking</h3>
+ *
+ * A huge text block (a long log file, or a big \<pre\> element) is not
+ * broken into lines at once. When it has at least LAZY_WRAP_MIN_WORDS
+ * words, lines are only built down to dw::core::Layout::getLazyResizeLimit,
+ * i.e. somewhat below the visible part, and lazyWrapWord is set to the
+ * first word which is not part of a line. The height of the rest is
+ * estimated from the average height per word of the lines built so far.
+ *
+ * As long as lazyWrapWord is not -1, sizeAllocateImpl() passes the text
+ * block to dw::core::Layout::queueLazyResize, which extends the limit in
+ * an idle function and resizes the text block again, so that rewrap()
+ * continues from lazyWrapWord. This is repeated until all lines exist,
+ * and the estimated height has become the real one.
+ *
+ * This is only done for text blocks without widgets (in flow or out of
+ * flow), so that the lines built lazily affect nothing else. When a
+ * widget is added, all lines are built immediately, and lazy line
+ * breaking is not used anymore for this text block.
+ *
+ * When the position of a word which is not part of a line yet is needed
+ * (a match of "find text", or the anchor the view should be scrolled to),
+ * the lines down to this word are built first; see wrapLazyWordsUpTo().
+ *
+ * For the same reason, sizeAllocateImpl() has nothing to do for lines
+ * that have already been allocated at the same position and width, apart
+ * from the last one, which may have grown. As long as lazy line breaking
+ * is allowed, it starts at that line (see allocatedLines), so that a
+ * step costs the same at the end of a huge text block as at its start.
+ *
+ * <h3>Line Break Cache</h3>
+ *
+ * When lines are rewrapped (e.g. because the window has become narrower),
+ * the line breaks of the lines which are discarded are kept in the
+ * paragraphs (see Paragraph::breakCache), for the last few line break
+ * widths. When rewrap() reaches the beginning of a paragraph whose line
+ * breaks are known for the current line break width, the lines are added
+ * directly, without searching for the break positions again. This makes
+ * it cheap to go back to a previous width, e.g. when a side panel is
+ * shown and hidden again.
+ *
+ * The line breaks are only valid for the same borders: the left and right
+ * offset of every line (see Line::leftOffset and Line::rightOffset), which
+ * depend on floats, are stored with them, and compared again. Paragraphs
+ * containing widgets are not cached, since their sizes may depend on the
+ * width. Likewise, hyphenation changes the number of words of a paragraph,
+ * which makes its cached line breaks invalid.
+ *
  * <h3>Widgets Ouf Of Flow</h3>
  *
  * See
@@ -219,18 +267,16 @@ private:
       PENALTY_PROHIBIT_BREAK = INT_MAX
    };
 
-   class BadnessAndPenalty
+   /**
+    * \brief The penalties for breaking the line after a word.
+    *
+    * Unlike the badness (see BadnessAndPenalty), they do not depend on the
+    * line break width, and are kept in every word (Word::penalties).
+    */
+   class Penalties
    {
-   private:
-      enum { NOT_STRETCHABLE, QUITE_LOOSE, BADNESS_VALUE, TOO_TIGHT }
-         badnessState;
-      int ratio; // ratio is only defined when badness is defined
-      int badness, penalty[2];
-
-      // For debugging: define DEBUG for more information in print().
-#ifdef DEBUG
-      int totalWidth, idealWidth, totalStretchability, totalShrinkability;
-#endif
+   protected:
+      int penalty[2];
 
       // "Infinity levels" are used to represent very large numbers,
       // including "quasi-infinite" numbers. A couple of infinity
@@ -258,23 +304,50 @@ private:
       };
 
       void setSinglePenalty (int index, int penalty);
-      int badnessValue (int infLevel);
       int penaltyValue (int index, int infLevel);
 
    public:
-      void calcBadness (int totalWidth, int idealWidth,
-                        int totalStretchability, int totalShrinkability);
       inline void setPenalty (int penalty) { setPenalties (penalty, penalty); }
       void setPenalties (int penalty1, int penalty2);
 
       // Rather for debugging:
       inline int getPenalty (int i) { return penalty[i]; }
 
+      bool lineMustBeBroken (int penaltyIndex);
+      bool lineCanBeBroken (int penaltyIndex);
+   };
+
+   /**
+    * \brief The badness of a line broken after a word, together with the
+    *    penalties of the word.
+    *
+    * Only needed while the line is built; see WordWrapData.
+    */
+   class BadnessAndPenalty: public Penalties
+   {
+   private:
+      enum { NOT_STRETCHABLE, QUITE_LOOSE, BADNESS_VALUE, TOO_TIGHT }
+         badnessState;
+      int ratio; // ratio is only defined when badness is defined
+      int badness;
+
+      // For debugging: define DEBUG for more information in print().
+#ifdef DEBUG
+      int totalWidth, idealWidth, totalStretchability, totalShrinkability;
+#endif
+
+      int badnessValue (int infLevel);
+
+   public:
+      void calcBadness (int totalWidth, int idealWidth,
+                        int totalStretchability, int totalShrinkability);
+      inline void setPenalties (Penalties *penalties)
+      { *(Penalties*)this = *penalties; }
+      using Penalties::setPenalties;
+
       bool lineLoose ();
       bool lineTight ();
       bool lineTooTight ();
-      bool lineMustBeBroken (int penaltyIndex);
-      bool lineCanBeBroken (int penaltyIndex);
       int compareTo (int penaltyIndex, BadnessAndPenalty *other);
 
       void intoStringBuffer(lout::misc::StringBuffer *sb);
@@ -284,6 +357,9 @@ private:
           PENALTY_NUM };
    enum { NUM_DIV_CHARS = 4 };
 
+   /* See "Lazy Line Breaking" above. */
+   enum { LAZY_WRAP_MIN_WORDS = 10000 };
+
    typedef struct
    {
       const char *s;
@@ -331,11 +407,44 @@ protected:
       core::style::Style *getStyle ();
    };
 
+   /**
+    * \brief The line breaks of a paragraph, for a few line break widths.
+    *
+    * See "Line Break Cache" in dw::Textblock.
+    */
+   class BreakCache
+   {
+   public:
+      struct Entry
+      {
+         int lineBreakWidth, numWords, numLines;
+         /* For each line: the last word (relative to the first word of
+            the paragraph), the left offset, and the right offset. */
+         int *lines;
+      };
+
+   private:
+      enum { NUM_ENTRIES = 4 };
+
+      /* The most recently used entry comes first. */
+      Entry entries[NUM_ENTRIES];
+      int numEntries;
+
+   public:
+      BreakCache ();
+      ~BreakCache ();
+
+      Entry *lookup (int lineBreakWidth, int numWords);
+      Entry *store (int lineBreakWidth, int numWords, int numLines);
+   };
+
    struct Paragraph
    {
       int firstWord;    /* first word's index in word vector */
       int lastWord;     /* last word's index in word vector */
 
+      BreakCache *breakCache; /* NULL, when no line breaks are cached. */
+
       /*
        * General remark: all values include the last hyphen width, but
        * not the last space; these values are, however corrected, when
@@ -472,8 +581,27 @@ protected:
                           * "hyphenWidth > 0" is also used to decide
                           * whether to draw a hyphen. */
       short flags;
+      /* Index in Textblock::imgRenderers, or -1, if there are no image
+       * renderers (for background images) for this word. */
+      int imgRenderers;
       core::Content content;
 
+      core::style::Style *style;
+      core::style::Style *spaceStyle; /* initially the same as of the word,
+                                         later set by a_Dw_page_add_space */
+
+      Penalties penalties; /* when line is broken after this word */
+   };
+
+   /**
+    * \brief Values of a word needed while the line containing it is built.
+    *
+    * These values are only needed for the words after the last line (see
+    * accumulateWordData()), so they are not part of Word, but kept in
+    * Textblock::wrapData, for these words only.
+    */
+   struct WordWrapData
+   {
       // accumulated values, relative to the beginning of the line
       int totalWidth;          /* The sum of all word widths; plus all
                                   spaces, excluding the one of this
@@ -487,16 +615,16 @@ protected:
       int totalSpaceStretchability; // includes all *before* current word
       int totalSpaceShrinkability;  // includes all *before* current word
       BadnessAndPenalty badnessAndPenalty; /* when line is broken after this
-                                            * word */
-
-      core::style::Style *style;
-      core::style::Style *spaceStyle; /* initially the same as of the word,
-                                         later set by a_Dw_page_add_space */
+                                            * word; the penalties are set by
+                                            * getBadnessAndPenalty() */
+   };
 
-      // These two are used rarely, so there is perhaps a way to store
-      // them which is consuming less memory.
-      WordImgRenderer *wordImgRenderer;
-      SpaceImgRenderer *spaceImgRenderer;
+   /* Image renderers of a word, which are used rarely; see
+      Word::imgRenderers. */
+   struct WordImgRenderers
+   {
+      WordImgRenderer *word;
+      SpaceImgRenderer *space;
    };
 
    struct Anchor
@@ -574,6 +702,9 @@ protected:
    
    int redrawY;
    int lastWordDrawn;
+   /* Lines allocated at the current allocation, and the width their text
+      offsets were calculated for; see "Lazy Line Breaking" above. */
+   int allocatedLines, allocatedLinesWidth;
 
    core::SizeParams sizeRequestParams;
    
@@ -608,7 +739,21 @@ protected:
    lout::misc::SimpleVector <Line> *lines;
    lout::misc::SimpleVector <Paragraph> *paragraphs;
    int nonTemporaryLines;
+   /* Line break width of the current lines; see "Line Break Cache"
+      above. */
+   int linesBreakWidth;
+   /* First word not yet wrapped into lines (-1 if there is none), and
+      whether this is allowed; see "Lazy Line Breaking" above. */
+   int lazyWrapWord;
+   bool lazyWrapAllowed;
+   /* Last word which must be wrapped anyway, since its position is needed
+      (-1 if there is none); see wrapLazyWordsUpTo(). */
+   int lazyWrapUpTo;
    lout::misc::NotSoSimpleVector <Word> *words;
+   /* Wrap data of the words from wrapDataFirst on; see WordWrapData. */
+   lout::misc::SimpleVector <WordWrapData> *wrapData;
+   int wrapDataFirst;
+   lout::misc::SimpleVector <WordImgRenderers> *imgRenderers;
    lout::misc::SimpleVector <Anchor> *anchors;
 
    struct { int index, nChar; }
@@ -627,6 +772,12 @@ protected:
    void justifyLine (Line *line, int diff);
    Line *addLine (int firstWord, int lastWord, int newLastOofPos,
                   bool temporary, int minHeight);
+   int lazyWrapLimit ();
+   bool wrapLater ();
+   void wrapLazyWords ();
+   void wrapLazyWordsUpTo (int wordIndex);
+   void saveLineBreaks (int firstLine);
+   int restoreLineBreaks (int wordIndex);
    void rewrap ();
    void fillParagraphs ();
    void initNewLine ();
@@ -665,6 +816,7 @@ protected:
    void breakAdded ();
    void initWord (int wordNo);
    void cleanupWord (int wordNo);
+   WordImgRenderers *getImgRenderers (int wordNo, bool create);
    void removeWordImgRenderer (int wordNo);
    void setWordImgRenderer (int wordNo);
    void removeSpaceImgRenderer (int wordNo);
@@ -805,6 +957,22 @@ protected:
    void moveWordIndices (int wordIndex, int num, int *addIndex1 = NULL);
    void accumulateWordForLine (int lineIndex, int wordIndex);
    void accumulateWordData (int wordIndex);
+
+   inline WordWrapData *getWrapData (int wordIndex)
+   {
+      assert (wordIndex >= wrapDataFirst &&
+              wordIndex < wrapDataFirst + wrapData->size ());
+      return wrapData->getRef (wordIndex - wrapDataFirst);
+   }
+
+   inline BadnessAndPenalty *getBadnessAndPenalty (int wordIndex)
+   {
+      // The penalties may have been changed after accumulateWordData().
+      BadnessAndPenalty *bap = &getWrapData(wordIndex)->badnessAndPenalty;
+      bap->setPenalties (&words->getRef(wordIndex)->penalties);
+      return bap;
+   }
+
    int calcLineBreakWidth (int lineIndex);
    void initLine1Offset (int wordIndex);
    void alignLine (int lineIndex);
@@ -913,13 +1081,13 @@ public:
 
 #define DBG_SET_WORD_PENALTY(n, i, is) \
    D_STMT_START { \
-      if (words->getRef(n)->badnessAndPenalty.getPenalty (i) == INT_MIN) \
+      if (words->getRef(n)->penalties.getPenalty (i) == INT_MIN) \
          DBG_OBJ_ARRATTRSET_SYM ("words", n, "penalty." is, "-inf"); \
-      else if (words->getRef(n)->badnessAndPenalty.getPenalty (i) == INT_MAX) \
+      else if (words->getRef(n)->penalties.getPenalty (i) == INT_MAX) \
          DBG_OBJ_ARRATTRSET_SYM ("words", n, "penalty." is, "inf"); \
       else \
          DBG_OBJ_ARRATTRSET_NUM ("words", n, "penalty." is, \
-                                 words->getRef(n)->badnessAndPenalty \
+                                 words->getRef(n)->penalties \
                                  .getPenalty (i)); \
    } D_STMT_END
 
@@ -194,6 +194,8 @@ void Textblock::TextblockIterator::getAllocation (int start, int end,
       Word *word = textblock->words->getRef (index);
       int firstWordOfLine, textOffset, lineYOffsetCanvas, lineBorderAscent;
 
+      // The line must exist, when it has only been left for later.
+      textblock->wrapLazyWordsUpTo (index);
       int lineIndex = textblock->findLineOfWord (index);
 
       // It may be that the line does not exist yet.
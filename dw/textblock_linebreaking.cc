@@ -27,6 +27,7 @@
 #include "../lout/misc.hh"
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 using namespace lout;
@@ -55,7 +56,7 @@ int Textblock::BadnessAndPenalty::badnessValue (int infLevel)
    return 0;
 }
 
-int Textblock::BadnessAndPenalty::penaltyValue (int index, int infLevel)
+int Textblock::Penalties::penaltyValue (int index, int infLevel)
 {
    if (penalty[index] == INT_MIN)
       return infLevel == INF_PENALTIES ? -1 : 0;
@@ -127,14 +128,14 @@ void Textblock::BadnessAndPenalty::calcBadness (int totalWidth, int idealWidth,
  *
  * (TODO plural: penalties, not penalty. Correct above comment)
  */
-void Textblock::BadnessAndPenalty::setPenalties (int penalty1, int penalty2)
+void Textblock::Penalties::setPenalties (int penalty1, int penalty2)
 {
    // TODO Check here some cases, e.g. both or no penalty INT_MIN.
    setSinglePenalty(0, penalty1);
    setSinglePenalty(1, penalty2);
 }
 
-void Textblock::BadnessAndPenalty::setSinglePenalty (int index, int penalty)
+void Textblock::Penalties::setSinglePenalty (int index, int penalty)
 {
    if (penalty == INT_MAX || penalty == INT_MIN)
       this->penalty[index] = penalty;
@@ -167,12 +168,12 @@ bool Textblock::BadnessAndPenalty::lineTooTight ()
 }
 
 
-bool Textblock::BadnessAndPenalty::lineMustBeBroken (int penaltyIndex)
+bool Textblock::Penalties::lineMustBeBroken (int penaltyIndex)
 {
    return penalty[penaltyIndex] == PENALTY_FORCE_BREAK;
 }
 
-bool Textblock::BadnessAndPenalty::lineCanBeBroken (int penaltyIndex)
+bool Textblock::Penalties::lineCanBeBroken (int penaltyIndex)
 {
    return penalty[penaltyIndex] != PENALTY_PROHIBIT_BREAK;
 }
@@ -241,6 +242,77 @@ void Textblock::BadnessAndPenalty::intoStringBuffer(StringBuffer *sb)
    sb->append (")");
 }
 
+Textblock::BreakCache::BreakCache ()
+{
+   numEntries = 0;
+}
+
+Textblock::BreakCache::~BreakCache ()
+{
+   for (int i = 0; i < numEntries; i++)
+      delete[] entries[i].lines;
+}
+
+/**
+ * Return the line breaks for this line break width, or NULL. numWords is
+ * the current number of words in the paragraph; when it has changed (due
+ * to hyphenation), the line breaks are not valid anymore.
+ */
+Textblock::BreakCache::Entry *Textblock::BreakCache::lookup (int
+                                                             lineBreakWidth,
+                                                             int numWords)
+{
+   for (int i = 0; i < numEntries; i++) {
+      if (entries[i].lineBreakWidth == lineBreakWidth &&
+          entries[i].numWords == numWords) {
+         Entry entry = entries[i];
+         memmove (entries + 1, entries, i * sizeof (Entry));
+         entries[0] = entry;
+         return entries;
+      }
+   }
+   return NULL;
+}
+
+/**
+ * Make place for the line breaks for this line break width, and return the
+ * entry, whose lines have to be filled by the caller. The least recently
+ * used entry is replaced, when necessary.
+ */
+Textblock::BreakCache::Entry *Textblock::BreakCache::store (int lineBreakWidth,
+                                                            int numWords,
+                                                            int numLines)
+{
+   int i;
+
+   for (i = 0; i < numEntries; i++)
+      if (entries[i].lineBreakWidth == lineBreakWidth)
+         break;
+
+   if (i == numEntries) {
+      if (numEntries < NUM_ENTRIES) {
+         entries[i].lines = NULL;
+         entries[i].numLines = 0;
+         numEntries++;
+      } else
+         // Reuse the least recently used entry.
+         i--;
+   }
+
+   Entry entry = entries[i];
+   memmove (entries + 1, entries, i * sizeof (Entry));
+
+   if (entry.numLines != numLines) {
+      delete[] entry.lines;
+      entry.lines = new int[3 * numLines];
+   }
+   entry.lineBreakWidth = lineBreakWidth;
+   entry.numWords = numWords;
+   entry.numLines = numLines;
+   entries[0] = entry;
+   return entries;
+}
+
 /*
  * ...
  *
@@ -317,9 +389,9 @@ Textblock::Line *Textblock::addLine (int firstWord, int lastWord,
       DBG_MSG_WORD ("construct.line", 1, "<i>first word:</i> ", firstWord, "");
       DBG_MSG_WORD ("construct.line", 1, "<i>last word:</i> ", lastWord, "");
 
-      Word *lastWordOfLine = words->getRef(lastWord);
-      // Word::totalWidth includes the hyphen (which is what we want here).
-      lineWidth = lastWordOfLine->totalWidth;
+      // WordWrapData::totalWidth includes the hyphen (which is what we
+      // want here).
+      lineWidth = getWrapData(lastWord)->totalWidth;
       DBG_OBJ_MSGF ("construct.line", 1, "lineWidth (from last word): %d",
                     lineWidth);
    } else {
@@ -458,10 +530,14 @@ Textblock::Line *Textblock::addLine (int firstWord, int lastWord,
    int yLine = yOffsetOfLineCreated (line);
    for (int i = firstWord; i <= lastWord; i++) {
       Word *word = words->getRef (i);
-      if (word->wordImgRenderer)
-         word->wordImgRenderer->setData (xWidget, lines->size () - 1);
-      if (word->spaceImgRenderer)
-         word->spaceImgRenderer->setData (xWidget, lines->size () - 1);
+      if (word->imgRenderers != -1) {
+         WordImgRenderers *renderers =
+            imgRenderers->getRef (word->imgRenderers);
+         if (renderers->word)
+            renderers->word->setData (xWidget, lines->size () - 1);
+         if (renderers->space)
+            renderers->space->setData (xWidget, lines->size () - 1);
+      }
 
       if (word->content.type == core::Content::WIDGET_OOF_REF) {
          Widget *widget = word->content.widgetReference->widget;
@@ -500,6 +576,21 @@ void Textblock::processWord (int wordIndex)
    DBG_OBJ_ENTER ("construct.all", 0, "processWord", "%d", wordIndex);
    DBG_MSG_WORD ("construct.all", 1, "<i>processed word:</i>", wordIndex, "");
 
+   if (lazyWrapWord == -1 && wrapLater ()) {
+      lazyWrapWord = lines->getLastRef()->lastWord + 1;
+      DBG_OBJ_SET_NUM ("lazyWrapWord", lazyWrapWord);
+   }
+
+   if (lazyWrapWord != -1) {
+      // The word is wrapped later, by rewrap(); only the extremes, which
+      // do not depend on the lines, are calculated now.
+      handleWordExtremes (wordIndex);
+      mustQueueResize = true;
+      DBG_OBJ_SET_BOOL ("mustQueueResize", mustQueueResize);
+      DBG_OBJ_LEAVE ();
+      return;
+   }
+
    int diffWords = wordWrap (wordIndex, false);
 
    if (diffWords == 0)
@@ -524,6 +615,7 @@ void Textblock::processWord (int wordIndex)
       int firstWord;
       if (paragraphs->size() > 0) {
          firstWord = paragraphs->getLastRef()->firstWord;
+         delete paragraphs->getLastRef()->breakCache;
          paragraphs->setSize (paragraphs->size() - 1);
          DBG_OBJ_SET_NUM ("paragraphs.size", paragraphs->size ());
          DBG_OBJ_MSG ("construct.paragraph", 1, "removing last paragraph");
@@ -636,7 +728,7 @@ int Textblock::wrapWordInFlow (int wordIndex, bool wrapAll)
       } else if (wordIndex >= firstIndex &&
                  // TODO: lineMustBeBroken should be independent of
                  // the penalty index?
-                 word->badnessAndPenalty.lineMustBeBroken (penaltyIndex)) {
+                 word->penalties.lineMustBeBroken (penaltyIndex)) {
          newLine = true;
          searchUntil = wordIndex;
          DBG_OBJ_MSG ("construct.word", 1, "<b>new line:</b> forced break");
@@ -659,7 +751,7 @@ int Textblock::wrapWordInFlow (int wordIndex, bool wrapAll)
                  && i <= wordIndex - 1;
               i++) {
             DBG_OBJ_MSGF ("construct.word", 2, "examining word %d", i);
-            if (words->getRef(i)->badnessAndPenalty
+            if (words->getRef(i)->penalties
                 .lineCanBeBroken (penaltyIndex)) {
                DBG_MSG_WORD ("construct.word", 2, "break possible for word:",
                              i, "");
@@ -672,11 +764,11 @@ int Textblock::wrapWordInFlow (int wordIndex, bool wrapAll)
                        possibleLineBreak ? "true" : "false");
 
          DBG_OBJ_MSGF ("construct.word", 1, "word->... too tight: %s",
-                       word->badnessAndPenalty.lineTooTight () ?
+                       getBadnessAndPenalty(wordIndex)->lineTooTight () ?
                        "true" : "false");
 
          if ((thereWillBeMoreSpace || possibleLineBreak)
-             && word->badnessAndPenalty.lineTooTight ()) {
+             && getBadnessAndPenalty(wordIndex)->lineTooTight ()) {
             newLine = true;
             searchUntil = wordIndex - 1;
             DBG_OBJ_MSG ("construct.word", 1,
@@ -1032,12 +1124,12 @@ int Textblock::searchBreakPos (int wordIndex, int firstIndex, int *searchUntil,
          result = firstIndex - 1;
          lineAdded = true;
       } else if (thereWillBeMoreSpace &&
-                 words->getRef(firstIndex)->badnessAndPenalty.lineTooTight ()) {
+                 getBadnessAndPenalty(firstIndex)->lineTooTight ()) {
          int hyphenatedWord = considerHyphenation (firstIndex, firstIndex);
 
          DBG_IF_RTFL {
             StringBuffer sb;
-            words->getRef(firstIndex)->badnessAndPenalty.intoStringBuffer (&sb);
+            getBadnessAndPenalty(firstIndex)->intoStringBuffer (&sb);
             DBG_OBJ_MSGF ("construct.word", 1,
                           "too tight: %s ... hyphenatedWord = %d",
                           sb.getChars (), hyphenatedWord);
@@ -1127,11 +1219,11 @@ int Textblock::searchMinBap (int firstWord, int lastWord, int penaltyIndex,
 
    DBG_OBJ_MSG_START ();
    for (int i = firstWord; i <= lastWord; i++) {
-      Word *w = words->getRef(i);
+      BadnessAndPenalty *bap = getBadnessAndPenalty (i);
 
       DBG_IF_RTFL {
          StringBuffer sb;
-         w->badnessAndPenalty.intoStringBuffer (&sb);
+         bap->intoStringBuffer (&sb);
          DBG_OBJ_MSGF ("construct.word", 2, "%d (of %d): b+p: %s",
                        i, words->size (), sb.getChars ());
          DBG_MSG_WORD ("construct.word", 2, "(<i>i. e.:</i> ", i, ")");
@@ -1142,9 +1234,7 @@ int Textblock::searchMinBap (int firstWord, int lastWord, int penaltyIndex,
       // per line -- theoretically. Practically, the case "==" will
       // never occur.
       if (pos == -1 ||
-          w->badnessAndPenalty.compareTo (penaltyIndex,
-                                          &words->getRef(pos)
-                                          ->badnessAndPenalty) <= 0)
+          bap->compareTo (penaltyIndex, getBadnessAndPenalty (pos)) <= 0)
          pos = i;
    }
    DBG_OBJ_MSG_END ();
@@ -1160,8 +1250,7 @@ int Textblock::searchMinBap (int firstWord, int lastWord, int penaltyIndex,
 
       // (Notice that it was once (temporally) set to -inf, not 0, but
       // this will make e.g. test/table-1.html not work.)
-      Word *w = words->getRef (lastWord);
-      BadnessAndPenalty correctedBap = w->badnessAndPenalty;
+      BadnessAndPenalty correctedBap = *getBadnessAndPenalty (lastWord);
       correctedBap.setPenalty (0);
 
       DBG_IF_RTFL {
@@ -1172,7 +1261,7 @@ int Textblock::searchMinBap (int firstWord, int lastWord, int penaltyIndex,
       }
 
       if (correctedBap.compareTo(penaltyIndex,
-                                 &words->getRef(pos)->badnessAndPenalty) <= 0) {
+                                 getBadnessAndPenalty (pos)) <= 0) {
          pos = lastWord;
          DBG_OBJ_MSGF ("construct.word", 1, "corrected: %d", pos);
       }
@@ -1191,28 +1280,27 @@ int Textblock::considerHyphenation (int firstIndex, int breakPos)
 {
    int hyphenatedWord = -1;
 
-   Word *wordBreak = words->getRef(breakPos);
+   BadnessAndPenalty *bapBreak = getBadnessAndPenalty (breakPos);
    //printf ("[%p] line (broken at word %d): ", this, breakPos);
-   //printWord (wordBreak);
+   //printWord (words->getRef(breakPos));
    //printf ("\n");
 
    // A tight line: maybe, after hyphenation, some parts of the last
    // word of this line can be put into the next line.
-   if (wordBreak->badnessAndPenalty.lineTight ()) {
+   if (bapBreak->lineTight ()) {
       // Sometimes, it is not the last word, which must be hyphenated,
       // but some word before. Here, we search for the first word
       // which can be hyphenated, *and* makes the line too tight.
       for (int i = breakPos; i >= firstIndex; i--) {
-         Word *word1 = words->getRef (i);
-         if (word1->badnessAndPenalty.lineTight () &&
-             isHyphenationCandidate (word1))
+         if (getBadnessAndPenalty(i)->lineTight () &&
+             isHyphenationCandidate (words->getRef (i)))
             hyphenatedWord = i;
       }
    }
 
    // A loose line: maybe, after hyphenation, some parts of the first
    // word of the next line can be put into this line.
-   if (wordBreak->badnessAndPenalty.lineLoose () &&
+   if (bapBreak->lineLoose () &&
        breakPos + 1 < words->size ()) {
       Word *word2 = words->getRef(breakPos + 1);
       if (isHyphenationCandidate (word2))
@@ -1276,7 +1364,7 @@ void Textblock::handleWordExtremes (int wordIndex)
 
    if (paragraphs->size() == 0 ||
        words->getRef(paragraphs->getLastRef()->lastWord)
-       ->badnessAndPenalty.lineMustBeBroken (1)) {
+       ->penalties.lineMustBeBroken (1)) {
       // Add a new paragraph.
       paragraphs->increase ();
       DBG_OBJ_SET_NUM ("paragraphs.size", paragraphs->size ());
@@ -1286,6 +1374,7 @@ void Textblock::handleWordExtremes (int wordIndex)
       Paragraph *par = paragraphs->getLastRef();
 
       par->firstWord = par->lastWord = wordIndex;
+      par->breakCache = NULL;
       par->parMin = par->parMinIntrinsic = par->parMax = par->parMaxIntrinsic =
          par->parAdjustmentWidth = 0;
 
@@ -1314,7 +1403,7 @@ void Textblock::handleWordExtremes (int wordIndex)
    int corrDiffMin, corrDiffMax;
    if (wordIndex - 1 >= lastPar->firstWord) {
       Word *lastWord = words->getRef (wordIndex - 1);
-      if (lastWord->badnessAndPenalty.lineCanBeBroken (1) &&
+      if (lastWord->penalties.lineCanBeBroken (1) &&
           (lastWord->flags & Word::UNBREAKABLE_FOR_MIN_WIDTH) == 0)
          corrDiffMin = 0;
       else
@@ -1351,7 +1440,7 @@ void Textblock::handleWordExtremes (int wordIndex)
                            "maxParAdjustmentWidth",
                            lastPar->maxParAdjustmentWidth);
 
-   if (word->badnessAndPenalty.lineCanBeBroken (1) &&
+   if (word->penalties.lineCanBeBroken (1) &&
        (word->flags & Word::UNBREAKABLE_FOR_MIN_WIDTH) == 0) {
       lastPar->parMin = lastPar->parMinIntrinsic = lastPar->parAdjustmentWidth
          = 0;
@@ -1393,7 +1482,7 @@ void Textblock::correctLastWordExtremes ()
 {
    if (paragraphs->size() > 0) {
       Word *word = words->getLastRef ();
-      if (word->badnessAndPenalty.lineCanBeBroken (1) &&
+      if (word->penalties.lineCanBeBroken (1) &&
           (word->flags & Word::UNBREAKABLE_FOR_MIN_WIDTH) == 0) {
          Paragraph *lastPar = paragraphs->getLastRef();
          lastPar->parMin = lastPar->parMinIntrinsic =
@@ -1428,6 +1517,17 @@ int Textblock::hyphenateWord (int wordIndex, int *addIndex1)
       PRINTF ("[%p]       %d words ...\n", this, words->size ());
       words->insert (wordIndex, numBreaks);
 
+      // The values of the following words are still used; see
+      // accumulateWordData().
+      if (wordIndex < wrapDataFirst)
+         wrapDataFirst += numBreaks;
+      else if (wordIndex < wrapDataFirst + wrapData->size ()) {
+         int i = wordIndex - wrapDataFirst, n = wrapData->size ();
+         wrapData->setSize (n + numBreaks);
+         memmove (wrapData->getRef (i + numBreaks), wrapData->getRef (i),
+                  (n - i) * sizeof (WordWrapData));
+      }
+
       DBG_IF_RTFL {
          for (int i = wordIndex + numBreaks; i < words->size (); i++)
             DBG_SET_WORD (i);
@@ -1474,8 +1574,8 @@ int Textblock::hyphenateWord (int wordIndex, int *addIndex1)
 
          if (i < numBreaks) {
             // TODO There should be a method fillHyphen.
-            w->badnessAndPenalty.setPenalties (penalties[PENALTY_HYPHEN][0],
-                                               penalties[PENALTY_HYPHEN][1]);
+            w->penalties.setPenalties (penalties[PENALTY_HYPHEN][0],
+                                       penalties[PENALTY_HYPHEN][1]);
             // "\xe2\x80\x90" is an unconditional hyphen.
             w->hyphenWidth =
                layout->textWidth (w->style->font, hyphenDrawChar,
@@ -1641,73 +1741,110 @@ void Textblock::accumulateWordData (int wordIndex)
    else
       firstWordOfLine = lines->getRef(lineIndex - 1)->lastWord + 1;
 
-   Word *word = words->getRef (wordIndex);
    DBG_OBJ_MSGF ("construct.word.accum", 2, "lineIndex = %d", lineIndex);
 
+   if (lineIndex < lines->size ()) {
+      // The word is already part of a line, so that the values are not
+      // needed anymore (see WordWrapData).
+      DBG_OBJ_MSGF ("construct.word.accum", 1,
+                    "already in existing line %d", lineIndex);
+      DBG_OBJ_LEAVE ();
+      return;
+   }
+
+   Word *word = words->getRef (wordIndex);
+   WordWrapData *data;
+
    int lineBreakWidth = calcLineBreakWidth (lineIndex);
 
    DBG_OBJ_MSGF ("construct.word.accum", 2,
-                 "(%s existing line %d starts with word %d; "
-                 "lineBreakWidth = %d)",
-                 lineIndex < lines->size () ? "already" : "not yet",
+                 "(line %d starts with word %d; lineBreakWidth = %d)",
                  lineIndex, firstWordOfLine, lineBreakWidth);
 
    if (wordIndex == firstWordOfLine) {
-      // first word of the (not necessarily yet existing) line
-      word->totalWidth = word->size.width + word->hyphenWidth;
-      word->maxAscent = word->size.ascent;
-      word->maxDescent = word->size.descent;
-      word->totalSpaceStretchability = 0;
-      word->totalSpaceShrinkability = 0;
+      // first word of the (not yet existing) line; the values of the
+      // following words are kept, when the line has not changed
+      if (wrapDataFirst != wordIndex) {
+         wrapDataFirst = wordIndex;
+         wrapData->setSize (0);
+      }
+      if (wrapData->size () == 0)
+         wrapData->setSize (1);
+      data = getWrapData (wordIndex);
+
+      data->totalWidth = word->size.width + word->hyphenWidth;
+      data->maxAscent = word->size.ascent;
+      data->maxDescent = word->size.descent;
+      data->totalSpaceStretchability = 0;
+      data->totalSpaceShrinkability = 0;
 
       DBG_OBJ_MSGF ("construct.word.accum", 1,
                     "first word of line: words[%d].totalWidth = %d + %d = %d; "
                     "maxAscent = %d, maxDescent = %d",
                     wordIndex, word->size.width, word->hyphenWidth,
-                    word->totalWidth, word->maxAscent, word->maxDescent);
+                    data->totalWidth, data->maxAscent, data->maxDescent);
    } else {
+      if (wrapDataFirst != firstWordOfLine ||
+          wordIndex - wrapDataFirst > wrapData->size ()) {
+         // The previous word has not been wrapped yet (e.g. because of
+         // lazy line breaking), so this word will be accumulated again
+         // when wrapped.
+         DBG_OBJ_MSG ("construct.word.accum", 1,
+                      "previous word not accumulated");
+         DBG_OBJ_LEAVE ();
+         return;
+      }
+
+      // The words are accumulated in order, so that the wrap data has to
+      // be extended by at most one word.
+      if (wordIndex - wrapDataFirst == wrapData->size ())
+         wrapData->setSize (wrapData->size () + 1);
+
       Word *prevWord = words->getRef (wordIndex - 1);
+      WordWrapData *prevData = getWrapData (wordIndex - 1);
+      data = getWrapData (wordIndex);
 
-      word->totalWidth = prevWord->totalWidth
+      data->totalWidth = prevData->totalWidth
          + prevWord->origSpace - prevWord->hyphenWidth
          + word->size.width + word->hyphenWidth;
-      word->maxAscent = max (prevWord->maxAscent, word->size.ascent);
-      word->maxDescent = max (prevWord->maxDescent, word->size.descent);
-      word->totalSpaceStretchability =
-         prevWord->totalSpaceStretchability + getSpaceStretchability(prevWord);
-      word->totalSpaceShrinkability =
-         prevWord->totalSpaceShrinkability + getSpaceShrinkability(prevWord);
+      data->maxAscent = max (prevData->maxAscent, word->size.ascent);
+      data->maxDescent = max (prevData->maxDescent, word->size.descent);
+      data->totalSpaceStretchability =
+         prevData->totalSpaceStretchability + getSpaceStretchability(prevWord);
+      data->totalSpaceShrinkability =
+         prevData->totalSpaceShrinkability + getSpaceShrinkability(prevWord);
 
       DBG_OBJ_MSGF ("construct.word.accum", 1,
                     "not first word of line: words[%d].totalWidth = %d + %d - "
                     "%d + %d + %d = %d; maxAscent = max (%d, %d) = %d, "
                     "maxDescent = max (%d, %d) = %d",
-                    wordIndex, prevWord->totalWidth, prevWord->origSpace,
+                    wordIndex, prevData->totalWidth, prevWord->origSpace,
                     prevWord->hyphenWidth, word->size.width,
-                    word->hyphenWidth, word->totalWidth,
-                    prevWord->maxAscent, word->size.ascent, word->maxAscent,
-                    prevWord->maxDescent, word->size.descent, word->maxDescent);
+                    word->hyphenWidth, data->totalWidth,
+                    prevData->maxAscent, word->size.ascent, data->maxAscent,
+                    prevData->maxDescent, word->size.descent,
+                    data->maxDescent);
    }
 
    int totalStretchability =
-      word->totalSpaceStretchability + getLineStretchability (wordIndex);
+      data->totalSpaceStretchability + getLineStretchability (wordIndex);
    int totalShrinkability =
-      word->totalSpaceShrinkability + getLineShrinkability (wordIndex);
+      data->totalSpaceShrinkability + getLineShrinkability (wordIndex);
 
    DBG_OBJ_MSGF ("construct.word.accum", 1,
                  "totalStretchability = %d + ... = %d",
-                 word->totalSpaceStretchability, totalStretchability);
+                 data->totalSpaceStretchability, totalStretchability);
    DBG_OBJ_MSGF ("construct.word.accum", 1,
                  "totalShrinkability = %d + ... = %d",
-                 word->totalSpaceShrinkability, totalShrinkability);
+                 data->totalSpaceShrinkability, totalShrinkability);
 
-   word->badnessAndPenalty.calcBadness (word->totalWidth, lineBreakWidth,
+   data->badnessAndPenalty.calcBadness (data->totalWidth, lineBreakWidth,
                                         totalStretchability,
                                         totalShrinkability);
 
    DBG_IF_RTFL {
       StringBuffer sb;
-      word->badnessAndPenalty.intoStringBuffer (&sb);
+      getBadnessAndPenalty(wordIndex)->intoStringBuffer (&sb);
       DBG_OBJ_ARRATTRSET_SYM ("words", wordIndex, "badnessAndPenalty",
                               sb.getChars ());
    }
@@ -1844,8 +1981,9 @@ void Textblock::alignLine (int lineIndex)
                // when the line would be shrunken otherwise. (This solution is
                // far from perfect, but a better solution would make changes in
                // the line breaking algorithm necessary.)
-               lineBreakWidth < lastWord->totalWidth)
-               justifyLine (line, lineBreakWidth - lastWord->totalWidth);
+               lineBreakWidth < getWrapData(line->lastWord)->totalWidth)
+               justifyLine (line, lineBreakWidth
+                                  - getWrapData(line->lastWord)->totalWidth);
             break;
          case core::style::TEXT_ALIGN_RIGHT:
             DBG_OBJ_MSG ("construct.line", 1,
@@ -1878,8 +2016,17 @@ void Textblock::calcTextOffset (int lineIndex, int totalWidth)
                   lineIndex, totalWidth);
 
    Line *line = lines->getRef (lineIndex);
-   int lineWidth = line->firstWord <= line->lastWord ?
-      words->getRef(line->lastWord)->totalWidth : 0;
+   int lineWidth = 0;
+
+   if (line->alignment != Line::LEFT) {
+      // Like WordWrapData::totalWidth of the last word, which is not kept
+      // for existing lines.
+      for (int i = line->firstWord; i <= line->lastWord; i++) {
+         Word *word = words->getRef (i);
+         lineWidth += word->size.width +
+            (i < line->lastWord ? word->origSpace : word->hyphenWidth);
+      }
+   }
 
    switch (line->alignment) {
    case Line::LEFT:
@@ -1917,25 +2064,225 @@ void Textblock::calcTextOffset (int lineIndex, int totalWidth)
    DBG_OBJ_LEAVE ();
 }
 
+/**
+ * Return down to which y position, relative to the allocation of this
+ * text block, lines have to be built. See "Lazy Line Breaking" in
+ * textblock.hh.
+ */
+int Textblock::lazyWrapLimit ()
+{
+   int limit = layout ? layout->getLazyResizeLimit () : INT_MAX;
+
+   if (limit != INT_MAX && wasAllocated ())
+      limit -= allocation.y;
+   return limit;
+}
+
+/**
+ * Return whether the words following the last line may be wrapped later.
+ */
+bool Textblock::wrapLater ()
+{
+   return lazyWrapAllowed && words->size () >= LAZY_WRAP_MIN_WORDS &&
+      lines->size () > 0 && nonTemporaryLines == lines->size () &&
+      lines->getLastRef()->lastWord >= lazyWrapUpTo &&
+      lines->getLastRef()->top > lazyWrapLimit ();
+}
+
+/**
+ * Build all the lines which have been left for later, and do not do this
+ * anymore.
+ */
+void Textblock::wrapLazyWords ()
+{
+   DBG_OBJ_ENTER0 ("construct.line", 0, "wrapLazyWords");
+
+   lazyWrapAllowed = false;
+   if (lazyWrapWord != -1)
+      rewrap ();
+
+   DBG_OBJ_LEAVE ();
+}
+
+/**
+ * Build the lines left for later down to the word wordIndex, whose
+ * position is needed now. The lines below are still built lazily.
+ */
+void Textblock::wrapLazyWordsUpTo (int wordIndex)
+{
+   DBG_OBJ_ENTER ("construct.line", 0, "wrapLazyWordsUpTo", "%d", wordIndex);
+
+   if (lazyWrapWord != -1 && wordIndex >= lazyWrapWord) {
+      lazyWrapUpTo = max (lazyWrapUpTo, wordIndex);
+      rewrap ();
+      // The estimated height of the rest has changed.
+      queueResize (-1, false);
+   }
+
+   DBG_OBJ_LEAVE ();
+}
+
+/**
+ * Keep the line breaks of the lines from firstLine on, which are about to
+ * be discarded, in the paragraphs. See "Line Break Cache" in textblock.hh.
+ */
+void Textblock::saveLineBreaks (int firstLine)
+{
+   DBG_OBJ_ENTER ("construct.line", 0, "saveLineBreaks", "%d", firstLine);
+
+   int lineNo = firstLine, parNo = lineNo < nonTemporaryLines ?
+      findParagraphOfWord (lines->getRef(lineNo)->firstWord) : -1;
+   // The lines of paragraph parNo are followed by those of parNo + 1.
+   for (; parNo != -1 && parNo < paragraphs->size () &&
+           lineNo < nonTemporaryLines; parNo++) {
+      Paragraph *par = paragraphs->getRef (parNo);
+      bool usable = lines->getRef(lineNo)->firstWord == par->firstWord;
+      int lastLineNo = lineNo;
+      while (lastLineNo < nonTemporaryLines &&
+             lines->getRef(lastLineNo)->lastWord < par->lastWord) {
+         // Empty lines are only created next to floats.
+         if (lines->getRef(lastLineNo)->lastWord <
+             lines->getRef(lastLineNo)->firstWord)
+            usable = false;
+         lastLineNo++;
+      }
+
+      // Only complete paragraphs, i.e. ending with a forced break.
+      if (lastLineNo >= nonTemporaryLines ||
+          lines->getRef(lastLineNo)->lastWord != par->lastWord ||
+          !words->getRef(par->lastWord)->penalties
+             .lineMustBeBroken (1))
+         break;
+
+      for (int i = par->firstWord; usable && i <= par->lastWord; i++)
+         if (words->getRef(i)->content.type & core::Content::ANY_WIDGET)
+            usable = false;
+
+      if (usable) {
+         if (par->breakCache == NULL)
+            par->breakCache = new BreakCache ();
+
+         int numLines = lastLineNo - lineNo + 1;
+         BreakCache::Entry *entry =
+            par->breakCache->store (linesBreakWidth,
+                                    par->lastWord - par->firstWord + 1,
+                                    numLines);
+         for (int i = 0; i < numLines; i++) {
+            Line *line = lines->getRef (lineNo + i);
+            entry->lines[3 * i] = line->lastWord - par->firstWord;
+            entry->lines[3 * i + 1] = line->leftOffset;
+            entry->lines[3 * i + 2] = line->rightOffset;
+         }
+      }
+
+      lineNo = lastLineNo + 1;
+   }
+
+   DBG_OBJ_LEAVE ();
+}
+
+/**
+ * If wordIndex is the first word of a paragraph, whose line breaks are
+ * known for the current line break width, add these lines. This stops at
+ * the first line whose borders are not the same anymore, or which is next
+ * to a float. Returns the number of words which have been wrapped.
+ *
+ * Like wordWrap(), this must be called for the first word after the last
+ * line.
+ */
+int Textblock::restoreLineBreaks (int wordIndex)
+{
+   // Most lines do not start a paragraph; this is cheaper than searching.
+   if (wordIndex > 0 &&
+       !words->getRef(wordIndex - 1)->penalties.lineMustBeBroken (1))
+      return 0;
+
+   int parNo = findParagraphOfWord (wordIndex);
+   if (parNo == -1)
+      return 0;
+
+   Paragraph *par = paragraphs->getRef (parNo);
+   BreakCache::Entry *entry;
+   if (par->firstWord != wordIndex || par->breakCache == NULL ||
+       lines->size () > nonTemporaryLines ||
+       (entry = par->breakCache->lookup (lineBreakWidth,
+                                         par->lastWord - par->firstWord + 1))
+       == NULL)
+      return 0;
+
+   DBG_OBJ_ENTER ("construct.line", 0, "restoreLineBreaks", "%d", wordIndex);
+
+   initLine1Offset (wordIndex);
+
+   int firstWord = wordIndex;
+   for (int i = 0; i < entry->numLines; i++) {
+      int lastWord = par->firstWord + entry->lines[3 * i];
+      int lastOofRef = lines->size() > 0 ?
+         lines->getLastRef()->lastOofRefPositionedBeforeThisLine : -1;
+
+      // As in addLine(), but with the borders for the height of this line.
+      calcBorders (lastOofRef, calcLinePartHeight (firstWord, lastWord));
+      bool regardBorder = mustBorderBeRegarded (lines->size ());
+      int leftOffset = max (regardBorder ? newLineLeftBorder : 0,
+                            boxOffsetX () + leftInnerPadding
+                            + (lines->size () == 0 ? line1OffsetEff : 0));
+      int rightOffset = max (regardBorder ? newLineRightBorder : 0,
+                             boxRestWidth ());
+
+      // Next to floats, wordWrap() may also choose other heights and
+      // borders, so the lines are only replayed without them.
+      if ((regardBorder && (newLineHasFloatLeft || newLineHasFloatRight)) ||
+          leftOffset != entry->lines[3 * i + 1] ||
+          rightOffset != entry->lines[3 * i + 2]) {
+         DBG_OBJ_MSGF ("construct.line", 1, "borders changed at word %d",
+                       firstWord);
+         initNewLine ();
+         break;
+      }
+
+      for (int j = firstWord; j <= lastWord; j++) {
+         Word *word = words->getRef (j);
+         word->effSpace = word->origSpace;
+         accumulateWordData (j);
+      }
+
+      addLine (firstWord, lastWord, lastOofRef, false, 1);
+      firstWord = lastWord + 1;
+   }
+
+   DBG_OBJ_LEAVE_VAL ("%d", firstWord - wordIndex);
+   return firstWord - wordIndex;
+}
+
 /**
  * Rewrap the page from the line from which this is necessary.
  * There are basically two times we'll want to do this:
  * either when the viewport is resized, or when the size changes on one
- * of the child widgets.
+ * of the child widgets. Furthermore, the lines not built yet because of
+ * lazy line breaking are built here.
  */
 void Textblock::rewrap ()
 {
    DBG_OBJ_ENTER0 ("construct.line", 0, "rewrap");
 
-   if (wrapRefLines == -1)
+   if (wrapRefLines == -1 && lazyWrapWord == -1)
       DBG_OBJ_MSG ("construct.line", 0, "does not have to be rewrapped");
    else {
-      // All lines up from wrapRef will be rebuild from the word list,
-      // the line list up from this position is rebuild.
-      lines->setSize (wrapRefLines);
-      DBG_OBJ_SET_NUM ("lines.size", lines->size ());
-      nonTemporaryLines = min (nonTemporaryLines, wrapRefLines);
+      if (wrapRefLines != -1) {
+         if (linesBreakWidth != -1)
+            saveLineBreaks (wrapRefLines);
+         linesBreakWidth = lineBreakWidth;
+
+         // All lines up from wrapRef will be rebuild from the word list,
+         // the line list up from this position is rebuild.
+         lines->setSize (wrapRefLines);
+         DBG_OBJ_SET_NUM ("lines.size", lines->size ());
+         allocatedLines = min (allocatedLines, lines->size ());
+         nonTemporaryLines = min (nonTemporaryLines, wrapRefLines);
+      }
 
+      // Otherwise, continue after the last line, which has been built
+      // before lazyWrapWord was set.
       initNewLine ();
 
       int firstWord;
@@ -1950,7 +2297,26 @@ void Textblock::rewrap ()
       lastWordDrawn = min (lastWordDrawn, firstWord - 1);
       DBG_OBJ_SET_NUM ("lastWordDrawn", lastWordDrawn);
 
+      lazyWrapWord = -1;
+
       for (int i = firstWord; i < words->size (); i++) {
+         if (wrapLater ()) {
+            lazyWrapWord = lines->getLastRef()->lastWord + 1;
+            DBG_OBJ_MSGF ("construct.line", 0, "wrapping word %d later",
+                          lazyWrapWord);
+            break;
+         }
+
+         int nextLineWord =
+            lines->size () > 0 ? lines->getLastRef()->lastWord + 1 : 0;
+         if (i == nextLineWord) {
+            int n = restoreLineBreaks (i);
+            if (n > 0) {
+               i += n - 1;
+               continue;
+            }
+         }
+
          Word *word = words->getRef (i);
 
          switch (word->content.type) {
@@ -1986,6 +2352,8 @@ void Textblock::rewrap ()
          // So this is necessary: word = words->getRef (i);
       }
 
+      DBG_OBJ_SET_NUM ("lazyWrapWord", lazyWrapWord);
+
       // Next time, the page will not have to be rewrapped.
       wrapRefLines = -1;
       DBG_OBJ_SET_NUM ("wrapRefLines", wrapRefLines);
@@ -2030,6 +2398,15 @@ void Textblock::fillParagraphs ()
          // -1: use 0 then instead.
          parNo = max (0, findParagraphOfWord (firstWordOfLine));
 
+      // The line break caches are kept for the paragraphs which are
+      // rebuilt with the same words, as on most resizes.
+      misc::SimpleVector <Paragraph> oldParagraphs (1);
+      for (int i = parNo; i < paragraphs->size (); i++)
+         if (paragraphs->getRef(i)->breakCache) {
+            oldParagraphs.increase ();
+            *oldParagraphs.getLastRef () = *paragraphs->getRef (i);
+         }
+
       paragraphs->setSize (parNo);
       DBG_OBJ_SET_NUM ("paragraphs.size", paragraphs->size ());
 
@@ -2047,6 +2424,27 @@ void Textblock::fillParagraphs ()
 
       DBG_OBJ_MSGF ("resize", 1, "words->size() = %d [after]", words->size ());
 
+      int oldParNo = 0;
+      for (int i = parNo;
+           i < paragraphs->size () && oldParNo < oldParagraphs.size (); i++) {
+         Paragraph *par = paragraphs->getRef (i);
+         Paragraph *oldPar;
+         while (oldParNo < oldParagraphs.size () &&
+                (oldPar = oldParagraphs.getRef (oldParNo))->firstWord
+                < par->firstWord) {
+            delete oldPar->breakCache;
+            oldParNo++;
+         }
+         if (oldParNo < oldParagraphs.size () &&
+             oldPar->firstWord == par->firstWord &&
+             oldPar->lastWord == par->lastWord) {
+            par->breakCache = oldPar->breakCache;
+            oldParNo++;
+         }
+      }
+      for (; oldParNo < oldParagraphs.size (); oldParNo++)
+         delete oldParagraphs.getRef(oldParNo)->breakCache;
+
       wrapRefParagraphs = -1;
       DBG_OBJ_SET_NUM ("wrapRefParagraphs", wrapRefParagraphs);
    }
@@ -2183,6 +2581,13 @@ void Textblock::showMissingLines ()
 {
    DBG_OBJ_ENTER0 ("construct.line", 0, "showMissingLines");
 
+   if (lazyWrapWord != -1) {
+      // Only the lines down to the limit are shown; see "Lazy Line
+      // Breaking" in textblock.hh.
+      DBG_OBJ_LEAVE ();
+      return;
+   }
+
    // "Temporary word": when the last word is an OOF reference, it is
    // not processed, and not part of any line. For this reason, we
    // introduce a "temporary word", which is in flow, after this last
@@ -2243,6 +2648,7 @@ void Textblock::removeTemporaryLines ()
    if (nonTemporaryLines < lines->size ()) {
       lines->setSize (nonTemporaryLines);
       DBG_OBJ_SET_NUM ("lines.size", lines->size ());
+      allocatedLines = min (allocatedLines, lines->size ());
 
       // For words which will be added, the values calculated before in
       // accumulateWordData() are wrong, so it is called again. (Actually, the
@@ -2294,12 +2700,13 @@ int Textblock::getLineStretchability(int lastWordIndex)
       str = 0;
       DBG_OBJ_MSG ("construct.word.accum", 1, "justified => 0");
    } else {
-      str = stretchabilityFactor * (lastWord->maxAscent
-                                    + lastWord->maxDescent) / 100;
+      WordWrapData *data = getWrapData (lastWordIndex);
+      str = stretchabilityFactor * (data->maxAscent
+                                    + data->maxDescent) / 100;
       DBG_OBJ_MSGF ("construct.word.accum", 1,
                     "not justified => %d * (%d + %d) / 100 = %d",
-                    stretchabilityFactor, lastWord->maxAscent,
-                    lastWord->maxDescent, str);
+                    stretchabilityFactor, data->maxAscent,
+                    data->maxDescent, str);
    }
 
    DBG_OBJ_LEAVE ();
@@ -156,7 +156,7 @@ static void IO_close_fd(IOData_t *io, int CloseCode)
  */
 static bool_t IO_read(IOData_t *io)
 {
-   char Buf[IOBufLen];
+   char *Buf;
    ssize_t St;
    bool_t ret = FALSE;
    int io_key = io->Key;
@@ -169,10 +169,13 @@ static bool_t IO_read(IOData_t *io)
    io->Status = 0;
 
    while (1) {
+      /* Read straight into io->Buf. It keeps its size between reads, so
+       * this only allocates while a transfer is faster than we read. */
+      Buf = dStr_reserve(io->Buf, IOBufLen);
       St = conn ? a_Tls_read(conn, Buf, IOBufLen)
                 : read(io->FD, Buf, IOBufLen);
       if (St > 0) {
-         dStr_append_l(io->Buf, Buf, St);
+         dStr_extend(io->Buf, St);
          continue;
       } else if (St < 0) {
          if (errno == EINTR) {
@@ -17,6 +17,7 @@ int a_Http_init(void);
 int a_Http_proxy_auth(void);
 void a_Http_set_proxy_passwd(const char *str);
 void a_Http_connect_done(int fd, bool_t success);
+void a_Http_preconnect(const DilloUrl *url, bool_t connect);
 
 void a_Http_ccc (int Op, int Branch, int Dir, ChainLink *Info,
                  void *Data1, void *Data2);
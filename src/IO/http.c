@@ -41,6 +41,7 @@
 #include "dlib/dlib.h" /* dIsdigit */
 
 #include "../uicmd.hh"
+#include "../timeout.hh"
 
 /* Used to send a message to the bw's status bar */
 #define MSG_BW(web, root, ...)                                        \
@@ -56,6 +57,9 @@ static const int HTTP_SOCKET_QUEUED      = 0x2;
 static const int HTTP_SOCKET_TO_BE_FREED = 0x4;
 static const int HTTP_SOCKET_TLS         = 0x8;
 static const int HTTP_SOCKET_IOWATCH_ACTIVE = 0x10;
+static const int HTTP_SOCKET_PIPELINED   = 0x20;
+static const int HTTP_SOCKET_RETRY       = 0x40;
+static const int HTTP_SOCKET_NO_REUSE    = 0x80;
 
 /* 'web' is just a reference (no need to deallocate it here). */
 typedef struct {
@@ -69,8 +73,25 @@ typedef struct {
    char *connected_to;     /* Used for per-server connection limit */
    uint_t connect_port;
    Dstr *https_proxy_reply;
+   ChainLink *InfoRecv;    /* Answer branch, once it has the FD */
+   Dlist *pipeline;        /* Sockets whose queries follow ours on the FD */
+   Dstr *rest;             /* What came after our reply (NULL: unknown) */
 } SocketData_t;
 
+typedef enum {
+   PRECONNECT_TCP,         /* connect() in progress */
+   PRECONNECT_TCP_DONE,
+   PRECONNECT_TLS,         /* TLS handshake in progress */
+   PRECONNECT_TLS_DONE
+} PreconnectState_t;
+
+/* A connection opened before any request needs it */
+typedef struct {
+   int fd;
+   PreconnectState_t state;
+   DilloUrl *url;
+} Preconnect_t;
+
 /* Data structures and functions to queue sockets that need to be
  * delayed due to the per host connection limit.
  */
@@ -82,6 +103,9 @@ typedef struct {
   int active_conns;
   int running_the_queue;
   Dlist *queue;
+  Preconnect_t *preconnect; /* counts in active_conns */
+  bool_t pipeline_ok;       /* keeps connections alive, may pipeline */
+  bool_t pipeline_broken;   /* closed a connection with queries pending */
 } Server_t;
 
 typedef struct {
@@ -96,6 +120,19 @@ static void Http_connect_socket(ChainLink *Info);
 static char *Http_get_connect_str(const DilloUrl *url);
 static void Http_send_query(SocketData_t *S);
 static void Http_socket_free(int SKey);
+static void Http_connect_socket_cb(int fd, void *data);
+static void Http_connect_tls(ChainLink *info);
+static bool_t Http_preconnect_done(int fd, bool_t success);
+static void Http_preconnect_take(Server_t *srv, SocketData_t *sd);
+static void Http_preconnect_free(Server_t *srv);
+static void Http_preconnect_timeout(void *data);
+static void Http_pipeline_fill(SocketData_t *owner);
+static void Http_pipeline_requeue(Server_t *srv, SocketData_t *sd);
+
+/* Seconds to keep an unused speculative connection open */
+#define HTTP_PRECONNECT_IDLE 10.0
+/* Most queries sent ahead on a connection, besides the one being answered */
+#define HTTP_PIPELINE_MAX 4
 
 /*
  * Local data
@@ -224,6 +261,7 @@ void a_Http_connect_done(int fd, bool_t success)
       if (success && valid_web) {
          a_Chain_bfcb(OpSend, info, &sd->SockFD, "FD");
          Http_send_query(sd);
+         Http_pipeline_fill(sd);
       } else {
          if (valid_web)
             MSG_BW(sd->web, 1, "Could not establish connection.");
@@ -233,7 +271,7 @@ void a_Http_connect_done(int fd, bool_t success)
          a_Chain_bfcb(OpAbort, info, NULL, "Both");
          dFree(info);
       }
-   } else {
+   } else if (!Http_preconnect_done(fd, success)) {
       MSG("**** but no luck with fme %p or sd\n", (void *) fme);
    }
 }
@@ -253,9 +291,10 @@ static void Http_connect_queued_sockets(Server_t *srv)
 
    srv->running_the_queue++;
 
+   /* a speculative connection is handed to the first socket */
    for (i = 0;
         (i < dList_length(srv->queue) &&
-         srv->active_conns < prefs.http_max_conns);
+         (srv->active_conns < prefs.http_max_conns || srv->preconnect));
         i++) {
       sd = dList_nth_data(srv->queue, i);
 
@@ -273,10 +312,16 @@ static void Http_connect_queued_sockets(Server_t *srv)
             int SKey = VOIDP2INT(sd->Info->LocalKey);
 
             Http_socket_free(SKey);
-         } else if (connect_ready == TLS_CONNECT_READY) {
+         } else if (connect_ready == TLS_CONNECT_READY ||
+                    (srv->preconnect &&
+                     (srv->preconnect->state == PRECONNECT_TLS ||
+                      srv->preconnect->state == PRECONNECT_TLS_DONE))) {
             i--;
             Http_socket_activate(srv, sd);
-            Http_connect_socket(sd->Info);
+            if (srv->preconnect)
+               Http_preconnect_take(srv, sd);
+            else
+               Http_connect_socket(sd->Info);
          }
       }
    }
@@ -306,8 +351,12 @@ static void Http_socket_free(int SKey)
          dClose(S->SockFD);
       }
       dStr_free(S->https_proxy_reply, 1);
+      dStr_free(S->rest, 1);
+      a_Dns_addr_list_free(S->addr_list);
+      S->addr_list = NULL;
 
-      if (S->flags & HTTP_SOCKET_QUEUED) {
+      if (S->flags & (HTTP_SOCKET_QUEUED | HTTP_SOCKET_PIPELINED)) {
+         /* freed by the queue or the pipeline it is in */
          S->flags |= HTTP_SOCKET_TO_BE_FREED;
          a_Url_free(S->url);
       } else {
@@ -319,6 +368,10 @@ static void Http_socket_free(int SKey)
 
             Server_t *srv = Http_server_get(S->connected_to, S->connect_port,
                                             (S->flags & HTTP_SOCKET_TLS));
+            if (S->pipeline) {
+               /* the queries sent ahead won't be answered here */
+               Http_pipeline_requeue(srv, S);
+            }
             srv->active_conns--;
             Http_connect_queued_sockets(srv);
          }
@@ -382,7 +435,7 @@ static Dstr *Http_make_content_type(const DilloUrl *url)
  */
 static Dstr *Http_make_query_str(DilloWeb *web, bool_t use_proxy, bool_t use_tls)
 {
-   char *ptr, *cookies, *referer, *auth;
+   char *ptr, *cookies, *referer, *auth, *validators;
    const DilloUrl *url = web->url;
    Dstr *query      = dStr_new(""),
         *request_uri = dStr_new(""),
@@ -428,6 +481,9 @@ static Dstr *Http_make_query_str(DilloWeb *web, bool_t use_proxy, bool_t use_tls
          "Accept-Encoding: gzip, deflate"
 #ifdef ENABLE_BROTLI
          ", br"
+#endif
+#ifdef ENABLE_ZSTD
+         ", zstd"
 #endif
          "\r\n"
          "%s" /* auth */
@@ -446,6 +502,7 @@ static Dstr *Http_make_query_str(DilloWeb *web, bool_t use_proxy, bool_t use_tls
       dStr_append_l(query, URL_DATA(url)->str, URL_DATA(url)->len);
       dStr_free(content_type, TRUE);
    } else {
+      validators = a_Cache_disk_validators(url);
       dStr_sprintfa(
          query,
          "GET %s HTTP/1.1\r\n"
@@ -456,6 +513,9 @@ static Dstr *Http_make_query_str(DilloWeb *web, bool_t use_proxy, bool_t use_tls
          "Accept-Encoding: gzip, deflate"
 #ifdef ENABLE_BROTLI
 	 ", br"
+#endif
+#ifdef ENABLE_ZSTD
+         ", zstd"
 #endif
          "\r\n"
          "%s" /* auth */
@@ -464,6 +524,7 @@ static Dstr *Http_make_query_str(DilloWeb *web, bool_t use_proxy, bool_t use_tls
          "%s" /* referer */
          "Connection: %s\r\n"
          "%s" /* cache control */
+         "%s" /* validators */
          "%s" /* cookies */
          "\r\n",
          request_uri->str, URL_AUTHORITY(url), prefs.http_user_agent,
@@ -471,7 +532,8 @@ static Dstr *Http_make_query_str(DilloWeb *web, bool_t use_proxy, bool_t use_tls
          proxy_auth->str, referer, connection_hdr_val,
          (URL_FLAGS(url) & URL_E2EQuery) ?
             "Pragma: no-cache\r\nCache-Control: no-cache\r\n" : "",
-         cookies);
+         validators ? validators : "", cookies);
+      dFree(validators);
    }
    dFree(referer);
    dFree(cookies);
@@ -571,6 +633,42 @@ static void Http_connect_socket_cb(int fd, void *data)
    }
 }
 
+/**
+ * Fill 'name' with the address of 'dh' and 'port'.
+ * Return the length of the address.
+ */
+static socklen_t Http_sockaddr_init(struct sockaddr_storage *name,
+                                    const DilloHost *dh, uint_t port)
+{
+   socklen_t socket_len = 0;
+
+   /* Some OSes require this...  */
+   memset(name, 0, sizeof(*name));
+   switch (dh->af) {
+   case AF_INET:
+   {
+      struct sockaddr_in *sin = (struct sockaddr_in *)name;
+      socket_len = sizeof(struct sockaddr_in);
+      sin->sin_family = dh->af;
+      sin->sin_port = htons(port);
+      memcpy(&sin->sin_addr, dh->data, (size_t)dh->alen);
+      break;
+   }
+#ifdef ENABLE_IPV6
+   case AF_INET6:
+   {
+      struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)name;
+      socket_len = sizeof(struct sockaddr_in6);
+      sin6->sin6_family = dh->af;
+      sin6->sin6_port = htons(port);
+      memcpy(&sin6->sin6_addr, dh->data, dh->alen);
+      break;
+   }
+#endif
+   } /* switch */
+   return socket_len;
+}
+
 /**
  * This function is called after the DNS succeeds in solving a hostname.
  * Task: Finish socket setup and start connecting the socket.
@@ -582,12 +680,8 @@ static void Http_connect_socket(ChainLink *Info)
 
    for (; (dh = dList_nth_data(S->addr_list, S->addr_list_idx));
         S->addr_list_idx++) {
-#ifdef ENABLE_IPV6
-      struct sockaddr_in6 name;
-#else
-      struct sockaddr_in name;
-#endif
-      socklen_t socket_len = 0;
+      struct sockaddr_storage name;
+      socklen_t socket_len;
 
       if (S->addr_list_idx > 0 && S->SockFD >= 0) {
          /* clean up the previous one that failed */
@@ -604,38 +698,16 @@ static void Http_connect_socket(ChainLink *Info)
       fcntl(S->SockFD, F_SETFL, O_NONBLOCK | fcntl(S->SockFD, F_GETFL));
       fcntl(S->SockFD, F_SETFD, FD_CLOEXEC | fcntl(S->SockFD, F_GETFD));
 
-      /* Some OSes require this...  */
-      memset(&name, 0, sizeof(name));
-      /* Set remaining parms. */
-      switch (dh->af) {
-      case AF_INET:
-      {
-         struct sockaddr_in *sin = (struct sockaddr_in *)&name;
-         socket_len = sizeof(struct sockaddr_in);
-         sin->sin_family = dh->af;
-         sin->sin_port = htons(S->connect_port);
-         memcpy(&sin->sin_addr, dh->data, (size_t)dh->alen);
-         if (a_Web_valid(S->web) && (S->web->flags & WEB_RootUrl))
-            MSG("Connecting to %s:%u\n", inet_ntoa(sin->sin_addr),
-                S->connect_port);
-         break;
-      }
-#ifdef ENABLE_IPV6
-      case AF_INET6:
-      {
+      socket_len = Http_sockaddr_init(&name, dh, S->connect_port);
+      if (a_Web_valid(S->web) && (S->web->flags & WEB_RootUrl)) {
          char buf[128];
-         struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&name;
-         socket_len = sizeof(struct sockaddr_in6);
-         sin6->sin6_family = dh->af;
-         sin6->sin6_port = htons(S->connect_port);
-         memcpy(&sin6->sin6_addr, dh->data, dh->alen);
-         inet_ntop(dh->af, dh->data, buf, sizeof(buf));
-         if (a_Web_valid(S->web) && (S->web->flags & WEB_RootUrl))
+
+         a_Dns_dillohost_to_string(dh, buf, sizeof(buf));
+         if (dh->af == AF_INET)
+            MSG("Connecting to %s:%u\n", buf, S->connect_port);
+         else
             MSG("Connecting to [%s]:%u\n", buf, S->connect_port);
-         break;
       }
-#endif
-      } /* switch */
       MSG_BW(S->web, 1, "Contacting host...");
 
       if (connect(S->SockFD, (struct sockaddr *)&name, socket_len) == 0) {
@@ -758,7 +830,7 @@ static void Http_dns_cb(int Status, Dlist *addr_list, void *data)
          if (Status == 0 && addr_list) {
 
             /* Successful DNS answer; save the IP */
-            S->addr_list = addr_list;
+            S->addr_list = a_Dns_addr_list_copy(addr_list);
             S->addr_list_idx = 0;
             clean_up = FALSE;
             srv = Http_server_get(host, S->connect_port,
@@ -780,6 +852,249 @@ static void Http_dns_cb(int Status, Dlist *addr_list, void *data)
    }
 }
 
+/* ----------------------------------------------------------------------
+ *  Speculative connections
+ */
+
+/**
+ * Return the server that has a speculative connection on 'fd', if any.
+ */
+static Server_t *Http_preconnect_find(int fd)
+{
+   Server_t *srv;
+   int i;
+
+   for (i = 0; i < dList_length(servers); i++) {
+      srv = dList_nth_data(servers, i);
+      if (srv->preconnect && srv->preconnect->fd == fd)
+         return srv;
+   }
+   return NULL;
+}
+
+/**
+ * Close the speculative connection of 'srv' and give back its slot.
+ */
+static void Http_preconnect_free(Server_t *srv)
+{
+   Preconnect_t *P = srv->preconnect;
+
+   a_Timeout_actually_remove(Http_preconnect_timeout, srv);
+   a_IOwatch_remove_fd(P->fd, -1);
+   /* this also resets the TLS state of the server */
+   if (P->state == PRECONNECT_TLS || P->state == PRECONNECT_TLS_DONE)
+      a_Tls_close_by_fd(P->fd);
+   /* the TLS layer closes the fd of a handshake in progress */
+   if (P->state != PRECONNECT_TLS)
+      dClose(P->fd);
+   a_Url_free(P->url);
+   dFree(P);
+   srv->preconnect = NULL;
+   srv->active_conns--;
+}
+
+/**
+ * Drop the speculative connection of 'srv', letting the queue use the slot.
+ */
+static void Http_preconnect_drop(Server_t *srv)
+{
+   _MSG("Preconnect to %s:%u dropped\n", srv->host, srv->port);
+   Http_preconnect_free(srv);
+   Http_connect_queued_sockets(srv);
+}
+
+/**
+ * Timeout callback: no request came for the connection.
+ */
+static void Http_preconnect_timeout(void *data)
+{
+   Http_preconnect_drop(data);
+}
+
+/**
+ * The connection is ready: close it if no request comes for it soon.
+ */
+static void Http_preconnect_ready(Server_t *srv)
+{
+   _MSG("Preconnect to %s:%u ready\n", srv->host, srv->port);
+   a_Timeout_add(HTTP_PRECONNECT_IDLE, Http_preconnect_timeout, srv);
+}
+
+/**
+ * Called by a_Http_connect_done() for a handshake that no socket owns.
+ * Return whether 'fd' was a speculative connection.
+ */
+static bool_t Http_preconnect_done(int fd, bool_t success)
+{
+   Server_t *srv = Http_preconnect_find(fd);
+
+   if (!srv)
+      return FALSE;
+   if (!success) {
+      /* the TLS layer is done with the fd, but did not close it */
+      srv->preconnect->state = PRECONNECT_TCP_DONE;
+      Http_preconnect_drop(srv);
+   } else {
+      srv->preconnect->state = PRECONNECT_TLS_DONE;
+      Http_preconnect_ready(srv);
+      /* sockets that waited for the handshake can go now */
+      Http_connect_queued_sockets(srv);
+   }
+   return TRUE;
+}
+
+/**
+ * connect() of a speculative connection finished.
+ */
+static void Http_preconnect_connect_cb(int fd, void *data)
+{
+   Server_t *srv = data;
+   Preconnect_t *P = srv->preconnect;
+   int ret, connect_ret;
+   socklen_t connect_ret_size = sizeof(connect_ret);
+
+   a_IOwatch_remove_fd(fd, -1);
+   ret = getsockopt(fd, SOL_SOCKET, SO_ERROR, &connect_ret,
+                    &connect_ret_size);
+   if (ret < 0 || connect_ret != 0) {
+      Http_preconnect_drop(srv);
+   } else if (srv->https &&
+              a_Tls_connect_ready(P->url) == TLS_CONNECT_READY) {
+      P->state = PRECONNECT_TLS;
+      a_Tls_preconnect(fd, P->url);
+   } else {
+      P->state = PRECONNECT_TCP_DONE;
+      Http_preconnect_ready(srv);
+   }
+}
+
+/**
+ * Take over the finished handshake of a speculative connection. This is
+ * done from a callback, and not while running the queue, since the user
+ * may be asked about the certificate.
+ */
+static void Http_preconnect_tls_cb(int fd, void *data)
+{
+   SocketData_t *S = a_Klist_get_data(ValidSocks, VOIDP2INT(data));
+
+   a_IOwatch_remove_fd(fd, -1);
+   if (S) {
+      S->flags &= ~HTTP_SOCKET_IOWATCH_ACTIVE;
+      Http_connect_tls(S->Info);
+   }
+}
+
+/**
+ * Hand the speculative connection of 'srv' to an activated socket, and
+ * continue connecting it from where the speculative one is.
+ */
+static void Http_preconnect_take(Server_t *srv, SocketData_t *sd)
+{
+   Preconnect_t *P = srv->preconnect;
+   PreconnectState_t state = P->state;
+
+   a_Timeout_actually_remove(Http_preconnect_timeout, srv);
+   a_IOwatch_remove_fd(P->fd, -1);
+   sd->SockFD = P->fd;
+   a_Url_free(P->url);
+   dFree(P);
+   srv->preconnect = NULL;
+   srv->active_conns--;         /* the socket holds the slot now */
+
+   _MSG("Using preconnected fd %d for %s\n", sd->SockFD, URL_STR(sd->url));
+   Http_fd_map_add_entry(sd);
+   if (state == PRECONNECT_TCP) {
+      a_IOwatch_add_fd(sd->SockFD, DIO_WRITE, Http_connect_socket_cb,
+                       sd->Info->LocalKey);
+      sd->flags |= HTTP_SOCKET_IOWATCH_ACTIVE;
+   } else if (state == PRECONNECT_TLS_DONE) {
+      a_IOwatch_add_fd(sd->SockFD, DIO_WRITE, Http_preconnect_tls_cb,
+                       sd->Info->LocalKey);
+      sd->flags |= HTTP_SOCKET_IOWATCH_ACTIVE;
+   } else if (state == PRECONNECT_TCP_DONE && (sd->flags & HTTP_SOCKET_TLS)) {
+      Http_connect_tls(sd->Info);
+   } else if (state == PRECONNECT_TLS) {
+      /* the handshake will call a_Http_connect_done() */
+      a_Tls_connect(sd->SockFD, sd->url);
+   } else {
+      a_Http_connect_done(sd->SockFD, TRUE);
+   }
+}
+
+/**
+ * Open a speculative connection to the server of 'url'. It takes one of
+ * the server's connection slots, so it is only done when one is free.
+ */
+static void Http_preconnect_start(const DilloUrl *url, Dlist *addr_list)
+{
+   bool_t https = !dStrAsciiCasecmp(URL_SCHEME(url), "https");
+   Server_t *srv = Http_server_get(URL_HOST(url), URL_PORT(url), https);
+   DilloHost *dh = dList_nth_data(addr_list, 0);
+   struct sockaddr_storage name;
+   socklen_t socket_len;
+   Preconnect_t *P;
+   int fd;
+
+   if (srv->preconnect || dList_length(srv->queue) > 0 ||
+       srv->active_conns >= prefs.http_max_conns || !dh ||
+       (fd = socket(dh->af, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+      if (srv->active_conns == 0 && srv->running_the_queue == 0 &&
+          dList_length(srv->queue) == 0)
+         Http_server_remove(srv);
+      return;
+   }
+   fcntl(fd, F_SETFL, O_NONBLOCK | fcntl(fd, F_GETFL));
+   fcntl(fd, F_SETFD, FD_CLOEXEC | fcntl(fd, F_GETFD));
+
+   P = dNew0(Preconnect_t, 1);
+   P->fd = fd;
+   P->state = PRECONNECT_TCP;
+   P->url = a_Url_dup(url);
+   srv->preconnect = P;
+   srv->active_conns++;
+
+   _MSG("Preconnect to %s:%u\n", srv->host, srv->port);
+   socket_len = Http_sockaddr_init(&name, dh, srv->port);
+   if (connect(fd, (struct sockaddr *)&name, socket_len) == 0) {
+      Http_preconnect_connect_cb(fd, srv);
+   } else if (errno == EINPROGRESS) {
+      a_IOwatch_add_fd(fd, DIO_WRITE, Http_preconnect_connect_cb, srv);
+   } else {
+      Http_preconnect_drop(srv);
+   }
+}
+
+/**
+ * Callback function for the DNS resolver.
+ * 'data' is the URL to connect to, or NULL when only resolving.
+ */
+static void Http_preconnect_dns_cb(int Status, Dlist *addr_list, void *data)
+{
+   DilloUrl *url = data;
+
+   if (url) {
+      if (Status == 0 && addr_list)
+         Http_preconnect_start(url, addr_list);
+      a_Url_free(url);
+   }
+}
+
+/**
+ * Resolve the host of 'url' ahead of time and, if 'connect' is set, also
+ * open a connection to it (with the TLS handshake for https) that the
+ * first request to the server will use.
+ */
+void a_Http_preconnect(const DilloUrl *url, bool_t connect)
+{
+   const char *host = URL_HOST(url);
+
+   if (!host || !*host || Http_must_use_proxy(host))
+      return;
+
+   a_Dns_resolve(host, Http_preconnect_dns_cb,
+                 connect ? a_Url_dup(url) : NULL);
+}
+
 /**
  * Asynchronously create a new http connection for 'Url'.
  * We'll set some socket parameters; the rest will be set later
@@ -845,9 +1160,230 @@ static bool_t Http_socket_reuse_compatible(SocketData_t *old,
    return FALSE;
 }
 
+/**
+ * Can the query of this socket be sent again if the server closes the
+ * connection without answering it?
+ */
+static bool_t Http_socket_idempotent(SocketData_t *sd)
+{
+   return a_Web_valid(sd->web) && !(URL_FLAGS(sd->web->url) & URL_Post);
+}
+
+/**
+ * Send the query of a queued socket on the connection of 'owner', after
+ * the queries already there. It is written right away: if it does not
+ * fit in the socket buffer, the connection is not reused afterwards.
+ * Return whether it was sent.
+ */
+static bool_t Http_pipeline_send(Server_t *srv, SocketData_t *owner,
+                                 SocketData_t *sd)
+{
+   void *conn = a_Tls_connection(owner->SockFD);
+   Dstr *query;
+   int St, len;
+
+   query = Http_make_query_str(sd->web, sd->flags & HTTP_SOCKET_USE_PROXY,
+                               sd->flags & HTTP_SOCKET_TLS);
+   if (prefs.trace_http)
+      MSG(">>> sending pipelined HTTP:\n%s\n", dStr_printable(query, 8192));
+   len = query->len;
+   do {
+      St = conn ? a_Tls_write(conn, query->str, len)
+                : write(owner->SockFD, query->str, len);
+   } while (St < 0 && errno == EINTR);
+   dStr_free(query, 1);
+
+   if (St != len) {
+      _MSG("Http_pipeline_send: wrote %d of %d\n", St, len);
+      owner->flags |= HTTP_SOCKET_NO_REUSE;
+      return FALSE;
+   }
+
+   dList_remove(srv->queue, sd);
+   sd->flags &= ~HTTP_SOCKET_QUEUED;
+   sd->flags |= HTTP_SOCKET_PIPELINED;
+   if (!owner->pipeline)
+      owner->pipeline = dList_new(HTTP_PIPELINE_MAX);
+   dList_append(owner->pipeline, sd);
+   MSG_BW(sd->web, 1, "Sending query (pipelined)...");
+   return TRUE;
+}
+
+/**
+ * When the server is known to keep connections alive, send the queries
+ * of queued sockets on the connection of 'owner' without waiting for its
+ * answer, so their answers follow it without a round trip each.
+ */
+static void Http_pipeline_fill(SocketData_t *owner)
+{
+   Server_t *srv;
+   SocketData_t *sd;
+   int i;
+
+   if (!prefs.http_pipelining || !prefs.http_persistent_conns ||
+       !owner->connected_to || (owner->flags & (HTTP_SOCKET_USE_PROXY |
+                                                HTTP_SOCKET_NO_REUSE)) ||
+       !Http_socket_idempotent(owner))
+      return;
+
+   srv = Http_server_get(owner->connected_to, owner->connect_port,
+                         (owner->flags & HTTP_SOCKET_TLS));
+   if (!srv->pipeline_ok || srv->pipeline_broken)
+      return;
+
+   for (i = 0; (sd = dList_nth_data(srv->queue, i)) &&
+               dList_length(owner->pipeline) < HTTP_PIPELINE_MAX; ) {
+      if ((sd->flags & HTTP_SOCKET_TO_BE_FREED) ||
+          !Http_socket_idempotent(sd) ||
+          !Http_socket_reuse_compatible(owner, sd)) {
+         i++;
+      } else if (!Http_pipeline_send(srv, owner, sd)) {
+         break;
+      }
+   }
+}
+
+/**
+ * Put the sockets pipelined after 'sd' back in the server queue, to be
+ * sent again on other connections.
+ */
+static void Http_pipeline_requeue(Server_t *srv, SocketData_t *sd)
+{
+   SocketData_t *p;
+
+   while ((p = dList_nth_data(sd->pipeline, 0))) {
+      dList_remove(sd->pipeline, p);
+      p->flags &= ~HTTP_SOCKET_PIPELINED;
+      if (p->flags & HTTP_SOCKET_TO_BE_FREED) {
+         dFree(p);
+      } else {
+         _MSG("Http: sending %s again\n", URL_STR(p->url));
+         Http_socket_enqueue(srv, p);
+      }
+   }
+   dList_free(sd->pipeline);
+   sd->pipeline = NULL;
+}
+
+/**
+ * Hand the connection of 'old_sd', whose answer is complete, to the
+ * first socket pipelined after it, and give it what came after the
+ * answer. Return FALSE when that can't be done (the connection must be
+ * closed then).
+ */
+static bool_t Http_pipeline_next(Server_t *srv, int SKey)
+{
+   SocketData_t *old_sd = a_Klist_get_data(ValidSocks, SKey);
+   SocketData_t *new_sd = dList_nth_data(old_sd->pipeline, 0);
+   Dstr *rest = old_sd->rest;
+   DataBuf *dbuf;
+   int NKey;
+
+   if ((old_sd->flags & HTTP_SOCKET_NO_REUSE) || !rest ||
+       (new_sd->flags & HTTP_SOCKET_TO_BE_FREED))
+      return FALSE;
+
+   dList_remove(old_sd->pipeline, new_sd);
+   new_sd->flags &= ~HTTP_SOCKET_PIPELINED;
+   new_sd->flags |= HTTP_SOCKET_RETRY;
+   if (dList_length(old_sd->pipeline) > 0)
+      new_sd->pipeline = old_sd->pipeline;
+   else
+      dList_free(old_sd->pipeline);
+   old_sd->pipeline = NULL;
+   old_sd->rest = NULL;
+
+   new_sd->SockFD = old_sd->SockFD;
+   old_sd->connected_to = NULL;
+   Http_socket_free(SKey);
+   new_sd->connected_to = srv->host;
+   Http_fd_map_add_entry(new_sd);
+   _MSG("Reading pipelined %s on fd %d\n", URL_STR(new_sd->url),
+        new_sd->SockFD);
+
+   /* The query was sent: only give the FD to the answer branch */
+   NKey = VOIDP2INT(new_sd->Info->LocalKey);
+   a_Chain_fcb(OpSend, new_sd->Info, &new_sd->SockFD, "FD");
+   if ((new_sd = a_Klist_get_data(ValidSocks, NKey))) {
+      if (!new_sd->InfoRecv) {
+         /* Nothing reads the answers (nor gets 'rest'): close the
+          * connection, the queries sent ahead go to other connections. */
+         ChainLink *info = new_sd->Info;
+         int fd = new_sd->SockFD;
+
+         MSG("Http: no reader for %s, closing fd %d\n", URL_STR(new_sd->url),
+             fd);
+         Http_socket_free(NKey); /* requeues new_sd->pipeline */
+         dClose(fd);
+         a_Chain_bfcb(OpAbort, info, NULL, "Both");
+         dFree(info);
+      } else {
+         Http_pipeline_fill(new_sd);
+         if (rest->len > 0) {
+            dbuf = a_Chain_dbuf_new(rest->str, rest->len, 0);
+            a_Http_ccc(OpSend, 2, FWD, new_sd->InfoRecv, dbuf, NULL);
+            dFree(dbuf);
+         }
+      }
+   }
+   dStr_free(rest, 1);
+   return TRUE;
+}
+
+/**
+ * The server closed the connection before answering the pipelined query
+ * of 'sd': give the answer branch a new reader and queue the socket to
+ * be sent again on a new connection.
+ */
+static void Http_socket_retry(SocketData_t *sd, ChainLink *Info)
+{
+   Server_t *srv = Http_server_get(sd->connected_to, sd->connect_port,
+                                   (sd->flags & HTTP_SOCKET_TLS));
+
+   MSG("Http: %s closed the connection, sending %s again.\n", srv->host,
+       URL_STR(sd->url));
+   srv->pipeline_broken = TRUE;
+
+   a_Chain_link_new(Info, a_Http_ccc, BCK, a_IO_ccc, 2, 2);
+   a_Chain_bcb(OpStart, Info, NULL, NULL); /* IORead */
+   sd->InfoRecv = NULL;
+
+   /* the IO closes the FD */
+   Http_fd_map_remove_entry(sd->SockFD);
+   a_Tls_close_by_fd(sd->SockFD);
+   sd->SockFD = -1;
+   sd->connected_to = NULL;
+   sd->addr_list_idx = 0;
+   sd->flags &= ~HTTP_SOCKET_RETRY;
+   if (sd->pipeline)
+      Http_pipeline_requeue(srv, sd);
+   Http_socket_enqueue(srv, sd);
+   srv->active_conns--;
+   Http_connect_queued_sockets(srv);
+}
+
+/**
+ * The connection of 'sd' was closed by the server (or failed).
+ * Return whether its query will be sent again, keeping the answer branch.
+ */
+static bool_t Http_socket_closed(SocketData_t *sd, ChainLink *Info)
+{
+   if (sd->pipeline && sd->connected_to) {
+      /* it won't answer the queries sent ahead */
+      Http_server_get(sd->connected_to, sd->connect_port,
+                      (sd->flags & HTTP_SOCKET_TLS))->pipeline_broken = TRUE;
+   }
+   if (sd->flags & HTTP_SOCKET_RETRY) {
+      Http_socket_retry(sd, Info);
+      return TRUE;
+   }
+   return FALSE;
+}
+
 /**
  * If any entry in the socket data queue can reuse our connection, set it up
- * and send off a new query.
+ * and send off a new query. When queries were pipelined after ours, the
+ * connection goes to the first of them instead.
  */
 static void Http_socket_reuse(int SKey)
 {
@@ -859,6 +1395,16 @@ static void Http_socket_reuse(int SKey)
                                       (old_sd->flags & HTTP_SOCKET_TLS));
       int i, n = dList_length(srv->queue);
 
+      /* the server keeps connections alive */
+      srv->pipeline_ok = TRUE;
+      if (old_sd->pipeline) {
+         if (Http_pipeline_next(srv, SKey))
+            return;
+         n = 0;
+      } else if (old_sd->flags & HTTP_SOCKET_NO_REUSE) {
+         n = 0;
+      }
+
       for (i = 0; i < n; i++) {
          new_sd = dList_nth_data(srv->queue, i);
 
@@ -976,10 +1522,13 @@ void a_Http_ccc(int Op, int Branch, int Dir, ChainLink *Info,
                }
             } else {
                /* Data1 = dbuf */
+               sd->flags &= ~HTTP_SOCKET_RETRY;
                a_Chain_fcb(OpSend, Info, Data1, "send_page_2eof");
             }
             break;
          case OpEnd:
+            if (Http_socket_closed(sd, Info))
+               break;
             if (sd->https_proxy_reply) {
                MSG("CONNECT through proxy failed. "
                    "Full reply not received:\n%s\n",
@@ -994,6 +1543,8 @@ void a_Http_ccc(int Op, int Branch, int Dir, ChainLink *Info,
             dFree(Info);
             break;
          case OpAbort:
+            if (Http_socket_closed(sd, Info))
+               break;
             if (sd->https_proxy_reply) {
                MSG("CONNECT through proxy failed. "
                    "Full reply not received:\n%s\n",
@@ -1021,8 +1572,16 @@ void a_Http_ccc(int Op, int Branch, int Dir, ChainLink *Info,
                   FdMapEntry_t *fme = dList_find_custom(fd_map, INT2VOIDP(fd),
                                                         Http_fd_map_cmp);
                   Info->LocalKey = INT2VOIDP(fme->skey);
+                  if ((sd = a_Klist_get_data(ValidSocks, fme->skey)))
+                     sd->InfoRecv = Info;
                   a_Chain_bcb(OpSend, Info, Data1, Data2);
                } else if (!strcmp(Data2, "reply_complete")) {
+                  /* Data1 = what came after the reply */
+                  if ((sd = a_Klist_get_data(ValidSocks, SKey)) &&
+                      (dbuf = Data1) && !dbuf->Code) {
+                     sd->rest = dStr_sized_new(dbuf->Size + 1);
+                     dStr_append_l(sd->rest, dbuf->Buf, dbuf->Size);
+                  }
                   a_Chain_bfcb(OpEnd, Info, NULL, NULL);
                   Http_socket_reuse(SKey);
                   dFree(Info);
@@ -1043,25 +1602,46 @@ void a_Http_ccc(int Op, int Branch, int Dir, ChainLink *Info,
 }
 
 /**
- * Add socket data to the queue. Pages/stylesheets/etc. have higher priority
- * than images.
+ * Return the queue priority of a socket (lower goes first): the page
+ * itself, its stylesheets (rendering waits for them), other resources,
+ * images, and images the page can do without for now.
+ */
+static int Http_socket_priority(SocketData_t *sock)
+{
+   int flags;
+
+   if (!a_Web_valid(sock->web))
+      return 4; /* will be dropped anyway */
+
+   flags = sock->web->flags;
+   if (flags & WEB_RootUrl)
+      return 0;
+   else if (flags & WEB_Stylesheet)
+      return 1;
+   else if (!(flags & WEB_Image))
+      return 2;
+   return (flags & WEB_Lazy) ? 4 : 3;
+}
+
+/**
+ * Add socket data to the queue, after the sockets with the same or higher
+ * priority.
  */
 static void Http_socket_enqueue(Server_t *srv, SocketData_t* sock)
 {
+   int i, n, prio;
+
    assert(~sock->flags & HTTP_SOCKET_QUEUED);
 
    sock->flags |= HTTP_SOCKET_QUEUED;
 
-   if ((sock->web->flags & WEB_Image) == 0) {
-      int i, n = dList_length(srv->queue);
-
-      for (i = 0; i < n; i++) {
-         SocketData_t *curr = dList_nth_data(srv->queue, i);
+   prio = Http_socket_priority(sock);
+   for (i = 0, n = dList_length(srv->queue); i < n; i++) {
+      SocketData_t *curr = dList_nth_data(srv->queue, i);
 
-         if (a_Web_valid(curr->web) && (curr->web->flags & WEB_Image)) {
-            dList_insert_pos(srv->queue, sock, i);
-            return;
-         }
+      if (Http_socket_priority(curr) > prio) {
+         dList_insert_pos(srv->queue, sock, i);
+         return;
       }
    }
    dList_append(srv->queue, sock);
@@ -1095,6 +1675,8 @@ static void Http_server_remove(Server_t *srv)
 {
    SocketData_t *sd;
 
+   if (srv->preconnect)
+      Http_preconnect_free(srv);
    while ((sd = dList_nth_data(srv->queue, 0))) {
       dList_remove_fast(srv->queue, sd);
       sd->flags &= ~HTTP_SOCKET_QUEUED;
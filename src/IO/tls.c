@@ -20,11 +20,158 @@
 
 #include "config.h"
 #include "../msg.h"
+#include "dlib/dlib.h"
 
 #include "tls.h"
 #include "tls_openssl.h"
 #include "tls_mbedtls.h"
 
+/*
+ * Session cache, so new connections to a server can resume the session of
+ * a previous one instead of doing a full handshake. Both TLS libraries
+ * store their sessions here, serialized.
+ */
+typedef struct {
+   char *host;
+   int port;
+   void *data;
+   size_t len;
+   time_t expires;
+} TlsSession_t;
+
+#define TLS_SESSION_CACHE_SIZE 64
+
+static Dlist *Sessions = NULL;   /* most recently used first */
+static uint_t StatFullHandshakes = 0, StatResumedHandshakes = 0;
+
+static void Tls_session_free(TlsSession_t *s)
+{
+   dFree(s->host);
+   dFree(s->data);
+   dFree(s);
+}
+
+/**
+ * Find the session for the server of 'url', dropping it if expired.
+ */
+static TlsSession_t *Tls_session_find(const DilloUrl *url)
+{
+   TlsSession_t *s;
+   int i;
+
+   for (i = 0; (s = dList_nth_data(Sessions, i)); i++) {
+      if (s->port == URL_PORT(url) &&
+          !dStrAsciiCasecmp(s->host, URL_HOST(url))) {
+         if (s->expires <= time(NULL)) {
+            dList_remove(Sessions, s);
+            Tls_session_free(s);
+            s = NULL;
+         }
+         return s;
+      }
+   }
+   return NULL;
+}
+
+/**
+ * Remember the session of a connection to the server of 'url', until
+ * 'expires'. It replaces the previous one for the same server.
+ */
+void a_Tls_session_store(const DilloUrl *url, const void *data, size_t len,
+                         time_t expires)
+{
+   TlsSession_t *s;
+
+   if (expires <= time(NULL))
+      return;
+   if (!Sessions)
+      Sessions = dList_new(TLS_SESSION_CACHE_SIZE);
+
+   if ((s = Tls_session_find(url))) {
+      dList_remove(Sessions, s);
+      dFree(s->data);
+   } else {
+      if (dList_length(Sessions) == TLS_SESSION_CACHE_SIZE) {
+         /* forget the least recently used */
+         TlsSession_t *last = dList_nth_data(Sessions, TLS_SESSION_CACHE_SIZE-1);
+         dList_remove(Sessions, last);
+         Tls_session_free(last);
+      }
+      s = dNew(TlsSession_t, 1);
+      s->host = dStrdup(URL_HOST(url));
+      s->port = URL_PORT(url);
+   }
+   s->data = dNew(char, len);
+   memcpy(s->data, data, len);
+   s->len = len;
+   s->expires = expires;
+   dList_prepend(Sessions, s);
+}
+
+/**
+ * Return the serialized session to resume for the server of 'url', or
+ * NULL. It is valid until the next call to a_Tls_session_store().
+ */
+const void *a_Tls_session_lookup(const DilloUrl *url, size_t *len)
+{
+   TlsSession_t *s = Tls_session_find(url);
+
+   if (!s)
+      return NULL;
+   dList_remove(Sessions, s);
+   dList_prepend(Sessions, s);
+   *len = s->len;
+   return s->data;
+}
+
+/**
+ * Account a completed handshake, for about:tls.
+ */
+void a_Tls_count_handshake(bool_t resumed)
+{
+   if (resumed)
+      StatResumedHandshakes++;
+   else
+      StatFullHandshakes++;
+}
+
+/**
+ * Return a page with the handshake statistics and the cached sessions.
+ */
+Dstr *a_Tls_stats(void)
+{
+   TlsSession_t *s;
+   time_t now = time(NULL);
+   uint_t total = StatFullHandshakes + StatResumedHandshakes;
+   int i;
+
+   Dstr *ds = dStr_new(
+      "<!DOCTYPE HTML>\n"
+      "<html>\n"
+      "<head><title>Dillo TLS</title></head>\n"
+      "<body>\n");
+
+   dStr_sprintfa(ds, "<h1>TLS handshakes (%u)</h1>\n", total);
+   dStr_sprintfa(ds, "<p>Full: %u</p>\n", StatFullHandshakes);
+   dStr_sprintfa(ds, "<p>Resumed: %u (%.1f%%)</p>\n", StatResumedHandshakes,
+                 total ? 100.0f * StatResumedHandshakes / total : 0.0f);
+
+   dStr_sprintfa(ds, "<h1>Cached sessions (%d)</h1>\n",
+                 dList_length(Sessions));
+   dStr_append(ds, "<table>\n");
+   dStr_append(ds, "<tr><th>Server</th><th>Expires in</th></tr>\n");
+   for (i = 0; (s = dList_nth_data(Sessions, i)); i++) {
+      dStr_sprintfa(ds, "<tr><td>%s:%d</td>"
+                    "<td style='text-align:right'>%ld s</td></tr>\n",
+                    s->host, s->port, (long)(s->expires - now));
+   }
+   dStr_append(ds,
+      "</table>\n"
+      "</body>\n"
+      "</html>\n");
+   return ds;
+}
+
 /**
  * Get the version of the TLS library.
  */
@@ -116,6 +263,15 @@ int a_Tls_certificate_is_clean(const DilloUrl *url)
  */
 void a_Tls_freeall(void)
 {
+   TlsSession_t *s;
+
+   while ((s = dList_nth_data(Sessions, 0))) {
+      dList_remove_fast(Sessions, s);
+      Tls_session_free(s);
+   }
+   dList_free(Sessions);
+   Sessions = NULL;
+
 #if ! defined(ENABLE_TLS)
    return;
 #elif defined(HAVE_OPENSSL)
@@ -154,6 +310,19 @@ void a_Tls_connect(int fd, const DilloUrl *url)
 #endif
 }
 
+void a_Tls_preconnect(int fd, const DilloUrl *url)
+{
+#if ! defined(ENABLE_TLS)
+   return;
+#elif defined(HAVE_OPENSSL)
+   a_Tls_openssl_preconnect(fd, url);
+#elif defined(HAVE_MBEDTLS)
+   a_Tls_mbedtls_preconnect(fd, url);
+#else
+# error "no TLS library found but ENABLE_TLS set"
+#endif
+}
+
 void a_Tls_close_by_fd(int fd)
 {
 #if ! defined(ENABLE_TLS)
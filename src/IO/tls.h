@@ -25,6 +25,8 @@
 extern "C" {
 #endif
 
+#include <time.h>
+
 #include "../url.h"
 
 #define TLS_CONNECT_NEVER -1
@@ -37,12 +39,19 @@ int a_Tls_certificate_is_clean(const DilloUrl *url);
 int a_Tls_connect_ready(const DilloUrl *url);
 void a_Tls_reset_server_state(const DilloUrl *url);
 void a_Tls_connect(int fd, const DilloUrl *url);
+void a_Tls_preconnect(int fd, const DilloUrl *url);
 void *a_Tls_connection(int fd);
 void a_Tls_freeall(void);
 void a_Tls_close_by_fd(int fd);
 int a_Tls_read(void *conn, void *buf, size_t len);
 int a_Tls_write(void *conn, void *buf, size_t len);
 
+void a_Tls_session_store(const DilloUrl *url, const void *data, size_t len,
+                         time_t expires);
+const void *a_Tls_session_lookup(const DilloUrl *url, size_t *len);
+void a_Tls_count_handshake(bool_t resumed);
+Dstr *a_Tls_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
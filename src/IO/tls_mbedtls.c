@@ -57,6 +57,24 @@
 #define CERT_STATUS_BAD 3
 #define CERT_STATUS_USER_ACCEPTED 4
 
+/* Sessions can be saved since 2.19.0. The certificate is needed to check
+ * resumed sessions too. */
+#if MBEDTLS_VERSION_NUMBER >= 0x02130000 && \
+    defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#define TLS_RESUME_SESSIONS
+#endif
+
+/* Servers don't tell how long they keep session IDs, guess an hour */
+#define TLS_SESSION_LIFETIME (60 * 60)
+
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+#define SESSION_ID(s) ((s)->id)
+#define SESSION_ID_LEN(s) ((s)->id_len)
+#else
+#define SESSION_ID(s) ((s)->MBEDTLS_PRIVATE(id))
+#define SESSION_ID_LEN(s) ((s)->MBEDTLS_PRIVATE(id_len))
+#endif
+
 typedef struct {
    char *hostname;
    int port;
@@ -81,6 +99,9 @@ typedef struct {
    DilloUrl *url;
    mbedtls_ssl_context *ssl;
    bool_t connecting;
+   bool_t speculative;  /* no request has taken the connection yet */
+   unsigned char session_id[32]; /* of the session offered to the server */
+   size_t session_id_len;
 } Conn_t;
 
 /* List of active TLS connections */
@@ -168,13 +189,14 @@ void *a_Tls_mbedtls_connection(int fd)
  * Add a new TLS connection information node.
  */
 static Conn_t *Tls_conn_new(int fd, const DilloUrl *url,
-                            mbedtls_ssl_context *ssl)
+                            mbedtls_ssl_context *ssl, bool_t speculative)
 {
    Conn_t *conn = dNew0(Conn_t, 1);
    conn->fd = fd;
    conn->url = a_Url_dup(url);
    conn->ssl = ssl;
    conn->connecting = TRUE;
+   conn->speculative = speculative;
    return conn;
 }
 
@@ -956,14 +978,75 @@ static void Tls_fatal_error_msg(int error_type)
             error_type, errmsg);
 }
 
+/*
+ * Offer the cached session for the server of 'conn', if any.
+ */
+static void Tls_resume_session(Conn_t *conn)
+{
+#ifdef TLS_RESUME_SESSIONS
+   mbedtls_ssl_session session;
+   const unsigned char *data;
+   size_t len;
+
+   if ((data = a_Tls_session_lookup(conn->url, &len))) {
+      mbedtls_ssl_session_init(&session);
+      if (mbedtls_ssl_session_load(&session, data, len) == 0 &&
+          mbedtls_ssl_set_session(conn->ssl, &session) == 0) {
+         conn->session_id_len = SESSION_ID_LEN(&session);
+         memcpy(conn->session_id, SESSION_ID(&session), conn->session_id_len);
+      }
+      mbedtls_ssl_session_free(&session);
+   }
+#else
+   (void)conn;
+#endif
+}
+
+/*
+ * Keep the session of a new connection in the session cache of tls.c.
+ * Return whether the server resumed the session that was offered.
+ */
+static bool_t Tls_save_session(Conn_t *conn)
+{
+   bool_t resumed = FALSE;
+#ifdef TLS_RESUME_SESSIONS
+   mbedtls_ssl_session session;
+   unsigned char *buf;
+   size_t len = 0;
+
+   mbedtls_ssl_session_init(&session);
+   if (mbedtls_ssl_get_session(conn->ssl, &session) == 0 &&
+       SESSION_ID_LEN(&session) > 0) {
+      /* When resuming, the server answers with the same session ID */
+      resumed = (conn->session_id_len == SESSION_ID_LEN(&session) &&
+                 !memcmp(conn->session_id, SESSION_ID(&session),
+                         conn->session_id_len));
+      /* A resumed session keeps its original lifetime */
+      if (!resumed &&
+          mbedtls_ssl_session_save(&session, NULL, 0, &len) ==
+             MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+         buf = dNew(unsigned char, len);
+         if (mbedtls_ssl_session_save(&session, buf, len, &len) == 0)
+            a_Tls_session_store(conn->url, buf, len,
+                                time(NULL) + TLS_SESSION_LIFETIME);
+         dFree(buf);
+      }
+   }
+   mbedtls_ssl_session_free(&session);
+#else
+   (void)conn;
+#endif
+   return resumed;
+}
+
 /*
  * Connect, set a callback if it's still not completed. If completed, check
  * the certificate and report back to http.
  */
 static void Tls_handshake(int fd, int connkey)
 {
-   int ret;
-   bool_t ongoing = FALSE, failed = TRUE;
+   int ret = 0;
+   bool_t ongoing = FALSE, failed = TRUE, resumed = FALSE;
    Conn_t *conn;
 
    if (!(conn = a_Klist_get_data(conn_list, connkey))) {
@@ -976,71 +1059,78 @@ static void Tls_handshake(int fd, int connkey)
 #else
    int ssl_state = conn->ssl->MBEDTLS_PRIVATE(state);
 #endif
-   if (ssl_state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+   /* The handshake of a speculative connection may be over already */
+   if (ssl_state != MBEDTLS_SSL_HANDSHAKE_OVER)
       ret = mbedtls_ssl_handshake(conn->ssl);
 
-      if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
-          ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
-         int want = ret == MBEDTLS_ERR_SSL_WANT_READ ? DIO_READ : DIO_WRITE;
-
-         _MSG("iowatching fd %d for tls -- want %s\n", fd,
-             ret == MBEDTLS_ERR_SSL_WANT_READ ? "read" : "write");
-         a_IOwatch_remove_fd(fd, -1);
-         a_IOwatch_add_fd(fd, want, Tls_handshake_cb, INT2VOIDP(connkey));
-         ongoing = TRUE;
+   if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+       ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+      int want = ret == MBEDTLS_ERR_SSL_WANT_READ ? DIO_READ : DIO_WRITE;
+
+      _MSG("iowatching fd %d for tls -- want %s\n", fd,
+          ret == MBEDTLS_ERR_SSL_WANT_READ ? "read" : "write");
+      a_IOwatch_remove_fd(fd, -1);
+      a_IOwatch_add_fd(fd, want, Tls_handshake_cb, INT2VOIDP(connkey));
+      ongoing = TRUE;
+      failed = FALSE;
+   } else if (ret == 0 && conn->speculative) {
+      /* The certificate is examined, and the user asked about it, only
+       * when a request takes the connection; see a_Tls_mbedtls_connect().
+       */
+      failed = FALSE;
+   } else if (ret == 0) {
+      Server_t *srv = dList_find_sorted(servers, conn->url,
+                                        Tls_servers_by_url_cmp);
+
+      if (srv->cert_status == CERT_STATUS_RECEIVING) {
+         /* Making first connection with the server. Show cipher used. */
+         mbedtls_ssl_context *ssl = conn->ssl;
+         const char *version = mbedtls_ssl_get_version(ssl),
+                    *cipher = mbedtls_ssl_get_ciphersuite(ssl);
+
+         MSG("%s", URL_AUTHORITY(conn->url));
+         if (URL_PORT(conn->url) != URL_HTTPS_PORT)
+            MSG(":%d", URL_PORT(conn->url));
+         MSG(" %s, cipher %s\n", version, cipher);
+      }
+      if (srv->cert_status == CERT_STATUS_USER_ACCEPTED ||
+          (Tls_examine_certificate(conn->ssl, srv) != -1)) {
          failed = FALSE;
-      } else if (ret == 0) {
-         Server_t *srv = dList_find_sorted(servers, conn->url,
-                                           Tls_servers_by_url_cmp);
-
-         if (srv->cert_status == CERT_STATUS_RECEIVING) {
-            /* Making first connection with the server. Show cipher used. */
-            mbedtls_ssl_context *ssl = conn->ssl;
-            const char *version = mbedtls_ssl_get_version(ssl),
-                       *cipher = mbedtls_ssl_get_ciphersuite(ssl);
-
-            MSG("%s", URL_AUTHORITY(conn->url));
-            if (URL_PORT(conn->url) != URL_HTTPS_PORT)
-               MSG(":%d", URL_PORT(conn->url));
-            MSG(" %s, cipher %s\n", version, cipher);
-         }
-         if (srv->cert_status == CERT_STATUS_USER_ACCEPTED ||
-             (Tls_examine_certificate(conn->ssl, srv) != -1)) {
-            failed = FALSE;
-         }
-      } else if (ret == MBEDTLS_ERR_NET_SEND_FAILED) {
-         MSG("mbedtls_ssl_handshake() send failed. Server may not be accepting"
-             " connections.\n");
-      } else if (ret == MBEDTLS_ERR_NET_CONNECT_FAILED) {
-         MSG("mbedtls_ssl_handshake() connect failed.\n");
-      } else if (ret == MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE) {
-         /* Paul Bakker, the mbed tls guy, says "beware, this might change in
-          * future versions" and "ssl->in_msg[1] is not going to change anytime
-          * soon, unless there are radical changes". It seems to be the best of
-          * the alternatives.
-          */
+         resumed = Tls_save_session(conn);
+      }
+      a_Tls_count_handshake(resumed);
+   } else if (ret == MBEDTLS_ERR_NET_SEND_FAILED) {
+      MSG("mbedtls_ssl_handshake() send failed. Server may not be accepting"
+          " connections.\n");
+   } else if (ret == MBEDTLS_ERR_NET_CONNECT_FAILED) {
+      MSG("mbedtls_ssl_handshake() connect failed.\n");
+   } else if (ret == MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE) {
+      /* Paul Bakker, the mbed tls guy, says "beware, this might change in
+       * future versions" and "ssl->in_msg[1] is not going to change anytime
+       * soon, unless there are radical changes". It seems to be the best of
+       * the alternatives.
+       */
 #if MBEDTLS_VERSION_NUMBER < 0x03000000
-         Tls_fatal_error_msg(conn->ssl->in_msg[1]);
+      Tls_fatal_error_msg(conn->ssl->in_msg[1]);
 #else
-         Tls_fatal_error_msg(conn->ssl->MBEDTLS_PRIVATE(in_msg[1]));
+      Tls_fatal_error_msg(conn->ssl->MBEDTLS_PRIVATE(in_msg[1]));
 #endif
-      } else if (ret == MBEDTLS_ERR_SSL_INVALID_RECORD) {
-         MSG("mbedtls_ssl_handshake() failed upon receiving 'an invalid "
-             "record'.\n");
-      } else if (ret == MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE) {
-         MSG("mbedtls_ssl_handshake() failed: 'The requested feature is not "
-             "available.'\n");
+   } else if (ret == MBEDTLS_ERR_SSL_INVALID_RECORD) {
+      MSG("mbedtls_ssl_handshake() failed upon receiving 'an invalid "
+          "record'.\n");
+   } else if (ret == MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE) {
+      MSG("mbedtls_ssl_handshake() failed: 'The requested feature is not "
+          "available.'\n");
 #if MBEDTLS_VERSION_NUMBER < 0x03000000
-      } else if (ret == MBEDTLS_ERR_SSL_BAD_HS_SERVER_KEY_EXCHANGE) {
-         MSG("mbedtls_ssl_handshake() failed: 'Processing of the "
-             "ServerKeyExchange handshake message failed.'\n");
+   } else if (ret == MBEDTLS_ERR_SSL_BAD_HS_SERVER_KEY_EXCHANGE) {
+      MSG("mbedtls_ssl_handshake() failed: 'Processing of the "
+          "ServerKeyExchange handshake message failed.'\n");
 #endif
-      } else if (ret == MBEDTLS_ERR_SSL_CONN_EOF) {
-         MSG("mbedtls_ssl_handshake() failed: Read EOF. Connection closed by "
-             "server.\n");
-      } else {
-         MSG("mbedtls_ssl_handshake() failed with error -0x%04x\n", -ret);
-      }
+   } else if (ret == MBEDTLS_ERR_SSL_CONN_EOF) {
+      MSG("mbedtls_ssl_handshake() failed: Read EOF. Connection closed by "
+          "server.\n");
+   } else {
+      MSG("mbedtls_ssl_handshake() failed with error -0x%04x\n", -ret);
    }
 
    /*
@@ -1070,7 +1160,7 @@ static void Tls_handshake_cb(int fd, void *vconnkey)
 /*
  * Make TLS connection over a connect()ed socket.
  */
-void a_Tls_mbedtls_connect(int fd, const DilloUrl *url)
+static void Tls_connect_new(int fd, const DilloUrl *url, bool_t speculative)
 {
    mbedtls_ssl_context *ssl = dNew0(mbedtls_ssl_context, 1);
    bool_t success = TRUE;
@@ -1091,10 +1181,11 @@ void a_Tls_mbedtls_connect(int fd, const DilloUrl *url)
 
    /* assign TLS connection to this file descriptor */
    if (success) {
-      Conn_t *conn = Tls_conn_new(fd, url, ssl);
+      Conn_t *conn = Tls_conn_new(fd, url, ssl, speculative);
       connkey = Tls_make_conn_key(conn);
       mbedtls_ssl_set_bio(ssl, &conn->fd, mbedtls_net_send, mbedtls_net_recv,
                           NULL);
+      Tls_resume_session(conn);
    }
 
    if (success && (ret = mbedtls_ssl_set_hostname(ssl, URL_HOST(url)))) {
@@ -1110,6 +1201,36 @@ void a_Tls_mbedtls_connect(int fd, const DilloUrl *url)
    }
 }
 
+/*
+ * Make TLS connection over a connect()ed socket, or take over the one of a
+ * speculative connection. In the latter case, the certificate is examined
+ * now, and http is called back as for a new handshake.
+ */
+void a_Tls_mbedtls_connect(int fd, const DilloUrl *url)
+{
+   FdMapEntry_t *fme = fd_map ?
+      dList_find_custom(fd_map, INT2VOIDP(fd), Tls_fd_map_cmp) : NULL;
+   Conn_t *conn = fme ? a_Klist_get_data(conn_list, fme->connkey) : NULL;
+
+   if (conn && conn->speculative) {
+      conn->speculative = FALSE;
+      /* else Tls_handshake() is called when the handshake goes on */
+      if (!conn->connecting)
+         Tls_handshake(fd, fme->connkey);
+   } else {
+      Tls_connect_new(fd, url, FALSE);
+   }
+}
+
+/*
+ * Make TLS connection of a speculative connection, without examining the
+ * certificate.
+ */
+void a_Tls_mbedtls_preconnect(int fd, const DilloUrl *url)
+{
+   Tls_connect_new(fd, url, TRUE);
+}
+
 /*
  * Read data from an open TLS connection.
  */
@@ -27,6 +27,7 @@ int a_Tls_mbedtls_certificate_is_clean(const DilloUrl *url);
 int a_Tls_mbedtls_connect_ready(const DilloUrl *url);
 void a_Tls_mbedtls_reset_server_state(const DilloUrl *url);
 void a_Tls_mbedtls_connect(int fd, const DilloUrl *url);
+void a_Tls_mbedtls_preconnect(int fd, const DilloUrl *url);
 void *a_Tls_mbedtls_connection(int fd);
 void a_Tls_mbedtls_freeall(void);
 void a_Tls_mbedtls_close_by_fd(int fd);
@@ -81,6 +81,9 @@ typedef struct {
    bool_t connecting;
    bool_t in_connect;
    bool_t do_shutdown;
+   bool_t speculative;  /* no request has taken the connection yet */
+   bool_t cert_accepted;
+   SSL_SESSION *new_session; /* to be cached once cert_accepted is set */
 } Conn_t;
 
 /* List of active TLS connections */
@@ -158,7 +161,8 @@ void *a_Tls_openssl_connection(int fd)
 /*
  * Add a new TLS connection information node.
  */
-static int Tls_conn_new(int fd, const DilloUrl *url, SSL *ssl)
+static int Tls_conn_new(int fd, const DilloUrl *url, SSL *ssl,
+                        bool_t speculative)
 {
    int key;
 
@@ -169,6 +173,8 @@ static int Tls_conn_new(int fd, const DilloUrl *url, SSL *ssl)
    conn->connecting = TRUE;
    conn->in_connect = FALSE;
    conn->do_shutdown = TRUE;
+   conn->speculative = speculative;
+   SSL_set_app_data(ssl, conn);
 
    key = a_Klist_insert(&conn_list, conn);
 
@@ -191,6 +197,62 @@ static void Tls_info_cb(const SSL *ssl, int where, int ret)
    }
 }
 
+/*
+ * Keep a session in the session cache of tls.c.
+ */
+static void Tls_store_session(const DilloUrl *url, SSL_SESSION *sess)
+{
+   unsigned char *data, *p;
+   int len;
+
+   if ((len = i2d_SSL_SESSION(sess, NULL)) > 0) {
+      data = p = dNew(unsigned char, len);
+      i2d_SSL_SESSION(sess, &p);
+      /* the timeout follows the ticket lifetime given by the server */
+      a_Tls_session_store(url, data, len, SSL_SESSION_get_time(sess) +
+                                          SSL_SESSION_get_timeout(sess));
+      dFree(data);
+   }
+}
+
+/*
+ * Called for new sessions after the handshake, or later when a TLS 1.3
+ * server sends a ticket. The handshake ends before the certificate is
+ * examined, so a session waits in the connection until it is accepted;
+ * a session with a rejected certificate must not be resumed.
+ */
+static int Tls_new_session_cb(SSL *ssl, SSL_SESSION *sess)
+{
+   Conn_t *conn = SSL_get_app_data(ssl);
+
+   if (!conn)
+      return 0;
+   if (conn->cert_accepted) {
+      Tls_store_session(conn->url, sess);
+      return 0; /* no reference to 'sess' was kept */
+   }
+   if (conn->new_session)
+      SSL_SESSION_free(conn->new_session);
+   conn->new_session = sess;
+   return 1;
+}
+
+/*
+ * Offer the cached session for the server of 'url', if any.
+ */
+static void Tls_resume_session(SSL *ssl, const DilloUrl *url)
+{
+   const unsigned char *p;
+   SSL_SESSION *sess;
+   size_t len;
+
+   if ((p = a_Tls_session_lookup(url, &len)) &&
+       (sess = d2i_SSL_SESSION(NULL, &p, len))) {
+      SSL_set_session(ssl, sess);
+      SSL_SESSION_free(sess);
+   }
+}
+
 /*
  * Load trusted certificates.
  * This is like using SSL_CTX_load_verify_locations() but permitting more
@@ -309,6 +371,11 @@ void a_Tls_openssl_init(void)
    /* This lets us deal with self-signed certificates */
    SSL_CTX_set_verify(ssl_context, SSL_VERIFY_NONE, NULL);
 
+   /* Sessions are kept by tls.c, not in the context */
+   SSL_CTX_set_session_cache_mode(ssl_context, SSL_SESS_CACHE_CLIENT |
+                                  SSL_SESS_CACHE_NO_INTERNAL_STORE);
+   SSL_CTX_sess_set_new_cb(ssl_context, Tls_new_session_cb);
+
    Tls_load_certificates();
 
    fd_map = dList_new(20);
@@ -1117,6 +1184,8 @@ static void Tls_close_by_key(int connkey)
          MSG("Tls_close_by_key: Avoiding SSL shutdown for: %s\n", URL_STR(c->url));
       }
       SSL_free(c->ssl);
+      if (c->new_session)
+         SSL_SESSION_free(c->new_session);
 
       a_Url_free(c->url);
       Tls_fd_map_remove_entry(c->fd);
@@ -1215,19 +1284,28 @@ static void Tls_connect(int fd, int connkey)
       Server_t *srv = dList_find_sorted(servers, conn->url,
                                         Tls_servers_by_url_cmp);
 
-      if (srv->cert_status == CERT_STATUS_RECEIVING) {
-         /* Making first connection with the server. Show cipher used. */
-         SSL *ssl = conn->ssl;
-         const char *version = SSL_get_version(ssl);
-         const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl);
+      if (conn->speculative) {
+         /* The certificate is examined, and the user asked about it, only
+          * when a request takes the connection; see a_Tls_openssl_connect().
+          */
+         failed = FALSE;
+      } else {
+         a_Tls_count_handshake(SSL_session_reused(conn->ssl));
+
+         if (srv->cert_status == CERT_STATUS_RECEIVING) {
+            /* Making first connection with the server. Show cipher used. */
+            SSL *ssl = conn->ssl;
+            const char *version = SSL_get_version(ssl);
+            const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl);
 
-         MSG("%s: %s, cipher %s\n", URL_AUTHORITY(conn->url), version,
-             SSL_CIPHER_get_name(cipher));
-      }
+            MSG("%s: %s, cipher %s\n", URL_AUTHORITY(conn->url), version,
+                SSL_CIPHER_get_name(cipher));
+         }
 
-      if (srv->cert_status == CERT_STATUS_USER_ACCEPTED ||
-          (Tls_examine_certificate(conn->ssl, srv) != -1)) {
-         failed = FALSE;
+         if (srv->cert_status == CERT_STATUS_USER_ACCEPTED ||
+             (Tls_examine_certificate(conn->ssl, srv) != -1)) {
+            failed = FALSE;
+         }
       }
    }
 
@@ -1246,6 +1324,13 @@ static void Tls_connect(int fd, int connkey)
             Tls_close_by_key(connkey);
             /* conn is freed now */
             conn = NULL;
+         } else if (!conn->speculative) {
+            conn->cert_accepted = TRUE;
+            if (conn->new_session) {
+               Tls_store_session(conn->url, conn->new_session);
+               SSL_SESSION_free(conn->new_session);
+               conn->new_session = NULL;
+            }
          }
          a_IOwatch_remove_fd(fd, DIO_READ|DIO_WRITE);
          a_Http_connect_done(fd, failed ? FALSE : TRUE);
@@ -1266,9 +1351,9 @@ static void Tls_connect_cb(int fd, void *vconnkey)
 /*
  * Perform the TLS handshake on an open socket.
  */
-void a_Tls_openssl_connect(int fd, const DilloUrl *url)
+static void Tls_connect_new(int fd, const DilloUrl *url, bool_t speculative)
 {
-   _MSG("a_Tls_openssl_connect: fd=%d url=%s\n", fd, URL_STR(url));
+   _MSG("Tls_connect_new: fd=%d url=%s\n", fd, URL_STR(url));
 
    SSL *ssl;
    bool_t success = TRUE;
@@ -1307,8 +1392,10 @@ void a_Tls_openssl_connect(int fd, const DilloUrl *url)
       success = FALSE;
    }
 
-   if (success)
-      connkey = Tls_conn_new(fd, url, ssl);
+   if (success) {
+      connkey = Tls_conn_new(fd, url, ssl, speculative);
+      Tls_resume_session(ssl, url);
+   }
 
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
    /* Server Name Indication. From the openssl changelog, it looks like this
@@ -1326,6 +1413,36 @@ void a_Tls_openssl_connect(int fd, const DilloUrl *url)
    }
 }
 
+/*
+ * Perform the TLS handshake on an open socket, or take over the one of a
+ * speculative connection. In the latter case, the certificate is examined
+ * now, and http is called back as for a new handshake.
+ */
+void a_Tls_openssl_connect(int fd, const DilloUrl *url)
+{
+   FdMapEntry_t *fme = fd_map ?
+      dList_find_custom(fd_map, INT2VOIDP(fd), Tls_fd_map_cmp) : NULL;
+   Conn_t *conn = fme ? a_Klist_get_data(conn_list, fme->connkey) : NULL;
+
+   if (conn && conn->speculative) {
+      conn->speculative = FALSE;
+      /* else Tls_connect() is called when the handshake goes on */
+      if (!conn->connecting)
+         Tls_connect(fd, fme->connkey);
+   } else {
+      Tls_connect_new(fd, url, FALSE);
+   }
+}
+
+/*
+ * Perform the TLS handshake of a speculative connection, without
+ * examining the certificate.
+ */
+void a_Tls_openssl_preconnect(int fd, const DilloUrl *url)
+{
+   Tls_connect_new(fd, url, TRUE);
+}
+
 /*
  * Traduces an SSL I/O error into something understandable by IO.c
  *
@@ -37,6 +37,7 @@ int a_Tls_openssl_certificate_is_clean(const DilloUrl *url);
 int a_Tls_openssl_connect_ready(const DilloUrl *url);
 void a_Tls_openssl_reset_server_state(const DilloUrl *url);
 void a_Tls_openssl_connect(int fd, const DilloUrl *url);
+void a_Tls_openssl_preconnect(int fd, const DilloUrl *url);
 void *a_Tls_openssl_connection(int fd);
 void a_Tls_openssl_freeall(void);
 void a_Tls_openssl_close_by_fd(int fd);
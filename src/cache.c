@@ -20,10 +20,12 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "msg.h"
 #include "IO/Url.h"
 #include "IO/IO.h"
+#include "IO/tls.h"
 #include "web.hh"
 #include "dicache.h"
 #include "nav.h"
@@ -38,6 +40,7 @@
 #include "uicmd.hh"
 #include "dlib/dlib.h"
 #include "prefs.h"
+#include "diskcache.h"
 
 /** Maximum initial size for the automatically-growing data buffer */
 #define MAX_INIT_BUF  1024*1024
@@ -48,7 +51,7 @@
  *  Local data types
  */
 
-typedef struct {
+typedef struct CacheEntry {
    const DilloUrl *Url;      /**< Cached Url. Url is used as a primary Key */
    char *TypeDet;            /**< MIME type string (detected from data) */
    char *TypeHdr;            /**< MIME type string as from the HTTP Header */
@@ -61,6 +64,8 @@ typedef struct {
    Dstr *Data;               /**< Pointer to raw data */
    Dstr *UTF8Data;           /**< Data after charset translation */
    int DataRefcount;         /**< Reference count */
+   int Pins;                 /**< Decoded images that may need the data
+                                  again (keeps it from being evicted) */
    DecodeTransfer *TransferDecoder;  /**< Transfer decoder (e.g., chunked) */
    Decode *ContentDecoder;   /**< Data decoder (e.g., gzip) */
    Decode *CharsetDecoder;   /**< Translates text to UTF-8 encoding */
@@ -68,24 +73,56 @@ typedef struct {
    int TransferSize;         /**< Actual length of the HTTP transfer */
    uint_t Flags;             /**< See Flag Defines in cache.h */
    int Hits;                 /**< Counter of hits for the entry */
+   uint_t Version;           /**< Changes whenever the data is replaced */
+   uint_t LastUse;           /**< Value of UseCounter when last requested */
+   size_t Size;              /**< Buffer bytes counted in CacheSize */
+   Dlist *Clients;           /**< Clients of this entry, in arrival order */
+   struct CacheEntry *HashNext; /**< Next entry in the same CacheIndex slot */
+   bool_t FromDisk;          /**< Data comes from the disk cache */
+   Dstr *DiskBody;           /**< Stored body that completes a 304 answer */
 } CacheEntry_t;
 
 
 /*
  *  Local data
  */
-/** A sorted list for cached data. Holds pointers to CacheEntry_t structs */
+/** A list for cached data. Holds pointers to CacheEntry_t structs */
 static Dlist *CachedURLs;
 
-/** A list for cache clients.
- * Although implemented as a list, we'll call it ClientQueue  --Jcid */
-static Dlist *ClientQueue;
+/** Hash table of the entries in CachedURLs, by URL_HASH() */
+static CacheEntry_t **CacheIndex;
+static int CacheIndexSize; /* a power of two */
+
+/** Hash table of the cache clients, by key. The clients of each entry
+ * are also kept in its Clients list, in the order they were added. */
+static CacheClient_t **ClientIndex;
+static int ClientIndexSize; /* a power of two */
+static int NumClients;
 
 /** A list for delayed clients (it holds weak pointers to cache entries,
  * which are used to make deferred calls to Cache_process_queue) */
 static Dlist *DelayedQueue;
 static uint_t DelayedQueueIdleId = 0;
 
+/** Cache_process_queue() is running (entries it works on may have no
+ * clients left, and must not be evicted meanwhile) */
+static bool_t QueueBusy = FALSE;
+/** A call to Cache_evict() is set from the main cycle */
+static bool_t EvictPending = FALSE;
+
+/** Last version given to the data of a cache entry */
+static uint_t LastVersion = 0;
+
+/** Incremented on every request, to find the least recently used entries */
+static uint_t UseCounter = 0;
+
+/** Sum of the buffer sizes of all the entries (see Cache_entry_size) */
+static size_t CacheSize = 0;
+
+/** Statistics shown in about:cache */
+static uint_t StatRequests = 0, StatHits = 0, StatEvictions = 0;
+static size_t StatEvictedBytes = 0;
+
 
 /*
  *  Forward declarations
@@ -95,36 +132,32 @@ static void Cache_delayed_process_queue(CacheEntry_t *entry);
 static void Cache_auth_entry(CacheEntry_t *entry, BrowserWindow *bw);
 static Dstr *Cache_data(CacheEntry_t *entry);
 static void Cache_entry_free(CacheEntry_t *entry, int deep);
+static CacheEntry_t *Cache_entry_search(const DilloUrl *Url);
+static void Cache_entry_update_size(CacheEntry_t *e);
 
 /**
- * Determine if two cache entries are equal (used by CachedURLs)
+ * Compare cache entries by URL, for qsort()
  */
 static int Cache_entry_cmp(const void *v1, const void *v2)
 {
-   const CacheEntry_t *d1 = v1, *d2 = v2;
+   const CacheEntry_t *d1 = *(CacheEntry_t * const *)v1,
+                      *d2 = *(CacheEntry_t * const *)v2;
 
    return a_Url_cmp(d1->Url, d2->Url);
 }
 
-/**
- * Determine if two cache entries are equal, using a URL as key.
- */
-static int Cache_entry_by_url_cmp(const void *v1, const void *v2)
-{
-   const DilloUrl *u1 = ((CacheEntry_t*)v1)->Url;
-   const DilloUrl *u2 = v2;
-
-   return a_Url_cmp(u1, u2);
-}
-
 /**
  * Initialize cache data
  */
 void a_Cache_init(void)
 {
-   ClientQueue = dList_new(32);
+   NumClients = 0;
+   ClientIndexSize = 64;
+   ClientIndex = dNew0(CacheClient_t *, ClientIndexSize);
    DelayedQueue = dList_new(32);
    CachedURLs = dList_new(256);
+   CacheIndexSize = 256;
+   CacheIndex = dNew0(CacheEntry_t *, CacheIndexSize);
 
    /* inject the splash screen in the cache */
    {
@@ -140,11 +173,58 @@ void a_Cache_init(void)
 /* Client operations ------------------------------------------------------ */
 
 /**
- * Add a client to ClientQueue.
+ * Add a client to ClientIndex.
+ */
+static void Cache_client_index(CacheClient_t *Client)
+{
+   CacheClient_t **slot, *c, *next;
+   int i;
+
+   if (++NumClients > ClientIndexSize) {
+      /* keep chains short: grow the table and rehash */
+      CacheClient_t **old = ClientIndex;
+      int oldSize = ClientIndexSize;
+
+      ClientIndexSize *= 2;
+      ClientIndex = dNew0(CacheClient_t *, ClientIndexSize);
+      for (i = 0; i < oldSize; i++) {
+         for (c = old[i]; c; c = next) {
+            next = c->HashNext;
+            slot = &ClientIndex[c->Key & (ClientIndexSize - 1)];
+            c->HashNext = *slot;
+            *slot = c;
+         }
+      }
+      dFree(old);
+   }
+
+   slot = &ClientIndex[Client->Key & (ClientIndexSize - 1)];
+   Client->HashNext = *slot;
+   *slot = Client;
+}
+
+/**
+ * Remove a client from ClientIndex.
+ */
+static void Cache_client_unindex(CacheClient_t *Client)
+{
+   CacheClient_t **slot = &ClientIndex[Client->Key & (ClientIndexSize - 1)];
+
+   for ( ; *slot; slot = &(*slot)->HashNext) {
+      if (*slot == Client) {
+         *slot = Client->HashNext;
+         NumClients--;
+         break;
+      }
+   }
+}
+
+/**
+ * Add a client to the queue.
  *  - Every client-field is just a reference (except 'Web').
  *  - Return a unique number for identifying the client.
  */
-static int Cache_client_enqueue(const DilloUrl *Url, DilloWeb *Web,
+static int Cache_client_enqueue(CacheEntry_t *entry, DilloWeb *Web,
                                  CA_Callback_t Callback, void *CbData)
 {
    static int ClientKey = 0; /* Provide a primary key for each client */
@@ -157,25 +237,31 @@ static int Cache_client_enqueue(const DilloUrl *Url, DilloWeb *Web,
 
    NewClient = dNew(CacheClient_t, 1);
    NewClient->Key = ClientKey;
-   NewClient->Url = Url;
+   NewClient->Url = entry->Url;
    NewClient->Version = 0;
    NewClient->Buf = NULL;
    NewClient->BufSize = 0;
    NewClient->Callback = Callback;
    NewClient->CbData = CbData;
    NewClient->Web    = Web;
+   NewClient->Busy   = FALSE;
 
-   dList_append(ClientQueue, NewClient);
+   dList_append(entry->Clients, NewClient);
+   Cache_client_index(NewClient);
 
    return ClientKey;
 }
 
 /**
- * Compare function for searching a Client by its key
+ * Find a client by its key.
  */
-static int Cache_client_by_key_cmp(const void *client, const void *key)
+static CacheClient_t *Cache_client_find(int Key)
 {
-   return ((CacheClient_t *)client)->Key - VOIDP2INT(key);
+   CacheClient_t *Client = ClientIndex[Key & (ClientIndexSize - 1)];
+
+   while (Client && Client->Key != Key)
+      Client = Client->HashNext;
+   return Client;
 }
 
 /**
@@ -183,8 +269,16 @@ static int Cache_client_by_key_cmp(const void *client, const void *key)
  */
 static void Cache_client_dequeue(CacheClient_t *Client)
 {
+   CacheEntry_t *entry;
+
    if (Client) {
-      dList_remove(ClientQueue, Client);
+      /* the entry may have been replaced by another one for the same URL.
+       * Removing from entry->Clients is linear, but that list only holds
+       * the few clients of one URL. */
+      if ((entry = Cache_entry_search(Client->Url)) &&
+          entry->Url == Client->Url)
+         dList_remove(entry->Clients, Client);
+      Cache_client_unindex(Client);
       a_Web_free(Client->Web);
       dFree(Client);
    }
@@ -210,6 +304,7 @@ static void Cache_entry_init(CacheEntry_t *NewEntry, const DilloUrl *Url)
    NewEntry->Data = dStr_sized_new(8*1024);
    NewEntry->UTF8Data = NULL;
    NewEntry->DataRefcount = 0;
+   NewEntry->Pins = 0;
    NewEntry->TransferDecoder = NULL;
    NewEntry->ContentDecoder = NULL;
    NewEntry->CharsetDecoder = NULL;
@@ -217,6 +312,12 @@ static void Cache_entry_init(CacheEntry_t *NewEntry, const DilloUrl *Url)
    NewEntry->TransferSize = 0;
    NewEntry->Flags = CA_IsEmpty | CA_InProgress | CA_KeepAlive;
    NewEntry->Hits = 0;
+   NewEntry->Version = ++LastVersion;
+   NewEntry->LastUse = ++UseCounter;
+   NewEntry->Size = 0;
+   NewEntry->Clients = dList_new(4);
+   NewEntry->FromDisk = FALSE;
+   NewEntry->DiskBody = NULL;
 }
 
 /**
@@ -225,7 +326,61 @@ static void Cache_entry_init(CacheEntry_t *NewEntry, const DilloUrl *Url)
  */
 static CacheEntry_t *Cache_entry_search(const DilloUrl *Url)
 {
-   return dList_find_sorted(CachedURLs, Url, Cache_entry_by_url_cmp);
+   CacheEntry_t *entry;
+
+   dReturn_val_if_fail(Url != NULL, NULL);
+
+   entry = CacheIndex[URL_HASH(Url) & (CacheIndexSize - 1)];
+   for ( ; entry; entry = entry->HashNext)
+      if (URL_HASH(entry->Url) == URL_HASH(Url) &&
+          a_Url_cmp(entry->Url, Url) == 0)
+         return entry;
+   return NULL;
+}
+
+/**
+ * Add an entry to CachedURLs and CacheIndex.
+ */
+static void Cache_entry_insert(CacheEntry_t *entry)
+{
+   CacheEntry_t **slot;
+   int i;
+
+   dList_append(CachedURLs, entry);
+
+   if (dList_length(CachedURLs) > CacheIndexSize) {
+      /* keep chains short: grow the table and rehash */
+      dFree(CacheIndex);
+      CacheIndexSize *= 2;
+      CacheIndex = dNew0(CacheEntry_t *, CacheIndexSize);
+      for (i = 0; i < dList_length(CachedURLs) - 1; i++) {
+         CacheEntry_t *e = dList_nth_data(CachedURLs, i);
+         slot = &CacheIndex[URL_HASH(e->Url) & (CacheIndexSize - 1)];
+         e->HashNext = *slot;
+         *slot = e;
+      }
+   }
+
+   slot = &CacheIndex[URL_HASH(entry->Url) & (CacheIndexSize - 1)];
+   entry->HashNext = *slot;
+   *slot = entry;
+}
+
+/**
+ * Remove an entry from CachedURLs and CacheIndex (without freeing it).
+ */
+static void Cache_entry_unlink(CacheEntry_t *entry)
+{
+   CacheEntry_t **slot = &CacheIndex[URL_HASH(entry->Url) &
+                                     (CacheIndexSize - 1)];
+
+   for ( ; *slot; slot = &(*slot)->HashNext) {
+      if (*slot == entry) {
+         *slot = entry->HashNext;
+         break;
+      }
+   }
+   dList_remove_fast(CachedURLs, entry);
 }
 
 /**
@@ -261,12 +416,13 @@ static CacheEntry_t *Cache_entry_add(const DilloUrl *Url)
 
    if ((old_entry = Cache_entry_search(Url))) {
       MSG_WARN("Cache_entry_add, leaking an entry.\n");
-      dList_remove(CachedURLs, old_entry);
+      Cache_entry_unlink(old_entry);
    }
 
    new_entry = dNew(CacheEntry_t, 1);
    Cache_entry_init(new_entry, Url);  /* Set safe values */
-   dList_insert_sorted(CachedURLs, new_entry, Cache_entry_cmp);
+   Cache_entry_insert(new_entry);
+   Cache_entry_update_size(new_entry);
    return new_entry;
 }
 
@@ -283,6 +439,29 @@ static int Cache_bufsize(CacheEntry_t *e)
       return 0;
 }
 
+/**
+ * Compute the memory used by a cache entry buffers.
+ */
+static size_t Cache_entry_size(CacheEntry_t *e)
+{
+   size_t size = e->Data->sz + e->Header->sz;
+
+   if (e->UTF8Data)
+      size += e->UTF8Data->sz;
+   return size;
+}
+
+/**
+ * Update CacheSize after the buffers of an entry have changed.
+ */
+static void Cache_entry_update_size(CacheEntry_t *e)
+{
+   size_t size = Cache_entry_size(e);
+
+   CacheSize = CacheSize - e->Size + size;
+   e->Size = size;
+}
+
 /**
  * Inject full page content directly into the cache.
  * Used for "about:splash". May be used for "about:cache" too.
@@ -306,12 +485,14 @@ void a_Cache_entry_inject(const DilloUrl *Url,
       dStr_append_l(entry->Data, buf, len);
       dStr_fit(entry->Data);
       entry->ExpectedSize = entry->TransferSize = entry->Data->len;
+      Cache_entry_update_size(entry);
    } else {
       /* Inject a new empty entry and process it to parse the headers and setup
        * any decoder or content handler. */
       Cache_entry_free(entry, 0);
       Cache_entry_init(entry, Url);
-      a_Cache_process_dbuf(IORead, buf, len, Url);
+      Cache_entry_update_size(entry);
+      a_Cache_process_dbuf(IORead, buf, len, Url, NULL);
    }
 }
 
@@ -332,6 +513,8 @@ static void Cache_auth_free(Dlist *auth)
  */
 static void Cache_entry_free(CacheEntry_t *entry, int deep)
 {
+   CacheSize -= entry->Size;
+   entry->Size = 0;
    a_Url_free((DilloUrl *)entry->Url);
    dFree(entry->TypeDet);
    dFree(entry->TypeHdr);
@@ -341,8 +524,10 @@ static void Cache_entry_free(CacheEntry_t *entry, int deep)
    dStr_free(entry->Header, TRUE);
    a_Url_free((DilloUrl *)entry->Location);
    Cache_auth_free(entry->Auth);
+   dList_free(entry->Clients);
    dStr_free(entry->Data, 1);
    dStr_free(entry->UTF8Data, 1);
+   dStr_free(entry->DiskBody, 1);
    if (entry->CharsetDecoder)
       a_Decode_free(entry->CharsetDecoder);
    if (entry->TransferDecoder)
@@ -360,7 +545,6 @@ static void Cache_entry_free(CacheEntry_t *entry, int deep)
  */
 static void Cache_entry_remove(CacheEntry_t *entry, DilloUrl *url)
 {
-   int i;
    CacheClient_t *Client;
 
    if (!entry && !(entry = Cache_entry_search(url)))
@@ -369,12 +553,8 @@ static void Cache_entry_remove(CacheEntry_t *entry, DilloUrl *url)
       return;
 
    /* remove all clients for this entry */
-   for (i = 0; (Client = dList_nth_data(ClientQueue, i)); ++i) {
-      if (Client->Url == entry->Url) {
-         a_Cache_stop_client(Client->Key);
-         --i;
-      }
-   }
+   while ((Client = dList_nth_data(entry->Clients, 0)))
+      a_Cache_stop_client(Client->Key);
 
    /* remove from DelayedQueue */
    dList_remove(DelayedQueue, entry);
@@ -383,7 +563,7 @@ static void Cache_entry_remove(CacheEntry_t *entry, DilloUrl *url)
    a_Dicache_invalidate_entry(entry->Url);
 
    /* remove from cache */
-   dList_remove(CachedURLs, entry);
+   Cache_entry_unlink(entry);
    Cache_entry_free(entry, 1);
 }
 
@@ -395,11 +575,94 @@ void a_Cache_entry_remove_by_url(DilloUrl *url)
    Cache_entry_remove(NULL, url);
 }
 
+/**
+ * Whether an entry can be removed without disturbing anyone using it.
+ */
+static int Cache_entry_is_evictable(CacheEntry_t *entry)
+{
+   return !(entry->DataRefcount > 0 || entry->Pins > 0 ||
+            dList_length(entry->Clients) > 0 ||
+            (entry->Flags & (CA_InProgress | CA_InternalUrl)) ||
+            dList_find(DelayedQueue, entry));
+}
+
+static int Cache_entry_by_last_use_cmp(const void *v1, const void *v2)
+{
+   const CacheEntry_t *e1 = *(CacheEntry_t * const *)v1,
+                      *e2 = *(CacheEntry_t * const *)v2;
+
+   return (e1->LastUse > e2->LastUse) - (e1->LastUse < e2->LastUse);
+}
+
+/**
+ * Remove the least recently used entries until the cache fits in the
+ * "cache_max_size" budget. Entries that are in use are kept.
+ */
+static void Cache_evict(void)
+{
+   size_t budget, size;
+   CacheEntry_t *e, **victims;
+   int i, n = 0;
+
+   if (prefs.cache_max_size <= 0)
+      return;
+   budget = (size_t)prefs.cache_max_size * 1024 * 1024;
+   if (CacheSize <= budget)
+      return;
+
+   victims = dNew(CacheEntry_t *, dList_length(CachedURLs));
+   for (i = 0; (e = dList_nth_data(CachedURLs, i)); ++i)
+      if (Cache_entry_is_evictable(e))
+         victims[n++] = e;
+   qsort(victims, n, sizeof(*victims), Cache_entry_by_last_use_cmp);
+
+   for (i = 0; i < n && CacheSize > budget; ++i) {
+      size = victims[i]->Size;
+      _MSG("Cache_evict: %s (%zu bytes)\n", URL_STR(victims[i]->Url), size);
+      Cache_entry_remove(victims[i], NULL);
+      StatEvictions++;
+      StatEvictedBytes += size;
+   }
+   dFree(victims);
+}
+
+/**
+ * Callback function for Cache_queue_evict.
+ */
+static void Cache_evict_callback(void *data)
+{
+   (void) data;
+   a_Timeout_remove();
+   if (QueueBusy) {
+      /* called from a nested loop while processing the queue */
+      a_Timeout_add(0.1, Cache_evict_callback, NULL);
+      return;
+   }
+   EvictPending = FALSE;
+   Cache_evict();
+}
+
+/**
+ * Set a call to Cache_evict from the main cycle, when the cache is over
+ * its budget. Entries are not evicted right away, as the caller may be
+ * using one that has no clients left (e.g. a redirection opens the new
+ * URL from Cache_process_queue).
+ */
+static void Cache_queue_evict(void)
+{
+   if (!EvictPending && prefs.cache_max_size > 0 &&
+       CacheSize > (size_t)prefs.cache_max_size * 1024 * 1024) {
+      a_Timeout_add(0.0, Cache_evict_callback, NULL);
+      EvictPending = TRUE;
+   }
+}
+
 /* Misc. operations ------------------------------------------------------- */
 
 static Dstr *Cache_stats(void)
 {
    float totalKB = 0.0f;
+   size_t resident = 0;
 
    Dstr *s = dStr_new(
       "<!DOCTYPE HTML>\n"
@@ -408,6 +671,11 @@ static Dstr *Cache_stats(void)
       "<body>\n");
 
    int n = dList_length(CachedURLs);
+   CacheEntry_t **entries = dNew(CacheEntry_t *, n + 1);
+   for (int i = 0; i < n; i++)
+      entries[i] = dList_nth_data(CachedURLs, i);
+   qsort(entries, n, sizeof(*entries), Cache_entry_cmp);
+
    dStr_sprintfa(s, "<h1>Cached URLs (%d)</h1>\n", n);
 
    dStr_append(s, "<table>\n");
@@ -417,7 +685,7 @@ static Dstr *Cache_stats(void)
    dStr_append(s, "<th>URL</th>\n");
    dStr_append(s, "</tr>\n");
    for (int i = 0; i < n; i++) {
-      CacheEntry_t *e = dList_nth_data(CachedURLs, i);
+      CacheEntry_t *e = entries[i];
       float sizeKB = Cache_bufsize(e) / 1024.0f;
       const char *url = URL_STR(e->Url);
       dStr_append(s, "<tr>\n");
@@ -428,9 +696,20 @@ static Dstr *Cache_stats(void)
       dStr_append(s, "</a></td>\n");
       dStr_append(s, "</tr>\n");
       totalKB += sizeKB;
+      resident += Cache_entry_size(e);
    }
+   dFree(entries);
    dStr_append(s, "</table>\n");
    dStr_sprintfa(s, "<p>Total cached: %.2f MiB</p>\n", totalKB / 1024.0f);
+   dStr_sprintfa(s, "<p>Resident: %.2f MiB", resident / (1024.0f * 1024.0f));
+   if (prefs.cache_max_size > 0)
+      dStr_sprintfa(s, " of %d MiB", prefs.cache_max_size);
+   dStr_append(s, "</p>\n");
+   dStr_sprintfa(s, "<p>Evictions: %u (%.2f MiB)</p>\n", StatEvictions,
+                 StatEvictedBytes / (1024.0f * 1024.0f));
+   dStr_sprintfa(s, "<p>Hit ratio: %.1f%% (%u of %u requests)</p>\n",
+                 StatRequests ? 100.0f * StatHits / StatRequests : 0.0f,
+                 StatHits, StatRequests);
    dStr_append(s,
       "</body>\n"
       "</html>\n");
@@ -446,6 +725,8 @@ static int Cache_internal_url(CacheEntry_t *entry)
       s = Cache_stats();
    } else if (strcmp(URL_PATH(entry->Url), "dicache") == 0) {
       s = a_Dicache_stats();
+   } else if (strcmp(URL_PATH(entry->Url), "tls") == 0) {
+      s = a_Tls_stats();
    }
 
    if (s != NULL) {
@@ -488,27 +769,34 @@ int a_Cache_open_url(void *web, CA_Callback_t Call, void *CbData)
       Cache_entry_remove(NULL, Url);
    }
 
+   if (!isInternal)
+      StatRequests++;
+
    if ((entry = Cache_entry_search(Url))) {
       _MSG("serving cached entry: %s\n", URL_STR(Url));
       /* URL is cached: feed our client with cached data */
-      ClientKey = Cache_client_enqueue(entry->Url, Web, Call, CbData);
+      ClientKey = Cache_client_enqueue(entry, Web, Call, CbData);
       Cache_delayed_process_queue(entry);
       entry->Hits++;
+      entry->LastUse = ++UseCounter;
+      if (!isInternal)
+         StatHits++;
 
    } else {
       _MSG("serving new entry: %s\n", URL_STR(Url));
-      /* URL not cached: create an entry, send our client to the queue,
-       * and open a new connection */
+      /* URL not cached: make room, create an entry, send our client to the
+       * queue, and open a new connection */
+      Cache_queue_evict();
       entry = Cache_entry_add(Url);
 
       /* URL is an internal call, populate */
       if (isInternal) {
          _MSG("handling internal: %s\n", URL_STR(Url));
          Cache_internal_url(entry);
-         ClientKey = Cache_client_enqueue(entry->Url, Web, Call, CbData);
+         ClientKey = Cache_client_enqueue(entry, Web, Call, CbData);
          Cache_delayed_process_queue(entry);
       } else {
-         ClientKey = Cache_client_enqueue(entry->Url, Web, Call, CbData);
+         ClientKey = Cache_client_enqueue(entry, Web, Call, CbData);
       }
    }
 
@@ -547,6 +835,7 @@ static void Cache_ref_data(CacheEntry_t *entry)
          entry->UTF8Data = a_Decode_process(entry->CharsetDecoder,
                                             entry->Data->str,
                                             entry->Data->len);
+         Cache_entry_update_size(entry);
       }
    }
 }
@@ -564,6 +853,7 @@ static void Cache_unref_data(CacheEntry_t *entry)
          if (entry->DataRefcount == 0) {
             dStr_free(entry->UTF8Data, 1);
             entry->UTF8Data = NULL;
+            Cache_entry_update_size(entry);
          } else if (entry->DataRefcount < 0) {
             MSG_ERR("Cache_unref_data: negative refcount\n");
             entry->DataRefcount = 0;
@@ -653,6 +943,8 @@ const char *a_Cache_set_content_type(const DilloUrl *url, const char *ctype,
             /* Invalidate UTF8Data */
             dStr_free(entry->UTF8Data, 1);
             entry->UTF8Data = NULL;
+            entry->Version = ++LastVersion;
+            Cache_entry_update_size(entry);
          }
          dFree(major); dFree(minor); dFree(charset);
       }
@@ -669,6 +961,7 @@ int a_Cache_get_buf(const DilloUrl *Url, char **PBuf, int *BufSize)
    CacheEntry_t *entry = Cache_entry_search_with_redirect(Url);
    if (entry) {
       Dstr *data;
+      entry->LastUse = ++UseCounter;
       Cache_ref_data(entry);
       data = Cache_data(entry);
       *PBuf = data->str;
@@ -680,6 +973,17 @@ int a_Cache_get_buf(const DilloUrl *Url, char **PBuf, int *BufSize)
    return (entry ? 1 : 0);
 }
 
+/**
+ * Get the version of the URL's data. Any change to the data, including
+ * a reload, gives a version that has not been used before.
+ * @return the version, or 0 if not cached.
+ */
+uint_t a_Cache_get_version(const DilloUrl *Url)
+{
+   CacheEntry_t *entry = Cache_entry_search_with_redirect(Url);
+   return (entry ? entry->Version : 0);
+}
+
 Dstr *a_Cache_get_header(const DilloUrl *Url)
 {
    CacheEntry_t *entry = Cache_entry_search_with_redirect(Url);
@@ -697,6 +1001,28 @@ void a_Cache_unref_buf(const DilloUrl *Url)
    Cache_unref_data(Cache_entry_search_with_redirect(Url));
 }
 
+/**
+ * Keep the data of the URL at 'Version' from being evicted, as it is
+ * needed later (e.g. to decode an image again). Undone by a_Cache_unpin().
+ */
+void a_Cache_pin(const DilloUrl *Url, uint_t Version)
+{
+   CacheEntry_t *entry = Cache_entry_search_with_redirect(Url);
+   if (entry && entry->Version == Version)
+      entry->Pins++;
+}
+
+/**
+ * Let the data of the URL at 'Version' be evicted again.
+ * (Nothing to do if it was replaced or removed meanwhile)
+ */
+void a_Cache_unpin(const DilloUrl *Url, uint_t Version)
+{
+   CacheEntry_t *entry = Cache_entry_search_with_redirect(Url);
+   if (entry && entry->Version == Version && entry->Pins > 0)
+      entry->Pins--;
+}
+
 
 /**
  * Extract a single field from the header, allocating and storing the value
@@ -777,6 +1103,237 @@ static Dlist *Cache_parse_multiple_fields(const char *header,
    return fields;
 }
 
+/**
+ * Parse the Cache-Control field of 'header'.
+ * @return The max-age in seconds, or -1 if the response has to be
+ *         validated before each use. 'no_store' is set if it must not be
+ *         stored at all.
+ */
+static long Cache_parse_cache_control(const char *header, bool_t *no_store)
+{
+   char *field, *p;
+   bool_t no_cache = FALSE;
+   long max_age = -1;
+
+   *no_store = FALSE;
+   if ((field = Cache_parse_field(header, "Cache-Control"))) {
+      for (p = field; *p; p += strcspn(p, ",")) {
+         p += strspn(p, " \t,");
+         if (!dStrnAsciiCasecmp(p, "no-store", 8))
+            *no_store = TRUE;
+         else if (!dStrnAsciiCasecmp(p, "no-cache", 8))
+            no_cache = TRUE;
+         else if (!dStrnAsciiCasecmp(p, "max-age=", 8))
+            max_age = strtol(p + 8, NULL, 10);
+      }
+      dFree(field);
+   }
+   return no_cache ? -1 : max_age;
+}
+
+/**
+ * Whether the response to 'url' may be kept in the disk cache.
+ * Only plain GET requests over HTTP are stored.
+ */
+static bool_t Cache_disk_usable(const DilloUrl *url)
+{
+   return prefs.disk_cache && !(URL_FLAGS(url) & URL_Post) &&
+          (!dStrAsciiCasecmp(URL_SCHEME(url), "http") ||
+           !dStrAsciiCasecmp(URL_SCHEME(url), "https"));
+}
+
+/**
+ * Whether the header field in 'line' is dropped from stored answers.
+ * The body is stored decoded, so the fields that describe the transfer
+ * are dropped, and so are the ones that must not be replayed.
+ */
+static bool_t Cache_disk_skip_field(const char *line)
+{
+   static const char *const skip[] = {
+      "Connection:", "Keep-Alive:", "Content-Length:", "Content-Encoding:",
+      "Transfer-Encoding:", "Set-Cookie:", "Strict-Transport-Security:"
+   };
+   uint_t i;
+
+   for (i = 0; i < sizeof(skip) / sizeof(skip[0]); i++)
+      if (!dStrnAsciiCasecmp(line, skip[i], strlen(skip[i])))
+         return TRUE;
+   return FALSE;
+}
+
+/**
+ * Whether the answer in 'header' depends on request fields other than
+ * Accept-Encoding (the body is stored decoded). Such answers are not kept
+ * in the disk cache, since the request fields are not stored with them.
+ */
+static bool_t Cache_disk_varies(const char *header)
+{
+   Dlist *fields = Cache_parse_multiple_fields(header, "Vary");
+   char *field, *p, *tok;
+   bool_t varies = FALSE;
+   int i;
+
+   for (i = 0; (field = dList_nth_data(fields, i)); i++) {
+      for (p = field; (tok = dStrsep(&p, ",")); )
+         if (*(tok = dStrstrip(tok)) &&
+             dStrAsciiCasecmp(tok, "Accept-Encoding"))
+            varies = TRUE;
+      dFree(field);
+   }
+   dList_free(fields);
+   return varies;
+}
+
+/**
+ * Save a complete "200 OK" answer in the disk cache, if it can be
+ * validated later (it has an ETag, a Last-Modified date or a max-age).
+ */
+static void Cache_disk_store(CacheEntry_t *entry)
+{
+   const char *header = entry->Header->str, *line, *end;
+   char *etag, *modified;
+   bool_t no_store;
+   long max_age;
+   Dstr *ds;
+
+   if (!Cache_disk_usable(entry->Url) || entry->Header->len <= 12 ||
+       strncmp(header + 9, "200", 3) ||
+       (entry->Flags & (CA_Aborted | CA_HugeFile)) ||
+       ((entry->Flags & CA_GotLength) &&
+        entry->ExpectedSize != entry->TransferSize))
+      return;
+
+   max_age = Cache_parse_cache_control(header, &no_store);
+   etag = Cache_parse_field(header, "ETag");
+   modified = Cache_parse_field(header, "Last-Modified");
+   if (no_store || (!etag && !modified && max_age <= 0) ||
+       Cache_disk_varies(header)) {
+      /* don't keep an older copy around */
+      a_Diskcache_remove(entry->Url);
+   } else {
+      ds = dStr_sized_new(entry->Header->len);
+      for (line = header; *line != '\n' && (end = strchr(line, '\n'));
+           line = end + 1) {
+         if (!Cache_disk_skip_field(line))
+            dStr_append_l(ds, line, end - line + 1);
+      }
+      dStr_sprintfa(ds, "Content-Length: %d\n\n", entry->Data->len);
+      a_Diskcache_store(entry->Url, ds, entry->Data);
+      dStr_free(ds, 1);
+   }
+   dFree(etag);
+   dFree(modified);
+}
+
+/**
+ * Return the conditional request fields for 'url' when there is a copy
+ * of it in the disk cache, or NULL.
+ */
+char *a_Cache_disk_validators(const DilloUrl *url)
+{
+   Dstr *header, *ds;
+   char *etag, *modified, *ret;
+   time_t stored;
+
+   if (!Cache_disk_usable(url) || (URL_FLAGS(url) & URL_E2EQuery) ||
+       !a_Diskcache_load(url, &header, NULL, &stored))
+      return NULL;
+   if (Cache_disk_varies(header->str)) {
+      /* stored before such answers were skipped */
+      dStr_free(header, 1);
+      return NULL;
+   }
+
+   ds = dStr_new("");
+   if ((etag = Cache_parse_field(header->str, "ETag")))
+      dStr_sprintfa(ds, "If-None-Match: %s\r\n", etag);
+   if ((modified = Cache_parse_field(header->str, "Last-Modified")))
+      dStr_sprintfa(ds, "If-Modified-Since: %s\r\n", modified);
+   ret = ds->len ? dStrdup(ds->str) : NULL;
+   dFree(etag);
+   dFree(modified);
+   dStr_free(ds, 1);
+   dStr_free(header, 1);
+   return ret;
+}
+
+/**
+ * Whether 'header' has a field after its status line, which is not
+ * dropped from stored answers, with the name of the field in the line
+ * from 'line' to 'end'.
+ */
+static bool_t Cache_disk_has_field(const char *header, const char *line,
+                                   const char *end)
+{
+   const char *colon = memchr(line, ':', end - line), *l;
+
+   if (!colon)
+      return FALSE;
+   for (l = strchr(header, '\n'); l && l[1] && l[1] != '\n';
+        l = strchr(l + 1, '\n'))
+      if (!dStrnAsciiCasecmp(l + 1, line, colon - line + 1) &&
+          !Cache_disk_skip_field(l + 1))
+         return TRUE;
+   return FALSE;
+}
+
+/**
+ * Return the stored header 'stored' updated with the fields of the
+ * "304 Not Modified" header 'update' (a new Cache-Control, ETag,
+ * Expires...). Both must end in an empty line.
+ */
+static Dstr *Cache_disk_merge_header(const char *stored, const char *update)
+{
+   Dstr *ds = dStr_sized_new(strlen(stored) + strlen(update));
+   const char *line, *end;
+
+   /* the status line, and the fields that are not updated */
+   for (line = stored; *line != '\n' && (end = strchr(line, '\n'));
+        line = end + 1) {
+      if (line == stored || !Cache_disk_has_field(update, line, end))
+         dStr_append_l(ds, line, end - line + 1);
+   }
+   for (line = strchr(update, '\n'); line && line[1] != '\n' &&
+        (end = strchr(line + 1, '\n')); line = end) {
+      if (!Cache_disk_skip_field(line + 1))
+         dStr_append_l(ds, line + 1, end - line);
+   }
+   dStr_append_c(ds, '\n');
+   return ds;
+}
+
+/**
+ * Handle a "304 Not Modified" answer by taking the header and the body
+ * from the disk cache. The stored header is updated with the fields of
+ * the answer.
+ * @return TRUE if there was a stored copy.
+ */
+static bool_t Cache_disk_revalidate(CacheEntry_t *entry)
+{
+   Dstr *header, *body;
+   time_t stored;
+   bool_t no_store;
+
+   if (!Cache_disk_usable(entry->Url) ||
+       !a_Diskcache_load(entry->Url, &header, &body, &stored))
+      return FALSE;
+
+   _MSG("Cache: %s not modified, using the stored copy\n",
+        URL_STR(entry->Url));
+   dStr_free(entry->Header, 1);
+   entry->Header = Cache_disk_merge_header(header->str, entry->Header->str);
+   dStr_free(header, 1);
+   entry->DiskBody = body;
+   entry->FromDisk = TRUE;
+
+   Cache_parse_cache_control(entry->Header->str, &no_store);
+   if (no_store || Cache_disk_varies(entry->Header->str))
+      a_Diskcache_remove(entry->Url);
+   else
+      a_Diskcache_store(entry->Url, entry->Header, body);
+   return TRUE;
+}
+
 /**
  * Scan, allocate, and set things according to header info.
  * (This function needs the whole header to work)
@@ -853,6 +1410,12 @@ static void Cache_parse_header(CacheEntry_t *entry)
       dFree(connection);
    }
 
+   if (entry->Header->len > 12 && strncmp(header + 9, "304", 3) == 0 &&
+       Cache_disk_revalidate(entry)) {
+      /* the rest of the fields describe the stored answer */
+      header = entry->Header->str;
+   }
+
    if (prefs.http_strict_transport_security &&
        !dStrAsciiCasecmp(URL_SCHEME(entry->Url), "https") &&
        a_Url_host_type(URL_HOST(entry->Url)) == URL_HOST_NAME &&
@@ -890,31 +1453,29 @@ static void Cache_parse_header(CacheEntry_t *entry)
    if ((Cookies = Cache_parse_multiple_fields(header, "Set-Cookie"))) {
       CacheClient_t *client;
 
-      for (i = 0; (client = dList_nth_data(ClientQueue, i)); ++i) {
-         if (client->Url == entry->Url) {
-            DilloWeb *web = client->Web;
-
-            /* Only set cookies if any of:
-             * - User made request (requester == NULL)
-             * - Is a redirect for the root url (safe)
-             * - Same organization (first party cookie)
-             *
-             * Always block third party cookies from images or css files which
-             * are commonly used to track users (those that don't have the
-             * WEB_RootUrl flag and come from a different organization).
-             * https://en.wikipedia.org/wiki/Third-party_cookies
-             * https://support.mozilla.org/en-US/kb/third-party-trackers
-             */
-            int safe_redirect =
-               entry->Flags & CA_Redirect && web->flags & WEB_RootUrl;
-
-            if (!web->requester || safe_redirect ||
-                a_Url_same_organization(entry->Url, web->requester)) {
-               char *server_date = Cache_parse_field(header, "Date");
-               a_Cookies_set(Cookies, entry->Url, server_date);
-               dFree(server_date);
-               break;
-            }
+      for (i = 0; (client = dList_nth_data(entry->Clients, i)); ++i) {
+         DilloWeb *web = client->Web;
+
+         /* Only set cookies if any of:
+          * - User made request (requester == NULL)
+          * - Is a redirect for the root url (safe)
+          * - Same organization (first party cookie)
+          *
+          * Always block third party cookies from images or css files which
+          * are commonly used to track users (those that don't have the
+          * WEB_RootUrl flag and come from a different organization).
+          * https://en.wikipedia.org/wiki/Third-party_cookies
+          * https://support.mozilla.org/en-US/kb/third-party-trackers
+          */
+         int safe_redirect =
+            entry->Flags & CA_Redirect && web->flags & WEB_RootUrl;
+
+         if (!web->requester || safe_redirect ||
+             a_Url_same_organization(entry->Url, web->requester)) {
+            char *server_date = Cache_parse_field(header, "Date");
+            a_Cookies_set(Cookies, entry->Url, server_date);
+            dFree(server_date);
+            break;
          }
       }
       for (i = 0; (data = dList_nth_data(Cookies, i)); ++i)
@@ -1021,6 +1582,10 @@ static void Cache_finish_msg(CacheEntry_t *entry)
       entry->ContentDecoder = NULL;
    }
    dStr_fit(entry->Data);                /* fit buffer size! */
+   Cache_entry_update_size(entry);
+
+   if (!entry->FromDisk)
+      Cache_disk_store(entry);
 
    if ((entry = Cache_process_queue(entry))) {
       if (entry->Flags & CA_GotHeader) {
@@ -1036,11 +1601,14 @@ static void Cache_finish_msg(CacheEntry_t *entry)
  * This function gets called whenever the IO has new data.
  *  'Op' is the operation to perform
  *  'VPtr' is a (void) pointer to the IO control structure
+ * When the reply is complete (TRUE is returned) and 'excess' is not NULL,
+ * it is set to the number of bytes at the end of 'buf' that come after
+ * the reply, or to -1 if where the reply ends is not known.
  */
 bool_t a_Cache_process_dbuf(int Op, const char *buf, size_t buf_size,
-                            const DilloUrl *Url)
+                            const DilloUrl *Url, int *excess)
 {
-   int offset, len;
+   int offset, len, rest = 0;
    const char *str;
    Dstr *dstr1, *dstr2, *dstr3;
    bool_t done = FALSE;
@@ -1066,6 +1634,18 @@ bool_t a_Cache_process_dbuf(int Op, const char *buf, size_t buf_size,
       if (entry->Flags & CA_GotHeader) {
          str = buf + offset;
          len = buf_size - offset;
+         if (entry->DiskBody) {
+            /* 304 Not Modified: the body is the stored one */
+            rest = len;
+            str = entry->DiskBody->str;
+            len = entry->DiskBody->len;
+         } else if (!entry->TransferDecoder &&
+                    (entry->Flags & CA_GotLength) &&
+                    entry->TransferSize + len > entry->ExpectedSize) {
+            /* the rest is the next reply on a persistent connection */
+            rest = entry->TransferSize + len - entry->ExpectedSize;
+            len -= rest;
+         }
          entry->TransferSize += len;
          dstr1 = dstr2 = dstr3 = NULL;
 
@@ -1073,6 +1653,8 @@ bool_t a_Cache_process_dbuf(int Op, const char *buf, size_t buf_size,
          if (entry->TransferDecoder) {
             dstr1 = a_Decode_transfer_process(entry->TransferDecoder, str,len);
             done = a_Decode_transfer_finished(entry->TransferDecoder);
+            if (done)
+               rest = a_Decode_transfer_excess(entry->TransferDecoder);
             str = dstr1->str;
             len = dstr1->len;
          }
@@ -1089,6 +1671,9 @@ bool_t a_Cache_process_dbuf(int Op, const char *buf, size_t buf_size,
          dStr_free(dstr1, 1);
          dStr_free(dstr2, 1);
          dStr_free(dstr3, 1);
+         dStr_free(entry->DiskBody, 1);
+         entry->DiskBody = NULL;
+         Cache_entry_update_size(entry);
 
          if (entry->Data->len)
             entry->Flags &= ~CA_IsEmpty;
@@ -1107,6 +1692,8 @@ bool_t a_Cache_process_dbuf(int Op, const char *buf, size_t buf_size,
          if (entry && done)
             Cache_finish_msg(entry);
       }
+      if (excess)
+         *excess = done ? rest : 0;
    } else if (Op == IOClose) {
       Cache_finish_msg(entry);
    } else if (Op == IOAbort) {
@@ -1118,20 +1705,59 @@ bool_t a_Cache_process_dbuf(int Op, const char *buf, size_t buf_size,
          int i;
          CacheClient_t *Client;
 
-         for (i = 0; (Client = dList_nth_data(ClientQueue, i)); ++i) {
-            if (Client->Url == entry->Url) {
-               DilloWeb *web = (DilloWeb *)Client->Web;
+         for (i = 0; (Client = dList_nth_data(entry->Clients, i)); ++i) {
+            DilloWeb *web = (DilloWeb *)Client->Web;
 
-               a_Bw_remove_client(web->bw, Client->Key);
-               Cache_client_dequeue(Client);
-               --i; /* Keep the index value in the next iteration */
-            }
+            a_Bw_remove_client(web->bw, Client->Key);
+            Cache_client_dequeue(Client);
+            --i; /* Keep the index value in the next iteration */
          }
       }
    }
    return done;
 }
 
+/**
+ * Load a fresh copy of 'url' from the disk cache, as if it had just been
+ * received, so it can be served without asking the server.
+ * @return TRUE if the copy was loaded.
+ */
+bool_t a_Cache_disk_load(const DilloUrl *url)
+{
+   Dstr *header, *body;
+   CacheEntry_t *entry;
+   time_t stored, now = time(NULL);
+   bool_t no_store;
+   long max_age;
+
+   if (!Cache_disk_usable(url) || (URL_FLAGS(url) & URL_E2EQuery) ||
+       Cache_entry_search(url) ||
+       !a_Diskcache_load(url, &header, &body, &stored))
+      return FALSE;
+
+   max_age = Cache_parse_cache_control(header->str, &no_store);
+   if (no_store || max_age <= 0 || now - MIN(stored, now) >= max_age ||
+       Cache_disk_varies(header->str)) {
+      dStr_free(header, 1);
+      dStr_free(body, 1);
+      return FALSE;
+   }
+
+   _MSG("Cache: serving %s from disk\n", URL_STR(url));
+   Cache_queue_evict();
+   entry = Cache_entry_add(url);
+   entry->FromDisk = TRUE;
+   dStr_append_l(header, body->str, body->len);
+   a_Cache_process_dbuf(IORead, header->str, header->len, url, NULL);
+   /* there is no connection to close it */
+   if ((entry = Cache_entry_search(url)))
+      Cache_finish_msg(entry);
+
+   dStr_free(header, 1);
+   dStr_free(body, 1);
+   return TRUE;
+}
+
 /**
  * Process redirections (HTTP 30x answers)
  * (This is a work in progress --not finished yet)
@@ -1324,14 +1950,13 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
    CacheClient_t *Client;
    DilloWeb *ClientWeb;
    BrowserWindow *Client_bw = NULL;
-   static bool_t Busy = FALSE;
    bool_t AbortEntry = FALSE;
    bool_t OfferDownload = FALSE;
    bool_t TypeMismatch = FALSE;
    char *dtype = NULL;
    char *dfilename = NULL;
 
-   if (Busy)
+   if (QueueBusy)
       MSG_ERR("FATAL!: >>>> Cache_process_queue Caught busy!!! <<<<\n");
    if (!(entry->Flags & CA_GotHeader))
       return entry;
@@ -1351,130 +1976,129 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
          return entry;  /* i.e., wait for more data */
    }
 
-   Busy = TRUE;
-   for (i = 0; (Client = dList_nth_data(ClientQueue, i)); ++i) {
-      if (Client->Url == entry->Url) {
-         ClientWeb = Client->Web;    /* It was a (void*) */
-         Client_bw = ClientWeb->bw;  /* 'bw' in a local var */
+   QueueBusy = TRUE;
+   for (i = 0; (Client = dList_nth_data(entry->Clients, i)); ++i) {
+      ClientWeb = Client->Web;    /* It was a (void*) */
+      Client_bw = ClientWeb->bw;  /* 'bw' in a local var */
 
-         if (ClientWeb->flags & WEB_RootUrl) {
-            /* Only parse Content-Disposition on root URLs */
-            if (entry->ContentDisposition) {
-               a_Misc_parse_content_disposition(entry->ContentDisposition,
-                     &dtype, &dfilename);
-            }
-            if (!(entry->Flags & CA_MsgErased)) {
-               /* clear the "expecting for reply..." message */
-               a_UIcmd_set_msg(Client_bw, "");
-               entry->Flags |= CA_MsgErased;
-            }
-            if (TypeMismatch) {
-               a_UIcmd_set_msg(Client_bw,"HTTP warning: Content-Type '%s' "
-                               "doesn't match the real data.", entry->TypeHdr);
-               OfferDownload = TRUE;
-            }
-            if (entry->Flags & CA_Redirect) {
-               if (!Client->Callback) {
-                  Client->Callback = Cache_null_client;
-                  Client_bw->redirect_level++;
-               }
-            } else {
-               Client_bw->redirect_level = 0;
-            }
-            if (entry->Flags & CA_HugeFile) {
-               a_UIcmd_set_msg(Client_bw, "Huge file! (%d MB)",
-                               entry->ExpectedSize / (1024*1024));
-               AbortEntry = OfferDownload = TRUE;
+      if (ClientWeb->flags & WEB_RootUrl) {
+         /* Only parse Content-Disposition on root URLs */
+         if (entry->ContentDisposition) {
+            a_Misc_parse_content_disposition(entry->ContentDisposition,
+                  &dtype, &dfilename);
+         }
+         if (!(entry->Flags & CA_MsgErased)) {
+            /* clear the "expecting for reply..." message */
+            a_UIcmd_set_msg(Client_bw, "");
+            entry->Flags |= CA_MsgErased;
+         }
+         if (TypeMismatch) {
+            a_UIcmd_set_msg(Client_bw,"HTTP warning: Content-Type '%s' "
+                            "doesn't match the real data.", entry->TypeHdr);
+            OfferDownload = TRUE;
+         }
+         if (entry->Flags & CA_Redirect) {
+            if (!Client->Callback) {
+               Client->Callback = Cache_null_client;
+               Client_bw->redirect_level++;
             }
          } else {
-            /* For non root URLs, ignore redirections and 404 answers */
-            if (entry->Flags & CA_Redirect || entry->Flags & CA_NotFound)
-               Client->Callback = Cache_null_client;
+            Client_bw->redirect_level = 0;
          }
-
-         /* Set the client function */
-         if (!Client->Callback) {
+         if (entry->Flags & CA_HugeFile) {
+            a_UIcmd_set_msg(Client_bw, "Huge file! (%d MB)",
+                            entry->ExpectedSize / (1024*1024));
+            AbortEntry = OfferDownload = TRUE;
+         }
+      } else {
+         /* For non root URLs, ignore redirections and 404 answers */
+         if (entry->Flags & CA_Redirect || entry->Flags & CA_NotFound)
             Client->Callback = Cache_null_client;
+      }
 
-            if (entry->Location && !(entry->Flags & CA_Redirect)) {
-               /* Not following redirection, so don't display page body. */
+      /* Set the client function */
+      if (!Client->Callback) {
+         Client->Callback = Cache_null_client;
+
+         if (entry->Location && !(entry->Flags & CA_Redirect)) {
+            /* Not following redirection, so don't display page body. */
+         } else {
+            if (TypeMismatch) {
+               AbortEntry = TRUE;
             } else {
-               if (TypeMismatch) {
-                  AbortEntry = TRUE;
-               } else {
-                  const char *curr_type = Cache_current_content_type(entry);
-                  st = a_Web_dispatch_by_type(curr_type, ClientWeb,
-                                              &Client->Callback,
-                                              &Client->CbData);
-                  if (st == -1) {
-                     /* MIME type is not viewable */
-                     if (ClientWeb->flags & WEB_RootUrl) {
-                        MSG("Content-Type '%s' not viewable.\n", curr_type);
-                        /* prepare a download offer... */
-                        AbortEntry = OfferDownload = TRUE;
-                     } else {
-                        /* TODO: Resource Type not handled.
-                         * Not aborted to avoid multiple connections on the
-                         * same resource. A better idea is to abort the
-                         * connection and to keep a failed-resource flag in
-                         * the cache entry. */
-                     }
-                  } else if (dtype && dStrnAsciiCasecmp(dtype, "inline", 6) != 0) {
+               const char *curr_type = Cache_current_content_type(entry);
+               st = a_Web_dispatch_by_type(curr_type, ClientWeb,
+                                           &Client->Callback,
+                                           &Client->CbData);
+               if (st == -1) {
+                  /* MIME type is not viewable */
+                  if (ClientWeb->flags & WEB_RootUrl) {
+                     MSG("Content-Type '%s' not viewable.\n", curr_type);
+                     /* prepare a download offer... */
                      AbortEntry = OfferDownload = TRUE;
+                  } else {
+                     /* TODO: Resource Type not handled.
+                      * Not aborted to avoid multiple connections on the
+                      * same resource. A better idea is to abort the
+                      * connection and to keep a failed-resource flag in
+                      * the cache entry. */
                   }
+               } else if (dtype &&
+                          dStrnAsciiCasecmp(dtype, "inline", 6) != 0) {
+                  AbortEntry = OfferDownload = TRUE;
                }
-               if (AbortEntry) {
-                  if (ClientWeb->flags & WEB_RootUrl)
-                     a_Nav_cancel_expect_if_eq(Client_bw, Client->Url);
-                  a_Bw_remove_client(Client_bw, Client->Key);
-                  Cache_client_dequeue(Client);
-                  --i; /* Keep the index value in the next iteration */
-                  continue;
-               }
+            }
+            if (AbortEntry) {
+               if (ClientWeb->flags & WEB_RootUrl)
+                  a_Nav_cancel_expect_if_eq(Client_bw, Client->Url);
+               a_Bw_remove_client(Client_bw, Client->Key);
+               Cache_client_dequeue(Client);
+               --i; /* Keep the index value in the next iteration */
+               continue;
             }
          }
+      }
 
-         /* Send data to our client */
-         if (ClientWeb->flags & WEB_Download) {
-            /* for download, always provide original data, not translated */
-            data = entry->Data;
-         } else {
-            data = Cache_data(entry);
-         }
-         if ((Client->BufSize = data->len) > 0) {
-            Client->Buf = data->str;
-            (Client->Callback)(CA_Send, Client);
-            if (ClientWeb->flags & WEB_RootUrl) {
-               /* show size of page received */
-               a_UIcmd_set_page_prog(Client_bw, entry->Data->len, 1);
-            }
+      /* Send data to our client */
+      if (ClientWeb->flags & WEB_Download) {
+         /* for download, always provide original data, not translated */
+         data = entry->Data;
+      } else {
+         data = Cache_data(entry);
+      }
+      if ((Client->BufSize = data->len) > 0) {
+         Client->Buf = data->str;
+         (Client->Callback)(CA_Send, Client);
+         if (ClientWeb->flags & WEB_RootUrl) {
+            /* show size of page received */
+            a_UIcmd_set_page_prog(Client_bw, entry->Data->len, 1);
          }
+      }
 
-         /* Remove client when done */
-         if (!(entry->Flags & CA_InProgress)) {
-            /* Copy flags to a local var */
-            int flags = ClientWeb->flags;
+      /* Remove client when done */
+      if (!(entry->Flags & CA_InProgress) && !Client->Busy) {
+         /* Copy flags to a local var */
+         int flags = ClientWeb->flags;
 
-            if (ClientWeb->flags & WEB_RootUrl && entry->Location &&
-                !(entry->Flags & CA_Redirect)) {
-               Cache_provide_redirection_blocked_page(entry, Client);
-            }
-            /* We finished sending data, let the client know */
-            (Client->Callback)(CA_Close, Client);
-            if (ClientWeb->flags & WEB_RootUrl) {
-               if (entry->Flags & CA_Aborted) {
-                  a_UIcmd_set_msg(Client_bw, "ERROR: Connection closed early, "
-                                             "read not complete.");
-               }
-               a_UIcmd_set_page_prog(Client_bw, 0, 0);
+         if (ClientWeb->flags & WEB_RootUrl && entry->Location &&
+             !(entry->Flags & CA_Redirect)) {
+            Cache_provide_redirection_blocked_page(entry, Client);
+         }
+         /* We finished sending data, let the client know */
+         (Client->Callback)(CA_Close, Client);
+         if (ClientWeb->flags & WEB_RootUrl) {
+            if (entry->Flags & CA_Aborted) {
+               a_UIcmd_set_msg(Client_bw, "ERROR: Connection closed early, "
+                                          "read not complete.");
             }
-            Cache_client_dequeue(Client);
-            --i; /* Keep the index value in the next iteration */
-
-            /* we assert just one redirect call */
-            if (entry->Flags & CA_Redirect)
-               Cache_redirect(entry, flags, Client_bw);
+            a_UIcmd_set_page_prog(Client_bw, 0, 0);
          }
+         Cache_client_dequeue(Client);
+         --i; /* Keep the index value in the next iteration */
+
+         /* we assert just one redirect call */
+         if (entry->Flags & CA_Redirect)
+            Cache_redirect(entry, flags, Client_bw);
       }
    } /* for */
 
@@ -1502,12 +2126,12 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
    dFree(dtype); dFree(dfilename);
 
    /* Trigger cleanup when there are no cache clients */
-   if (dList_length(ClientQueue) == 0) {
+   if (NumClients == 0) {
       a_Dicache_cleanup();
    }
 
-   Busy = FALSE;
-   _MSG("QueueSize ====> %d\n", dList_length(ClientQueue));
+   QueueBusy = FALSE;
+   _MSG("QueueSize ====> %d\n", NumClients);
    return entry;
 }
 
@@ -1546,6 +2170,19 @@ static void Cache_delayed_process_queue(CacheEntry_t *entry)
    }
 }
 
+/**
+ * Send the data of 'Url' to its clients again, from the main loop.
+ * For clients that process it in the background (they may have news, or
+ * be done and waiting to be closed).
+ */
+void a_Cache_process_url(const DilloUrl *Url)
+{
+   CacheEntry_t *entry = Cache_entry_search(Url);
+
+   if (entry)
+      Cache_delayed_process_queue(entry);
+}
+
 /**
  * Last Client for this entry?
  * @return Client if true, NULL otherwise
@@ -1553,18 +2190,14 @@ static void Cache_delayed_process_queue(CacheEntry_t *entry)
  */
 CacheClient_t *a_Cache_client_get_if_unique(int Key)
 {
-   int i, n = 0;
-   CacheClient_t *Client, *iClient;
+   CacheClient_t *Client;
+   CacheEntry_t *entry;
 
-   if ((Client = dList_find_custom(ClientQueue, INT2VOIDP(Key),
-                                   Cache_client_by_key_cmp))) {
-      for (i = 0; (iClient = dList_nth_data(ClientQueue, i)); ++i) {
-         if (iClient->Url == Client->Url) {
-            ++n;
-         }
-      }
-   }
-   return (n == 1) ? Client : NULL;
+   if ((Client = Cache_client_find(Key)) &&
+       (entry = Cache_entry_search(Client->Url)) &&
+       entry->Url == Client->Url && dList_length(entry->Clients) == 1)
+      return Client;
+   return NULL;
 }
 
 /**
@@ -1578,8 +2211,7 @@ void a_Cache_stop_client(int Key)
    DICacheEntry *DicEntry;
 
    /* The client can be in both queues at the same time */
-   if ((Client = dList_find_custom(ClientQueue, INT2VOIDP(Key),
-                                   Cache_client_by_key_cmp))) {
+   if ((Client = Cache_client_find(Key))) {
       /* Dicache */
       if ((DicEntry = a_Dicache_get_entry(Client->Url, Client->Version)))
          a_Dicache_unref(Client->Url, Client->Version);
@@ -1604,10 +2236,12 @@ void a_Cache_freeall(void)
 {
    CacheClient_t *Client;
    void *data;
+   int i;
 
    /* free the client queue */
-   while ((Client = dList_nth_data(ClientQueue, 0)))
-      Cache_client_dequeue(Client);
+   for (i = 0; i < ClientIndexSize; i++)
+      while ((Client = ClientIndex[i]))
+         Cache_client_dequeue(Client);
 
    /* Remove every cache entry */
    while ((data = dList_nth_data(CachedURLs, 0))) {
@@ -1616,4 +2250,7 @@ void a_Cache_freeall(void)
    }
    /* Remove the cache list */
    dList_free(CachedURLs);
+   dFree(CacheIndex);
+   dFree(ClientIndex);
+   a_Diskcache_freeall();
 }
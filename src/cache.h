@@ -66,6 +66,8 @@ struct CacheClient {
    CA_Callback_t Callback;  /**< Client function */
    void *CbData;            /**< Client function data */
    void *Web;               /**< Pointer to the Web structure of our client */
+   CacheClient_t *HashNext; /**< Next client in the same cache index slot */
+   bool_t Busy;             /**< Still processing the data; don't close it */
 };
 
 /*
@@ -76,6 +78,9 @@ void a_Cache_entry_inject(const DilloUrl *Url, const char *buf, size_t len, int
 int a_Cache_open_url(void *Web, CA_Callback_t Call, void *CbData);
 int a_Cache_get_buf(const DilloUrl *Url, char **PBuf, int *BufSize);
 void a_Cache_unref_buf(const DilloUrl *Url);
+void a_Cache_pin(const DilloUrl *Url, uint_t Version);
+void a_Cache_unpin(const DilloUrl *Url, uint_t Version);
+uint_t a_Cache_get_version(const DilloUrl *Url);
 Dstr *a_Cache_get_header(const DilloUrl *Url);
 const char *a_Cache_get_content_type(const DilloUrl *url);
 const char *a_Cache_set_content_type(const DilloUrl *url, const char *ctype,
@@ -83,12 +88,15 @@ const char *a_Cache_set_content_type(const DilloUrl *url, const char *ctype,
 uint_t a_Cache_get_flags(const DilloUrl *url);
 uint_t a_Cache_get_flags_with_redirection(const DilloUrl *url);
 bool_t a_Cache_process_dbuf(int Op, const char *buf, size_t buf_size,
-                          const DilloUrl *Url);
+                            const DilloUrl *Url, int *excess);
 int a_Cache_download_enabled(const DilloUrl *url);
 void a_Cache_entry_remove_by_url(DilloUrl *url);
+bool_t a_Cache_disk_load(const DilloUrl *url);
+char *a_Cache_disk_validators(const DilloUrl *url);
 void a_Cache_freeall(void);
 CacheClient_t *a_Cache_client_get_if_unique(int Key);
 void a_Cache_stop_client(int Key);
+void a_Cache_process_url(const DilloUrl *Url);
 
 
 #ifdef __cplusplus
@@ -467,6 +467,10 @@ int a_Capi_open_url(DilloWeb *web, CA_Callback_t Call, void *CbData)
             return 0;
          }
 #endif
+         if (reload && a_Cache_disk_load(web->url)) {
+            /* a fresh copy was in the disk cache */
+            reload = 0;
+         }
          if (reload) {
             a_Capi_conn_abort_by_url(web->url);
             /* create a new connection and start the CCC operations */
@@ -495,6 +499,30 @@ int a_Capi_open_url(DilloWeb *web, CA_Callback_t Call, void *CbData)
    return ret;
 }
 
+/**
+ * Warm up the server of 'url' before anything is requested from it:
+ * resolve its name and, if 'connect' is set, also open a connection
+ * that the first request will use. Only done when enabled in dillorc.
+ * 'requester' is the page that refers to 'url'.
+ */
+void a_Capi_preconnect(const DilloUrl *requester, const DilloUrl *url,
+                       bool_t connect)
+{
+   const char *scheme = URL_SCHEME(url);
+
+   if (!prefs.http_preconnect ||
+       (dStrAsciiCasecmp(scheme, "http") && dStrAsciiCasecmp(scheme, "https")))
+      return;
+#ifndef ENABLE_TLS
+   if (!dStrAsciiCasecmp(scheme, "https"))
+      return;
+#endif
+   if (connect && !a_Domain_permit(requester, url))
+      connect = FALSE;
+
+   a_Http_preconnect(url, connect);
+}
+
 /**
  * Convert cache-defined flags to Capi ones.
  */
@@ -553,6 +581,30 @@ void a_Capi_unref_buf(const DilloUrl *Url)
    a_Cache_unref_buf(Url);
 }
 
+/**
+ * Get the version of the cached data for the URL (0 if not cached).
+ */
+uint_t a_Capi_get_version(const DilloUrl *Url)
+{
+   return a_Cache_get_version(Url);
+}
+
+/**
+ * Keep the cached data of the URL at 'Version' until a_Capi_unpin().
+ */
+void a_Capi_pin(const DilloUrl *Url, uint_t Version)
+{
+   a_Cache_pin(Url, Version);
+}
+
+/**
+ * Let the cached data of the URL at 'Version' be evicted again.
+ */
+void a_Capi_unpin(const DilloUrl *Url, uint_t Version)
+{
+   a_Cache_unpin(Url, Version);
+}
+
 /**
  * Get the Content-Type associated with the URL
  */
@@ -704,7 +756,7 @@ void a_Capi_ccc(int Op, int Branch, int Dir, ChainLink *Info,
          case OpAbort:
             conn = Info->LocalKey;
             conn->InfoSend = NULL;
-            a_Cache_process_dbuf(IOAbort, NULL, 0, conn->url);
+            a_Cache_process_dbuf(IOAbort, NULL, 0, conn->url, NULL);
             if (Data2) {
                if (!strcmp(Data2, "DpidERROR")) {
                   a_UIcmd_set_msg(conn->bw,
@@ -770,15 +822,23 @@ void a_Capi_ccc(int Op, int Branch, int Dir, ChainLink *Info,
             conn = Info->LocalKey;
             if (strcmp(Data2, "send_page_2eof") == 0) {
                /* Data1 = dbuf */
-               DataBuf *dbuf = Data1;
+               DataBuf *dbuf = Data1, *rest;
+               int excess;
                bool_t finished = a_Cache_process_dbuf(IORead, dbuf->Buf,
-                                                      dbuf->Size, conn->url);
+                                                      dbuf->Size, conn->url,
+                                                      &excess);
                if (finished && Capi_conn_valid(conn) && conn->InfoRecv) {
                   /* If we have a persistent connection where cache tells us
                    * that we've received the full response, and cache didn't
                    * trigger an abort and tear everything down, tell upstream.
+                   * Pass on what came after the response (the start of a
+                   * pipelined one); Code is set when its end is unknown.
                    */
-                  a_Chain_bcb(OpSend, conn->InfoRecv, NULL, "reply_complete");
+                  rest = a_Chain_dbuf_new(dbuf->Buf + dbuf->Size -
+                                          MAX(excess, 0), MAX(excess, 0),
+                                          excess < 0);
+                  a_Chain_bcb(OpSend, conn->InfoRecv, rest, "reply_complete");
+                  dFree(rest);
                }
             } else if (strcmp(Data2, "send_status_message") == 0) {
                a_UIcmd_set_msg(conn->bw, "%s", Data1);
@@ -801,7 +861,7 @@ void a_Capi_ccc(int Op, int Branch, int Dir, ChainLink *Info,
             conn = Info->LocalKey;
             conn->InfoRecv = NULL;
 
-            a_Cache_process_dbuf(IOClose, NULL, 0, conn->url);
+            a_Cache_process_dbuf(IOClose, NULL, 0, conn->url, NULL);
 
             if (conn->InfoSend) {
                /* Propagate OpEnd to the sending branch too */
@@ -813,7 +873,7 @@ void a_Capi_ccc(int Op, int Branch, int Dir, ChainLink *Info,
          case OpAbort:
             conn = Info->LocalKey;
             conn->InfoRecv = NULL;
-            a_Cache_process_dbuf(IOAbort, NULL, 0, conn->url);
+            a_Cache_process_dbuf(IOAbort, NULL, 0, conn->url, NULL);
             if (Data2) {
                if (!strcmp(Data2, "Both") && conn->InfoSend) {
                   /* abort the other branch too */
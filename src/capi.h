@@ -23,8 +23,13 @@ extern "C" {
  */
 void a_Capi_init(void);
 int a_Capi_open_url(DilloWeb *web, CA_Callback_t Call, void *CbData);
+void a_Capi_preconnect(const DilloUrl *requester, const DilloUrl *url,
+                       bool_t connect);
 int a_Capi_get_buf(const DilloUrl *Url, char **PBuf, int *BufSize);
 void a_Capi_unref_buf(const DilloUrl *Url);
+uint_t a_Capi_get_version(const DilloUrl *Url);
+void a_Capi_pin(const DilloUrl *Url, uint_t Version);
+void a_Capi_unpin(const DilloUrl *Url, uint_t Version);
 const char *a_Capi_get_content_type(const DilloUrl *url);
 const char *a_Capi_set_content_type(const DilloUrl *url, const char *ctype,
                                     const char *from);
@@ -17,6 +17,32 @@
 
 using namespace dw::core::style;
 
+bool CssProperty::equals (const CssProperty *other) const {
+   if (name != other->name || type != other->type)
+      return false;
+
+   switch (type) {
+      case CSS_TYPE_STRING:
+      case CSS_TYPE_SYMBOL:
+      case CSS_TYPE_URI:
+         return strcmp (value.strVal, other->value.strVal) == 0;
+      case CSS_TYPE_BACKGROUND_POSITION:
+         return value.posVal->posX.type == other->value.posVal->posX.type &&
+                value.posVal->posX.i == other->value.posVal->posX.i &&
+                value.posVal->posY.type == other->value.posVal->posY.type &&
+                value.posVal->posY.i == other->value.posVal->posY.i;
+      case CSS_TYPE_LENGTH_PERCENTAGE:
+      case CSS_TYPE_LENGTH:
+      case CSS_TYPE_SIGNED_LENGTH:
+      case CSS_TYPE_LENGTH_PERCENTAGE_NUMBER:
+      case CSS_TYPE_AUTO:
+         return value.lenVal.type == other->value.lenVal.type &&
+                value.lenVal.i == other->value.lenVal.i;
+      default:
+         return value.intVal == other->value.intVal;
+   }
+}
+
 void CssProperty::print () {
    fprintf (stderr, "%s - %d\n",
             CssParser::propertyNameString((CssPropertyName)name),
@@ -99,6 +125,21 @@ void CssPropertyList::apply (CssPropertyList *props) {
    }
 }
 
+/**
+ * \brief Return whether both lists have the same properties, in the same
+ *        order, with the same values.
+ */
+bool CssPropertyList::equals (CssPropertyList *other) {
+   if (size () != other->size ())
+      return false;
+
+   for (int i = 0; i < size (); i++)
+      if (!getRef (i)->equals (other->getRef (i)))
+         return false;
+
+   return true;
+}
+
 void CssPropertyList::print () {
    for (int i = 0; i < size (); i++)
       getRef (i)->print ();
@@ -109,6 +150,7 @@ CssSelector::CssSelector () {
 
    refCount = 0;
    matchCacheOffset = -1;
+   numAncestorHashes = 0;
    selectorList.increase ();
    cs = selectorList.getRef (selectorList.size () - 1);
 
@@ -125,7 +167,8 @@ CssSelector::~CssSelector () {
  * \brief Return whether selector matches at a given node in the document tree.
  */
 bool CssSelector::match (Doctree *docTree, const DoctreeNode *node,
-                         int i, Combinator comb, MatchCache *matchCache) {
+                         int i, Combinator comb, MatchCache *matchCache,
+                         int matchCacheBase) {
    int *matchCacheEntry;
    assert (node);
 
@@ -146,12 +189,14 @@ bool CssSelector::match (Doctree *docTree, const DoctreeNode *node,
          break;
       case COMB_DESCENDANT:
          node = docTree->parent (node);
-         matchCacheEntry = matchCache->getRef(matchCacheOffset + i);
+         matchCacheEntry =
+            matchCache->getRef(matchCacheBase + matchCacheOffset + i);
 
          for (const DoctreeNode *n = node;
               n && n->num > *matchCacheEntry; n = docTree->parent (n))
             if (sel->match (n) &&
-                match (docTree, n, i - 1, cs->combinator, matchCache))
+                match (docTree, n, i - 1, cs->combinator, matchCache,
+                       matchCacheBase))
                return true;
 
          if (node) // remember that it didn't match to avoid future tests
@@ -167,7 +212,8 @@ bool CssSelector::match (Doctree *docTree, const DoctreeNode *node,
       return false;
 
    // tail recursion should be optimized by the compiler
-   return match (docTree, node, i - 1, cs->combinator, matchCache);
+   return match (docTree, node, i - 1, cs->combinator, matchCache,
+                 matchCacheBase);
 }
 
 void CssSelector::addSimpleSelector (Combinator c) {
@@ -181,6 +227,45 @@ void CssSelector::addSimpleSelector (Combinator c) {
    cs->selector = new CssSimpleSelector ();
 }
 
+/**
+ * \brief Collect the element names, ids and classes that the ancestors of a
+ *        matching node must have.
+ *
+ * A simple selector followed by a child or descendant combinator matches
+ * an ancestor of the node. One followed by an adjacent sibling combinator
+ * matches a sibling, which is not in the filter, so it is skipped.
+ */
+void CssSelector::computeAncestorHashes () {
+   numAncestorHashes = 0;
+
+   for (int i = selectorList.size () - 2; i >= 0; i--) {
+      Combinator comb = selectorList.getRef (i + 1)->combinator;
+      CssSimpleSelector *sel = selectorList.getRef (i)->selector;
+      unsigned h[3];
+      int n = 0;
+
+      if (comb != COMB_CHILD && comb != COMB_DESCENDANT)
+         continue;
+
+      if (sel->getId ())
+         h[n++] = DoctreeFilter::hashString (sel->getId (), 'i');
+      if (sel->getClass ()->size () > 0)
+         h[n++] = DoctreeFilter::hashString (sel->getClass ()->get (0), 'c');
+      if (sel->getElement () >= 0)
+         h[n++] = DoctreeFilter::hashElement (sel->getElement ());
+
+      for (int j = 0; j < n && numAncestorHashes < MAX_ANCESTOR_HASHES; j++)
+         ancestorHashes[numAncestorHashes++] = h[j];
+   }
+}
+
+bool CssSelector::checksSibling () {
+   for (int i = 0; i < selectorList.size (); i++)
+      if (selectorList.getRef (i)->combinator == COMB_ADJACENT_SIBLING)
+         return true;
+   return false;
+}
+
 bool CssSelector::checksPseudoClass () {
    for (int i = 0; i < selectorList.size (); i++)
       if (selectorList.getRef (i)->selector->getPseudoClass ())
@@ -317,7 +402,8 @@ void CssSimpleSelector::print () {
       fprintf (stderr, ".%s", klass.get (i));
 }
 
-CssRule::CssRule (CssSelector *selector, CssPropertyList *props, int pos) {
+CssRule::CssRule (CssSelector *selector, CssPropertyList *props, int pos,
+                  int matchCacheBase) {
    assert (selector->size () > 0);
 
    this->selector = selector;
@@ -325,6 +411,7 @@ CssRule::CssRule (CssSelector *selector, CssPropertyList *props, int pos) {
    this->props = props;
    this->props->ref ();
    this->pos = pos;
+   this->matchCacheBase = matchCacheBase;
    spec = selector->specificity ();
 }
 
@@ -335,7 +422,7 @@ CssRule::~CssRule () {
 
 void CssRule::apply (CssPropertyList *props, Doctree *docTree,
                      const DoctreeNode *node, MatchCache *matchCache) const {
-   if (selector->match (docTree, node, matchCache))
+   if (selector->match (docTree, node, matchCache, matchCacheBase))
       this->props->apply (props);
 }
 
@@ -400,8 +487,10 @@ void CssStyleSheet::addRule (CssRule *rule) {
 
    if (ruleList) {
       ruleList->insert (rule);
-      if (rule->selector->getRequiredMatchCache () > requiredMatchCache)
-         requiredMatchCache = rule->selector->getRequiredMatchCache ();
+      if (rule->selector->checksSibling ())
+         siblingRules = true;
+      if (rule->getRequiredMatchCache () > requiredMatchCache)
+         requiredMatchCache = rule->getRequiredMatchCache ();
    } else {
       assert (top->getElement () == CssSimpleSelector::ELEMENT_NONE);
       delete rule;
@@ -484,6 +573,53 @@ void CssStyleSheet::apply (CssPropertyList *props, Doctree *docTree,
    }
 }
 
+CssRuleSet::CssRuleSet () : rules (16), imports (1) {
+   refCount = 0;
+   requiredMatchCache = 0;
+}
+
+CssRuleSet::~CssRuleSet () {
+   for (int i = 0; i < rules.size (); i++) {
+      rules.getRef (i)->selector->unref ();
+      rules.getRef (i)->props->unref ();
+   }
+   for (int i = 0; i < imports.size (); i++)
+      a_Url_free (imports.get (i));
+}
+
+/**
+ * \brief Append a rule to the set.
+ *
+ * The match cache offsets of the selectors are relative to the set; each
+ * CssContext the set is added to reserves its own range for them.
+ */
+void CssRuleSet::addRule (CssSelector *sel, CssPropertyList *props,
+                          CssPrimaryOrder order) {
+   if (props->size () > 0) {
+      Rule *rule;
+
+      sel->setMatchCacheOffset (requiredMatchCache);
+      if (sel->getRequiredMatchCache () > requiredMatchCache) {
+         /* first rule with this selector */
+         sel->computeAncestorHashes ();
+         requiredMatchCache = sel->getRequiredMatchCache ();
+      }
+
+      rules.increase ();
+      rule = rules.getRef (rules.size () - 1);
+      rule->selector = sel;
+      rule->props = props;
+      rule->order = order;
+      sel->ref ();
+      props->ref ();
+   }
+}
+
+void CssRuleSet::addImport (const DilloUrl *url) {
+   imports.increase ();
+   imports.set (imports.size () - 1, a_Url_dup (url));
+}
+
 CssStyleSheet CssContext::userAgentSheet;
 
 CssContext::CssContext () {
@@ -491,6 +627,15 @@ CssContext::CssContext () {
    matchCache.setSize (userAgentSheet.getRequiredMatchCache (), -1);
 }
 
+bool CssContext::hasSiblingRules () {
+   if (userAgentSheet.hasSiblingRules ())
+      return true;
+   for (int i = 0; i <= CSS_PRIMARY_USER_IMPORTANT; i++)
+      if (sheet[i].hasSiblingRules ())
+         return true;
+   return false;
+}
+
 /**
  * \brief Apply a CSS context to a property list.
  *
@@ -527,26 +672,33 @@ void CssContext::apply (CssPropertyList *props, Doctree *docTree,
 }
 
 void CssContext::addRule (CssSelector *sel, CssPropertyList *props,
-                          CssPrimaryOrder order) {
+                          CssPrimaryOrder order, int matchCacheBase) {
+   CssRule *rule = new CssRule (sel, props, pos++, matchCacheBase);
 
-   if (props->size () > 0) {
-      CssRule *rule = new CssRule (sel, props, pos++);
+   if ((order == CSS_PRIMARY_AUTHOR ||
+        order == CSS_PRIMARY_AUTHOR_IMPORTANT) &&
+        !rule->isSafe ()) {
+      _MSG_WARN ("Ignoring unsafe author style that might reveal browsing history\n");
+      delete rule;
+   } else if (order == CSS_PRIMARY_USER_AGENT) {
+      userAgentSheet.addRule (rule);
+   } else {
+      sheet[order].addRule (rule);
+   }
+}
 
-      if ((order == CSS_PRIMARY_AUTHOR ||
-           order == CSS_PRIMARY_AUTHOR_IMPORTANT) &&
-           !rule->isSafe ()) {
-         _MSG_WARN ("Ignoring unsafe author style that might reveal browsing history\n");
-         delete rule;
-      } else {
-         rule->selector->setMatchCacheOffset(matchCache.size ());
-         if (rule->selector->getRequiredMatchCache () > matchCache.size ())
-            matchCache.setSize (rule->selector->getRequiredMatchCache (), -1);
-
-         if (order == CSS_PRIMARY_USER_AGENT) {
-            userAgentSheet.addRule (rule);
-         } else {
-            sheet[order].addRule (rule);
-         }
-      }
+/**
+ * \brief Add the rules of a parsed stylesheet to the context.
+ *
+ * The rules keep their order of appearance, after any rules added before.
+ */
+void CssContext::addRuleSet (CssRuleSet *ruleSet) {
+   int matchCacheBase = matchCache.size ();
+
+   matchCache.setSize (matchCacheBase + ruleSet->requiredMatchCache, -1);
+
+   for (int i = 0; i < ruleSet->rules.size (); i++) {
+      CssRuleSet::Rule *r = ruleSet->rules.getRef (i);
+      addRule (r->selector, r->props, r->order, matchCacheBase);
    }
 }
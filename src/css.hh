@@ -322,6 +322,7 @@ class CssProperty {
                break;
          }
       }
+      bool equals (const CssProperty *other) const;
       void print ();
 };
 
@@ -346,6 +347,7 @@ class CssPropertyList : public lout::misc::SimpleVector <CssProperty> {
       void set (CssPropertyName name, CssValueType type,
                 CssPropertyValue value);
       void apply (CssPropertyList *props);
+      bool equals (CssPropertyList *other);
       bool isSafe () { return safe; };
       void print ();
       inline void ref () { refCount++; }
@@ -409,11 +411,22 @@ class CssSelector {
          CssSimpleSelector *selector;
       };
 
+      enum { MAX_ANCESTOR_HASHES = 4 };
+
       int refCount, matchCacheOffset;
       lout::misc::SimpleVector <struct CombinatorAndSelector> selectorList;
+      /** Keys the ancestors must have, checked against the DoctreeFilter */
+      unsigned ancestorHashes[MAX_ANCESTOR_HASHES];
+      int numAncestorHashes;
 
       bool match (Doctree *dt, const DoctreeNode *node, int i, Combinator comb,
-                  MatchCache *matchCache);
+                  MatchCache *matchCache, int matchCacheBase);
+      inline bool ancestorsMayMatch (const DoctreeFilter *filter) {
+         for (int i = 0; i < numAncestorHashes; i++)
+            if (!filter->mayContain (ancestorHashes[i]))
+               return false;
+         return true;
+      }
 
    public:
       CssSelector ();
@@ -424,10 +437,12 @@ class CssSelector {
       }
       inline int size () { return selectorList.size (); };
       inline bool match (Doctree *dt, const DoctreeNode *node,
-                         MatchCache *matchCache) {
-         return match (dt, node, selectorList.size () - 1, COMB_NONE,
-                       matchCache);
+                         MatchCache *matchCache, int matchCacheBase) {
+         return ancestorsMayMatch (dt->filter ()) &&
+                match (dt, node, selectorList.size () - 1, COMB_NONE,
+                       matchCache, matchCacheBase);
       }
+      void computeAncestorHashes ();
       inline void setMatchCacheOffset (int mo) {
          if (matchCacheOffset == -1)
             matchCacheOffset = mo;
@@ -437,6 +452,7 @@ class CssSelector {
       }
       int specificity ();
       bool checksPseudoClass ();
+      bool checksSibling ();
       void print ();
       inline void ref () { refCount++; }
       inline void unref () { if (--refCount == 0) delete this; }
@@ -450,12 +466,13 @@ class CssSelector {
 class CssRule {
    private:
       CssPropertyList *props;
-      int spec, pos;
+      int spec, pos, matchCacheBase;
 
    public:
       CssSelector *selector;
 
-      CssRule (CssSelector *selector, CssPropertyList *props, int pos);
+      CssRule (CssSelector *selector, CssPropertyList *props, int pos,
+               int matchCacheBase);
       ~CssRule ();
 
       void apply (CssPropertyList *props, Doctree *docTree,
@@ -465,6 +482,9 @@ class CssRule {
       };
       inline int specificity () { return spec; };
       inline int position () { return pos; };
+      inline int getRequiredMatchCache () {
+         return matchCacheBase + selector->getRequiredMatchCache ();
+      }
       void print ();
 };
 
@@ -503,13 +523,51 @@ class CssStyleSheet {
       RuleList elementTable[ntags], anyTable;
       RuleMap idTable, classTable;
       int requiredMatchCache;
+      bool siblingRules;
 
    public:
-      CssStyleSheet () { requiredMatchCache = 0; }
+      CssStyleSheet () { requiredMatchCache = 0; siblingRules = false; }
       void addRule (CssRule *rule);
       void apply (CssPropertyList *props, Doctree *docTree,
                   const DoctreeNode *node, MatchCache *matchCache) const;
       int getRequiredMatchCache () { return requiredMatchCache; }
+      /** Whether some rule depends on the preceding sibling of a node */
+      bool hasSiblingRules () { return siblingRules; }
+};
+
+/**
+ * \brief The rules of a parsed stylesheet, in order of appearance.
+ *
+ * The CssParser fills a CssRuleSet, which can then be added to any number
+ * of CssContexts. Selectors and property lists are shared, not copied, so
+ * a stylesheet used by several documents only needs to be parsed once.
+ * Once filled, a CssRuleSet is not modified anymore.
+ */
+class CssRuleSet {
+   private:
+      struct Rule {
+         CssSelector *selector;
+         CssPropertyList *props;
+         CssPrimaryOrder order;
+      };
+
+      int refCount, requiredMatchCache;
+      lout::misc::SimpleVector <Rule> rules;
+      lout::misc::SimpleVector <DilloUrl*> imports;
+
+   public:
+      CssRuleSet ();
+      ~CssRuleSet ();
+
+      void addRule (CssSelector *sel, CssPropertyList *props,
+                    CssPrimaryOrder order);
+      void addImport (const DilloUrl *url);
+      inline int numImports () { return imports.size (); }
+      inline const DilloUrl *getImport (int i) { return imports.get (i); }
+      inline void ref () { refCount++; }
+      inline void unref () { if (--refCount == 0) delete this; }
+
+      friend class CssContext;
 };
 
 /**
@@ -522,11 +580,14 @@ class CssContext {
       MatchCache matchCache;
       int pos;
 
+      void addRule (CssSelector *sel, CssPropertyList *props,
+                    CssPrimaryOrder order, int matchCacheBase);
+
    public:
       CssContext ();
 
-      void addRule (CssSelector *sel, CssPropertyList *props,
-                    CssPrimaryOrder order);
+      void addRuleSet (CssRuleSet *ruleSet);
+      bool hasSiblingRules ();
       void apply (CssPropertyList *props,
          Doctree *docTree, DoctreeNode *node,
          CssPropertyList *tagStyle, CssPropertyList *tagStyleImportant,
@@ -455,11 +455,11 @@ static const CssShorthandInfo Css_shorthand_info[] = {
  *    Parsing
  * ---------------------------------------------------------------------- */
 
-CssParser::CssParser(CssContext *context, CssOrigin origin,
+CssParser::CssParser(CssRuleSet *ruleSet, CssOrigin origin,
                      const DilloUrl *baseUrl,
                      const char *buf, int buflen)
 {
-   this->context = context;
+   this->ruleSet = ruleSet;
    this->origin = origin;
    this->buf = buf;
    this->buflen = buflen;
@@ -1564,13 +1564,13 @@ void CssParser::parseRuleset()
       CssSelector *s = list->get(i);
 
       if (origin == CSS_ORIGIN_USER_AGENT) {
-         context->addRule(s, props, CSS_PRIMARY_USER_AGENT);
+         ruleSet->addRule(s, props, CSS_PRIMARY_USER_AGENT);
       } else if (origin == CSS_ORIGIN_USER) {
-         context->addRule(s, props, CSS_PRIMARY_USER);
-         context->addRule(s, importantProps, CSS_PRIMARY_USER_IMPORTANT);
+         ruleSet->addRule(s, props, CSS_PRIMARY_USER);
+         ruleSet->addRule(s, importantProps, CSS_PRIMARY_USER_IMPORTANT);
       } else if (origin == CSS_ORIGIN_AUTHOR) {
-         context->addRule(s, props, CSS_PRIMARY_AUTHOR);
-         context->addRule(s, importantProps, CSS_PRIMARY_AUTHOR_IMPORTANT);
+         ruleSet->addRule(s, props, CSS_PRIMARY_AUTHOR);
+         ruleSet->addRule(s, importantProps, CSS_PRIMARY_AUTHOR_IMPORTANT);
       }
 
       s->unref();
@@ -1676,8 +1676,10 @@ void CssParser::parseImport(DilloHtml *html)
          MSG("CssParser::parseImport(): @import %s\n", urlStr);
          DilloUrl *url = a_Html_url_new (html, urlStr, a_Url_str(this->baseUrl),
                                          this->baseUrl ? 1 : 0);
-         a_Html_load_stylesheet(html, url);
-         a_Url_free(url);
+         if (url) {
+            ruleSet->addImport(url);
+            a_Url_free(url);
+         }
       }
       dFree (urlStr);
    }
@@ -1767,12 +1769,16 @@ void CssParser::ignoreStatement()
    }
 }
 
+/**
+ * Parse a stylesheet into ruleSet. The stylesheets it imports are only
+ * recorded there; loading them is up to the caller.
+ */
 void CssParser::parse(DilloHtml *html, const DilloUrl *baseUrl,
-                      CssContext *context,
+                      CssRuleSet *ruleSet,
                       const char *buf,
                       int buflen, CssOrigin origin)
 {
-   CssParser parser (context, origin, baseUrl, buf, buflen);
+   CssParser parser (ruleSet, origin, baseUrl, buf, buflen);
    bool importsAreAllowed = true;
 
    while (parser.ttype != CSS_TK_END) {
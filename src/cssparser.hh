@@ -13,7 +13,7 @@ class CssParser {
       } CssTokenType;
 
       static const int maxStrLen = 256;
-      CssContext *context;
+      CssRuleSet *ruleSet;
       CssOrigin origin;
       const DilloUrl *baseUrl;
 
@@ -25,7 +25,7 @@ class CssParser {
       bool withinBlock;
       bool spaceSeparated; /* used when parsing CSS selectors */
 
-      CssParser(CssContext *context, CssOrigin origin, const DilloUrl *baseUrl,
+      CssParser(CssRuleSet *ruleSet, CssOrigin origin, const DilloUrl *baseUrl,
                 const char *buf, int buflen);
       int getChar();
       void ungetChar();
@@ -53,8 +53,9 @@ class CssParser {
                                         const char *buf, int buflen,
                                         CssPropertyList *props,
                                         CssPropertyList *propsImortant);
-      static void parse(DilloHtml *html, const DilloUrl *baseUrl, CssContext *context,
-                        const char *buf, int buflen, CssOrigin origin);
+      static void parse(DilloHtml *html, const DilloUrl *baseUrl,
+                        CssRuleSet *ruleSet, const char *buf, int buflen,
+                        CssOrigin origin);
       static const char *propertyNameString(CssPropertyName name);
 };
 
@@ -21,6 +21,10 @@
 #include <brotli/decode.h>
 #endif
 
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "decode.h"
 #include "utf8.hh"
 #include "msg.h"
@@ -94,6 +98,25 @@ bool_t a_Decode_transfer_finished(DecodeTransfer *dc)
    return dc->finished;
 }
 
+/**
+ * Once the terminating chunk has been seen, return how many of the bytes
+ * given to the decoder come after the end of the message (its trailer
+ * fields and empty line included), or -1 if that end has not arrived yet.
+ */
+int a_Decode_transfer_excess(DecodeTransfer *dc)
+{
+   const char *p = dc->leftover->str, *end = p + dc->leftover->len, *eol;
+
+   /* skip the "0" chunk line, then the trailer up to an empty line */
+   if (!dc->finished || !(eol = memchr(p, '\n', end - p)))
+      return -1;
+   for (p = eol + 1; (eol = memchr(p, '\n', end - p)); p = eol + 1) {
+      if (eol == p || (eol == p + 1 && *p == '\r'))
+         return end - (eol + 1);
+   }
+   return -1;
+}
+
 void a_Decode_transfer_free(DecodeTransfer *dc)
 {
    dFree(dc->state);
@@ -314,6 +337,68 @@ static Decode *Decode_brotli_init(void)
 }
 #endif /* ENABLE_BROTLI */
 
+#ifdef ENABLE_ZSTD
+/**
+ * Decode zstd compressed data in stream mode.
+ * The output is written straight into the returned string, which grows
+ * as needed, instead of going through dc->buffer.
+ */
+static Dstr *Decode_zstd_process(Decode *dc, const char *instr, int inlen)
+{
+   ZSTD_DStream *zds = (ZSTD_DStream *) dc->state;
+   ZSTD_inBuffer in = { instr, inlen, 0 };
+   ZSTD_outBuffer out;
+   Dstr *output = dStr_sized_new(MAX(bufsize, 4 * inlen));
+   size_t ret;
+
+   do {
+      out.size = MAX(bufsize, output->len);
+      out.dst = dStr_reserve(output, out.size);
+      out.pos = 0;
+
+      ret = ZSTD_decompressStream(zds, &out, &in);
+      dStr_extend(output, out.pos);
+
+      if (ZSTD_isError(ret)) {
+         MSG_ERR("zstd decompression error: %s\n", ZSTD_getErrorName(ret));
+         break;
+      }
+      /* a full output buffer may mean there's more data to flush */
+   } while (in.pos < in.size || out.pos == out.size);
+
+   return output;
+}
+
+static void Decode_zstd_free(Decode *dc)
+{
+   ZSTD_freeDStream((ZSTD_DStream *) dc->state);
+}
+
+static Decode *Decode_zstd_init(void)
+{
+   ZSTD_DStream *zds = ZSTD_createDStream();
+
+   if (zds == NULL) {
+      MSG_ERR("Cannot create zstd decoder instance\n");
+      return NULL;
+   }
+   ZSTD_initDStream(zds);
+   /* RFC 9659: the window of the zstd content coding is at most 8 MiB;
+    * this also bounds the memory a server can make us use. */
+   ZSTD_DCtx_setParameter(zds, ZSTD_d_windowLogMax, 23);
+
+   Decode *dc = dNew0(Decode, 1);
+
+   dc->buffer = NULL;   /* not used */
+   dc->state = zds;
+   dc->leftover = NULL; /* not used */
+   dc->decode = Decode_zstd_process;
+   dc->free = Decode_zstd_free;
+
+   return dc;
+}
+#endif /* ENABLE_ZSTD */
+
 
 /**
  * Translate to desired character set (UTF-8)
@@ -405,7 +490,8 @@ static Decode *Decode_content_init_common(void)
 }
 
 /**
- * Initialize content decoder. Currently handles 'gzip', 'deflate' and 'br'.
+ * Initialize content decoder. Currently handles 'gzip', 'deflate', 'br' and
+ * 'zstd'.
  */
 Decode *a_Decode_content_init(const char *format)
 {
@@ -435,6 +521,11 @@ Decode *a_Decode_content_init(const char *format)
       } else if (!dStrAsciiCasecmp(format, "br")) {
          _MSG("brotli data!\n");
          dc = Decode_brotli_init();
+#endif
+#ifdef ENABLE_ZSTD
+      } else if (!dStrAsciiCasecmp(format, "zstd")) {
+         _MSG("zstd data!\n");
+         dc = Decode_zstd_init();
 #endif
       } else {
          MSG("Content-Encoding '%s' not recognized.\n", format);
@@ -28,6 +28,7 @@ DecodeTransfer *a_Decode_transfer_init(const char *format);
 Dstr *a_Decode_transfer_process(DecodeTransfer *dc, const char *instr,
                                 int inlen);
 bool_t a_Decode_transfer_finished(DecodeTransfer *dc);
+int a_Decode_transfer_excess(DecodeTransfer *dc);
 void a_Decode_transfer_free(DecodeTransfer *dc);
 
 Decode *a_Decode_content_init(const char *format);
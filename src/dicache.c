@@ -24,6 +24,7 @@
 #include "imgbuf.hh"
 #include "web.hh"
 #include "dicache.h"
+#include "capi.h"
 #include "dpng.h"
 #include "dwebp.h"
 #include "dgif.h"
@@ -57,7 +58,25 @@ static Dlist *CachedIMGs = NULL;
 
 static uint_t dicache_size_total; /* invariant: dicache_size_total is
                                    * the sum of the image sizes (3*w*h)
-                                   * of all the images in the dicache. */
+                                   * of all the images in the dicache,
+                                   * but those reclaimed. */
+
+/** Images drawn after this (see a_Imgbuf_last_drawn) are not reclaimed */
+static ulong_t dicache_drawn_mark = 0;
+static uint_t StatReclaims = 0, StatReloads = 0;
+
+/**
+ * Data of the reloader of an Imgbuf: the entry it belongs to.
+ */
+typedef struct {
+   DilloUrl *url;
+   int version;
+   DilloImage Image;   /**< Given to the decoder when reloading */
+} DicacheReload;
+
+static bool_t Dicache_reload(void *data);
+static bool_t Dicache_unreduce(void *data, uint_t width, uint_t height);
+static void Dicache_reload_free(void *data);
 
 /**
  * Compare function for image entries
@@ -103,9 +122,15 @@ static DICacheEntry *Dicache_entry_new(void)
 
    entry->width = 0;
    entry->height = 0;
+   entry->Reduction = 1;
+   entry->DrawWidth = -1;
+   entry->DrawHeight = -1;
    entry->Flags = DIF_Valid;
    entry->SurvCleanup = 0;
    entry->type = DILLO_IMG_TYPE_NOTSET;
+   entry->Format = -1;
+   entry->BgColor = 0;
+   entry->DataVersion = 0;
    entry->cmap = NULL;
    entry->v_imgbuf = NULL;
    entry->RefCount = 1;
@@ -118,6 +143,7 @@ static DICacheEntry *Dicache_entry_new(void)
    entry->Decoder = NULL;
    entry->DecoderData = NULL;
    entry->DecodedSize = 0;
+   entry->Job = NULL;
 
    return entry;
 }
@@ -184,14 +210,20 @@ static void Dicache_remove(const DilloUrl *Url, int version)
        entry->v_imgbuf, entry->Decoder, entry->DecoderData);
    /* Eliminate this dicache entry */
    dList_remove(CachedIMGs, entry);
-   dicache_size_total -= entry->TotalSize;
+   if (!(entry->Flags & DIF_Reclaimed))
+      dicache_size_total -= entry->TotalSize;
+   if (entry->Flags & DIF_Pinned)
+      a_Capi_unpin(entry->url, entry->DataVersion);
 
    /* entry cleanup */
-   a_Url_free(entry->url);
    dFree(entry->cmap);
    a_Bitvec_free(entry->BitVec);
    a_Imgbuf_unref(entry->v_imgbuf);
-   if (entry->Decoder) {
+   a_Url_free(entry->url);
+   if (entry->Job) {
+      /* The job frees the decoder, when a worker is done with it */
+      a_Imgdec_job_abort(entry->Job);
+   } else if (entry->Decoder) {
       entry->Decoder(CA_Abort, entry->DecoderData);
    }
    dFree(entry);
@@ -253,6 +285,27 @@ void a_Dicache_invalidate_entry(const DilloUrl *Url)
 
 /* ------------------------------------------------------------------------- */
 
+/**
+ * Let the decoder fill the entry with a copy of the image reduced to
+ * 1/'reduction' of its size (rounding up), as it is drawn smaller.
+ * Must be called before a_Dicache_set_parms().
+ */
+void a_Dicache_set_reduction(DilloUrl *url, int version, uint_t reduction)
+{
+   DICacheEntry *DicEntry;
+   ImgdecJob *job;
+
+   if ((job = a_Imgdec_current())) {
+      a_Imgdec_set_reduction(job, reduction);
+      return;
+   }
+
+   DicEntry = a_Dicache_get_entry(url, version);
+   dReturn_if_fail ( DicEntry != NULL && reduction > 0 );
+   dReturn_if_fail ( DicEntry->State < DIC_SetParms );
+   DicEntry->Reduction = reduction;
+}
+
 /**
  * Set image's width, height & type
  * - 'width' and 'height' come from the image data.
@@ -264,6 +317,14 @@ void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
                          double gamma)
 {
    DICacheEntry *DicEntry;
+   ImgdecJob *job;
+   uint_t r;
+
+   if ((job = a_Imgdec_current())) {
+      /* Called by the decoder in a worker thread */
+      a_Imgdec_set_parms(job, Image, width, height, type, gamma);
+      return;
+   }
 
    _MSG("a_Dicache_set_parms (%s)\n", URL_STR(url));
    dReturn_if_fail ( Image != NULL && width && height );
@@ -275,10 +336,34 @@ void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
 
    _MSG("  RefCount=%d version=%d\n", DicEntry->RefCount, DicEntry->version);
 
+   if (DicEntry->v_imgbuf) {
+      /* Decoding it again into the same Imgbuf (see Dicache_reload) */
+      DicEntry->State = DIC_SetParms;
+      return;
+   }
+
    /* BUG: there's just one image-type now */
    #define I_RGB 0
-   DicEntry->v_imgbuf =
-      a_Imgbuf_new(Image->layout, I_RGB, width, height, gamma);
+   if ((r = DicEntry->Reduction) > 1) {
+      DicEntry->v_imgbuf = a_Imgbuf_new(Image->layout, I_RGB,
+                                        (width + r - 1) / r,
+                                        (height + r - 1) / r, gamma);
+      a_Imgbuf_set_root_size(DicEntry->v_imgbuf, width, height);
+      width = (width + r - 1) / r;
+      height = (height + r - 1) / r;
+   } else {
+      DicEntry->v_imgbuf =
+         a_Imgbuf_new(Image->layout, I_RGB, width, height, gamma);
+   }
+
+   if (DicEntry->Format != DIC_Svg) {
+      DicacheReload *reload = dNew(DicacheReload, 1);
+
+      reload->url = a_Url_dup(url);
+      reload->version = version;
+      a_Imgbuf_set_reloader(DicEntry->v_imgbuf, Dicache_reload,
+                            Dicache_unreduce, Dicache_reload_free, reload);
+   }
 
    DicEntry->TotalSize = width * height * 3;
    DicEntry->width = width;
@@ -297,8 +382,16 @@ void a_Dicache_set_cmap(DilloUrl *url, int version, int bg_color,
                         const uchar_t *cmap, uint_t num_colors,
                         int num_colors_max, int bg_index)
 {
-   DICacheEntry *DicEntry = a_Dicache_get_entry(url, version);
+   DICacheEntry *DicEntry;
+   ImgdecJob *job;
+
+   if ((job = a_Imgdec_current())) {
+      a_Imgdec_set_cmap(job, bg_color, cmap, num_colors, num_colors_max,
+                        bg_index);
+      return;
+   }
 
+   DicEntry = a_Dicache_get_entry(url, version);
    _MSG("a_Dicache_set_cmap\n");
    dReturn_if_fail ( DicEntry != NULL );
 
@@ -320,6 +413,12 @@ void a_Dicache_set_cmap(DilloUrl *url, int version, int bg_color,
 void a_Dicache_new_scan(const DilloUrl *url, int version)
 {
    DICacheEntry *DicEntry;
+   ImgdecJob *job;
+
+   if ((job = a_Imgdec_current())) {
+      a_Imgdec_new_scan(job);
+      return;
+   }
 
    _MSG("a_Dicache_new_scan\n");
    dReturn_if_fail ( url != NULL );
@@ -343,6 +442,12 @@ void a_Dicache_new_scan(const DilloUrl *url, int version)
 void a_Dicache_write(DilloUrl *url, int version, const uchar_t *buf, uint_t Y)
 {
    DICacheEntry *DicEntry;
+   ImgdecJob *job;
+
+   if ((job = a_Imgdec_current())) {
+      a_Imgdec_write(job, buf, Y);
+      return;
+   }
 
    _MSG("a_Dicache_write\n");
    DicEntry = a_Dicache_get_entry(url, version);
@@ -357,6 +462,20 @@ void a_Dicache_write(DilloUrl *url, int version, const uchar_t *buf, uint_t Y)
    DicEntry->State = DIC_Write;
 }
 
+/**
+ * Keep the cached data of a whole image, as long as the entry is there,
+ * so that its image data can be reclaimed and decoded again.
+ */
+static void Dicache_pin(DICacheEntry *entry)
+{
+   if (!(entry->Flags & DIF_Pinned) && entry->Format != DIC_Svg &&
+       a_Capi_get_version(entry->url) == entry->DataVersion &&
+       (a_Capi_get_flags(entry->url) & CAPI_Completed)) {
+      a_Capi_pin(entry->url, entry->DataVersion);
+      entry->Flags |= DIF_Pinned;
+   }
+}
+
 /**
  * Implement the close method of the decoding process
  */
@@ -373,12 +492,13 @@ void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client)
    _MSG(" a_Dicache_close imgbuf=%p Decoder=%p DecoderData=%p\n",
         DicEntry->v_imgbuf, DicEntry->Decoder, DicEntry->DecoderData);
 
-   if (DicEntry->State < DIC_Close) {
+   if (DicEntry->State < DIC_Close && !(DicEntry->Flags & DIF_Reloading)) {
       DicEntry->State = DIC_Close;
       dFree(DicEntry->cmap);
       DicEntry->cmap = NULL;
       DicEntry->Decoder = NULL;
       DicEntry->DecoderData = NULL;
+      Dicache_pin(DicEntry);
    }
    a_Dicache_unref(url, version);
 
@@ -387,6 +507,50 @@ void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client)
 
 /* ------------------------------------------------------------------------- */
 
+/**
+ * Whether 'entry' may hold a copy of the image that is too small for
+ * 'Image' (it was reduced for a client that draws it smaller).
+ */
+static bool_t Dicache_too_small(DICacheEntry *entry, DilloImage *Image)
+{
+   int w, h;
+
+   if (entry->DrawWidth == -1 && entry->DrawHeight == -1)
+      return FALSE;      /* never reduced */
+   if (entry->State >= DIC_SetParms && entry->Reduction == 1)
+      return FALSE;
+   if (!a_Image_get_draw_size(Image, &w, &h))
+      return TRUE;       /* it may be drawn at any size */
+   if (entry->State >= DIC_SetParms)
+      return w > (int)entry->width || h > (int)entry->height;
+   /* The decoder doesn't know the size yet, but it can only be reduced
+    * down to the size the first client draws it at */
+   return w > entry->DrawWidth || h > entry->DrawHeight;
+}
+
+/**
+ * Attach a decoder for the format of the entry.
+ */
+static void Dicache_decoder_new(DICacheEntry *entry, DilloImage *Image)
+{
+   if (entry->Format == DIC_Jpeg) {
+      entry->Decoder = (CA_Callback_t)a_Jpeg_callback;
+      entry->DecoderData = a_Jpeg_new(Image, entry->url, entry->version);
+   } else if (entry->Format == DIC_Gif) {
+      entry->Decoder = (CA_Callback_t)a_Gif_callback;
+      entry->DecoderData = a_Gif_new(Image, entry->url, entry->version);
+   } else if (entry->Format == DIC_Webp) {
+      entry->Decoder = (CA_Callback_t)a_Webp_callback;
+      entry->DecoderData = a_Webp_new(Image, entry->url, entry->version);
+   } else if (entry->Format == DIC_Png) {
+      entry->Decoder = (CA_Callback_t)a_Png_callback;
+      entry->DecoderData = a_Png_new(Image, entry->url, entry->version);
+   } else if (entry->Format == DIC_Svg) {
+      entry->Decoder = (CA_Callback_t)a_Svg_callback;
+      entry->DecoderData = a_Svg_new(Image, entry->url, entry->version);
+   }
+}
+
 /**
  * Generic MIME handler for GIF, JPEG, PNG and SVG.
  * Sets a_Dicache_callback as the cache-client,
@@ -417,31 +581,28 @@ static void *Dicache_image(int ImgType, const char *MimeType, void *Ptr,
    }
 
    DicEntry = a_Dicache_get_entry(web->url, DIC_Last);
+   if (DicEntry && Dicache_too_small(DicEntry, web->Image)) {
+      /* Decode it again for this client, from the cached data */
+      a_Dicache_invalidate_entry(web->url);
+      DicEntry = NULL;
+   }
    if (!DicEntry) {
       /* Create an entry for this image... */
       DicEntry = Dicache_add_entry(web->url);
-      /* Attach a decoder */
+      DicEntry->Format = ImgType;
+      DicEntry->BgColor = web->Image->bg_color;
+      DicEntry->DataVersion = a_Capi_get_version(web->url);
       if (ImgType == DIC_Jpeg) {
-         DicEntry->Decoder = (CA_Callback_t)a_Jpeg_callback;
-         DicEntry->DecoderData =
-            a_Jpeg_new(web->Image, DicEntry->url, DicEntry->version);
-      } else if (ImgType == DIC_Gif) {
-         DicEntry->Decoder = (CA_Callback_t)a_Gif_callback;
-         DicEntry->DecoderData =
-            a_Gif_new(web->Image, DicEntry->url, DicEntry->version);
-      } else if (ImgType == DIC_Webp) {
-         DicEntry->Decoder = (CA_Callback_t)a_Webp_callback;
-         DicEntry->DecoderData =
-            a_Webp_new(web->Image, DicEntry->url, DicEntry->version);
-      } else if (ImgType == DIC_Png) {
-         DicEntry->Decoder = (CA_Callback_t)a_Png_callback;
-         DicEntry->DecoderData =
-            a_Png_new(web->Image, DicEntry->url, DicEntry->version);
-      } else if (ImgType == DIC_Svg) {
-         DicEntry->Decoder = (CA_Callback_t)a_Svg_callback;
-         DicEntry->DecoderData =
-            a_Svg_new(web->Image, DicEntry->url, DicEntry->version);
+         /* It may be decoded at the size this client draws it */
+         a_Image_get_draw_size(web->Image, &DicEntry->DrawWidth,
+                               &DicEntry->DrawHeight);
       }
+      Dicache_decoder_new(DicEntry, web->Image);
+      /* The SVG decoder draws into the Imgbuf, keep it in this thread */
+      if (ImgType != DIC_Svg && a_Imgdec_enabled())
+         DicEntry->Job = a_Imgdec_job_new(DicEntry->url, DicEntry->version,
+                                          DicEntry->Decoder,
+                                          DicEntry->DecoderData);
    } else {
       /* Repeated image */
       a_Dicache_ref(DicEntry->url, DicEntry->version);
@@ -519,16 +680,45 @@ void a_Dicache_callback(int Op, CacheClient_t *Client)
    /* Only call the decoder when necessary */
    if (Op == CA_Send && DicEntry->State < DIC_Close &&
        DicEntry->DecodedSize < Client->BufSize) {
-      DicEntry->Decoder(Op, Client);
+      if (DicEntry->Job) {
+         /* A worker thread decodes it */
+         a_Imgdec_job_feed(DicEntry->Job,
+                           (char *)Client->Buf + DicEntry->DecodedSize,
+                           Client->BufSize - DicEntry->DecodedSize,
+                           (a_Capi_get_flags(Client->Url) &
+                            CAPI_Completed) != 0);
+      } else {
+         DicEntry->Decoder(Op, Client);
+      }
       DicEntry->DecodedSize = Client->BufSize;
    } else if (Op == CA_Close || Op == CA_Abort) {
-      if (DicEntry->State < DIC_Close) {
+      if (DicEntry->Flags & DIF_Reloading) {
+         /* The reload job is not this client's to stop */
+         a_Dicache_close(DicEntry->url, DicEntry->version, Client);
+      } else if (DicEntry->State < DIC_Close && DicEntry->Job &&
+                 Op == CA_Abort) {
+         /* Don't wait for the worker: it frees the job and the decoder */
+         a_Imgdec_job_abort(DicEntry->Job);
+         DicEntry->Job = NULL;
+         DicEntry->State = DIC_Close;
+         DicEntry->Decoder = NULL;
+         DicEntry->DecoderData = NULL;
+      } else if (DicEntry->State < DIC_Close) {
+         if (DicEntry->Job) {
+            /* Usually there is nothing left to decode (see Busy below) */
+            a_Imgdec_job_finish(DicEntry->Job);
+            DicEntry->Job = NULL;
+         }
          DicEntry->Decoder(Op, Client);
       } else {
          a_Dicache_close(DicEntry->url, DicEntry->version, Client);
       }
    }
 
+   /* Don't let the cache close the client before the job is done */
+   if (Op == CA_Send)
+      Client->Busy = DicEntry->Job && a_Imgdec_job_busy(DicEntry->Job);
+
    /* when the data stream is not an image 'v_imgbuf' remains NULL */
    if (Op == CA_Send && DicEntry->v_imgbuf) {
       if (Image->height == 0 && DicEntry->State >= DIC_SetParms) {
@@ -568,6 +758,194 @@ void a_Dicache_callback(int Op, CacheClient_t *Client)
 
 /* ------------------------------------------------------------------------- */
 
+/**
+ * The entry is decoded again: let it be reclaimed again later.
+ */
+static void Dicache_reload_end(DICacheEntry *entry)
+{
+   entry->Flags &= ~DIF_Reloading;
+   entry->Decoder = NULL;
+   entry->DecoderData = NULL;
+   dFree(entry->cmap);
+   entry->cmap = NULL;
+   entry->State = DIC_Close;
+   StatReloads++;
+}
+
+/**
+ * The decode worker is done with a reload (its job frees the decoder).
+ */
+static void Dicache_reload_done(const DilloUrl *url, int version)
+{
+   DICacheEntry *entry = a_Dicache_get_entry(url, version);
+
+   dReturn_if (entry == NULL || !(entry->Flags & DIF_Reloading));
+   entry->Job = NULL;
+   Dicache_reload_end(entry);
+   a_Imgbuf_reload_done(entry->v_imgbuf);
+}
+
+/**
+ * Decode a reclaimed entry again, into its Imgbuf, from the cached data.
+ * Called by the Imgbuf when it is drawn. Return FALSE when a decode worker
+ * does it, and a_Imgbuf_reload_done() is called at the end.
+ */
+static bool_t Dicache_reload(void *data)
+{
+   DicacheReload *reload = data;
+   DICacheEntry *entry = a_Dicache_get_entry(reload->url, reload->version);
+   CacheClient_t Client;
+   char *buf;
+   int size;
+
+   dReturn_val_if (entry == NULL || !(entry->Flags & DIF_Reclaimed), TRUE);
+
+   /* The Imgbuf holds the data again, decoded or not */
+   entry->Flags &= ~DIF_Reclaimed;
+   dicache_size_total += entry->TotalSize;
+
+   /* The cached data is pinned, unless it was replaced or removed */
+   if (a_Capi_get_version(entry->url) != entry->DataVersion ||
+       !a_Capi_get_buf(entry->url, &buf, &size)) {
+      MSG("Dicache_reload: %s is no longer cached\n", URL_STR(entry->url));
+      return TRUE;
+   }
+   _MSG("Dicache_reload: %s\n", URL_STR(entry->url));
+
+   /* The decoders only take the background color from it, as the
+    * parameters are set already */
+   memset(&reload->Image, 0, sizeof(reload->Image));
+   reload->Image.bg_color = entry->BgColor;
+   entry->State = DIC_Empty;
+   a_Bitvec_clear(entry->BitVec);
+   Dicache_decoder_new(entry, &reload->Image);
+
+   if (a_Imgdec_enabled()) {
+      /* A worker decodes it, and the image is drawn again after */
+      entry->Flags |= DIF_Reloading;
+      entry->Job = a_Imgdec_job_new(entry->url, entry->version,
+                                    entry->Decoder, entry->DecoderData);
+      a_Imgdec_job_run(entry->Job, buf, size, Dicache_reload_done);
+      a_Capi_unref_buf(entry->url);
+      return FALSE;
+   }
+
+   /* Decode it in one go, as the image is being drawn */
+   memset(&Client, 0, sizeof(Client));
+   Client.Url = entry->url;
+   Client.Version = entry->version;
+   Client.Buf = buf;
+   Client.BufSize = size;
+   Client.CbData = entry->DecoderData;
+   entry->Decoder(CA_Send, &Client);
+   entry->Decoder(CA_Abort, entry->DecoderData);
+   a_Capi_unref_buf(entry->url);
+   Dicache_reload_end(entry);
+   return TRUE;
+}
+
+/**
+ * The Imgbuf of a reduced entry is drawn larger: get the entry ready to
+ * be decoded again at the size of the image ('width' x 'height') when it
+ * is drawn. Return whether that can be done now.
+ */
+static bool_t Dicache_unreduce(void *data, uint_t width, uint_t height)
+{
+   DicacheReload *reload = data;
+   DICacheEntry *entry = a_Dicache_get_entry(reload->url, reload->version);
+
+   if (entry == NULL || entry->Reduction == 1 || entry->State != DIC_Close ||
+       !(entry->Flags & DIF_Pinned) ||
+       a_Capi_get_version(entry->url) != entry->DataVersion ||
+       !(a_Capi_get_flags(entry->url) & CAPI_Completed))
+      return FALSE;
+
+   _MSG("Dicache_unreduce: %s\n", URL_STR(entry->url));
+   if (!(entry->Flags & DIF_Reclaimed)) {
+      entry->Flags |= DIF_Reclaimed;
+      dicache_size_total -= entry->TotalSize;
+   }
+   /* Not reduced for any draw size anymore */
+   entry->Reduction = 1;
+   entry->DrawWidth = entry->DrawHeight = -1;
+   entry->width = width;
+   entry->height = height;
+   entry->TotalSize = width * height * 3;
+   a_Bitvec_free(entry->BitVec);
+   entry->BitVec = a_Bitvec_new((int)height);
+   return TRUE;
+}
+
+static void Dicache_reload_free(void *data)
+{
+   DicacheReload *reload = data;
+
+   a_Url_free(reload->url);
+   dFree(reload);
+}
+
+/**
+ * Whether the image data of the entry can be freed and decoded again.
+ */
+static bool_t Dicache_is_reclaimable(DICacheEntry *entry)
+{
+   return entry->v_imgbuf && entry->State == DIC_Close &&
+          (entry->Flags & (DIF_Valid | DIF_Reclaimed | DIF_Pinned)) ==
+          (DIF_Valid | DIF_Pinned) &&
+          a_Imgbuf_last_drawn(entry->v_imgbuf) <= dicache_drawn_mark &&
+          a_Capi_get_version(entry->url) == entry->DataVersion &&
+          (a_Capi_get_flags(entry->url) & CAPI_Completed);
+}
+
+static int Dicache_entry_by_last_drawn_cmp(const void *v1, const void *v2)
+{
+   ulong_t d1 = a_Imgbuf_last_drawn((*(DICacheEntry * const *)v1)->v_imgbuf),
+           d2 = a_Imgbuf_last_drawn((*(DICacheEntry * const *)v2)->v_imgbuf);
+
+   return (d1 > d2) - (d1 < d2);
+}
+
+/**
+ * Free the image data of the least recently drawn images until the
+ * dicache fits in the "dicache_max_size" budget. The images stay in use,
+ * and are decoded again from the cached data when they are drawn. Those
+ * drawn since the last pass (most likely on screen) are kept.
+ */
+static void Dicache_reclaim(void)
+{
+   DICacheEntry *entry, **victims;
+   ulong_t mark = dicache_drawn_mark;
+   size_t budget;
+   int i, n = 0;
+
+   for (i = 0; (entry = dList_nth_data(CachedIMGs, i)); ++i)
+      if (entry->v_imgbuf)
+         mark = MAX(mark, a_Imgbuf_last_drawn(entry->v_imgbuf));
+
+   if (prefs.dicache_max_size > 0) {
+      budget = (size_t)prefs.dicache_max_size * 1024 * 1024;
+      if (dicache_size_total > budget) {
+         victims = dNew(DICacheEntry *, dList_length(CachedIMGs));
+         for (i = 0; (entry = dList_nth_data(CachedIMGs, i)); ++i)
+            if (Dicache_is_reclaimable(entry))
+               victims[n++] = entry;
+         qsort(victims, n, sizeof(*victims), Dicache_entry_by_last_drawn_cmp);
+
+         for (i = 0; i < n && dicache_size_total > budget; ++i) {
+            entry = victims[i];
+            _MSG("Dicache_reclaim: %s (%u bytes)\n", URL_STR(entry->url),
+                 entry->TotalSize);
+            a_Imgbuf_reclaim(entry->v_imgbuf);
+            entry->Flags |= DIF_Reclaimed;
+            dicache_size_total -= entry->TotalSize;
+            StatReclaims++;
+         }
+         dFree(victims);
+      }
+   }
+   dicache_drawn_mark = mark;
+}
+
 /**
  * Free the imgbuf (RGB data) of unused entries.
  */
@@ -588,6 +966,7 @@ void a_Dicache_cleanup(void)
          --i; /* adjust counter */
       }
    }
+   Dicache_reclaim();
    _MSG("a_Dicache_cleanup: length = %d\n", dList_length(CachedIMGs));
 }
 
@@ -604,11 +983,14 @@ void a_Dicache_freeall(void)
    /* Remove all the dicache entries */
    while ((entry = dList_nth_data(CachedIMGs, dList_length(CachedIMGs)-1))) {
       dList_remove_fast(CachedIMGs, entry);
+      if (entry->Job)
+         a_Imgdec_job_abort(entry->Job);
       a_Url_free(entry->url);
       dFree(entry->cmap);
       a_Bitvec_free(entry->BitVec);
       a_Imgbuf_unref(entry->v_imgbuf);
-      dicache_size_total -= entry->TotalSize;
+      if (!(entry->Flags & DIF_Reclaimed))
+         dicache_size_total -= entry->TotalSize;
       dFree(entry);
    }
    dList_free(CachedIMGs);
@@ -652,6 +1034,13 @@ Dstr *a_Dicache_stats(void)
    float mb = (float) bytesCached / (1024.0f * 1024.0f);
 
    dStr_sprintfa(s, "<p>Total cached: %.2f MiB</p>\n", mb);
+   dStr_sprintfa(s, "<p>Resident: %.2f MiB",
+                 dicache_size_total / (1024.0f * 1024.0f));
+   if (prefs.dicache_max_size > 0)
+      dStr_sprintfa(s, " of %d MiB", prefs.dicache_max_size);
+   dStr_append(s, "</p>\n");
+   dStr_sprintfa(s, "<p>Reclaimed: %u, decoded again: %u</p>\n",
+                 StatReclaims, StatReloads);
 
    dStr_append(s,
       "</body>\n"
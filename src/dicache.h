@@ -21,13 +21,18 @@ extern "C" {
 #include "bitvec.h"
 #include "image.hh"
 #include "cache.h"
+#include "imgdec.h"
 #include "dlib/dlib.h"
 
 /** Symbolic name to request the last version of an image */
 #define DIC_Last  -1
-/** Flags: Last version, Valid entry */
-#define DIF_Last  1
-#define DIF_Valid 2
+/** Flags: Last version, Valid entry, Image data reclaimed, Being decoded
+ * again after a reclaim, Cached data pinned */
+#define DIF_Last      1
+#define DIF_Valid     2
+#define DIF_Reclaimed 4
+#define DIF_Reloading 8
+#define DIF_Pinned    16
 
 
 /* These will reflect the entry's "state" */
@@ -43,7 +48,13 @@ typedef enum {
 typedef struct DICacheEntry {
    DilloUrl *url;          /**< Image URL for this entry */
    DilloImgType type;      /**< Image type */
-   uint_t width, height;   /**< As taken from image data */
+   int Format;             /**< Image format (to decode it again) */
+   int32_t BgColor;        /**< Background color given to the decoder */
+   uint_t DataVersion;     /**< Version of the cached data decoded */
+   uint_t width, height;   /**< Of the decoded data (maybe reduced) */
+   uint_t Reduction;       /**< Decoded at 1/Reduction of the image size */
+   int DrawWidth;          /**< Size the first client draws it at, used */
+   int DrawHeight;         /**< to reduce it; -1 if unknown */
    short Flags;            /**< See Flags */
    short SurvCleanup;      /**< Cleanup-pass survival for unused images */
    uchar_t *cmap;          /**< Color map */
@@ -59,6 +70,7 @@ typedef struct DICacheEntry {
    uint_t DecodedSize;     /**< Size of already decoded data */
    CA_Callback_t Decoder;  /**< Client function */
    void *DecoderData;      /**< Client function data */
+   ImgdecJob *Job;         /**< Decoding job, if run by worker threads */
 } DICacheEntry;
 
 
@@ -74,6 +86,7 @@ void *a_Dicache_jpeg_image(const char *Type, void *Ptr, CA_Callback_t *Call,
                            void **Data);
 void a_Dicache_callback(int Op, CacheClient_t *Client);
 
+void a_Dicache_set_reduction(DilloUrl *url, int version, uint_t reduction);
 void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
                          uint_t width, uint_t height, DilloImgType type,
                          double gamma);
@@ -57,11 +57,13 @@
 #include "IO/control.h"
 #include "capi.h"
 #include "dicache.h"
+#include "imgdec.h"
 #include "cookies.h"
 #include "actions.h"
 #include "hsts.h"
 #include "domain.h"
 #include "auth.h"
+#include "htmlscan.h"
 #include "styleengine.hh"
 
 #include "dw/fltkcore.hh"
@@ -504,6 +506,7 @@ int main(int argc, char **argv)
    a_Mime_init();
    a_Capi_init();
    a_Dicache_init();
+   a_Imgdec_init();
    a_Bw_init();
    a_Cookies_init();
    a_Actions_init();
@@ -511,6 +514,7 @@ int main(int argc, char **argv)
    a_Auth_init();
    a_UIcmd_init();
    a_Control_init();
+   a_Htmlscan_init();
    StyleEngine::init();
 
    Keys::genAboutKeys();
@@ -639,6 +643,7 @@ int main(int argc, char **argv)
    a_Hsts_freeall();
    a_Cache_freeall();
    a_Dicache_freeall();
+   a_Imgdec_freeall();
    a_Http_freeall();
    a_Tls_freeall();
    a_Dns_freeall();
@@ -0,0 +1,461 @@
+/*
+ * File: diskcache.c
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * Persistent copies of HTTP responses, kept in ~/.dillo/cache.
+ *
+ * Each response is stored in its own file, named after the URL hash, so
+ * the directory itself is the index. The first line of the file holds the
+ * URL (to tell apart URLs with the same hash), followed by the HTTP header
+ * up to and including the empty line, and then the decoded body. The
+ * modification time of the file is the time the response was last
+ * validated with the server.
+ *
+ * The cache module decides what is stored and whether a copy is still
+ * fresh; this file only deals with the files.
+ *
+ * Files are written, touched and removed by a writer thread, so the main
+ * thread does not wait for the disk; the thread also keeps the directory
+ * within "disk_cache_max_size", removing the least recently used copies.
+ * Reading stays in the main thread, because the cache needs the answer
+ * right away to decide whether to ask the server. A copy with a write
+ * still pending is read from the queue instead of the file.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "diskcache.h"
+#include "prefs.h"
+#include "list.h"
+#include "msg.h"
+#include "dlib/dlib.h"
+
+typedef enum {
+   DISKCACHE_Store,     /**< Write 'data' as the file */
+   DISKCACHE_Touch,     /**< Mark the copy as validated now */
+   DISKCACHE_Use,       /**< Mark the copy as used now (for pruning) */
+   DISKCACHE_Remove     /**< Remove the file */
+} DiskcacheOp;
+
+/**
+ * A pending change to the cache directory.
+ */
+typedef struct {
+   DiskcacheOp op;
+   char *filename;
+   Dstr *data;          /**< Store: the contents of the file */
+   time_t stored;       /**< Store: when it was queued */
+} DiskcacheJob;
+
+/**
+ * A file found when pruning the directory.
+ */
+typedef struct {
+   char *filename;
+   time_t used;
+   off_t size;
+} DiskcacheFile;
+
+/*
+ * Local data
+ */
+static pthread_mutex_t diskcache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t diskcache_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t diskcache_thread;
+static bool_t diskcache_started = FALSE;
+static bool_t diskcache_quit = FALSE;
+/** Jobs for the writer, in order; the one being done is kept first */
+static Dlist *diskcache_jobs = NULL;
+/** Bytes in the directory, or -1 when unknown (writer thread only) */
+static off_t diskcache_size = -1;
+
+
+/**
+ * Return the cache directory (must be freed).
+ */
+static char *Diskcache_dir(void)
+{
+   return dStrconcat(dGethomedir(), "/.dillo/cache", NULL);
+}
+
+/**
+ * Return the name of the file for 'url' (must be freed).
+ */
+static char *Diskcache_filename(const DilloUrl *url)
+{
+   char name[16];
+
+   snprintf(name, sizeof(name), "%08x", URL_HASH(url));
+   return dStrconcat(dGethomedir(), "/.dillo/cache/", name, NULL);
+}
+
+/**
+ * Size of a file, or 0 when it does not exist.
+ */
+static off_t Diskcache_file_size(const char *filename)
+{
+   struct stat st;
+
+   return stat(filename, &st) == 0 ? st.st_size : 0;
+}
+
+static int Diskcache_file_cmp(const void *a, const void *b)
+{
+   const DiskcacheFile *fa = a, *fb = b;
+
+   return (fa->used > fb->used) - (fa->used < fb->used);
+}
+
+/**
+ * Find the copies in the cache directory and add up their size.
+ * When 'budget' is exceeded, remove the least recently used copies
+ * other than 'keep' until the directory is down to three quarters of it.
+ */
+static void Diskcache_prune(off_t budget, const char *keep)
+{
+   char *dir = Diskcache_dir();
+   DiskcacheFile *files = NULL;
+   int i, nfiles = 0, maxfiles = 64;
+   struct dirent *de;
+   struct stat st;
+   off_t total = 0;
+   DIR *d;
+
+   if (!(d = opendir(dir))) {
+      dFree(dir);
+      diskcache_size = 0;
+      return;
+   }
+   while ((de = readdir(d))) {
+      /* only the copies, not the temporary files */
+      if (strlen(de->d_name) != 8 ||
+          strspn(de->d_name, "0123456789abcdef") != 8)
+         continue;
+      a_List_add(files, nfiles, maxfiles);
+      files[nfiles].filename = dStrconcat(dir, "/", de->d_name, NULL);
+      if (stat(files[nfiles].filename, &st) < 0) {
+         dFree(files[nfiles].filename);
+         continue;
+      }
+      files[nfiles].used = st.st_atime;
+      files[nfiles].size = st.st_size;
+      total += st.st_size;
+      nfiles++;
+   }
+   closedir(d);
+
+   if (total > budget) {
+      qsort(files, nfiles, sizeof(DiskcacheFile), Diskcache_file_cmp);
+      for (i = 0; i < nfiles && total > budget / 4 * 3; i++) {
+         if (strcmp(files[i].filename, keep) &&
+             unlink(files[i].filename) == 0)
+            total -= files[i].size;
+      }
+      _MSG("Diskcache: pruned %d copies, %ld bytes left\n", i, (long)total);
+   }
+   for (i = 0; i < nfiles; i++)
+      dFree(files[i].filename);
+   dFree(files);
+   dFree(dir);
+   diskcache_size = total;
+}
+
+/**
+ * Write a copy under a temporary name and rename it, so a reader never
+ * sees a partial copy.
+ */
+static void Diskcache_write(DiskcacheJob *job)
+{
+   char *dir, *tmpname;
+   off_t budget = (off_t)prefs.disk_cache_max_size * 1024 * 1024;
+   off_t old_size;
+   bool_t ok;
+   FILE *fp;
+
+   dir = Diskcache_dir();
+   if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+      MSG_ERR("Diskcache: cannot create %s: %s\n", dir, dStrerror(errno));
+      dFree(dir);
+      return;
+   }
+   dFree(dir);
+
+   old_size = Diskcache_file_size(job->filename);
+   tmpname = dStrconcat(job->filename, ".tmp", NULL);
+   if ((fp = fopen(tmpname, "wb"))) {
+      ok = fwrite(job->data->str, 1, job->data->len, fp) ==
+           (size_t)job->data->len;
+      ok = (fclose(fp) == 0) && ok;
+      if (!ok || rename(tmpname, job->filename) < 0) {
+         MSG_ERR("Diskcache: cannot write %s: %s\n", job->filename,
+                 dStrerror(errno));
+         unlink(tmpname);
+      } else if (diskcache_size >= 0) {
+         diskcache_size += job->data->len - old_size;
+      }
+   }
+   dFree(tmpname);
+
+   if (budget > 0 && (diskcache_size < 0 || diskcache_size > budget))
+      Diskcache_prune(budget, job->filename);
+}
+
+/**
+ * Do a job (in the writer thread).
+ */
+static void Diskcache_do(DiskcacheJob *job)
+{
+   struct utimbuf ut;
+   struct stat st;
+
+   switch (job->op) {
+   case DISKCACHE_Store:
+      Diskcache_write(job);
+      break;
+   case DISKCACHE_Touch:
+      utime(job->filename, NULL);
+      break;
+   case DISKCACHE_Use:
+      /* keep the validation time */
+      if (stat(job->filename, &st) == 0) {
+         ut.actime = time(NULL);
+         ut.modtime = st.st_mtime;
+         utime(job->filename, &ut);
+      }
+      break;
+   case DISKCACHE_Remove:
+      st.st_size = Diskcache_file_size(job->filename);
+      if (unlink(job->filename) == 0 && diskcache_size >= 0)
+         diskcache_size -= st.st_size;
+      break;
+   }
+}
+
+static void Diskcache_job_free(DiskcacheJob *job)
+{
+   dFree(job->filename);
+   if (job->data)
+      dStr_free(job->data, 1);
+   dFree(job);
+}
+
+static void *Diskcache_writer(void *data)
+{
+   DiskcacheJob *job;
+
+   pthread_mutex_lock(&diskcache_mutex);
+   while (1) {
+      while (!dList_length(diskcache_jobs) && !diskcache_quit)
+         pthread_cond_wait(&diskcache_work_cond, &diskcache_mutex);
+      if (!(job = dList_nth_data(diskcache_jobs, 0)))
+         break;
+      pthread_mutex_unlock(&diskcache_mutex);
+      Diskcache_do(job);
+      pthread_mutex_lock(&diskcache_mutex);
+      dList_remove(diskcache_jobs, job);
+      Diskcache_job_free(job);
+   }
+   pthread_mutex_unlock(&diskcache_mutex);
+   return NULL;
+}
+
+/**
+ * Queue a job for the writer thread, starting it if needed.
+ * Without the thread, the job is done right away.
+ */
+static void Diskcache_queue(DiskcacheOp op, const DilloUrl *url, Dstr *data)
+{
+   DiskcacheJob *job = dNew0(DiskcacheJob, 1);
+
+   job->op = op;
+   job->filename = Diskcache_filename(url);
+   job->data = data;
+   job->stored = time(NULL);
+
+   pthread_mutex_lock(&diskcache_mutex);
+   if (!diskcache_started) {
+      diskcache_jobs = dList_new(16);
+      diskcache_started =
+         pthread_create(&diskcache_thread, NULL, Diskcache_writer, NULL) == 0;
+      if (!diskcache_started) {
+         MSG_ERR("Diskcache: cannot start the writer thread\n");
+         dList_free(diskcache_jobs);
+         diskcache_jobs = NULL;
+      }
+   }
+   if (diskcache_started) {
+      dList_append(diskcache_jobs, job);
+      pthread_cond_signal(&diskcache_work_cond);
+      job = NULL;
+   }
+   pthread_mutex_unlock(&diskcache_mutex);
+
+   if (job) {
+      Diskcache_do(job);
+      Diskcache_job_free(job);
+   }
+}
+
+/**
+ * Look for a store or a removal of 'filename' that the writer has not
+ * finished. For a store, its contents are copied to 'ds'.
+ * @return the last such job's operation, or -1.
+ */
+static int Diskcache_pending(const char *filename, Dstr **ds, time_t *stored)
+{
+   DiskcacheJob *job, *last = NULL;
+   int i, ret = -1;
+
+   pthread_mutex_lock(&diskcache_mutex);
+   for (i = 0; (job = dList_nth_data(diskcache_jobs, i)); ++i)
+      if ((job->op == DISKCACHE_Store || job->op == DISKCACHE_Remove) &&
+          !strcmp(job->filename, filename))
+         last = job;
+   if (last) {
+      ret = last->op;
+      if (last->op == DISKCACHE_Store) {
+         *ds = dStr_sized_new(last->data->len + 1);
+         dStr_append_l(*ds, last->data->str, last->data->len);
+         *stored = last->stored;
+      }
+   }
+   pthread_mutex_unlock(&diskcache_mutex);
+   return ret;
+}
+
+/**
+ * Read the stored copy of 'url'.
+ * On success, the header (ending in an empty line) and the body are
+ * returned in new strings, and 'stored' is set to the validation time.
+ * 'body' may be NULL when only the header is wanted.
+ */
+bool_t a_Diskcache_load(const DilloUrl *url, Dstr **header, Dstr **body,
+                        time_t *stored)
+{
+   char *filename, *nl, *end, buf[8192];
+   bool_t ret = FALSE;
+   struct stat st;
+   DilloUrl *file_url;
+   Dstr *ds = NULL;
+   FILE *fp;
+   size_t n;
+   int pending;
+
+   filename = Diskcache_filename(url);
+   pending = Diskcache_pending(filename, &ds, stored);
+   if (pending == DISKCACHE_Remove) {
+      dFree(filename);
+      return FALSE;
+   }
+   if (pending == -1) {
+      if (!(fp = fopen(filename, "rb"))) {
+         dFree(filename);
+         return FALSE;
+      }
+      if (fstat(fileno(fp), &st) < 0) {
+         fclose(fp);
+         dFree(filename);
+         return FALSE;
+      }
+      ds = dStr_sized_new(body ? (int)st.st_size + 1 : (int)sizeof(buf));
+      while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+         dStr_append_l(ds, buf, n);
+         if (!body && strstr(ds->str, "\n\n"))
+            break;   /* only the header is wanted */
+      }
+      fclose(fp);
+      *stored = st.st_mtime;
+   }
+
+   if ((nl = memchr(ds->str, '\n', ds->len)) &&
+       (end = strstr(nl + 1, "\n\n"))) {
+      *nl = 0;
+      file_url = a_Url_new(ds->str, NULL);
+      if (a_Url_cmp(file_url, url) == 0) {
+         end += 2;
+         *header = dStr_new("");
+         dStr_append_l(*header, nl + 1, end - (nl + 1));
+         if (body) {
+            *body = dStr_sized_new(ds->len - (end - ds->str) + 1);
+            dStr_append_l(*body, end, ds->len - (end - ds->str));
+         }
+         ret = TRUE;
+      }
+      a_Url_free(file_url);
+   }
+   if (!ret) {
+      _MSG("Diskcache: no usable copy of %s in %s\n", URL_STR(url), filename);
+   } else if (pending == -1) {
+      Diskcache_queue(DISKCACHE_Use, url, NULL);
+   }
+
+   dStr_free(ds, 1);
+   dFree(filename);
+   return ret;
+}
+
+/**
+ * Store a copy of 'url'. 'header' must end in an empty line.
+ */
+void a_Diskcache_store(const DilloUrl *url, const Dstr *header,
+                       const Dstr *body)
+{
+   Dstr *data = dStr_sized_new(header->len + body->len + 256);
+
+   dStr_append(data, URL_STR(url));
+   dStr_append_c(data, '\n');
+   dStr_append_l(data, header->str, header->len);
+   dStr_append_l(data, body->str, body->len);
+   Diskcache_queue(DISKCACHE_Store, url, data);
+}
+
+/**
+ * Mark the stored copy of 'url' as validated now.
+ */
+void a_Diskcache_touch(const DilloUrl *url)
+{
+   Diskcache_queue(DISKCACHE_Touch, url, NULL);
+}
+
+/**
+ * Remove the stored copy of 'url', if any.
+ */
+void a_Diskcache_remove(const DilloUrl *url)
+{
+   Diskcache_queue(DISKCACHE_Remove, url, NULL);
+}
+
+/**
+ * Finish the pending writes and stop the writer thread (at exit time).
+ */
+void a_Diskcache_freeall(void)
+{
+   pthread_mutex_lock(&diskcache_mutex);
+   diskcache_quit = TRUE;
+   pthread_cond_signal(&diskcache_work_cond);
+   pthread_mutex_unlock(&diskcache_mutex);
+
+   if (diskcache_started) {
+      pthread_join(diskcache_thread, NULL);
+      dList_free(diskcache_jobs);
+      diskcache_jobs = NULL;
+      diskcache_started = FALSE;
+   }
+}
@@ -0,0 +1,24 @@
+#ifndef __DISKCACHE_H__
+#define __DISKCACHE_H__
+
+#include <time.h>
+
+#include "d_size.h"
+#include "url.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+bool_t a_Diskcache_load(const DilloUrl *url, Dstr **header, Dstr **body,
+                        time_t *stored);
+void   a_Diskcache_store(const DilloUrl *url, const Dstr *header,
+                         const Dstr *body);
+void   a_Diskcache_touch(const DilloUrl *url);
+void   a_Diskcache_remove(const DilloUrl *url);
+void   a_Diskcache_freeall(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* !__DISKCACHE_H__ */
@@ -37,20 +37,29 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "msg.h"
 #include "dns.h"
 #include "list.h"
+#include "prefs.h"
 #include "IO/iowatch.hh"
 
 
-/* Maximum dns resolving threads */
+/* Maximum dns resolving threads (the actual number is set in dillorc) */
 #ifdef D_DNS_THREADED
-#  define D_DNS_MAX_SERVERS 4
+#  define D_DNS_MAX_SERVERS 32
 #else
 #  define D_DNS_MAX_SERVERS 1
 #endif
 
+/* Size of the hash table and maximum number of cached hosts */
+#define DNS_CACHE_BUCKETS 256
+#define DNS_CACHE_MAX 512
+
+/* Seconds to remember that a host name does not exist */
+#define DNS_NEGATIVE_TTL 30
+
 typedef enum {
    DNS_SERVER_IDLE,
    DNS_SERVER_PROCESSING,
@@ -68,9 +77,14 @@ typedef struct {
 #endif
 } DnsServer;
 
-typedef struct {
+typedef struct GDnsCache {
    char *hostname;         /**< host name for cache */
-   Dlist *addr_list;       /**< addresses of host */
+   uint_t hash;            /**< Dns_hash(hostname) */
+   Dlist *addr_list;       /**< addresses of host (NULL if it doesn't exist) */
+   int status;             /**< resolver error code for a missing host */
+   time_t expires;         /**< when the answer must be asked again */
+   time_t last_used;       /**< for eviction when the cache is full */
+   struct GDnsCache *next; /**< next entry in the same bucket */
 } GDnsCache;
 
 typedef struct {
@@ -89,10 +103,10 @@ static void Dns_timeout_client(int fd, void *data);
 /*
  * Local Data
  */
-static DnsServer dns_server[D_DNS_MAX_SERVERS];
+static DnsServer *dns_server;
 static int num_servers;
-static GDnsCache *dns_cache;
-static int dns_cache_size, dns_cache_size_max;
+static GDnsCache *dns_cache[DNS_CACHE_BUCKETS];
+static int dns_cache_size;
 static GDnsQueue *dns_queue;
 static int dns_queue_size, dns_queue_size_max;
 static int dns_notify_pipe[2];
@@ -159,16 +173,141 @@ void Dns_queue_print()
 }
  */
 
+/* ----------------------------------------------------------------------
+ *  Dns cache functions
+ */
+
+/**
+ * Case-insensitive FNV-1a hash of a host name
+ */
+static uint_t Dns_hash(const char *hostname)
+{
+   uint_t h = 2166136261u;
+
+   for ( ; *hostname; hostname++) {
+      h ^= (unsigned char) D_ASCII_TOLOWER(*hostname);
+      h *= 16777619u;
+   }
+   return h;
+}
+
+/**
+ * Unlink the cache entry pointed to by 'link' and free it
+ */
+static void Dns_cache_remove(GDnsCache **link)
+{
+   GDnsCache *entry = *link;
+
+   *link = entry->next;
+   dFree(entry->hostname);
+   a_Dns_addr_list_free(entry->addr_list);
+   dFree(entry);
+   --dns_cache_size;
+}
+
+/**
+ * Find a cached answer for hostname.
+ * An expired answer is dropped, and NULL returned.
+ */
+static GDnsCache *Dns_cache_find(const char *hostname, uint_t hash)
+{
+   GDnsCache **link = &dns_cache[hash % DNS_CACHE_BUCKETS];
+
+   for ( ; *link; link = &(*link)->next) {
+      if ((*link)->hash == hash &&
+          !dStrAsciiCasecmp(hostname, (*link)->hostname)) {
+         if ((*link)->expires <= time(NULL)) {
+            Dns_cache_remove(link);
+            return NULL;
+         }
+         return *link;
+      }
+   }
+   return NULL;
+}
+
 /**
- *  Add an IP/hostname pair to Dns-cache
+ * Make room for a new entry: drop every expired answer and, if the cache
+ * is still full, the one that was used least recently.
  */
-static void Dns_cache_add(char *hostname, Dlist *addr_list)
+static void Dns_cache_make_room(void)
 {
-   a_List_add(dns_cache, dns_cache_size, dns_cache_size_max);
-   dns_cache[dns_cache_size].hostname = dStrdup(hostname);
-   dns_cache[dns_cache_size].addr_list = addr_list;
+   GDnsCache **link, **lru = NULL;
+   time_t now = time(NULL);
+   int i;
+
+   if (dns_cache_size < DNS_CACHE_MAX)
+      return;
+
+   for (i = 0; i < DNS_CACHE_BUCKETS; i++) {
+      for (link = &dns_cache[i]; *link; ) {
+         if ((*link)->expires <= now) {
+            Dns_cache_remove(link);
+         } else {
+            if (!lru || (*link)->last_used < (*lru)->last_used)
+               lru = link;
+            link = &(*link)->next;
+         }
+      }
+   }
+   if (dns_cache_size >= DNS_CACHE_MAX && lru)
+      Dns_cache_remove(lru);
+}
+
+/**
+ * Add the answer for hostname to the Dns-cache.
+ * A NULL addr_list records that the host doesn't exist, for a short time.
+ * Return whether the cache took ownership of addr_list.
+ */
+static bool_t Dns_cache_add(const char *hostname, int status,
+                            Dlist *addr_list)
+{
+   uint_t hash = Dns_hash(hostname);
+   int ttl = addr_list ? prefs.dns_cache_ttl :
+                         MIN(prefs.dns_cache_ttl, DNS_NEGATIVE_TTL);
+   GDnsCache **link, *entry;
+
+   if (ttl <= 0)
+      return FALSE;
+
+   /* replace a previous answer, if any */
+   for (link = &dns_cache[hash % DNS_CACHE_BUCKETS]; *link;
+        link = &(*link)->next) {
+      if ((*link)->hash == hash &&
+          !dStrAsciiCasecmp(hostname, (*link)->hostname)) {
+         Dns_cache_remove(link);
+         break;
+      }
+   }
+   Dns_cache_make_room();
+
+   entry = dNew(GDnsCache, 1);
+   entry->hostname = dStrdup(hostname);
+   entry->hash = hash;
+   entry->addr_list = addr_list;
+   entry->status = status;
+   entry->last_used = time(NULL);
+   entry->expires = entry->last_used + ttl;
+   entry->next = dns_cache[hash % DNS_CACHE_BUCKETS];
+   dns_cache[hash % DNS_CACHE_BUCKETS] = entry;
    ++dns_cache_size;
    _MSG("Cache objects: %d\n", dns_cache_size);
+   return TRUE;
+}
+
+/**
+ * Whether a resolver error means that the host name doesn't exist
+ * (as opposed to a temporary failure that is worth retrying).
+ */
+static bool_t Dns_error_is_permanent(int status)
+{
+   if (status == EAI_NONAME)
+      return TRUE;
+#ifdef EAI_NODATA
+   if (status == EAI_NODATA)
+      return TRUE;
+#endif
+   return FALSE;
 }
 
 
@@ -190,10 +329,9 @@ void a_Dns_init(void)
    dns_queue = dNew(GDnsQueue, dns_queue_size_max);
 
    dns_cache_size = 0;
-   dns_cache_size_max = 16;
-   dns_cache = dNew(GDnsCache, dns_cache_size_max);
 
-   num_servers = D_DNS_MAX_SERVERS;
+   num_servers = MAX(1, MIN(prefs.dns_max_threads, D_DNS_MAX_SERVERS));
+   dns_server = dNew(DnsServer, num_servers);
 
    res = pipe(dns_notify_pipe);
    assert(res == 0);
@@ -357,23 +495,21 @@ static void Dns_server_req(int channel, const char *hostname)
 
 /**
  * Return the IP for the given hostname using a callback.
+ * The address list passed to the callback is only valid during the call.
  * Side effect: a thread is spawned when hostname is not cached.
  */
 void a_Dns_resolve(const char *hostname, DnsCallback_t cb_func, void *cb_data)
 {
    int i, channel;
+   GDnsCache *entry;
 
    if (!hostname)
       return;
 
-   /* check for cache hit. */
-   for (i = 0; i < dns_cache_size; i++)
-      if (!dStrAsciiCasecmp(hostname, dns_cache[i].hostname))
-         break;
-
-   if (i < dns_cache_size) {
+   if ((entry = Dns_cache_find(hostname, Dns_hash(hostname)))) {
       /* already resolved, call the Callback immediately. */
-      cb_func(0, dns_cache[i].addr_list, cb_data);
+      entry->last_used = time(NULL);
+      cb_func(entry->status, entry->addr_list, cb_data);
 
    } else if ((i = Dns_queue_find(hostname)) != -1) {
       /* hit in queue, but answer hasn't come back yet. */
@@ -458,13 +594,19 @@ static void Dns_timeout_client(int fd, void *data)
 
    for (i = 0; i < num_servers; ++i) {
       DnsServer *srv = &dns_server[i];
+      bool_t cached = FALSE;
 
       if (srv->state == DNS_SERVER_RESOLVED) {
-         if (srv->addr_list != NULL) {
-            /* DNS succeeded, let's cache it */
-            Dns_cache_add(srv->hostname, srv->addr_list);
+         if (srv->addr_list != NULL ||
+             Dns_error_is_permanent(srv->status)) {
+            /* DNS succeeded or the host doesn't exist, let's cache it */
+            cached = Dns_cache_add(srv->hostname, srv->status,
+                                   srv->addr_list);
          }
          Dns_serve_channel(i);
+         if (!cached)
+            a_Dns_addr_list_free(srv->addr_list);
+         srv->addr_list = NULL;
          srv->state = DNS_SERVER_IDLE;
       }
    }
@@ -476,22 +618,49 @@ static void Dns_timeout_client(int fd, void *data)
  *  Dns memory-deallocation.
  *  (Call this one at exit time)
  *  The Dns_queue is deallocated at execution time (no need to do that here)
- *  'dns_cache' is the only one that grows dynamically
+ *  'dns_server' is kept, as resolver threads may still be running.
  */
 void a_Dns_freeall(void)
 {
-   int i, j;
+   int i;
 
-   for ( i = 0; i < dns_cache_size; ++i ){
-      dFree(dns_cache[i].hostname);
-      for ( j = 0; j < dList_length(dns_cache[i].addr_list); ++j)
-         dFree(dList_nth_data(dns_cache[i].addr_list, j));
-      dList_free(dns_cache[i].addr_list);
-   }
+   for (i = 0; i < DNS_CACHE_BUCKETS; ++i)
+      while (dns_cache[i])
+         Dns_cache_remove(&dns_cache[i]);
    a_IOwatch_remove_fd(dns_notify_pipe[0], DIO_READ);
    dClose(dns_notify_pipe[0]);
    dClose(dns_notify_pipe[1]);
-   dFree(dns_cache);
+}
+
+/**
+ * Return a copy of an address list, to keep it after the DNS callback.
+ */
+Dlist *a_Dns_addr_list_copy(Dlist *addr_list)
+{
+   Dlist *copy;
+   int i;
+
+   if (!addr_list)
+      return NULL;
+   copy = dList_new(dList_length(addr_list));
+   for (i = 0; i < dList_length(addr_list); ++i) {
+      DilloHost *dh = dNew(DilloHost, 1);
+      *dh = *(DilloHost *) dList_nth_data(addr_list, i);
+      dList_append(copy, dh);
+   }
+   return copy;
+}
+
+/**
+ * Free an address list and its hosts.
+ */
+void a_Dns_addr_list_free(Dlist *addr_list)
+{
+   int i;
+
+   for (i = 0; i < dList_length(addr_list); ++i)
+      dFree(dList_nth_data(addr_list, i));
+   dList_free(addr_list);
 }
 
 /**
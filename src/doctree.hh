@@ -2,6 +2,57 @@
 #define __DOCTREE_HH__
 
 #include "lout/misc.hh"
+#include "dlib/dlib.h"
+
+/**
+ * \brief Counting Bloom filter of the element names, ids and classes of
+ * the open elements.
+ *
+ * It is a superset of the ancestors of any node being styled, so if a key
+ * that a selector requires from its ancestors is not in the filter, the
+ * selector can't match and the walk up the tree is skipped.
+ */
+class DoctreeFilter {
+   private:
+      enum { BITS = 12, SIZE = 1 << BITS, MASK = SIZE - 1, MAX = 255 };
+      unsigned char count[SIZE];
+
+      static inline unsigned mix (unsigned h) {
+         h ^= h >> 16;
+         h *= 0x7feb352dU;
+         h ^= h >> 15;
+         return h;
+      }
+      /* Counters that reach MAX stay there, so they never underflow */
+      inline void inc (unsigned i) { if (count[i] < MAX) count[i]++; }
+      inline void dec (unsigned i) { if (count[i] < MAX) count[i]--; }
+
+   public:
+      DoctreeFilter () { memset (count, 0, sizeof (count)); };
+
+      static inline unsigned hashElement (int element) {
+         return mix ((unsigned) element * 0x9e3779b1U + 1);
+      }
+      /** Hash ids (salt 'i') and classes (salt 'c'), ignoring ASCII case */
+      static inline unsigned hashString (const char *s, char salt) {
+         unsigned h = 2166136261U ^ (unsigned char) salt;
+         for ( ; *s; s++)
+            h = (h ^ (unsigned char) D_ASCII_TOLOWER (*s)) * 16777619U;
+         return mix (h);
+      }
+
+      inline void add (unsigned h) {
+         inc (h & MASK);
+         inc ((h >> BITS) & MASK);
+      }
+      inline void remove (unsigned h) {
+         dec (h & MASK);
+         dec ((h >> BITS) & MASK);
+      }
+      inline bool mayContain (unsigned h) const {
+         return count[h & MASK] && count[(h >> BITS) & MASK];
+      }
+};
 
 class DoctreeNode {
    public:
@@ -50,6 +101,7 @@ class Doctree {
       DoctreeNode *topNode;
       DoctreeNode *rootNode;
       int num;
+      DoctreeFilter ancestorFilter;
 
    public:
       Doctree () {
@@ -94,6 +146,10 @@ class Doctree {
       inline DoctreeNode *sibling (const DoctreeNode *node) {
          return node->sibling;
       };
+
+      inline DoctreeFilter *filter () {
+         return &ancestorFilter;
+      };
 };
 
 #endif
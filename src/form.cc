@@ -725,28 +725,31 @@ void Html_tag_close_textarea(DilloHtml *html)
 {
    char *str;
    DilloHtmlInput *input;
+   Dstr *stash;
    int i;
 
    if (html->InFlags & IN_TEXTAREA && a_Html_should_display(html)) {
+      stash = a_Html_stash_get(html);
+
       /* Remove the line ending that follows the opening tag */
-      if (html->Stash->str[0] == '\r')
-         dStr_erase(html->Stash, 0, 1);
-      if (html->Stash->str[0] == '\n')
-         dStr_erase(html->Stash, 0, 1);
+      if (stash->str[0] == '\r')
+         dStr_erase(stash, 0, 1);
+      if (stash->str[0] == '\n')
+         dStr_erase(stash, 0, 1);
 
       /* As the spec recommends to canonicalize line endings, it is safe
        * to replace '\r' with '\n'. It will be canonicalized anyway! */
-      for (i = 0; i < html->Stash->len; ++i) {
-         if (html->Stash->str[i] == '\r') {
-            if (html->Stash->str[i + 1] == '\n')
-               dStr_erase(html->Stash, i, 1);
+      for (i = 0; i < stash->len; ++i) {
+         if (stash->str[i] == '\r') {
+            if (stash->str[i + 1] == '\n')
+               dStr_erase(stash, i, 1);
             else
-               html->Stash->str[i] = '\n';
+               stash->str[i] = '\n';
          }
       }
 
       /* The HTML3.2 spec says it can have "text and character entities". */
-      str = a_Html_parse_entities(html, html->Stash->str, html->Stash->len);
+      str = a_Html_parse_entities(html, stash->str, stash->len);
       input = Html_get_current_input(html);
       if (input) {
          input->init_str = str;
@@ -156,7 +156,7 @@ void *a_Gif_new(DilloImage *Image, DilloUrl *url, int version)
    _MSG("a_Gif_new: gif=%p\n", gif);
 
    gif->Image = Image;
-   gif->url = url;
+   gif->url = a_Url_dup(url);
    gif->version = version;
 
    gif->Flags = 0;
@@ -189,6 +189,7 @@ static void Gif_free(DilloGif *gif)
          dFree(gif->spill_lines[i]);
       dFree(gif->spill_lines);
    }
+   a_Url_free(gif->url);
    dFree(gif);
 }
 
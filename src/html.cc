@@ -27,6 +27,7 @@
 #include "binaryconst.h"
 #include "colors.h"
 #include "html_charrefs.h"
+#include "htmlscan.h"
 #include "utf8.hh"
 #include "dlib/dlib.h"  /* dIsxdigit */
 
@@ -57,6 +58,9 @@
 
 #define TAB_SIZE 8
 
+/* Most hosts of link targets to resolve ahead of time, per page */
+#define HTML_PREFETCH_HOSTS_MAX 8
+
 /*-----------------------------------------------------------------------------
  * Name spaces
  *---------------------------------------------------------------------------*/
@@ -102,7 +106,8 @@ void *a_Html_text(const char *type, void *P, CA_Callback_t *Call,void **Data);
  *---------------------------------------------------------------------------*/
 static int Html_write_raw(DilloHtml *html, char *buf, int bufsize, int Eof);
 static bool Html_load_image(BrowserWindow *bw, DilloUrl *url,
-                            const DilloUrl *requester, DilloImage *image);
+                            const DilloUrl *requester, DilloImage *image,
+                            bool lazy);
 static void Html_callback(int Op, CacheClient_t *Client);
 static void Html_tag_cleanup_at_close(DilloHtml *html, int TagIdx);
 int a_Html_tag_index(const char *tag);
@@ -447,6 +452,7 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
    /* Init for-parsing variables */
    Start_Buf = NULL;
    Start_Ofs = 0;
+   memset(&scan, 0, sizeof(scan));
 
    _MSG("DilloHtml(): content type: %s\n", content_type);
    this->content_type = dStrdup(content_type);
@@ -465,6 +471,7 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
    styleEngine = new StyleEngine (HT2LT (this), page_url, base_url, bw->zoom);
 
    cssUrls = new misc::SimpleVector <DilloUrl*> (1);
+   prefetchHosts = new misc::SimpleVector <char*> (HTML_PREFETCH_HOSTS_MAX);
 
    stack = new misc::SimpleVector <DilloHtmlState> (16);
    stack->increase();
@@ -485,6 +492,7 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
 
    Stash = dStr_new("");
    StashSpace = false;
+   StashViewOfs = StashViewLen = 0;
 
    pre_column = 0;
    PreFirstChar = false;
@@ -628,6 +636,10 @@ void DilloHtml::freeParseData()
 {
    delete(stack);
 
+   for (int i = 0; i < prefetchHosts->size(); i++)
+      dFree(prefetchHosts->get(i));
+   delete(prefetchHosts);
+
    dStr_free(Stash, TRUE);
    dStr_free(attr_data, TRUE);
    dFree(content_type);
@@ -718,7 +730,7 @@ void DilloHtml::loadImages (const DilloUrl *pattern)
       if (hi->image) {
          assert(hi->url);
          if ((!pattern) || (!a_Url_cmp(hi->url, pattern))) {
-            if (Html_load_image(bw, hi->url, requester, hi->image)) {
+            if (Html_load_image(bw, hi->url, requester, hi->image, false)) {
                a_Image_unref (hi->image);
                hi->image = NULL;  // web owns it now
             }
@@ -854,9 +866,57 @@ void a_Html_stash_init(DilloHtml *html)
 {
    S_TOP(html)->parse_mode = DILLO_HTML_PARSE_MODE_STASH;
    html->StashSpace = false;
+   html->StashViewLen = 0;
    dStr_truncate(html->Stash, 0);
 }
 
+/**
+ * Add VERBATIM text to the stash. The text is left in the page buffer when
+ * it is all the stash has, so that <script> and <style> bodies are not
+ * copied just to be read once and thrown away.
+ */
+static void Html_stash_append_verbatim(DilloHtml *html, const char *text,
+                                       int len)
+{
+   if (html->Stash->len == 0 && html->StashViewLen == 0 &&
+       !(html->InFlags & IN_META_HACK)) {
+      /* The META hack parses its own buffer, which is not kept */
+      html->StashViewOfs = text - html->Start_Buf;
+      html->StashViewLen = len;
+   } else {
+      dStr_append_l(a_Html_stash_get(html), text, len);
+   }
+}
+
+/**
+ * Return the stash contents, without copying the VERBATIM text that is
+ * still in the page buffer. The pointer is only valid while parsing the
+ * current data.
+ */
+static const char *Html_stash_view(DilloHtml *html, int *len)
+{
+   if (html->StashViewLen > 0) {
+      *len = html->StashViewLen;
+      return html->Start_Buf + html->StashViewOfs;
+   }
+   *len = html->Stash->len;
+   return html->Stash->str;
+}
+
+/**
+ * Return the stash as a Dstr that can be modified, copying any text still
+ * in the page buffer into it.
+ */
+Dstr *a_Html_stash_get(DilloHtml *html)
+{
+   if (html->StashViewLen > 0) {
+      dStr_append_l(html->Stash, html->Start_Buf + html->StashViewOfs,
+                    html->StashViewLen);
+      html->StashViewLen = 0;
+   }
+   return html->Stash;
+}
+
 /**
  * This is M$ non-standard "smart quotes" (w1252). Now even deprecated by them!
  *
@@ -1150,7 +1210,7 @@ static void Html_process_space(DilloHtml *html, const char *space,
       html->StashSpace = (html->Stash->len > 0);
 
    } else if (parse_mode == DILLO_HTML_PARSE_MODE_VERBATIM) {
-      dStr_append_l(html->Stash, space, spacesize);
+      dStr_append_l(a_Html_stash_get(html), space, spacesize);
 
    } else if (parse_mode == DILLO_HTML_PARSE_MODE_PRE) {
       int spaceCnt = 0;
@@ -1248,7 +1308,7 @@ static void Html_process_word(DilloHtml *html, const char *word, int size)
 
    } else if (parse_mode == DILLO_HTML_PARSE_MODE_VERBATIM) {
       /* word goes in untouched, it is not processed here. */
-      dStr_append_l(html->Stash, word, size);
+      dStr_append_l(a_Html_stash_get(html), word, size);
    }
 
    if (parse_mode == DILLO_HTML_PARSE_MODE_STASH ||
@@ -1782,9 +1842,14 @@ static void Html_tag_open_style(DilloHtml *html, const char *tag, int tagsize)
  */
 static void Html_tag_close_style(DilloHtml *html)
 {
-   if (prefs.parse_embedded_css && html->loadCssFromStash)
-      html->styleEngine->parse(html, html->base_url, html->Stash->str,
-                               html->Stash->len, CSS_ORIGIN_AUTHOR);
+   const char *css;
+   int len;
+
+   if (prefs.parse_embedded_css && html->loadCssFromStash) {
+      css = Html_stash_view(html, &len);
+      html->styleEngine->parse(html, html->base_url, css, len,
+                               CSS_ORIGIN_AUTHOR);
+   }
 }
 
 /*
@@ -2142,7 +2207,7 @@ void a_Html_common_image_attrs(DilloHtml *html, const char *tag, int tagsize)
 
 DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize)
 {
-   bool load_now;
+   bool load_now, lazy;
    char *alt_ptr;
    const char *attrbuf;
    DilloUrl *url;
@@ -2183,7 +2248,13 @@ DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize)
               !dStrAsciiCasecmp(URL_SCHEME(url), "data") ||
               (a_Capi_get_flags_with_redirection(url) & CAPI_IsCached);
 
-   if (load_now && Html_load_image(html->bw, url, html->page_url, image)) {
+   /* The page says the image is not needed right away (e.g. it is far
+    * below), so let the other resources go first. */
+   lazy = (attrbuf = a_Html_get_attr(html, tag, tagsize, "loading")) &&
+          !dStrAsciiCasecmp(attrbuf, "lazy");
+
+   if (load_now &&
+       Html_load_image(html->bw, url, html->page_url, image, lazy)) {
       // hi->image is NULL if dillo tries to load the image immediately
       hi->image = NULL;
       a_Image_unref(image);
@@ -2200,7 +2271,8 @@ DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize)
  * Tell cache to retrieve image
  */
 static bool Html_load_image(BrowserWindow *bw, DilloUrl *url,
-                            const DilloUrl *requester, DilloImage *Image)
+                            const DilloUrl *requester, DilloImage *Image,
+                            bool lazy)
 {
    DilloWeb *Web;
    int ClientKey;
@@ -2209,6 +2281,8 @@ static bool Html_load_image(BrowserWindow *bw, DilloUrl *url,
    Web->Image = Image;
    a_Image_ref(Image);
    Web->flags |= WEB_Image;
+   if (lazy)
+      Web->flags |= WEB_Lazy;
    /* Request image data from the cache */
    if ((ClientKey = a_Capi_open_url(Web, NULL, NULL)) != 0) {
       a_Bw_add_client(bw, ClientKey, 0);
@@ -2702,6 +2776,27 @@ static void Html_add_anchor(DilloHtml *html, const char *name)
     */
 }
 
+/**
+ * Resolve the host of a link target ahead of time. Only the first few
+ * other hosts of a page are resolved, so that the queries of a page with
+ * many links do not delay those of the resources it really needs.
+ */
+static void Html_prefetch_link_host(DilloHtml *html, const DilloUrl *url)
+{
+   const char *host = URL_HOST(url);
+
+   if (!*host || html->prefetchHosts->size() >= HTML_PREFETCH_HOSTS_MAX ||
+       !dStrAsciiCasecmp(host, URL_HOST(html->page_url)))
+      return;
+   for (int i = 0; i < html->prefetchHosts->size(); i++)
+      if (!dStrAsciiCasecmp(host, html->prefetchHosts->get(i)))
+         return;
+
+   html->prefetchHosts->increase();
+   html->prefetchHosts->set(html->prefetchHosts->size() - 1, dStrdup(host));
+   a_Capi_preconnect(html->page_url, url, FALSE);
+}
+
 /*
  * <A>
  */
@@ -2731,6 +2826,9 @@ static void Html_tag_open_a(DilloHtml *html, const char *tag, int tagsize)
                                              CSS_TYPE_COLOR,
                                              html->non_css_visited_color);
       } else {
+         /* resolve the name in case the link is followed */
+         if (!(URL_FLAGS(html->base_url) & URL_SpamSafe))
+            Html_prefetch_link_host(html, url);
          html->styleEngine->setPseudoLink ();
          if (html->non_css_link_color != -1)
             html->styleEngine->setNonCssHint(CSS_PROPERTY_COLOR,
@@ -3258,7 +3356,7 @@ static void Html_css_load_callback(int Op, CacheClient_t *Client)
 /**
  * Tell cache to retrieve a stylesheet
  */
-void a_Html_load_stylesheet(DilloHtml *html, DilloUrl *url)
+void a_Html_load_stylesheet(DilloHtml *html, const DilloUrl *url)
 {
    char *data;
    int len;
@@ -3285,7 +3383,8 @@ void a_Html_load_stylesheet(DilloHtml *html, DilloUrl *url)
             a_Capi_get_buf(url, &data, &len);
          }
       }
-      html->styleEngine->parse(html, url, data, len, CSS_ORIGIN_AUTHOR);
+      html->styleEngine->parseStyleSheet(html, url, a_Capi_get_version(url),
+                                         data, len);
       a_Capi_unref_buf(url);
    } else {
       /* Fill a Web structure for the cache query */
@@ -3322,6 +3421,20 @@ static void Html_tag_open_link(DilloHtml *html, const char *tag, int tagsize)
    /* When viewing suspicious HTML email, don't load LINK */
    dReturn_if (URL_FLAGS(html->base_url) & URL_SpamSafe);
 
+   /* Connection hints, allowed in the body too */
+   if ((attrbuf = a_Html_get_attr(html, tag, tagsize, "rel")) &&
+       (dStriAsciiStr(attrbuf, "preconnect") ||
+        dStriAsciiStr(attrbuf, "dns-prefetch"))) {
+      bool_t connect = dStriAsciiStr(attrbuf, "preconnect") != NULL;
+
+      if ((attrbuf = a_Html_get_attr(html, tag, tagsize, "href")) &&
+          (url = a_Html_url_new(html, attrbuf, NULL, 0))) {
+         a_Capi_preconnect(html->page_url, url, connect);
+         a_Url_free(url);
+      }
+      return;
+   }
+
    /* Ignore LINK outside HEAD */
    if (!(html->InFlags & IN_HEAD)) {
       if (!((html->DocType == DT_HTML && html->DocTypeVersion >= 5.0f) &&
@@ -4334,123 +4447,235 @@ static void Html_callback(int Op, CacheClient_t *Client)
    }
 }
 
+/**
+ * Search the closing tag of the VERBATIM element, starting at 'i'.
+ * Return its offset, or -1 if it's not in the buffer yet; in that case
+ * '*resume' is where the search must continue when more data arrives.
+ */
+static int Html_scan_verbatim(DilloHtml *html, char *buf, int bufsize, int i,
+                              int *resume)
+{
+   const char *tag = Tags[S_TOP(html)->tag_idx].name;
+   int taglen = strlen(tag);
+
+   while (i < bufsize) {
+      i += a_Htmlscan_cspn(buf + i, bufsize - i, HTMLSCAN_LT);
+      if (i + taglen + 3 > bufsize)
+         break;   /* can't tell yet */
+      if (strncmp(buf + i, "</", 2) == 0 &&
+          Html_match_tag(tag, buf + i + 2, taglen + 1))
+         return i;
+      ++i;
+   }
+   *resume = MIN(i, bufsize);
+   return -1;
+}
+
+/**
+ * Search the "-->" that closes the comment, starting at 'i'.
+ * Return the offset after it, or -1 if it's not in the buffer yet.
+ */
+static int Html_scan_comment(char *buf, int bufsize, int i)
+{
+   char *p;
+
+   while ((p = (char*) memchr(buf + i, '>', bufsize - i))) {
+      i = p - buf + 1;
+      if (p[-1] == '-' && p[-2] == '-')
+         return i;
+   }
+   return -1;
+}
+
+/**
+ * Search the end of the tag at 'token_start' (skipping over quoted
+ * strings), resuming from the state in 'scan' if there is one.
+ * Return the offset after the tag, or -1 if it's not complete yet; in that
+ * case 'scan' tells where to go on (with offsets relative to the buffer).
+ */
+static int Html_scan_tag(DilloHtml *html, char *buf, int bufsize,
+                         int token_start, DilloHtmlScan *scan)
+{
+   DilloHtmlScanState state = scan->state;
+   int i = scan->ofs, gt = scan->gt_ofs;
+   char ch, q = scan->quote, *p;
+
+   if (state == DILLO_HTML_SCAN_NONE) {
+      state = DILLO_HTML_SCAN_TAG;
+      i = token_start + 1;
+   }
+
+   while (1) {
+      if (state == DILLO_HTML_SCAN_TAG) {
+         i += a_Htmlscan_cspn(buf + i, bufsize - i, HTMLSCAN_TAG);
+         if (i == bufsize)
+            break;
+         if ((ch = buf[i]) == '>') {
+            return i + 1;
+         } else if (ch == '"' || ch == '\'') {
+            /* Skip over quoted string */
+            q = ch;
+            state = DILLO_HTML_SCAN_QUOTE;
+         } else if (ch == '<') {
+            /* unterminated tag detected */
+            p = dStrndup(buf+token_start+1,
+                         strcspn(buf+token_start+1, " <\n\r\t"));
+            BUG_MSG("<%s> lacks its closing '>'.", p);
+            dFree(p);
+            return i;
+         }
+         ++i;
+      } else if (state == DILLO_HTML_SCAN_QUOTE) {
+         i += a_Htmlscan_cspn(buf + i, bufsize - i,
+                              (q == '"') ? HTMLSCAN_DQUOTE_GT :
+                                           HTMLSCAN_SQUOTE_GT);
+         if (i == bufsize)
+            break;
+         if (buf[i] == '>') {
+            /* Unterminated string value? Let's look ahead and test:
+             * (<: unterminated, closing-quote: terminated) */
+            gt = i++;
+            state = DILLO_HTML_SCAN_QUOTE_GT;
+         } else {
+            /* closing quote (or NUL) */
+            ++i;
+            state = DILLO_HTML_SCAN_TAG;
+         }
+      } else {
+         /* DILLO_HTML_SCAN_QUOTE_GT */
+         i += a_Htmlscan_cspn(buf + i, bufsize - i,
+                              (q == '"') ? HTMLSCAN_DQUOTE_LT :
+                                           HTMLSCAN_SQUOTE_LT);
+         if (i == bufsize)
+            break;
+         if (buf[i] == '<') {
+            BUG_MSG("Attribute lacks closing quote.");
+            return gt + 1;
+         }
+         ++i;
+         state = DILLO_HTML_SCAN_TAG;
+      }
+   }
+
+   scan->state = state;
+   scan->ofs = i;
+   scan->gt_ofs = gt;
+   scan->quote = q;
+   return -1;
+}
+
+/**
+ * Search the end of the word, starting at 'i' (the word is known to go on
+ * at least up to there). Return its offset, or bufsize if the word may go
+ * on in the data still to come.
+ */
+static int Html_scan_word(char *buf, int bufsize, int i)
+{
+   char ch;
+
+   while (i < bufsize) {
+      i += a_Htmlscan_cspn(buf + i, bufsize - i, HTMLSCAN_WORD);
+      if (buf[i] == '<' && (ch = buf[i + 1]) &&
+          !dIsalpha(ch) && !strchr("/!?", ch)) {
+         ++i;
+         continue;
+      }
+      break;
+   }
+   return i;
+}
+
 /**
  * Here's where we parse the html and put it into the Textblock structure.
+ *
+ * When the last token is incomplete, html->scan records how far it was
+ * examined, so the next call resumes there instead of starting over
+ * (this matters for huge comments, scripts or words on slow links).
+ *
  * Return value: number of bytes parsed
  */
 static int Html_write_raw(DilloHtml *html, char *buf, int bufsize, int Eof)
 {
-   char ch = 0, *p, *text;
-   int token_start, buf_index;
+   char ch = 0;
+   int token_start, buf_index, end;
+   DilloHtmlScan scan = html->scan;
 
    /* Now, 'buf' and 'bufsize' define a buffer aligned to start at a token
     * boundary. Iterate through tokens until end of buffer is reached. */
    buf_index = 0;
    token_start = buf_index;
+   memset(&html->scan, 0, sizeof(html->scan));
+
    while ((buf_index < bufsize) && !html->stop_parser) {
       /* invariant: buf_index == bufsize || token_start == buf_index */
 
       if (S_TOP(html)->parse_mode ==
           DILLO_HTML_PARSE_MODE_VERBATIM) {
          /* Non HTML code here, let's skip until closing tag */
-         do {
-            const char *tag = Tags[S_TOP(html)->tag_idx].name;
-            buf_index += strcspn(buf + buf_index, "<");
-            if (buf_index + (int)strlen(tag) + 3 > bufsize) {
-               buf_index = bufsize;
-            } else if (strncmp(buf + buf_index, "</", 2) == 0 &&
-                       Html_match_tag(tag, buf+buf_index+2, strlen(tag)+1)) {
-               /* copy VERBATIM text into the stash buffer */
-               text = dStrndup(buf + token_start, buf_index - token_start);
-               dStr_append(html->Stash, text);
-               dFree(text);
-               token_start = buf_index;
-               break;
-            } else
-               ++buf_index;
-         } while (buf_index < bufsize);
-
-         if (buf_index == bufsize)
+         int from = (scan.state == DILLO_HTML_SCAN_VERBATIM) ?
+                    scan.ofs : buf_index;
+
+         scan.state = DILLO_HTML_SCAN_NONE;
+         if ((end = Html_scan_verbatim(html, buf, bufsize, from,
+                                       &scan.ofs)) < 0) {
+            scan.state = DILLO_HTML_SCAN_VERBATIM;
+            buf_index = bufsize;
             break;
+         }
+         Html_stash_append_verbatim(html, buf + token_start,
+                                    end - token_start);
+         buf_index = token_start = end;
       }
 
       if (dIsspace(buf[buf_index])) {
          /* whitespace: group all available whitespace */
-         while (++buf_index < bufsize && dIsspace(buf[buf_index])) ;
+         ++buf_index;
+         buf_index += a_Htmlscan_spn_space(buf + buf_index,
+                                           bufsize - buf_index);
          Html_process_space(html, buf + token_start, buf_index - token_start);
          token_start = buf_index;
 
       } else if (buf[buf_index] == '<' && (ch = buf[buf_index + 1]) &&
                  (dIsalpha(ch) || strchr("/!?", ch)) ) {
          /* Tag */
-         if (buf_index + 3 < bufsize && !strncmp(buf + buf_index, "<!--", 4)) {
+         if (scan.state == DILLO_HTML_SCAN_COMMENT ||
+             (buf_index + 3 < bufsize &&
+              !strncmp(buf + buf_index, "<!--", 4))) {
             /* Comment: search for close of comment, skipping over
              * everything except a matching "-->" tag. */
-            while ( (p = (char*) memchr(buf + buf_index, '>',
-                                        bufsize - buf_index)) ){
-               buf_index = p - buf + 1;
-               if (p[-1] == '-' && p[-2] == '-') break;
-            }
-            if (p) {
+            int from = (scan.state == DILLO_HTML_SCAN_COMMENT) ?
+                       scan.ofs : buf_index;
+
+            scan.state = DILLO_HTML_SCAN_NONE;
+            if ((end = Html_scan_comment(buf, bufsize, from)) >= 0) {
                /* Got the whole comment. Let's throw it away! :) */
-               token_start = buf_index;
-            } else
+               buf_index = token_start = end;
+            } else {
+               scan.state = DILLO_HTML_SCAN_COMMENT;
+               scan.ofs = bufsize;
                buf_index = bufsize;
+            }
          } else {
             /* Tag: search end of tag (skipping over quoted strings) */
             html->CurrOfs = html->Start_Ofs + token_start;
 
-            while ( buf_index < bufsize ) {
-               buf_index++;
-               buf_index += strcspn(buf + buf_index, ">\"'<");
-               if ((ch = buf[buf_index]) == '>') {
-                  break;
-               } else if (ch == '"' || ch == '\'') {
-                  /* Skip over quoted string */
-                  buf_index++;
-                  buf_index += strcspn(buf + buf_index,
-                                       (ch == '"') ? "\">" : "'>");
-                  if (buf[buf_index] == '>') {
-                     /* Unterminated string value? Let's look ahead and test:
-                      * (<: unterminated, closing-quote: terminated) */
-                     int offset = buf_index + 1;
-                     offset += strcspn(buf + offset,
-                                       (ch == '"') ? "\"<" : "'<");
-                     if (buf[offset] == ch || !buf[offset]) {
-                        buf_index = offset;
-                     } else {
-                        BUG_MSG("Attribute lacks closing quote.");
-                        break;
-                     }
-                  }
-               } else if (ch == '<') {
-                  /* unterminated tag detected */
-                  p = dStrndup(buf+token_start+1,
-                               strcspn(buf+token_start+1, " <\n\r\t"));
-                  BUG_MSG("<%s> lacks its closing '>'.", p);
-                  dFree(p);
-                  --buf_index;
-                  break;
-               }
-            }
-            if (buf_index < bufsize) {
-               buf_index++;
-               Html_process_tag(html, buf + token_start,
-                                buf_index - token_start);
-               token_start = buf_index;
+            if ((end = Html_scan_tag(html, buf, bufsize, token_start,
+                                     &scan)) >= 0) {
+               scan.state = DILLO_HTML_SCAN_NONE;
+               Html_process_tag(html, buf + token_start, end - token_start);
+               buf_index = token_start = end;
+            } else {
+               buf_index = bufsize;
             }
          }
       } else {
          /* A Word: search for whitespace or tag open */
          html->CurrOfs = html->Start_Ofs + token_start;
 
-         while (++buf_index < bufsize) {
-            buf_index += strcspn(buf + buf_index, " <\n\r\t\f\v");
-            if (buf[buf_index] == '<' && (ch = buf[buf_index + 1]) &&
-                !dIsalpha(ch) && !strchr("/!?", ch))
-               continue;
-            break;
-         }
+         buf_index = Html_scan_word(buf, bufsize,
+                                    (scan.state == DILLO_HTML_SCAN_WORD) ?
+                                    scan.ofs : buf_index + 1);
+         scan.state = DILLO_HTML_SCAN_NONE;
          if (buf_index < bufsize || Eof) {
             /* successfully found end of token */
             ch = buf[buf_index];
@@ -4459,10 +4684,24 @@ static int Html_write_raw(DilloHtml *html, char *buf, int bufsize, int Eof)
                               buf_index - token_start);
             buf[buf_index] = ch;
             token_start = buf_index;
+         } else {
+            scan.state = DILLO_HTML_SCAN_WORD;
+            scan.ofs = bufsize;
          }
       }
    }/*while*/
 
+   /* Keep the scanning state of an incomplete token, unless the kind of
+    * token was guessed from too few bytes (e.g. "<!-" or a lone '<') */
+   if (scan.state != DILLO_HTML_SCAN_NONE && token_start < bufsize &&
+       bufsize - token_start >= 4 && !html->stop_parser) {
+      scan.ofs -= token_start;
+      scan.gt_ofs -= token_start;
+      html->scan = scan;
+   } else {
+      memset(&html->scan, 0, sizeof(html->scan));
+   }
+
    HT2TB(html)->flush ();
 
    return token_start;
@@ -86,6 +86,17 @@ typedef enum {
    HTML_LIST_ORDERED
 } DilloHtmlListMode;
 
+/** Where the tokenizer stopped inside a token that is not complete yet */
+typedef enum {
+   DILLO_HTML_SCAN_NONE = 0,  /**< at a token boundary */
+   DILLO_HTML_SCAN_VERBATIM,  /**< looking for the closing tag */
+   DILLO_HTML_SCAN_COMMENT,   /**< looking for "-->" */
+   DILLO_HTML_SCAN_TAG,       /**< looking for the '>' of a tag */
+   DILLO_HTML_SCAN_QUOTE,     /**< inside a quoted attribute value */
+   DILLO_HTML_SCAN_QUOTE_GT,  /**< '>' inside quotes, looking ahead */
+   DILLO_HTML_SCAN_WORD       /**< looking for the end of a word */
+} DilloHtmlScanState;
+
 typedef enum {
    IN_NONE        = 0,
    IN_HTML        = 1 << 0,
@@ -138,6 +149,18 @@ typedef struct {
    bool hand_over_break;
 } DilloHtmlState;
 
+/**
+ * Tokenizer state kept between calls to DilloHtml::write(), so that the
+ * bytes of a partial token are not examined again when more data arrives.
+ * Offsets are relative to the start of the token (i.e. Start_Ofs).
+ */
+typedef struct {
+   DilloHtmlScanState state;
+   int ofs;        /**< where to resume scanning */
+   int gt_ofs;     /**< '>' that ends the tag if the quote is unterminated */
+   char quote;     /**< quote character in the QUOTE states */
+} DilloHtmlScan;
+
 /*
  * Classes
  */
@@ -167,6 +190,7 @@ public:  //BUG: for now everything is public
    /* -------------------------------------------------------------------*/
    char *Start_Buf;
    int Start_Ofs;
+   DilloHtmlScan scan;    /**< partial token at Start_Ofs */
    char *content_type, *charset;
    bool stop_parser;
 
@@ -178,6 +202,9 @@ public:  //BUG: for now everything is public
    /* vector of remote CSS resources, as given by the LINK element */
    lout::misc::SimpleVector<DilloUrl*> *cssUrls;
 
+   /* hosts of link targets whose names have been resolved ahead of time */
+   lout::misc::SimpleVector<char*> *prefetchHosts;
+
    lout::misc::SimpleVector<DilloHtmlState> *stack;
    StyleEngine *styleEngine;
 
@@ -185,6 +212,8 @@ public:  //BUG: for now everything is public
 
    Dstr *Stash;
    bool StashSpace;
+   int StashViewOfs;      /**< VERBATIM stash still in the page buffer... */
+   int StashViewLen;      /**< ...at Start_Buf + StashViewOfs (not copied) */
 
    int pre_column;        /**< current column, used in PRE tags with tabs */
    bool PreFirstChar;     /**< used to skip the first CR or CRLF in PRE tags */
@@ -279,6 +308,7 @@ DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize);
 char *a_Html_parse_entities(DilloHtml *html, const char *token, int toksize);
 void a_Html_pop_tag(DilloHtml *html, int TagIdx);
 void a_Html_stash_init(DilloHtml *html);
+Dstr *a_Html_stash_get(DilloHtml *html);
 int32_t a_Html_color_parse(DilloHtml *html, const char *str,
                            int32_t default_color);
 CssLength a_Html_parse_length (DilloHtml *html,
@@ -287,7 +317,7 @@ void a_Html_tag_set_align_attr(DilloHtml *html, const char *tag, int tagsize);
 bool a_Html_tag_set_valign_attr(DilloHtml *html,
                                 const char *tag, int tagsize);
 
-void a_Html_load_stylesheet(DilloHtml *html, DilloUrl *url);
+void a_Html_load_stylesheet(DilloHtml *html, const DilloUrl *url);
 bool a_Html_should_display(DilloHtml *html);
 
 #endif /* __HTML_COMMON_HH__ */
@@ -0,0 +1,375 @@
+/*
+ * File: htmlscan.c
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * Character class scanning for the HTML tokenizer.
+ *
+ * The tokenizer spends most of its time looking for the next byte of a
+ * small set ('<', '>', quotes, whitespace). These routines do the same job
+ * as strcspn()/strspn() but are bounded by an explicit length and look at
+ * 16 (SSE2) or 32 (AVX2) bytes per step when the CPU allows it. The
+ * implementation is chosen once at runtime by a_Htmlscan_init(); the scalar
+ * code is the reference and is always available.
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "htmlscan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HTMLSCAN_X86
+#  include <immintrin.h>
+#endif
+
+/** Bytes checked one by one before using the vector loop */
+#define HTMLSCAN_PROBE 16
+
+typedef int (*HtmlscanCspn_t)(const char *s, int len, HtmlscanSet_t set);
+typedef int (*HtmlscanSpn_t)(const char *s, int len);
+
+/*
+ * All the bytes in these sets are below 64. That lets the scalar code use
+ * a 64-bit mask and the AVX2 code a two-level nibble lookup.
+ */
+static const char *const Htmlscan_chars[HTMLSCAN_NSETS] = {
+   "<", ">\"'<", "\">", "'>", "\"<", "'<", " <\n\r\t\f\v"
+};
+
+typedef struct {
+   uint64_t mask;    /* bit 'c' is set for each byte 'c' in the set */
+   uint8_t lo[16];   /* low nibble -> bits of the high nibbles in the set */
+} HtmlscanClass_t;
+
+static HtmlscanClass_t Htmlscan_class[HTMLSCAN_NSETS];
+
+/**
+ * Build the lookup tables of every set (NUL included).
+ */
+static void Htmlscan_build_classes(void)
+{
+   const char *p;
+   int i;
+
+   for (i = 0; i < HTMLSCAN_NSETS; ++i) {
+      HtmlscanClass_t *cls = &Htmlscan_class[i];
+
+      memset(cls, 0, sizeof(*cls));
+      cls->mask = 1;
+      cls->lo[0] = 1;
+      for (p = Htmlscan_chars[i]; *p; ++p) {
+         cls->mask |= (uint64_t)1 << *p;
+         cls->lo[*p & 0x0f] |= 1 << (*p >> 4);
+      }
+   }
+}
+
+/*
+ * Scalar reference implementation
+ */
+
+static inline int Htmlscan_in_class(const HtmlscanClass_t *cls, char c)
+{
+   return (unsigned char)c < 64 && (cls->mask >> (unsigned char)c & 1);
+}
+
+static inline int Htmlscan_is_space(char c)
+{
+   return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/**
+ * Return the length of the initial segment of 's' (at most 'len' bytes)
+ * made of bytes not in 'set'. As with strcspn(), NUL always stops it.
+ */
+static int Htmlscan_cspn_scalar(const char *s, int len, HtmlscanSet_t set)
+{
+   const HtmlscanClass_t *cls = &Htmlscan_class[set];
+   int i;
+
+   for (i = 0; i < len && !Htmlscan_in_class(cls, s[i]); ++i) ;
+   return i;
+}
+
+/**
+ * Return the length of the initial run of ASCII whitespace in 's'.
+ */
+static int Htmlscan_spn_space_scalar(const char *s, int len)
+{
+   int i;
+
+   for (i = 0; i < len && Htmlscan_is_space(s[i]); ++i) ;
+   return i;
+}
+
+#ifdef HTMLSCAN_X86
+
+/*
+ * Most tokens are short words, so the vector versions look at the first
+ * bytes one at a time before paying for the vector setup. The probes
+ * return the span length if it was found, or -1 to go on.
+ */
+
+static inline int Htmlscan_cspn_probe(const char *s, int len,
+                                      const HtmlscanClass_t *cls)
+{
+   int i;
+
+   for (i = 0; i < len && i < HTMLSCAN_PROBE; ++i)
+      if (Htmlscan_in_class(cls, s[i]))
+         return i;
+   return (i == len) ? i : -1;
+}
+
+static inline int Htmlscan_spn_space_probe(const char *s, int len)
+{
+   int i;
+
+   for (i = 0; i < len && i < HTMLSCAN_PROBE; ++i)
+      if (!Htmlscan_is_space(s[i]))
+         return i;
+   return (i == len) ? i : -1;
+}
+
+/*
+ * SSE2: 16 bytes per step, one compare per byte of the set
+ */
+
+__attribute__((target("sse2")))
+static int Htmlscan_cspn_sse2(const char *s, int len, HtmlscanSet_t set)
+{
+   const char *chars = Htmlscan_chars[set];
+   __m128i eq[8], v, m;
+   int i, k, n, mask;
+
+   if ((i = Htmlscan_cspn_probe(s, len, &Htmlscan_class[set])) >= 0)
+      return i;
+   eq[0] = _mm_setzero_si128();
+   for (n = 1; *chars; ++n)
+      eq[n] = _mm_set1_epi8(*chars++);
+
+   for (i = HTMLSCAN_PROBE; i + 16 <= len; i += 16) {
+      v = _mm_loadu_si128((const __m128i *)(s + i));
+      m = _mm_cmpeq_epi8(v, eq[0]);
+      for (k = 1; k < n; ++k)
+         m = _mm_or_si128(m, _mm_cmpeq_epi8(v, eq[k]));
+      if ((mask = _mm_movemask_epi8(m)))
+         return i + __builtin_ctz(mask);
+   }
+   return i + Htmlscan_cspn_scalar(s + i, len - i, set);
+}
+
+__attribute__((target("sse2")))
+static int Htmlscan_spn_space_sse2(const char *s, int len)
+{
+   const __m128i sp = _mm_set1_epi8(' '), lo = _mm_set1_epi8('\t' - 1),
+                 hi = _mm_set1_epi8('\r' + 1);
+   __m128i v, m;
+   int i, mask;
+
+   if ((i = Htmlscan_spn_space_probe(s, len)) >= 0)
+      return i;
+   for (i = HTMLSCAN_PROBE; i + 16 <= len; i += 16) {
+      v = _mm_loadu_si128((const __m128i *)(s + i));
+      /* '\t'..'\r' are below 0x80, so a signed compare is fine */
+      m = _mm_or_si128(_mm_cmpeq_epi8(v, sp),
+                       _mm_and_si128(_mm_cmpgt_epi8(v, lo),
+                                     _mm_cmplt_epi8(v, hi)));
+      if ((mask = ~_mm_movemask_epi8(m) & 0xffff))
+         return i + __builtin_ctz(mask);
+   }
+   return i + Htmlscan_spn_space_scalar(s + i, len - i);
+}
+
+/*
+ * AVX2: 32 bytes per step. The set membership of each byte is found with
+ * two table lookups: the low nibble gives the high nibbles that go with it
+ * in the set, and the high nibble selects one of those bits. The cost does
+ * not depend on the size of the set.
+ */
+
+__attribute__((target("avx2")))
+static int Htmlscan_cspn_avx2(const char *s, int len, HtmlscanSet_t set)
+{
+   const HtmlscanClass_t *cls = &Htmlscan_class[set];
+   const __m256i nib = _mm256_set1_epi8(0x0f), zero = _mm256_setzero_si256(),
+                 hi_tbl = _mm256_setr_epi8(1, 2, 4, 8, 0, 0, 0, 0,
+                                           0, 0, 0, 0, 0, 0, 0, 0,
+                                           1, 2, 4, 8, 0, 0, 0, 0,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+   __m256i lo_tbl, v, m;
+   int i;
+   unsigned mask;
+
+   if ((i = Htmlscan_cspn_probe(s, len, cls)) >= 0)
+      return i;
+   lo_tbl = _mm256_broadcastsi128_si256(
+               _mm_loadu_si128((const __m128i *)cls->lo));
+
+   for (i = HTMLSCAN_PROBE; i + 32 <= len; i += 32) {
+      v = _mm256_loadu_si256((const __m256i *)(s + i));
+      m = _mm256_and_si256(
+             _mm256_shuffle_epi8(lo_tbl, _mm256_and_si256(v, nib)),
+             _mm256_shuffle_epi8(hi_tbl,
+                _mm256_and_si256(_mm256_srli_epi16(v, 4), nib)));
+      m = _mm256_cmpeq_epi8(m, zero);
+      if ((mask = ~(unsigned)_mm256_movemask_epi8(m)))
+         return i + __builtin_ctz(mask);
+   }
+   return i + Htmlscan_cspn_scalar(s + i, len - i, set);
+}
+
+__attribute__((target("avx2")))
+static int Htmlscan_spn_space_avx2(const char *s, int len)
+{
+   const __m256i sp = _mm256_set1_epi8(' '), lo = _mm256_set1_epi8('\t' - 1),
+                 hi = _mm256_set1_epi8('\r' + 1);
+   __m256i v, m;
+   int i;
+   unsigned mask;
+
+   if ((i = Htmlscan_spn_space_probe(s, len)) >= 0)
+      return i;
+   for (i = HTMLSCAN_PROBE; i + 32 <= len; i += 32) {
+      v = _mm256_loadu_si256((const __m256i *)(s + i));
+      m = _mm256_or_si256(_mm256_cmpeq_epi8(v, sp),
+                          _mm256_and_si256(_mm256_cmpgt_epi8(v, lo),
+                                           _mm256_cmpgt_epi8(hi, v)));
+      if ((mask = ~(unsigned)_mm256_movemask_epi8(m)))
+         return i + __builtin_ctz(mask);
+   }
+   return i + Htmlscan_spn_space_scalar(s + i, len - i);
+}
+
+#endif /* HTMLSCAN_X86 */
+
+/*
+ * Dispatch
+ */
+
+static int Htmlscan_cspn_first(const char *s, int len, HtmlscanSet_t set);
+static int Htmlscan_spn_space_first(const char *s, int len);
+
+/* Until a_Htmlscan_init() runs, the first call does it */
+static HtmlscanCspn_t Htmlscan_cspn = Htmlscan_cspn_first;
+static HtmlscanSpn_t Htmlscan_spn_space = Htmlscan_spn_space_first;
+
+/**
+ * Tell whether the running CPU can execute 'impl'.
+ */
+static int Htmlscan_supported(HtmlscanImpl_t impl)
+{
+   switch (impl) {
+   case HTMLSCAN_SCALAR:
+      return 1;
+#ifdef HTMLSCAN_X86
+   case HTMLSCAN_SSE2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2");
+   case HTMLSCAN_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse2") &&
+             __builtin_cpu_supports("avx2");
+#endif
+   default:
+      return 0;
+   }
+}
+
+/**
+ * Use 'impl' if the CPU supports it, otherwise the best one below it.
+ * Return the implementation actually selected.
+ */
+HtmlscanImpl_t a_Htmlscan_select(HtmlscanImpl_t impl)
+{
+   if (!Htmlscan_class[0].mask)
+      Htmlscan_build_classes();
+
+   while (impl > HTMLSCAN_SCALAR && !Htmlscan_supported(impl))
+      impl--;
+
+   switch (impl) {
+#ifdef HTMLSCAN_X86
+   case HTMLSCAN_AVX2:
+      Htmlscan_cspn = Htmlscan_cspn_avx2;
+      Htmlscan_spn_space = Htmlscan_spn_space_avx2;
+      break;
+   case HTMLSCAN_SSE2:
+      Htmlscan_cspn = Htmlscan_cspn_sse2;
+      Htmlscan_spn_space = Htmlscan_spn_space_sse2;
+      break;
+#endif
+   default:
+      impl = HTMLSCAN_SCALAR;
+      Htmlscan_cspn = Htmlscan_cspn_scalar;
+      Htmlscan_spn_space = Htmlscan_spn_space_scalar;
+      break;
+   }
+   return impl;
+}
+
+const char *a_Htmlscan_impl_name(HtmlscanImpl_t impl)
+{
+   switch (impl) {
+   case HTMLSCAN_AVX2:
+      return "avx2";
+   case HTMLSCAN_SSE2:
+      return "sse2";
+   default:
+      return "scalar";
+   }
+}
+
+/**
+ * Return the bytes of 'set' (without the implicit NUL).
+ */
+const char *a_Htmlscan_set_chars(HtmlscanSet_t set)
+{
+   return Htmlscan_chars[set];
+}
+
+/**
+ * Pick the fastest scanner for this CPU.
+ */
+void a_Htmlscan_init(void)
+{
+   a_Htmlscan_select(HTMLSCAN_AVX2);
+}
+
+static int Htmlscan_cspn_first(const char *s, int len, HtmlscanSet_t set)
+{
+   a_Htmlscan_init();
+   return Htmlscan_cspn(s, len, set);
+}
+
+static int Htmlscan_spn_space_first(const char *s, int len)
+{
+   a_Htmlscan_init();
+   return Htmlscan_spn_space(s, len);
+}
+
+/**
+ * Bounded strcspn(): return the number of leading bytes of 's' (at most
+ * 'len') that are neither NUL nor in 'set'.
+ */
+int a_Htmlscan_cspn(const char *s, int len, HtmlscanSet_t set)
+{
+   return (len > 0) ? Htmlscan_cspn(s, len, set) : 0;
+}
+
+/**
+ * Return the number of leading ASCII whitespace bytes of 's' (at most
+ * 'len'), i.e. what dIsspace() accepts in the C locale.
+ */
+int a_Htmlscan_spn_space(const char *s, int len)
+{
+   return (len > 0) ? Htmlscan_spn_space(s, len) : 0;
+}
@@ -0,0 +1,43 @@
+#ifndef __HTMLSCAN_H__
+#define __HTMLSCAN_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Scanner implementations, in increasing order of preference.
+ */
+typedef enum {
+   HTMLSCAN_SCALAR,
+   HTMLSCAN_SSE2,
+   HTMLSCAN_AVX2
+} HtmlscanImpl_t;
+
+/*
+ * Byte sets the tokenizer looks for (NUL is always part of the set).
+ */
+typedef enum {
+   HTMLSCAN_LT,           /* "<" */
+   HTMLSCAN_TAG,          /* ">\"'<" */
+   HTMLSCAN_DQUOTE_GT,    /* "\">" */
+   HTMLSCAN_SQUOTE_GT,    /* "'>" */
+   HTMLSCAN_DQUOTE_LT,    /* "\"<" */
+   HTMLSCAN_SQUOTE_LT,    /* "'<" */
+   HTMLSCAN_WORD,         /* " <\n\r\t\f\v" */
+   HTMLSCAN_NSETS
+} HtmlscanSet_t;
+
+void a_Htmlscan_init(void);
+HtmlscanImpl_t a_Htmlscan_select(HtmlscanImpl_t impl);
+const char *a_Htmlscan_impl_name(HtmlscanImpl_t impl);
+const char *a_Htmlscan_set_chars(HtmlscanSet_t set);
+
+int a_Htmlscan_cspn(const char *s, int len, HtmlscanSet_t set);
+int a_Htmlscan_spn_space(const char *s, int len);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __HTMLSCAN_H__ */
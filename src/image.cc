@@ -157,3 +157,13 @@ void a_Image_abort(DilloImage *Image)
    I2IR(Image)->fatal();
 }
 
+/**
+ * Get the size the image will be drawn at, if it is known in advance.
+ * An unknown dimension is set to -1.
+ */
+bool_t a_Image_get_draw_size(DilloImage *Image, int *width, int *height)
+{
+   *width = *height = -1;
+   return I2IR(Image)->getDrawSize(width, height) ? TRUE : FALSE;
+}
+
@@ -92,6 +92,7 @@ void a_Image_set_parms(DilloImage *Image, void *v_imgbuf, DilloUrl *url,
 void a_Image_write(DilloImage *Image, uint_t y);
 void a_Image_close(DilloImage *Image);
 void a_Image_abort(DilloImage *Image);
+bool_t a_Image_get_draw_size(DilloImage *Image, int *width, int *height);
 
 
 #ifdef __cplusplus
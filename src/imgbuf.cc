@@ -30,20 +30,15 @@ static uchar_t *Imgbuf_rgb_line(const uchar_t *buf,
                                 DilloImgType type, uchar_t *cmap,
                                 uint_t width, uint_t y)
 {
-   uint_t x;
-
    switch (type) {
    case DILLO_IMG_TYPE_INDEXED:
-      if (cmap) {
-         for (x = 0; x < width; x++)
-            memcpy(linebuf + x * 3, cmap + buf[x] * 3, 3);
-      } else {
+      if (cmap)
+         pixel::indexedToRgb(linebuf, buf, width, cmap);
+      else
          MSG_WARN("Gif:: image lacks a color map\n");
-      }
       break;
    case DILLO_IMG_TYPE_GRAY:
-      for (x = 0; x < width; x++)
-         memset(linebuf + x * 3, buf[x], 3);
+      pixel::grayToRgb(linebuf, buf, width);
       break;
    case DILLO_IMG_TYPE_CMYK_INV:
       /*
@@ -51,12 +46,7 @@ static uchar_t *Imgbuf_rgb_line(const uchar_t *buf,
        * trying to handle CMYK jpegs is confused by this, and supposedly
        * the issue is that Adobe CMYK is "wrong" but ubiquitous.
        */
-      for (x = 0; x < width; x++) {
-         uint_t white = buf[x * 4 + 3];
-         linebuf[x * 3] = buf[x * 4] * white / 0x100;
-         linebuf[x * 3 + 1] = buf[x * 4 + 1] * white / 0x100;
-         linebuf[x * 3 + 2] = buf[x * 4 + 2] * white / 0x100;
-      }
+      pixel::cmykInvToRgb(linebuf, buf, width);
       break;
    case DILLO_IMG_TYPE_RGB:
       /* avoid a memcpy here!  --Jcid */
@@ -68,6 +58,48 @@ static uchar_t *Imgbuf_rgb_line(const uchar_t *buf,
    return linebuf;
 }
 
+/*
+ * A vector source made of C callbacks.
+ */
+class ImgbufVectorSource: public Imgbuf::VectorSource
+{
+   void (*drawFn) (void *data, uchar_t *buf, uint_t width, uint_t height);
+   void (*freeFn) (void *data);
+   void *data;
+
+public:
+   ImgbufVectorSource (void (*drawFn) (void*, uchar_t*, uint_t, uint_t),
+                       void (*freeFn) (void*), void *data)
+   { this->drawFn = drawFn; this->freeFn = freeFn; this->data = data; }
+   ~ImgbufVectorSource () { freeFn (data); }
+
+   void draw (byte *buf, int width, int height)
+   { drawFn (data, (uchar_t *)buf, width, height); }
+};
+
+/*
+ * A reloader made of C callbacks.
+ */
+class ImgbufReloader: public Imgbuf::Reloader
+{
+   bool_t (*reloadFn) (void *data);
+   bool_t (*unreduceFn) (void *data, uint_t width, uint_t height);
+   void (*freeFn) (void *data);
+   void *data;
+
+public:
+   ImgbufReloader (bool_t (*reloadFn) (void*),
+                   bool_t (*unreduceFn) (void*, uint_t, uint_t),
+                   void (*freeFn) (void*), void *data)
+   { this->reloadFn = reloadFn; this->unreduceFn = unreduceFn;
+     this->freeFn = freeFn; this->data = data; }
+   ~ImgbufReloader () { freeFn (data); }
+
+   bool reload () { return reloadFn (data); }
+   bool unreduce (int width, int height)
+   { return unreduceFn (data, width, height); }
+};
+
 // Wrappers for Imgbuf -------------------------------------------------------
 
 /**
@@ -137,3 +169,74 @@ void a_Imgbuf_new_scan(void *v_imgbuf)
    ((Imgbuf*)v_imgbuf)->newScan();
 }
 
+/**
+ * Let a vector image draw its scaled buffers at their size. 'draw' fills
+ * an RGB buffer of the given size; 'free_data' releases 'data' once the
+ * Imgbuf no longer needs it.
+ */
+void a_Imgbuf_set_vector_source(void *v_imgbuf,
+                                void (*draw)(void *data, uchar_t *buf,
+                                             uint_t width, uint_t height),
+                                void (*free_data)(void *data), void *data)
+{
+   ((Imgbuf*)v_imgbuf)->setVectorSource(
+      new ImgbufVectorSource(draw, free_data, data));
+}
+
+/**
+ * Tell the size of the image, when the Imgbuf holds a reduced copy of it.
+ */
+void a_Imgbuf_set_root_size(void *v_imgbuf, uint_t width, uint_t height)
+{
+   ((Imgbuf*)v_imgbuf)->setRootSize(width, height);
+}
+
+/**
+ * Let the image data be reclaimed. 'reload' copies the rows again (with
+ * a_Imgbuf_update) when the Imgbuf is drawn after a_Imgbuf_reclaim(), and
+ * returns FALSE when it copies them later, calling a_Imgbuf_reload_done();
+ * 'unreduce' tells whether 'reload' can copy the whole image from now on,
+ * when the Imgbuf holds a reduced copy that is drawn larger;
+ * 'free_data' releases 'data' once the Imgbuf no longer needs it.
+ */
+void a_Imgbuf_set_reloader(void *v_imgbuf, bool_t (*reload)(void *data),
+                           bool_t (*unreduce)(void *data, uint_t width,
+                                              uint_t height),
+                           void (*free_data)(void *data), void *data)
+{
+   ((Imgbuf*)v_imgbuf)->setReloader(
+      new ImgbufReloader(reload, unreduce, free_data, data));
+}
+
+/**
+ * Free the image data, until the Imgbuf is drawn again.
+ */
+void a_Imgbuf_reclaim(void *v_imgbuf)
+{
+   ((Imgbuf*)v_imgbuf)->reclaim();
+}
+
+/**
+ * The rows of a reload have all been copied: draw the image again.
+ */
+void a_Imgbuf_reload_done(void *v_imgbuf)
+{
+   ((Imgbuf*)v_imgbuf)->reloadDone();
+}
+
+/**
+ * Tell when the Imgbuf was last drawn (a larger number is more recent).
+ */
+ulong_t a_Imgbuf_last_drawn(void *v_imgbuf)
+{
+   return ((Imgbuf*)v_imgbuf)->getLastDrawn();
+}
+
+/**
+ * Blend 'n' RGBA pixels from 'src' over 'bg_color', as RGB into 'dest'
+ */
+void a_Imgbuf_rgba_to_rgb(uchar_t *dest, const uchar_t *src, uint_t n,
+                          int bg_color)
+{
+   pixel::blendRgba(dest, src, n, bg_color);
+}
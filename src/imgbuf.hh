@@ -22,6 +22,20 @@ int a_Imgbuf_last_reference(void *v_imgbuf);
 void a_Imgbuf_update(void *v_imgbuf, const uchar_t *buf, DilloImgType type,
                      uchar_t *cmap, uint_t width, uint_t height, uint_t y);
 void a_Imgbuf_new_scan(void *v_imgbuf);
+void a_Imgbuf_set_vector_source(void *v_imgbuf,
+                                void (*draw)(void *data, uchar_t *buf,
+                                             uint_t width, uint_t height),
+                                void (*free_data)(void *data), void *data);
+void a_Imgbuf_set_root_size(void *v_imgbuf, uint_t width, uint_t height);
+void a_Imgbuf_set_reloader(void *v_imgbuf, bool_t (*reload)(void *data),
+                           bool_t (*unreduce)(void *data, uint_t width,
+                                              uint_t height),
+                           void (*free_data)(void *data), void *data);
+void a_Imgbuf_reclaim(void *v_imgbuf);
+void a_Imgbuf_reload_done(void *v_imgbuf);
+ulong_t a_Imgbuf_last_drawn(void *v_imgbuf);
+void a_Imgbuf_rgba_to_rgb(uchar_t *dest, const uchar_t *src, uint_t n,
+                          int bg_color);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,617 @@
+/*
+ * File: imgdec.c
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/** @file
+ * Worker threads for the image decoders.
+ *
+ * The GIF, JPEG, PNG and WebP decoders used to run inside the cache
+ * callbacks, in the main thread, so decoding large images stalled
+ * scrolling and input. Now the dicache gives each image a job: the data
+ * the cache sends is copied into the job, and one of a few worker threads
+ * runs the decoder over it.
+ *
+ * The decoders are not aware of this. While a decoder runs in a worker,
+ * the dicache functions it calls (set_parms, set_cmap, new_scan and write)
+ * record what they are asked instead of doing it, and the main thread
+ * replays the records, a batch of rows at a time. It is woken up through
+ * a pipe, like with the DNS threads. A job is run by one worker at a time,
+ * so a decoder still gets its data in order.
+ *
+ * The cache clients of an image are kept open (see CacheClient_t::Busy)
+ * until the job has decoded all the data they sent; the decoder is then
+ * closed in the main thread, as before.
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "msg.h"
+#include "prefs.h"
+#include "imgdec.h"
+#include "dicache.h"
+#include "IO/iowatch.hh"
+
+/** Most worker threads */
+#define IMGDEC_MAX_THREADS 16
+/** Bytes of decoded rows that are handed to the main thread at once */
+#define IMGDEC_BATCH (64 * 1024)
+
+typedef enum {
+   IMGDEC_SetReduction,
+   IMGDEC_SetParms,
+   IMGDEC_SetCmap,
+   IMGDEC_NewScan,
+   IMGDEC_Rows
+} ImgdecOp;
+
+/**
+ * A dicache call made by a decoder in a worker thread.
+ */
+typedef struct {
+   ImgdecOp op;
+   uint_t reduction;        /**< SetReduction */
+   DilloImage *Image;       /**< SetParms */
+   uint_t width, height;    /**< SetParms */
+   DilloImgType type;       /**< SetParms */
+   double gamma;            /**< SetParms */
+   int bg_color;            /**< SetCmap */
+   uint_t num_colors;       /**< SetCmap */
+   int num_colors_max;      /**< SetCmap */
+   int bg_index;            /**< SetCmap */
+   uint_t rowlen;           /**< Rows: bytes in a row */
+   Dstr *data;              /**< SetCmap: the color map;
+                                 Rows: each row after its number */
+} ImgdecMsg;
+
+struct ImgdecJob {
+   DilloUrl *url;           /**< Dicache entry of the image (a copy) */
+   int version;
+   CA_Callback_t Decoder;
+   void *DecoderData;
+   /** When set, called once the job is done (see a_Imgdec_job_run) */
+   void (*Done)(const DilloUrl *url, int version);
+
+   /* Only used by the thread running the decoder */
+   Dstr *data;              /**< All the data given to the decoder */
+   bool_t complete;         /**< 'data' is the whole image */
+   ImgdecMsg *rows;         /**< Rows not handed to the main thread yet */
+   uint_t reduction;        /**< The image is decoded at 1/reduction */
+   uint_t rowlen;           /**< Bytes in a row */
+
+   /* Protected by imgdec_mutex */
+   Dstr *input;             /**< Data not given to the decoder yet */
+   bool_t input_complete;   /**< No more data will come */
+   Dlist *msgs;             /**< Calls for the main thread to make */
+   bool_t queued;           /**< In imgdec_ready */
+   bool_t running;          /**< A worker is running the decoder */
+   bool_t posted;           /**< In imgdec_done */
+   bool_t cancel;           /**< Aborted while running */
+};
+
+/*
+ * Local data
+ */
+static int imgdec_threads = 0;
+static pthread_t imgdec_tids[IMGDEC_MAX_THREADS];
+static bool_t imgdec_quit = FALSE;
+static pthread_key_t imgdec_key;
+static pthread_mutex_t imgdec_mutex = PTHREAD_MUTEX_INITIALIZER;
+/** A job was queued */
+static pthread_cond_t imgdec_work_cond = PTHREAD_COND_INITIALIZER;
+/** A worker finished running a job */
+static pthread_cond_t imgdec_idle_cond = PTHREAD_COND_INITIALIZER;
+/** Jobs waiting for a worker */
+static Dlist *imgdec_ready = NULL;
+/** Jobs with news for the main thread */
+static Dlist *imgdec_done = NULL;
+static int imgdec_notify_pipe[2];
+
+
+static ImgdecMsg *Imgdec_msg_new(ImgdecOp op)
+{
+   ImgdecMsg *msg = dNew0(ImgdecMsg, 1);
+
+   msg->op = op;
+   return msg;
+}
+
+static void Imgdec_msgs_free(Dlist *msgs)
+{
+   ImgdecMsg *msg;
+   int i;
+
+   for (i = 0; (msg = dList_nth_data(msgs, i)); ++i) {
+      if (msg->data)
+         dStr_free(msg->data, 1);
+      dFree(msg);
+   }
+   dList_free(msgs);
+}
+
+/**
+ * Free a job that is not in use by a worker. When aborted, the decoder
+ * is freed too.
+ */
+static void Imgdec_job_free(ImgdecJob *job, bool_t abort)
+{
+   if (abort)
+      job->Decoder(CA_Abort, job->DecoderData);
+   a_Url_free(job->url);
+   if (job->msgs)
+      Imgdec_msgs_free(job->msgs);
+   dStr_free(job->data, 1);
+   dStr_free(job->input, 1);
+   dFree(job);
+}
+
+/**
+ * Let the main thread know about 'job' (imgdec_mutex must be held).
+ */
+static void Imgdec_post(ImgdecJob *job)
+{
+   if (!job->posted) {
+      job->posted = TRUE;
+      dList_append(imgdec_done, job);
+      if (dList_length(imgdec_done) == 1 &&
+          write(imgdec_notify_pipe[1], ".", 1) != 1)
+         MSG_ERR("Imgdec_post: write: %s\n", dStrerror(errno));
+   }
+}
+
+static void Imgdec_send(ImgdecJob *job, ImgdecMsg *msg)
+{
+   pthread_mutex_lock(&imgdec_mutex);
+   dList_append(job->msgs, msg);
+   Imgdec_post(job);
+   pthread_mutex_unlock(&imgdec_mutex);
+}
+
+static void Imgdec_flush_rows(ImgdecJob *job)
+{
+   ImgdecMsg *msg = job->rows;
+
+   if (msg) {
+      job->rows = NULL;
+      Imgdec_send(job, msg);
+   }
+}
+
+/**
+ * Give the decoder all the data of the job.
+ */
+static void Imgdec_run(ImgdecJob *job)
+{
+   CacheClient_t Client;
+
+   memset(&Client, 0, sizeof(Client));
+   Client.Url = job->url;
+   Client.Version = job->version;
+   Client.Buf = job->data->str;
+   Client.BufSize = job->data->len;
+   Client.CbData = job->DecoderData;
+   job->Decoder(CA_Send, &Client);
+}
+
+/**
+ * Make the dicache calls recorded by the decoder (main thread).
+ */
+static void Imgdec_apply(ImgdecJob *job, Dlist *msgs)
+{
+   ImgdecMsg *msg;
+   char *p, *end;
+   uint_t Y;
+   int i;
+
+   for (i = 0; (msg = dList_nth_data(msgs, i)); ++i) {
+      switch (msg->op) {
+      case IMGDEC_SetReduction:
+         a_Dicache_set_reduction(job->url, job->version, msg->reduction);
+         break;
+      case IMGDEC_SetParms:
+         a_Dicache_set_parms(job->url, job->version, msg->Image, msg->width,
+                             msg->height, msg->type, msg->gamma);
+         break;
+      case IMGDEC_SetCmap:
+         a_Dicache_set_cmap(job->url, job->version, msg->bg_color,
+                            (uchar_t *)msg->data->str, msg->num_colors,
+                            msg->num_colors_max, msg->bg_index);
+         break;
+      case IMGDEC_NewScan:
+         a_Dicache_new_scan(job->url, job->version);
+         break;
+      case IMGDEC_Rows:
+         end = msg->data->str + msg->data->len;
+         for (p = msg->data->str; p < end; p += sizeof(Y) + msg->rowlen) {
+            memcpy(&Y, p, sizeof(Y));
+            a_Dicache_write(job->url, job->version,
+                            (uchar_t *)p + sizeof(Y), Y);
+         }
+         break;
+      }
+   }
+   Imgdec_msgs_free(msgs);
+}
+
+static void *Imgdec_worker(void *data)
+{
+   ImgdecJob *job;
+
+   (void) data;
+   pthread_mutex_lock(&imgdec_mutex);
+   while (!imgdec_quit) {
+      if (!(job = dList_nth_data(imgdec_ready, 0))) {
+         pthread_cond_wait(&imgdec_work_cond, &imgdec_mutex);
+         continue;
+      }
+      dList_remove(imgdec_ready, job);
+      job->queued = FALSE;
+      job->running = TRUE;
+      dStr_append_l(job->data, job->input->str, job->input->len);
+      dStr_truncate(job->input, 0);
+      job->complete = job->input_complete;
+      pthread_mutex_unlock(&imgdec_mutex);
+
+      pthread_setspecific(imgdec_key, job);
+      Imgdec_run(job);
+      pthread_setspecific(imgdec_key, NULL);
+      Imgdec_flush_rows(job);
+
+      pthread_mutex_lock(&imgdec_mutex);
+      job->running = FALSE;
+      if (job->input->len > 0 && !job->cancel) {
+         /* more data came meanwhile; go behind the other images */
+         job->queued = TRUE;
+         dList_append(imgdec_ready, job);
+      }
+      Imgdec_post(job);
+      pthread_cond_broadcast(&imgdec_idle_cond);
+   }
+   pthread_mutex_unlock(&imgdec_mutex);
+   return NULL;
+}
+
+/**
+ * Called on the main thread when there are news from the workers.
+ */
+static void Imgdec_notify_cb(int fd, void *data)
+{
+   ImgdecJob *job;
+   Dlist *msgs;
+   bool_t cancel, running, done;
+   char buf[16];
+
+   (void) fd;
+   (void) data;
+   while (read(imgdec_notify_pipe[0], buf, sizeof(buf)) > 0) ;
+
+   pthread_mutex_lock(&imgdec_mutex);
+   while ((job = dList_nth_data(imgdec_done, 0))) {
+      dList_remove(imgdec_done, job);
+      job->posted = FALSE;
+      msgs = job->msgs;
+      job->msgs = dList_new(8);
+      cancel = job->cancel;
+      running = job->running;
+      done = job->Done && !running && !job->queued && job->input->len == 0;
+      pthread_mutex_unlock(&imgdec_mutex);
+
+      if (cancel) {
+         Imgdec_msgs_free(msgs);
+         if (!running)
+            Imgdec_job_free(job, TRUE);
+      } else {
+         Imgdec_apply(job, msgs);
+         if (done)
+            job->Done(job->url, job->version);
+         /* Let the clients draw the new rows (and close, when done) */
+         a_Cache_process_url(job->url);
+         if (done)
+            Imgdec_job_free(job, TRUE);
+      }
+      pthread_mutex_lock(&imgdec_mutex);
+   }
+   pthread_mutex_unlock(&imgdec_mutex);
+}
+
+/**
+ * Start the worker threads.
+ */
+void a_Imgdec_init(void)
+{
+   int i, n = prefs.image_decode_threads;
+
+#ifdef _SC_NPROCESSORS_ONLN
+   if (n == 0)
+      n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+   n = MIN(n, IMGDEC_MAX_THREADS);
+   if (n <= 0)
+      return;
+
+   if (pipe(imgdec_notify_pipe) < 0) {
+      MSG_ERR("a_Imgdec_init: pipe: %s\n", dStrerror(errno));
+      return;
+   }
+   fcntl(imgdec_notify_pipe[0], F_SETFL, O_NONBLOCK);
+   pthread_key_create(&imgdec_key, NULL);
+   imgdec_ready = dList_new(16);
+   imgdec_done = dList_new(16);
+
+   for (i = 0; i < n; i++)
+      if (pthread_create(&imgdec_tids[imgdec_threads], NULL, Imgdec_worker,
+                         NULL) == 0)
+         imgdec_threads++;
+
+   if (imgdec_threads > 0)
+      a_IOwatch_add_fd(imgdec_notify_pipe[0], DIO_READ, Imgdec_notify_cb,
+                       NULL);
+   _MSG("a_Imgdec_init: %d threads\n", imgdec_threads);
+}
+
+/**
+ * Stop the workers (at exit time, after a_Dicache_freeall() aborted the
+ * jobs). A worker running a decoder is waited for.
+ */
+void a_Imgdec_freeall(void)
+{
+   ImgdecJob *job;
+   int i;
+
+   if (imgdec_threads > 0) {
+      pthread_mutex_lock(&imgdec_mutex);
+      imgdec_quit = TRUE;
+      pthread_cond_broadcast(&imgdec_work_cond);
+      pthread_mutex_unlock(&imgdec_mutex);
+      for (i = 0; i < imgdec_threads; i++)
+         pthread_join(imgdec_tids[i], NULL);
+
+      /* Now nobody writes to the pipe */
+      a_IOwatch_remove_fd(imgdec_notify_pipe[0], DIO_READ);
+      dClose(imgdec_notify_pipe[0]);
+      dClose(imgdec_notify_pipe[1]);
+      imgdec_threads = 0;
+
+      /* Aborted jobs that were running */
+      while ((job = dList_nth_data(imgdec_done, 0))) {
+         dList_remove(imgdec_done, job);
+         if (job->cancel)
+            Imgdec_job_free(job, TRUE);
+      }
+      dList_free(imgdec_done);
+      dList_free(imgdec_ready);
+   }
+}
+
+/**
+ * Are images decoded by worker threads?
+ */
+bool_t a_Imgdec_enabled(void)
+{
+   return imgdec_threads > 0;
+}
+
+/**
+ * Make a job to decode the image of a dicache entry with 'Decoder'.
+ */
+ImgdecJob *a_Imgdec_job_new(DilloUrl *url, int version,
+                            CA_Callback_t Decoder, void *DecoderData)
+{
+   ImgdecJob *job = dNew0(ImgdecJob, 1);
+
+   job->url = a_Url_dup(url);
+   job->version = version;
+   job->Decoder = Decoder;
+   job->DecoderData = DecoderData;
+   job->reduction = 1;
+   job->data = dStr_sized_new(8 * 1024);
+   job->input = dStr_sized_new(8 * 1024);
+   job->msgs = dList_new(8);
+   return job;
+}
+
+/**
+ * Add new image data to the job ('complete' when it is the last).
+ */
+void a_Imgdec_job_feed(ImgdecJob *job, const char *buf, uint_t len,
+                       bool_t complete)
+{
+   pthread_mutex_lock(&imgdec_mutex);
+   dStr_append_l(job->input, buf, len);
+   job->input_complete = complete;
+   if (!job->queued && !job->running) {
+      job->queued = TRUE;
+      dList_append(imgdec_ready, job);
+      pthread_cond_signal(&imgdec_work_cond);
+   }
+   pthread_mutex_unlock(&imgdec_mutex);
+}
+
+/**
+ * Decode the whole image in 'buf' with the job, which is not fed by a
+ * cache client. Once the decoder is done, 'done' is called in the main
+ * thread, and the job is freed along with its decoder.
+ */
+void a_Imgdec_job_run(ImgdecJob *job, const char *buf, uint_t len,
+                      void (*done)(const DilloUrl *url, int version))
+{
+   job->Done = done;
+   a_Imgdec_job_feed(job, buf, len, TRUE);
+}
+
+/**
+ * Has the job data yet to be decoded, or calls yet to be made?
+ */
+bool_t a_Imgdec_job_busy(ImgdecJob *job)
+{
+   bool_t busy;
+
+   pthread_mutex_lock(&imgdec_mutex);
+   busy = job->queued || job->running || job->posted || job->input->len > 0;
+   pthread_mutex_unlock(&imgdec_mutex);
+   return busy;
+}
+
+/**
+ * Decode what is left of the job in this thread, and free it.
+ * The decoder is kept, to be closed by the caller.
+ */
+void a_Imgdec_job_finish(ImgdecJob *job)
+{
+   Dlist *msgs;
+   bool_t more;
+
+   pthread_mutex_lock(&imgdec_mutex);
+   while (job->queued || job->running) {
+      if (job->queued) {
+         dList_remove(imgdec_ready, job);
+         job->queued = FALSE;
+      } else {
+         pthread_cond_wait(&imgdec_idle_cond, &imgdec_mutex);
+      }
+   }
+   if (job->posted) {
+      dList_remove(imgdec_done, job);
+      job->posted = FALSE;
+   }
+   msgs = job->msgs;
+   job->msgs = NULL;
+   more = job->input->len > 0;
+   dStr_append_l(job->data, job->input->str, job->input->len);
+   job->complete = job->input_complete;
+   pthread_mutex_unlock(&imgdec_mutex);
+
+   Imgdec_apply(job, msgs);
+   if (more)
+      Imgdec_run(job);
+   Imgdec_job_free(job, FALSE);
+}
+
+/**
+ * Stop the job, and free it along with its decoder
+ * (later, if a worker is running it).
+ */
+void a_Imgdec_job_abort(ImgdecJob *job)
+{
+   pthread_mutex_lock(&imgdec_mutex);
+   if (job->running) {
+      job->cancel = TRUE;
+      pthread_mutex_unlock(&imgdec_mutex);
+      return;
+   }
+   if (job->queued)
+      dList_remove(imgdec_ready, job);
+   if (job->posted)
+      dList_remove(imgdec_done, job);
+   pthread_mutex_unlock(&imgdec_mutex);
+   Imgdec_job_free(job, TRUE);
+}
+
+/**
+ * Return the job run by this thread, or NULL in the main thread.
+ */
+ImgdecJob *a_Imgdec_current(void)
+{
+   return imgdec_threads > 0 ? pthread_getspecific(imgdec_key) : NULL;
+}
+
+/**
+ * Has the decoder of the job been given the whole image?
+ * (For decoders in a worker, which can't ask the cache)
+ */
+bool_t a_Imgdec_complete(ImgdecJob *job)
+{
+   return job->complete;
+}
+
+static uint_t Imgdec_bpp(DilloImgType type)
+{
+   switch (type) {
+   case DILLO_IMG_TYPE_INDEXED:
+   case DILLO_IMG_TYPE_GRAY:
+      return 1;
+   case DILLO_IMG_TYPE_RGB:
+      return 3;
+   case DILLO_IMG_TYPE_CMYK_INV:
+      return 4;
+   default:
+      return 0;
+   }
+}
+
+/*
+ * The dicache calls, as made by a decoder in a worker thread
+ */
+
+void a_Imgdec_set_reduction(ImgdecJob *job, uint_t reduction)
+{
+   ImgdecMsg *msg = Imgdec_msg_new(IMGDEC_SetReduction);
+
+   msg->reduction = reduction;
+   job->reduction = reduction;
+   Imgdec_send(job, msg);
+}
+
+void a_Imgdec_set_parms(ImgdecJob *job, DilloImage *Image, uint_t width,
+                        uint_t height, DilloImgType type, double gamma)
+{
+   ImgdecMsg *msg = Imgdec_msg_new(IMGDEC_SetParms);
+
+   msg->Image = Image;
+   msg->width = width;
+   msg->height = height;
+   msg->type = type;
+   msg->gamma = gamma;
+   job->rowlen = (width + job->reduction - 1) / job->reduction *
+                 Imgdec_bpp(type);
+   Imgdec_flush_rows(job);
+   Imgdec_send(job, msg);
+}
+
+void a_Imgdec_set_cmap(ImgdecJob *job, int bg_color, const uchar_t *cmap,
+                       uint_t num_colors, int num_colors_max, int bg_index)
+{
+   ImgdecMsg *msg = Imgdec_msg_new(IMGDEC_SetCmap);
+
+   msg->bg_color = bg_color;
+   msg->num_colors = num_colors;
+   msg->num_colors_max = num_colors_max;
+   msg->bg_index = bg_index;
+   msg->data = dStr_sized_new(3 * num_colors + 1);
+   dStr_append_l(msg->data, (const char *)cmap, 3 * num_colors);
+   Imgdec_flush_rows(job);
+   Imgdec_send(job, msg);
+}
+
+void a_Imgdec_new_scan(ImgdecJob *job)
+{
+   Imgdec_flush_rows(job);
+   Imgdec_send(job, Imgdec_msg_new(IMGDEC_NewScan));
+}
+
+void a_Imgdec_write(ImgdecJob *job, const uchar_t *buf, uint_t Y)
+{
+   ImgdecMsg *msg;
+
+   if (job->rowlen == 0)
+      return;   /* no parameters yet */
+   if (!(msg = job->rows)) {
+      msg = job->rows = Imgdec_msg_new(IMGDEC_Rows);
+      msg->rowlen = job->rowlen;
+      msg->data = dStr_sized_new(IMGDEC_BATCH + sizeof(Y) + job->rowlen);
+   }
+   dStr_append_l(msg->data, (const char *)&Y, sizeof(Y));
+   dStr_append_l(msg->data, (const char *)buf, job->rowlen);
+   if (msg->data->len >= IMGDEC_BATCH)
+      Imgdec_flush_rows(job);
+}
@@ -0,0 +1,43 @@
+#ifndef __IMGDEC_H__
+#define __IMGDEC_H__
+
+#include "cache.h"
+#include "image.hh"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+typedef struct ImgdecJob ImgdecJob;
+
+void a_Imgdec_init(void);
+void a_Imgdec_freeall(void);
+bool_t a_Imgdec_enabled(void);
+
+ImgdecJob *a_Imgdec_job_new(DilloUrl *url, int version,
+                            CA_Callback_t Decoder, void *DecoderData);
+void a_Imgdec_job_feed(ImgdecJob *job, const char *buf, uint_t len,
+                       bool_t complete);
+void a_Imgdec_job_run(ImgdecJob *job, const char *buf, uint_t len,
+                      void (*done)(const DilloUrl *url, int version));
+bool_t a_Imgdec_job_busy(ImgdecJob *job);
+void a_Imgdec_job_finish(ImgdecJob *job);
+void a_Imgdec_job_abort(ImgdecJob *job);
+
+/* For the dicache and the decoders, when run in a worker thread */
+ImgdecJob *a_Imgdec_current(void);
+bool_t a_Imgdec_complete(ImgdecJob *job);
+void a_Imgdec_set_reduction(ImgdecJob *job, uint_t reduction);
+void a_Imgdec_set_parms(ImgdecJob *job, DilloImage *Image, uint_t width,
+                        uint_t height, DilloImgType type, double gamma);
+void a_Imgdec_set_cmap(ImgdecJob *job, int bg_color, const uchar_t *cmap,
+                       uint_t num_colors, int num_colors_max, int bg_index);
+void a_Imgdec_new_scan(ImgdecJob *job);
+void a_Imgdec_write(ImgdecJob *job, const uchar_t *buf, uint_t Y);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __IMGDEC_H__ */
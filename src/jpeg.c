@@ -75,6 +75,7 @@ struct DilloJpeg {
    char *Data;
 
    uint_t y;
+   int draw_width, draw_height;  /**< Size it is drawn at, or -1 */
 
    struct jpeg_decompress_struct cinfo;
    struct my_error_mgr jerr;
@@ -107,6 +108,7 @@ static void Jpeg_free(DilloJpeg *jpeg)
 {
    _MSG("Jpeg_free: jpeg=%p\n", jpeg);
    jpeg_destroy_decompress(&(jpeg->cinfo));
+   a_Url_free(jpeg->url);
    dFree(jpeg);
 }
 
@@ -186,12 +188,16 @@ static void term_source(struct jpeg_decompress_struct *p)
 void *a_Jpeg_new(DilloImage *Image, DilloUrl *url, int version)
 {
    my_source_mgr *src;
+   DICacheEntry *entry = a_Dicache_get_entry(url, version);
    DilloJpeg *jpeg = dMalloc(sizeof(*jpeg));
    _MSG("a_Jpeg_new: jpeg=%p\n", jpeg);
 
    jpeg->Image = Image;
-   jpeg->url = url;
+   jpeg->url = a_Url_dup(url);
    jpeg->version = version;
+   /* The dicache tells the size the image is drawn at, if known */
+   jpeg->draw_width = entry ? entry->DrawWidth : -1;
+   jpeg->draw_height = entry ? entry->DrawHeight : -1;
 
    jpeg->state = DILLO_JPEG_INIT;
    jpeg->Start_Ofs = 0;
@@ -248,6 +254,41 @@ const char *a_Jpeg_version(void)
 #undef QUOTE
 }
 
+/**
+ * Is the whole image in the cache?
+ */
+static bool_t Jpeg_complete(DilloJpeg *jpeg)
+{
+   ImgdecJob *job;
+
+   /* In a worker thread, the cache can't be asked */
+   if ((job = a_Imgdec_current()))
+      return a_Imgdec_complete(job);
+   return (a_Capi_get_flags(jpeg->url) & CAPI_Completed) != 0;
+}
+
+/**
+ * Find how much the image can be reduced while decoding it (libjpeg can
+ * scale the DCT by 1/2, 1/4 or 1/8), and still be at least as large as
+ * it is drawn. This saves most of the decoding time and memory of large
+ * photos shown as thumbnails.
+ */
+static uint_t Jpeg_scale_denom(DilloJpeg *jpeg)
+{
+   uint_t denom, w = jpeg->cinfo.image_width, h = jpeg->cinfo.image_height;
+
+   if (jpeg->draw_width == -1 && jpeg->draw_height == -1)
+      return 1;
+   for (denom = 8; denom > 1; denom /= 2) {
+      if ((jpeg->draw_width == -1 ||
+           (w + denom - 1) / denom >= (uint_t)jpeg->draw_width) &&
+          (jpeg->draw_height == -1 ||
+           (h + denom - 1) / denom >= (uint_t)jpeg->draw_height))
+         break;
+   }
+   return denom;
+}
+
 /**
  * Receive and process new chunks of JPEG image data
  */
@@ -257,6 +298,7 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
    uchar_t *linebuf;
    JSAMPLE *array[1];
    int num_read;
+   uint_t denom;
 
    _MSG("Jpeg_write: (%p) Bytes in buff: %ld Ofs: %lu\n", jpeg,
         (long) BufSize, (ulong_t)jpeg->Start_Ofs);
@@ -297,8 +339,7 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
           * If a multiple-scan image is not completely in cache,
           * use progressive display, updating as it arrives.
           */
-         if (jpeg_has_multiple_scans(&jpeg->cinfo) &&
-             !(a_Capi_get_flags(jpeg->url) & CAPI_Completed))
+         if (jpeg_has_multiple_scans(&jpeg->cinfo) && !Jpeg_complete(jpeg))
             jpeg->cinfo.buffered_image = TRUE;
 
          /* check max image size */
@@ -312,6 +353,13 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
             return;
          }
 
+         /* The output size is rounded up, as the dicache expects */
+         if ((denom = Jpeg_scale_denom(jpeg)) > 1) {
+            jpeg->cinfo.scale_num = 1;
+            jpeg->cinfo.scale_denom = denom;
+            a_Dicache_set_reduction(jpeg->url, jpeg->version, denom);
+         }
+
          /** \todo Gamma for JPEG? */
          a_Dicache_set_parms(jpeg->url, jpeg->version, jpeg->Image,
                              (uint_t)jpeg->cinfo.image_width,
@@ -356,7 +404,7 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
    }
 
    if (jpeg->state == DILLO_JPEG_READ_IN_SCAN) {
-      linebuf = dMalloc(jpeg->cinfo.image_width *
+      linebuf = dMalloc(jpeg->cinfo.output_width *
                          jpeg->cinfo.num_components);
       array[0] = linebuf;
 
@@ -370,7 +418,7 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
 
          jpeg->y++;
 
-         if (jpeg->y == jpeg->cinfo.image_height) {
+         if (jpeg->y == jpeg->cinfo.output_height) {
             /* end of scan */
             if (!jpeg->cinfo.buffered_image) {
                /* single scan */
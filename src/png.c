@@ -318,6 +318,7 @@ static void Png_free(DilloPng *png)
       MSG_WARN("PNG: can't destroy read structure\n");
    else if (png->png_ptr)
       png_destroy_read_struct(&png->png_ptr, &png->info_ptr, NULL);
+   a_Url_free(png->url);
    dFree(png);
 }
 
@@ -451,7 +452,7 @@ void *a_Png_new(DilloImage *Image, DilloUrl *url, int version)
    _MSG("a_Png_new: png=%p\n", png);
 
    png->Image = Image;
-   png->url = url;
+   png->url = a_Url_dup(url);
    png->version = version;
    png->bgcolor = Image->bg_color;
    png->error = 0;
@@ -42,7 +42,13 @@ void a_Prefs_init(void)
    prefs.white_bg_replacement = 0xe0e0a3; // 0xdcd1ba;
    prefs.bg_color = 0xdcd1ba;
    prefs.buffered_drawing = 1;
+   prefs.cache_max_size = 64;
    prefs.contrast_visited_color = TRUE;
+   prefs.dicache_max_size = 128;
+   prefs.disk_cache = FALSE;
+   prefs.disk_cache_max_size = 256;
+   prefs.dns_cache_ttl = 300;
+   prefs.dns_max_threads = 8;
    prefs.enterpress_forces_submit = FALSE;
    prefs.focus_new_tab = FALSE;
    prefs.font_cursive = dStrdup(PREFS_FONT_CURSIVE);
@@ -67,6 +73,8 @@ void a_Prefs_init(void)
    prefs.http_proxy = NULL;
    prefs.http_max_conns = 6;
    prefs.http_persistent_conns = TRUE;
+   prefs.http_pipelining = FALSE;
+   prefs.http_preconnect = FALSE;
    prefs.http_proxyuser = NULL;
    prefs.http_referer = dStrdup(PREFS_HTTP_REFERER);
    prefs.http_strict_transport_security = TRUE;
@@ -77,6 +85,7 @@ void a_Prefs_init(void)
    prefs.adjust_table_min_width = TRUE;
    prefs.load_images=TRUE;
    prefs.ignore_image_formats = NULL;
+   prefs.image_decode_threads = 0;
    prefs.mark_unloaded_images=FALSE;
    prefs.load_background_images=FALSE;
    prefs.load_stylesheets=TRUE;
@@ -41,6 +41,7 @@ typedef struct {
    int ypos;
    char *http_language;
    int32_t http_max_conns;
+   bool_t http_preconnect;
    DilloUrl *http_proxy;
    char *http_proxyuser;
    char *http_referer;
@@ -50,6 +51,12 @@ typedef struct {
    DilloUrl *home;
    DilloUrl *new_tab_page;
    bool_t allow_white_bg;
+   int32_t cache_max_size;
+   int32_t dicache_max_size;
+   bool_t disk_cache;
+   int32_t disk_cache_max_size;
+   int32_t dns_cache_ttl;
+   int32_t dns_max_threads;
    int32_t white_bg_replacement;
    int32_t bg_color;
    int32_t ui_button_highlight_color;
@@ -98,11 +105,13 @@ typedef struct {
    bool_t fullwindow_start;
    bool_t load_images;
    char *ignore_image_formats;
+   int32_t image_decode_threads;
    bool_t mark_unloaded_images;
    bool_t load_background_images;
    bool_t load_stylesheets;
    bool_t parse_embedded_css;
    bool_t http_persistent_conns;
+   bool_t http_pipelining;
    bool_t http_strict_transport_security;
    bool_t http_force_https;
    int32_t buffered_drawing;
@@ -155,7 +155,13 @@ void PrefsParser::parse(FILE *fp)
       { "white_bg_replacement", &prefs.white_bg_replacement, PREFS_COLOR, 0 },
       { "bg_color", &prefs.bg_color, PREFS_COLOR, 0 },
       { "buffered_drawing", &prefs.buffered_drawing, PREFS_INT32, 0 },
+      { "cache_max_size", &prefs.cache_max_size, PREFS_INT32, 0 },
       { "contrast_visited_color", &prefs.contrast_visited_color, PREFS_BOOL, 0 },
+      { "dicache_max_size", &prefs.dicache_max_size, PREFS_INT32, 0 },
+      { "disk_cache", &prefs.disk_cache, PREFS_BOOL, 0 },
+      { "disk_cache_max_size", &prefs.disk_cache_max_size, PREFS_INT32, 0 },
+      { "dns_cache_ttl", &prefs.dns_cache_ttl, PREFS_INT32, 0 },
+      { "dns_max_threads", &prefs.dns_max_threads, PREFS_INT32, 0 },
       { "enterpress_forces_submit", &prefs.enterpress_forces_submit,
         PREFS_BOOL, 0 },
       { "focus_new_tab", &prefs.focus_new_tab, PREFS_BOOL, 0 },
@@ -174,6 +180,8 @@ void PrefsParser::parse(FILE *fp)
       { "http_language", &prefs.http_language, PREFS_STRING, 0 },
       { "http_max_conns", &prefs.http_max_conns, PREFS_INT32, 0 },
       { "http_persistent_conns", &prefs.http_persistent_conns, PREFS_BOOL, 0 },
+      { "http_pipelining", &prefs.http_pipelining, PREFS_BOOL, 0 },
+      { "http_preconnect", &prefs.http_preconnect, PREFS_BOOL, 0 },
       { "http_proxy", &prefs.http_proxy, PREFS_URL, 0 },
       { "http_proxyuser", &prefs.http_proxyuser, PREFS_STRING, 0 },
       { "http_referer", &prefs.http_referer, PREFS_STRING, 0 },
@@ -187,6 +195,7 @@ void PrefsParser::parse(FILE *fp)
       { "load_images", &prefs.load_images, PREFS_BOOL, 0 },
       { "mark_unloaded_images", &prefs.mark_unloaded_images, PREFS_BOOL, 0 },
       { "ignore_image_formats", &prefs.ignore_image_formats, PREFS_STRING, 0 },
+      { "image_decode_threads", &prefs.image_decode_threads, PREFS_INT32, 0 },
       { "load_background_images", &prefs.load_background_images, PREFS_BOOL, 0 },
       { "load_stylesheets", &prefs.load_stylesheets, PREFS_BOOL, 0 },
       { "middle_click_drags_page", &prefs.middle_click_drags_page,
@@ -22,6 +22,22 @@
 using namespace lout::misc;
 using namespace dw::core::style;
 
+/** Maximum number of parsed stylesheets kept for reuse */
+#define STYLESHEET_CACHE_SIZE 64
+
+/**
+ * A parsed external stylesheet. It is reused while the cache entry of the
+ * URL keeps the same version.
+ */
+typedef struct {
+   DilloUrl *url;
+   uint_t version;
+   CssRuleSet *ruleSet;
+} StyleSheetCacheEntry;
+
+/** Most recently used first */
+static Dlist *StyleSheetCache = NULL;
+
 /**
  * Signal handler for "delete": This handles the case when an instance
  * of StyleImage is deleted, possibly when the cache client is still
@@ -67,6 +83,7 @@ StyleEngine::StyleEngine (dw::core::Layout *layout,
 
    doctree = new Doctree ();
    stack = new lout::misc::SimpleVector <Node> (1);
+   sharedStyles = new lout::misc::SimpleVector <SharedStyle> (1);
    cssContext = new CssContext ();
    buildUserStyle ();
    this->layout = layout;
@@ -109,6 +126,8 @@ StyleEngine::~StyleEngine () {
    a_Url_free(pageUrl);
    a_Url_free(baseUrl);
 
+   clearSharedStyles ();
+   delete sharedStyles;
    delete stack;
    delete doctree;
    delete cssContext;
@@ -116,14 +135,43 @@ StyleEngine::~StyleEngine () {
 
 void StyleEngine::stackPush () {
    static const Node emptyNode = {
-      NULL, NULL, NULL, NULL, NULL, NULL, false, false, NULL
+      NULL, NULL, NULL, NULL, NULL, NULL, false, false, false, NULL
    };
 
    stack->setSize (stack->size () + 1, emptyNode);
 }
 
 void StyleEngine::stackPop () {
-   Node *n = stack->getRef (stack->size () - 1);
+   int i = stack->size () - 1;
+   Node *n = stack->getRef (i);
+
+   if (n->shareable) {
+      // keep the properties and style for the next sibling
+      static const SharedStyle emptySharedStyle = {
+         NULL, NULL, NULL, NULL, NULL, false
+      };
+
+      if (sharedStyles->size () <= i)
+         sharedStyles->setSize (i + 1, emptySharedStyle);
+
+      SharedStyle *s = sharedStyles->getRef (i);
+      delete s->styleAttrProperties;
+      delete s->styleAttrPropertiesImportant;
+      delete s->nonCssProperties;
+      if (s->style)
+         s->style->unref ();
+
+      s->doctreeNode = n->doctreeNode;
+      s->styleAttrProperties = n->styleAttrProperties;
+      s->styleAttrPropertiesImportant = n->styleAttrPropertiesImportant;
+      s->nonCssProperties = n->nonCssProperties;
+      s->style = n->style;
+      s->displayNone = n->displayNone;
+      n->styleAttrProperties = NULL;
+      n->styleAttrPropertiesImportant = NULL;
+      n->nonCssProperties = NULL;
+      n->style = NULL;
+   }
 
    delete n->styleAttrProperties;
    delete n->styleAttrPropertiesImportant;
@@ -137,6 +185,19 @@ void StyleEngine::stackPop () {
    stack->setSize (stack->size () - 1);
 }
 
+void StyleEngine::clearSharedStyles () {
+   for (int i = 0; i < sharedStyles->size (); i++) {
+      SharedStyle *s = sharedStyles->getRef (i);
+
+      delete s->styleAttrProperties;
+      delete s->styleAttrPropertiesImportant;
+      delete s->nonCssProperties;
+      if (s->style)
+         s->style->unref ();
+   }
+   sharedStyles->setSize (0);
+}
+
 /**
  * \brief tell the styleEngine that a new html element has started.
  */
@@ -148,6 +209,7 @@ void StyleEngine::startElement (int element, BrowserWindow *bw) {
    DoctreeNode *dn = doctree->push ();
 
    dn->element = element;
+   doctree->filter ()->add (DoctreeFilter::hashElement (element));
    n->doctreeNode = dn;
    if (stack->size () > 1)
       n->displayNone = stack->getRef (stack->size () - 2)->displayNone;
@@ -161,6 +223,7 @@ void StyleEngine::setId (const char *id) {
    DoctreeNode *dn = doctree->top ();
    assert (dn->id == NULL);
    dn->id = dStrdup (id);
+   doctree->filter ()->add (DoctreeFilter::hashString (id, 'i'));
 }
 
 /**
@@ -192,11 +255,16 @@ void StyleEngine::setClass (const char *klass) {
    DoctreeNode *dn = doctree->top ();
    assert (dn->klass == NULL);
    dn->klass = splitStr (klass, ' ');
+   for (int i = 0; i < dn->klass->size (); i++)
+      doctree->filter ()->add (DoctreeFilter::hashString (dn->klass->get (i),
+                                                          'c'));
 }
 
 void StyleEngine::setStyle (const char *styleAttr) {
    Node *n = stack->getRef (stack->size () - 1);
    assert (n->styleAttrProperties == NULL);
+   if (n->style)
+      n->shareable = false;
    // parse style information from style="" attribute, if it exists
    if (styleAttr && prefs.parse_embedded_css) {
       n->styleAttrProperties = new CssPropertyList (true);
@@ -220,6 +288,8 @@ void StyleEngine::inheritNonCssHints () {
       Node *n = stack->getRef (stack->size () - 1);
       CssPropertyList *origNonCssProperties = n->nonCssProperties;
 
+      if (n->style)
+         n->shareable = false;
       n->nonCssProperties = new CssPropertyList(*pn->nonCssProperties, true);
 
       if (origNonCssProperties) // original nonCssProperties have precedence
@@ -232,6 +302,9 @@ void StyleEngine::inheritNonCssHints () {
 void StyleEngine::clearNonCssHints () {
    Node *n = stack->getRef (stack->size () - 1);
 
+   if (n->style)
+      n->shareable = false;
+
    delete n->nonCssProperties;
    n->nonCssProperties = NULL;
 }
@@ -297,7 +370,17 @@ void StyleEngine::setPseudoVisited () {
  * \brief tell the styleEngine that a html element has ended.
  */
 void StyleEngine::endElement (int element) {
-   assert (element == doctree->top ()->element);
+   DoctreeNode *dn = doctree->top ();
+   DoctreeFilter *filter = doctree->filter ();
+
+   assert (element == dn->element);
+
+   filter->remove (DoctreeFilter::hashElement (dn->element));
+   if (dn->id)
+      filter->remove (DoctreeFilter::hashString (dn->id, 'i'));
+   if (dn->klass)
+      for (int i = 0; i < dn->klass->size (); i++)
+         filter->remove (DoctreeFilter::hashString (dn->klass->get (i), 'c'));
 
    stackPop ();
    doctree->pop ();
@@ -911,6 +994,57 @@ Style * StyleEngine::backgroundStyle (BrowserWindow *bw) {
    return stack->getRef (stack->size () - 1)->backgroundStyle;
 }
 
+static bool equalProperties (CssPropertyList *p1, CssPropertyList *p2) {
+   if (p1 == NULL || p2 == NULL)
+      return p1 == p2;
+   return p1->equals (p2);
+}
+
+/**
+ * \brief Reuse the style of the preceding sibling if it is known to be the
+ * same.
+ *
+ * This is the case when both elements have the same tag, classes, style
+ * attribute and non-CSS hints, and no id or pseudo class. Rules with the
+ * adjacent sibling combinator would tell them apart, so nothing is shared
+ * when there are any.
+ */
+bool StyleEngine::shareStyle (int i) {
+   Node *n = stack->getRef (i);
+   const DoctreeNode *dn = n->doctreeNode, *sdn;
+   SharedStyle *s;
+
+   if (i >= sharedStyles->size ())
+      return false;
+
+   s = sharedStyles->getRef (i);
+   sdn = s->doctreeNode;
+   if (sdn == NULL || sdn != dn->sibling || sdn->element != dn->element ||
+       dn->id || sdn->id || dn->pseudo || sdn->pseudo)
+      return false;
+
+   if (dn->klass || sdn->klass) {
+      if (!dn->klass || !sdn->klass ||
+          dn->klass->size () != sdn->klass->size ())
+         return false;
+      for (int j = 0; j < dn->klass->size (); j++)
+         if (strcmp (dn->klass->get (j), sdn->klass->get (j)) != 0)
+            return false;
+   }
+
+   if (!equalProperties (n->styleAttrProperties, s->styleAttrProperties) ||
+       !equalProperties (n->styleAttrPropertiesImportant,
+                         s->styleAttrPropertiesImportant) ||
+       !equalProperties (n->nonCssProperties, s->nonCssProperties) ||
+       cssContext->hasSiblingRules ())
+      return false;
+
+   n->style = s->style;
+   n->style->ref ();
+   n->displayNone = s->displayNone;
+   return true;
+}
+
 /**
  * \brief Create a new style object based on the previously opened / closed
  * HTML elements and the nonCssProperties that have been set.
@@ -930,6 +1064,10 @@ Style * StyleEngine::style0 (int i, BrowserWindow *bw) {
    // style() or wordStyle() for each new element.
    assert (stack->getRef (i)->style == NULL);
 
+   stack->getRef (i)->shareable = true;
+   if (shareStyle (i))
+      return stack->getRef (i)->style;
+
    // reset values that are not inherited according to CSS
    attrs.resetValues ();
    preprocessAttrs (&attrs);
@@ -980,6 +1118,8 @@ Style * StyleEngine::wordStyle0 (BrowserWindow *bw) {
  * Note that restyle() does not change any styles in the widget tree.
  */
 void StyleEngine::restyle (BrowserWindow *bw) {
+   clearSharedStyles ();
+
    for (int i = 1; i < stack->size (); i++) {
       Node *n = stack->getRef (i);
       if (n->style) {
@@ -999,18 +1139,91 @@ void StyleEngine::restyle (BrowserWindow *bw) {
    }
 }
 
-void StyleEngine::parse (DilloHtml *html, DilloUrl *url, const char *buf,
-                         int buflen, CssOrigin origin) {
+/**
+ * \brief Load the stylesheets imported by ruleSet, then add its rules.
+ */
+void StyleEngine::addRuleSet (DilloHtml *html, CssRuleSet *ruleSet) {
    if (importDepth > 10) { // avoid looping with recursive @import directives
       MSG_WARN("Maximum depth of CSS @import reached--ignoring stylesheet.\n");
       return;
    }
 
    importDepth++;
-   CssParser::parse (html, url, cssContext, buf, buflen, origin);
+   for (int i = 0; i < ruleSet->numImports (); i++)
+      a_Html_load_stylesheet (html, ruleSet->getImport (i));
+   cssContext->addRuleSet (ruleSet);
+   clearSharedStyles (); // they may not match the new rules
    importDepth--;
 }
 
+void StyleEngine::parse (DilloHtml *html, DilloUrl *url, const char *buf,
+                         int buflen, CssOrigin origin) {
+   CssRuleSet *ruleSet = new CssRuleSet ();
+
+   ruleSet->ref ();
+   CssParser::parse (html, url, ruleSet, buf, buflen, origin);
+   addRuleSet (html, ruleSet);
+   ruleSet->unref ();
+}
+
+/**
+ * \brief Add an external author stylesheet.
+ *
+ * The parsed rules are kept, keyed by URL and cache version, so other
+ * documents using the same stylesheet don't need to parse it again.
+ */
+void StyleEngine::parseStyleSheet (DilloHtml *html, const DilloUrl *url,
+                                   uint_t version, const char *buf,
+                                   int buflen) {
+   StyleSheetCacheEntry *e = NULL;
+   CssRuleSet *ruleSet;
+   int i;
+
+   if (!StyleSheetCache)
+      StyleSheetCache = dList_new (STYLESHEET_CACHE_SIZE);
+
+   for (i = 0; (e = (StyleSheetCacheEntry *) dList_nth_data (StyleSheetCache,
+                                                             i)); i++)
+      if (a_Url_cmp (e->url, url) == 0)
+         break;
+
+   if (e && e->version != version) {
+      /* the stylesheet changed */
+      dList_remove (StyleSheetCache, e);
+      e->ruleSet->unref ();
+      a_Url_free (e->url);
+      dFree (e);
+      e = NULL;
+   }
+
+   if (e) {
+      _MSG("StyleEngine::parseStyleSheet: reusing %s\n", URL_STR(url));
+      dList_remove (StyleSheetCache, e);
+   } else {
+      if (dList_length (StyleSheetCache) >= STYLESHEET_CACHE_SIZE) {
+         e = (StyleSheetCacheEntry *) dList_nth_data (StyleSheetCache,
+                                 dList_length (StyleSheetCache) - 1);
+         dList_remove (StyleSheetCache, e);
+         e->ruleSet->unref ();
+         a_Url_free (e->url);
+         dFree (e);
+      }
+      e = dNew (StyleSheetCacheEntry, 1);
+      e->url = a_Url_dup (url);
+      e->version = version;
+      e->ruleSet = new CssRuleSet ();
+      e->ruleSet->ref ();
+      CssParser::parse (html, url, e->ruleSet, buf, buflen,
+                        CSS_ORIGIN_AUTHOR);
+   }
+   dList_prepend (StyleSheetCache, e);
+
+   ruleSet = e->ruleSet;
+   ruleSet->ref (); // the entry may be dropped by a nested parseStyleSheet
+   addRuleSet (html, ruleSet);
+   ruleSet->unref ();
+}
+
 /**
  * \brief Create the user agent style.
  *
@@ -1074,8 +1287,13 @@ void StyleEngine::init () {
       "table, caption {font-size: medium; font-weight: normal}";
 
    CssContext context;
-   CssParser::parse (NULL, NULL, &context, cssBuf, strlen (cssBuf),
+   CssRuleSet *ruleSet = new CssRuleSet ();
+
+   ruleSet->ref ();
+   CssParser::parse (NULL, NULL, ruleSet, cssBuf, strlen (cssBuf),
                      CSS_ORIGIN_USER_AGENT);
+   context.addRuleSet (ruleSet);
+   ruleSet->unref ();
 }
 
 void StyleEngine::buildUserStyle () {
@@ -1083,7 +1301,12 @@ void StyleEngine::buildUserStyle () {
    char *filename = dStrconcat(dGethomedir(), "/.dillo/style.css", NULL);
 
    if ((style = a_Misc_file2dstr(filename))) {
-      CssParser::parse (NULL,NULL,cssContext,style->str, style->len,CSS_ORIGIN_USER);
+      CssRuleSet *ruleSet = new CssRuleSet ();
+
+      ruleSet->ref ();
+      CssParser::parse (NULL,NULL,ruleSet,style->str, style->len,CSS_ORIGIN_USER);
+      cssContext->addRuleSet (ruleSet);
+      ruleSet->unref ();
       dStr_free (style, 1);
    }
    dFree (filename);
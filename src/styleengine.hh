@@ -40,11 +40,26 @@ class StyleEngine {
          dw::core::style::Style *backgroundStyle;
          bool inheritBackgroundColor;
          bool displayNone;
+         bool shareable; /* style was computed from the current properties */
          DoctreeNode *doctreeNode;
       };
 
+      /**
+       * The last closed element at some depth, whose style can be reused
+       * by its next sibling if they have the same properties.
+       */
+      struct SharedStyle {
+         const DoctreeNode *doctreeNode;
+         CssPropertyList *styleAttrProperties;
+         CssPropertyList *styleAttrPropertiesImportant;
+         CssPropertyList *nonCssProperties;
+         dw::core::style::Style *style;
+         bool displayNone;
+      };
+
       dw::core::Layout *layout;
       lout::misc::SimpleVector <Node> *stack;
+      lout::misc::SimpleVector <SharedStyle> *sharedStyles;
       CssContext *cssContext;
       Doctree *doctree;
       int importDepth;
@@ -54,13 +69,18 @@ class StyleEngine {
 
       void stackPush ();
       void stackPop ();
+      void clearSharedStyles ();
+      bool shareStyle (int i);
       void buildUserStyle ();
+      void addRuleSet (DilloHtml *html, CssRuleSet *ruleSet);
       dw::core::style::Style *style0 (int i, BrowserWindow *bw);
       dw::core::style::Style *wordStyle0 (BrowserWindow *bw);
       inline void setNonCssHint(CssPropertyName name, CssValueType type,
                                 CssPropertyValue value) {
          Node *n = stack->getRef (stack->size () - 1);
 
+         if (n->style)
+            n->shareable = false;
          if (!n->nonCssProperties)
             n->nonCssProperties = new CssPropertyList (true);
          n->nonCssProperties->set(name, type, value);
@@ -87,6 +107,8 @@ class StyleEngine {
 
       void parse (DilloHtml *html, DilloUrl *url, const char *buf, int buflen,
                   CssOrigin origin);
+      void parseStyleSheet (DilloHtml *html, const DilloUrl *url,
+                            uint_t version, const char *buf, int buflen);
       void startElement (int tag, BrowserWindow *bw);
       void startElement (const char *tagname, BrowserWindow *bw);
       void setId (const char *id);
@@ -19,6 +19,7 @@
 #include "image.hh"
 #include "cache.h"
 #include "dicache.h"
+#include "imgbuf.hh"
 
 #define NANOSVG_ALL_COLOR_KEYWORDS
 #define NANOSVG_IMPLEMENTATION
@@ -32,8 +33,18 @@ typedef struct {
    int version;                 /* Secondary Key for the dicache */
    int bgcolor;                 /* Parent widget background color */
    int fgcolor;                 /* Parent widget foreground color */
+   uint_t scanned;              /* Bytes already searched for "</svg>" */
+   bool_t done;                 /* The image has been decoded */
 } DilloSvg;
 
+/*
+ * A parsed image, kept by the Imgbuf to draw it at any size.
+ */
+typedef struct {
+   NSVGimage *nimg;
+   int bgcolor;
+} SvgSource;
+
 /*
  * Free up the resources for this image.
  */
@@ -41,6 +52,7 @@ static void Svg_free(DilloSvg *svg)
 {
    _MSG("Svg_free: svg=%p\n", svg);
 
+   a_Url_free(svg->url);
    dFree(svg);
 }
 
@@ -56,21 +68,73 @@ static void Svg_close(DilloSvg *svg, CacheClient_t *Client)
 }
 
 /*
- * Receive and process new chunks of SVG image data
+ * Rasterize the image to 'width' x 'height' RGB pixels, blended over the
+ * background color.
  */
-static void Svg_write(DilloSvg *svg, void *Buf, uint_t BufSize)
+static void Svg_draw(void *data, uchar_t *buf, uint_t width, uint_t height)
 {
    static NSVGrasterizer *rasterizer = NULL;
+   SvgSource *src = data;
+   NSVGimage *nimg = src->nimg;
+   unsigned stride = width * 4;
 
    if (!rasterizer)
       rasterizer = nsvgCreateRasterizer();
 
-   if (Buf == NULL || BufSize <= 0)
+   unsigned char *dest = dNew(unsigned char, height * stride);
+
+   nsvgRasterizeXY(rasterizer, nimg, 0, 0, width / nimg->width,
+                   height / nimg->height, dest, width, height, stride);
+
+   a_Imgbuf_rgba_to_rgb(buf, dest, width * height, src->bgcolor);
+   dFree(dest);
+}
+
+static void Svg_source_free(void *data)
+{
+   SvgSource *src = data;
+
+   nsvgDelete(src->nimg);
+   dFree(src);
+}
+
+/*
+ * Look for the end of the image in the new data. Only the bytes that were
+ * not searched before are scanned (plus the tail of the old ones, in case
+ * the tag was split).
+ */
+static bool_t Svg_complete(DilloSvg *svg, const char *buf, uint_t bufsize)
+{
+   static const char tag[] = "</svg>";
+   const uint_t taglen = sizeof(tag) - 1;
+   const char *p, *end = buf + bufsize;
+
+   if (svg->scanned > bufsize)
+      svg->scanned = 0;
+   p = buf + (svg->scanned >= taglen ? svg->scanned - (taglen - 1) : 0);
+   svg->scanned = bufsize;
+   while ((p = memchr(p, '<', end - p))) {
+      if ((uint_t)(end - p) < taglen)
+         break;
+      if (memcmp(p, tag, taglen) == 0)
+         return TRUE;
+      p++;
+   }
+   return FALSE;
+}
+
+/*
+ * Receive and process new chunks of SVG image data
+ */
+static void Svg_write(DilloSvg *svg, void *Buf, uint_t BufSize)
+{
+   if (Buf == NULL || BufSize <= 0 || svg->done)
       return;
 
    /* SVG image not finished yet */
-   if (strstr(Buf, "</svg>") == NULL)
+   if (!Svg_complete(svg, Buf, BufSize))
       return;
+   svg->done = TRUE;
 
    /* Use foreground as the current color, but transform to
     * nanosvg color format (BGR). */
@@ -100,36 +164,29 @@ static void Svg_write(DilloSvg *svg, void *Buf, uint_t BufSize)
    }
 
    DilloImgType type = DILLO_IMG_TYPE_RGB;
-   unsigned stride = width * 4;
+   SvgSource *src = dNew(SvgSource, 1);
+   src->nimg = nimg;
+   src->bgcolor = svg->bgcolor;
 
    a_Dicache_set_parms(svg->url, svg->version, svg->Image,
          width, height, type, 1 / 2.2);
 
-   unsigned char *dest = dNew(unsigned char, height * stride);
-
-   nsvgRasterizeXY(rasterizer, nimg, 0, 0, 1, 1, dest, width, height, stride);
-
-   unsigned bg_blue  = (svg->bgcolor) & 0xFF;
-   unsigned bg_green = (svg->bgcolor >> 8) & 0xFF;
-   unsigned bg_red   = (svg->bgcolor >> 16) & 0xFF;
-
-   unsigned char *line = dNew(unsigned char, width * 3);
-   for (unsigned i = 0; i < height; i++) {
-      for (unsigned j = 0; j < width; j++) {
-         unsigned r = dest[i * stride + 4 * j];
-         unsigned g = dest[i * stride + 4 * j + 1];
-         unsigned b = dest[i * stride + 4 * j + 2];
-         unsigned alpha = dest[i * stride + 4 * j + 3];
-
-         line[3 * j + 0] = (r * alpha + (bg_red   * (0xFF - alpha))) / 0xFF;
-         line[3 * j + 1] = (g * alpha + (bg_green * (0xFF - alpha))) / 0xFF;
-         line[3 * j + 2] = (b * alpha + (bg_blue  * (0xFF - alpha))) / 0xFF;
-      }
-      a_Dicache_write(svg->url, svg->version, line, i);
+   /* Scaled buffers are rasterized at their size, instead of scaling the
+    * pixels of the root buffer */
+   DICacheEntry *DicEntry = a_Dicache_get_entry(svg->url, svg->version);
+   if (!DicEntry || !DicEntry->v_imgbuf) {
+      Svg_source_free(src);
+      return;
    }
-   dFree(dest);
-   dFree(line);
-   nsvgDelete(nimg);
+   a_Imgbuf_set_vector_source(DicEntry->v_imgbuf, Svg_draw, Svg_source_free,
+                              src);
+
+   /* The root buffer holds the image at its own size */
+   unsigned char *pixels = dNew(unsigned char, height * width * 3);
+   Svg_draw(src, pixels, width, height);
+   for (unsigned i = 0; i < height; i++)
+      a_Dicache_write(svg->url, svg->version, pixels + i * width * 3, i);
+   dFree(pixels);
 }
 
 void a_Svg_callback(int Op, void *data)
@@ -154,7 +211,7 @@ void *a_Svg_new(DilloImage *Image, DilloUrl *url, int version)
    _MSG("a_Svg_new: svg=%p\n", svg);
 
    svg->Image = Image;
-   svg->url = url;
+   svg->url = a_Url_dup(url);
    svg->version = version;
    svg->bgcolor = Image->bg_color;
    svg->fgcolor = Image->fg_color;
@@ -129,6 +129,37 @@ const char *a_Url_hostname(const DilloUrl *u)
    return url->hostname;
 }
 
+/**
+ * Add a string to a FNV-1a hash, optionally ignoring ASCII case.
+ */
+static uint_t Url_hash_str(uint_t h, const char *s, int len, int icase)
+{
+   int i;
+
+   for (i = 0; i < len; i++)
+      h = (h ^ (uchar_t)(icase ? D_ASCII_TOLOWER(s[i]) : s[i])) * 16777619U;
+   /* separate the fields */
+   return (h ^ 0xff) * 16777619U;
+}
+
+/**
+ * Compute the hash of the fields compared by a_Url_cmp(), so URLs that
+ * compare equal have the same hash.
+ */
+static void Url_update_hash(DilloUrl *u)
+{
+   const char *path = u->path ? u->path + (*u->path == '/') : "";
+   uint_t h = 2166136261U;
+
+   h = Url_hash_str(h, URL_SCHEME(u), strlen(URL_SCHEME(u)), 1);
+   h = Url_hash_str(h, URL_AUTHORITY(u), strlen(URL_AUTHORITY(u)), 1);
+   h = Url_hash_str(h, path, strlen(path), 0);
+   h = Url_hash_str(h, URL_QUERY(u), strlen(URL_QUERY(u)), 0);
+   if (u->data)
+      h = Url_hash_str(h, u->data->str, u->data->len, 0);
+   u->hash = h;
+}
+
 /**
  *  Create a DilloUrl object and initialize it.
  *  (buffer, scheme, authority, path, query and fragment).
@@ -466,6 +497,7 @@ DilloUrl* a_Url_new(const char *url_str, const char *base_url)
       url->url_string = NULL;
    }
 
+   Url_update_hash(url);
    return url;
 }
 
@@ -488,6 +520,7 @@ DilloUrl* a_Url_dup(const DilloUrl *ori)
    url->illegal_chars_spc    = ori->illegal_chars_spc;
    url->data                 = dStr_sized_new(URL_DATA(ori)->len);
    dStr_append_l(url->data, URL_DATA(ori)->str, URL_DATA(ori)->len);
+   Url_update_hash(url);
    return url;
 }
 
@@ -538,6 +571,7 @@ void a_Url_set_data(DilloUrl *u, Dstr **data)
       dStr_free(u->data, 1);
       u->data = *data;
       *data = NULL;
+      Url_update_hash(u);
    }
 }
 
@@ -557,6 +591,7 @@ void a_Url_set_ismap_coords(DilloUrl *u, char *coord_str)
       dStr_truncate(u->url_string, u->ismap_url_len);
       dStr_append(u->url_string, coord_str);
       u->query = u->url_string->str + u->ismap_url_len + 1;
+      Url_update_hash(u);
    }
 }
 
@@ -60,6 +60,7 @@
 #define URL_FLAGS_(u)               (u)->flags
 #define URL_ILLEGAL_CHARS_(u)       (u)->illegal_chars
 #define URL_ILLEGAL_CHARS_SPC_(u)   (u)->illegal_chars_spc
+#define URL_HASH_(u)                (u)->hash
 
 /*
  * Access methods that never return NULL.
@@ -79,6 +80,7 @@
 #define URL_FLAGS(u)                URL_FLAGS_(u)
 #define URL_ILLEGAL_CHARS(u)        URL_ILLEGAL_CHARS_(u)
 #define URL_ILLEGAL_CHARS_SPC(u)    URL_ILLEGAL_CHARS_SPC_(u)
+#define URL_HASH(u)                 URL_HASH_(u)
 
 
 #ifdef __cplusplus
@@ -100,6 +102,7 @@ typedef struct {
    int ismap_url_len;             /**< Used by server side image maps */
    int illegal_chars;             /**< number of illegal chars */
    int illegal_chars_spc;         /**< number of illegal space chars */
+   uint_t hash;                   /**< Hash of the fields a_Url_cmp() uses */
 } DilloUrl;
 
 
@@ -17,6 +17,7 @@ extern "C" {
 #define WEB_Image    2
 #define WEB_Stylesheet 4
 #define WEB_Download 8   /* Half implemented... */
+#define WEB_Lazy    16   /* Can wait for the rest of the page */
 
 
 typedef struct _DilloWeb DilloWeb;
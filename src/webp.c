@@ -48,6 +48,7 @@ static void Webp_free(DilloWebp *webp)
    WebPFreeDecBuffer(&webp->output_buffer);
    if (webp->idec)
       WebPIDelete(webp->idec);
+   a_Url_free(webp->url);
    dFree(webp);
 }
 
@@ -199,7 +200,7 @@ void *a_Webp_new(DilloImage *Image, DilloUrl *url, int version)
    _MSG("a_Webp_new: webp=%p\n", webp);
 
    webp->Image = Image;
-   webp->url = url;
+   webp->url = a_Url_dup(url);
    webp->version = version;
 
    webp->bgcolor = Image->bg_color;
@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# Copyright (C) 2026 agent <agent@local>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+
+set -eux
+
+# Load a page with many images from a server with a 100 ms delay per
+# answer, with and without http_pipelining, and print the time until the
+# page is complete. Then load it again with a server that closes the
+# connection after a few answers, which must not lose any image.
+
+delay=100
+images=32
+wdir=$(readlink -f "$WORKDIR")
+
+function httpd_start() {
+  rm -f "$wdir/port"
+  "$BUILDDIR/httpd" -d $delay -n $images -p "$wdir/port" "$@" \
+    > "$wdir/httpd.log" &
+  httpd_pid=$!
+  while [ ! -s "$wdir/port" ]; do sleep 0.1; done
+  url="http://127.0.0.1:$(cat "$wdir/port")/page.html"
+}
+
+function httpd_stop() {
+  kill $httpd_pid || true
+  wait $httpd_pid || true
+}
+
+# Restart dillo with its own dillorc and time the page load
+function load() {
+  dilloc_stop
+  export HOME="$wdir/home-$1"
+  mkdir -p "$HOME/.dillo"
+  printf 'http_pipelining=%s\nhttp_persistent_conns=YES\n' "$1" \
+    > "$HOME/.dillo/dillorc"
+  dilloc_start
+
+  local t0=$(date +%s%N)
+  $DILLOC open "$url"
+  $DILLOC wait 30
+  local t1=$(date +%s%N)
+  echo "http_pipelining=$1: $(( (t1 - t0) / 1000000 )) ms"
+}
+
+# Every image has been answered at least once
+function check_images() {
+  for i in $(seq 0 $((images - 1))); do
+    grep -q "^/img/$i.gif " "$wdir/httpd.log"
+  done
+}
+
+trap 'httpd_stop; driver_stop' EXIT
+
+httpd_start
+load NO
+check_images
+# Nothing was pipelined
+[ -z "$(awk '$3 > 1' "$wdir/httpd.log")" ]
+httpd_stop
+
+httpd_start
+load YES
+check_images
+# Some requests were sent ahead
+awk '$3 > 1' "$wdir/httpd.log" | grep -q .
+httpd_stop
+
+# The server closes after three answers, with requests still pipelined
+httpd_start -c 3
+load YES
+check_images
+httpd_stop
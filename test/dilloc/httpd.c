@@ -0,0 +1,249 @@
+/*
+ * File: httpd.c
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * A small HTTP/1.1 server for the dilloc tests, that answers like a
+ * server far away: every answer is sent 'delay' ms after its request
+ * arrived. Connections are kept alive and pipelined requests are
+ * answered in order, so a client that sends its requests ahead waits
+ * about one delay for all of them, and one that doesn't waits one delay
+ * per request.
+ *
+ * It serves /page.html, a page with 'images' images from the same server
+ * (/img/N.gif), and the images. With '-c max', a connection is closed
+ * after answering 'max' requests, even if more were sent on it.
+ *
+ * The port it listens on is written to the file given with '-p', and a
+ * line is written to stdout for each answer: the path, the number of the
+ * request on its connection, and how many requests had arrived on the
+ * connection without an answer yet (1 when not pipelined).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#define MAX_PENDING 64
+
+/* A 1x1 transparent GIF */
+static const unsigned char gif[] = {
+   0x47, 0x49, 0x46, 0x38, 0x39, 0x61, 0x01, 0x00, 0x01, 0x00, 0x80, 0x00,
+   0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0x21, 0xf9, 0x04, 0x01, 0x00,
+   0x00, 0x00, 0x00, 0x2c, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00,
+   0x00, 0x02, 0x02, 0x44, 0x01, 0x00, 0x3b
+};
+
+static int delay = 100, images = 32, max_requests = 0;
+
+typedef struct {
+   char path[256];
+   double due;
+} Request;
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+   struct timespec ts;
+   double d = t - now();
+
+   if (d > 0) {
+      ts.tv_sec = (time_t)d;
+      ts.tv_nsec = (long)((d - ts.tv_sec) * 1e9);
+      nanosleep(&ts, NULL);
+   }
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+   const char *p = buf;
+   ssize_t n;
+
+   while (len > 0) {
+      if ((n = write(fd, p, len)) < 0) {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      p += n;
+      len -= n;
+   }
+   return 0;
+}
+
+static int answer(int fd, const char *path, int close_it)
+{
+   char hdr[256], page[64 * 1024];
+   const void *body;
+   const char *type = "text/html", *status = "200 OK";
+   int i, len, n;
+
+   if (!strcmp(path, "/page.html")) {
+      len = snprintf(page, sizeof(page),
+                     "<!DOCTYPE html>\n<title>pipeline</title>\n<p>");
+      for (i = 0; i < images && len < (int)sizeof(page) - 64; i++)
+         len += snprintf(page + len, sizeof(page) - len,
+                         "<img src=\"/img/%d.gif\" width=8 height=8>\n", i);
+      body = page;
+   } else if (!strncmp(path, "/img/", 5)) {
+      body = gif;
+      len = sizeof(gif);
+      type = "image/gif";
+   } else {
+      status = "404 Not Found";
+      body = "not found\n";
+      len = strlen(body);
+      type = "text/plain";
+   }
+   n = snprintf(hdr, sizeof(hdr),
+                "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n"
+                "Cache-Control: no-store\r\n%s\r\n",
+                status, type, len, close_it ? "Connection: close\r\n" : "");
+   return write_all(fd, hdr, n) || write_all(fd, body, len);
+}
+
+/*
+ * Serve one connection: read requests as they come, and answer each of
+ * them when it is due.
+ */
+static void serve(int fd)
+{
+   Request pending[MAX_PENDING];
+   char buf[16384], *p, *end;
+   int npending = 0, served = 0, len = 0, n, i;
+   struct timeval tv;
+   fd_set rfds;
+
+   while (1) {
+      /* wait for more requests, or until the first one is due */
+      FD_ZERO(&rfds);
+      FD_SET(fd, &rfds);
+      if (npending) {
+         double d = pending[0].due - now();
+
+         d = d > 0 ? d : 0;
+         tv.tv_sec = (time_t)d;
+         tv.tv_usec = (long)((d - tv.tv_sec) * 1e6);
+      }
+      n = select(fd + 1, &rfds, NULL, NULL, npending ? &tv : NULL);
+      if (n < 0 && errno != EINTR)
+         break;
+
+      if (n > 0 && FD_ISSET(fd, &rfds)) {
+         if ((n = read(fd, buf + len, sizeof(buf) - 1 - len)) <= 0) {
+            /* the client is done: answer what it asked for */
+            for (i = 0; i < npending; i++) {
+               sleep_until(pending[i].due);
+               if (answer(fd, pending[i].path, 0))
+                  break;
+            }
+            break;
+         }
+         len += n;
+         buf[len] = 0;
+         /* take every complete request */
+         while ((end = strstr(buf, "\r\n\r\n")) && npending < MAX_PENDING) {
+            p = pending[npending].path;
+            if (sscanf(buf, "GET %255s", p) != 1)
+               strcpy(p, "/");
+            pending[npending++].due = now() + delay / 1000.0;
+            end += 4;
+            len -= end - buf;
+            memmove(buf, end, len + 1);
+         }
+      }
+
+      if (npending && now() >= pending[0].due) {
+         int last = max_requests > 0 && served + 1 >= max_requests;
+
+         printf("%s %d %d\n", pending[0].path, served + 1, npending);
+         fflush(stdout);
+         if (answer(fd, pending[0].path, last) || last)
+            break;
+         served++;
+         memmove(pending, pending + 1, --npending * sizeof(Request));
+      }
+   }
+   close(fd);
+}
+
+int main(int argc, char **argv)
+{
+   struct sockaddr_in addr;
+   socklen_t addrlen = sizeof(addr);
+   const char *portfile = NULL;
+   int opt, sock, fd, one = 1;
+   FILE *f;
+
+   while ((opt = getopt(argc, argv, "c:d:n:p:")) != -1) {
+      switch (opt) {
+      case 'c': max_requests = atoi(optarg); break;
+      case 'd': delay = atoi(optarg); break;
+      case 'n': images = atoi(optarg); break;
+      case 'p': portfile = optarg; break;
+      default:
+         fprintf(stderr, "usage: %s [-c max] [-d ms] [-n images] "
+                 "[-p portfile]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   signal(SIGPIPE, SIG_IGN);
+   signal(SIGCHLD, SIG_IGN);
+   sock = socket(AF_INET, SOCK_STREAM, 0);
+   setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+       listen(sock, 16) < 0 ||
+       getsockname(sock, (struct sockaddr *)&addr, &addrlen) < 0) {
+      perror("httpd");
+      return 1;
+   }
+   if (portfile && (f = fopen(portfile, "w"))) {
+      fprintf(f, "%d\n", ntohs(addr.sin_port));
+      fclose(f);
+   } else {
+      printf("port %d\n", ntohs(addr.sin_port));
+      fflush(stdout);
+   }
+
+   while (1) {
+      if ((fd = accept(sock, NULL, NULL)) < 0) {
+         if (errno == EINTR)
+            continue;
+         perror("accept");
+         return 1;
+      }
+      if (fork() == 0) {
+         close(sock);
+         serve(fd);
+         _exit(0);
+      }
+      close(fd);
+   }
+   return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Dillo Widget
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Lays out the text of a big HTML or text file (a book, for instance) in
+ * a textblock, with and without the text width caches of the fonts, and
+ * prints how long it takes. The markup is simply skipped: tags only start
+ * new paragraphs when they are <p>, <br> or headings.
+ *
+ * Finally, the text is laid out by the main loop, as in dillo, and the
+ * statistics of the layout (see dw::core::Layout::ResizeStats) are
+ * printed, to see how long the main loop is blocked.
+ *
+ * Usage: dw-layout-bench FILE [WIDTH]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include <FL/Fl.H>
+#include "dw/core.hh"
+#include "dw/fltkcore.hh"
+#include "dw/fltkviewport.hh"
+#include "dw/textblock.hh"
+
+using namespace dw;
+using namespace dw::core;
+using namespace dw::core::style;
+using namespace dw::fltk;
+
+static double now ()
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char *readFile (const char *filename)
+{
+   FILE *fp = fopen (filename, "rb");
+   char *buf;
+   long size;
+
+   if (fp == NULL)
+      return NULL;
+   fseek (fp, 0, SEEK_END);
+   size = ftell (fp);
+   fseek (fp, 0, SEEK_SET);
+   buf = (char *) malloc (size + 1);
+   size = fread (buf, 1, size, fp);
+   buf[size] = 0;
+   fclose (fp);
+   return buf;
+}
+
+static bool breaksParagraph (const char *tag, int len)
+{
+   static const char *tags[] = { "p", "/p", "br", "h1", "h2", "h3", "div" };
+
+   for (unsigned i = 0; i < sizeof (tags) / sizeof (tags[0]); i++) {
+      int n = strlen (tags[i]);
+      if (len >= n && strncasecmp (tag, tags[i], n) == 0 &&
+          (len == n || !isalnum ((unsigned char) tag[n])))
+         return true;
+   }
+   return false;
+}
+
+/*
+ * Fill the textblock with the words of 'text', and return the number of
+ * words.
+ */
+static int addWords (Textblock *textblock, const char *text, Style *style)
+{
+   int numWords = 0;
+   bool space = false;
+
+   for (const char *p = text; *p; ) {
+      if (*p == '<') {
+         const char *end = strchr (p, '>');
+         if (end == NULL)
+            break;
+         if (breaksParagraph (p + 1, end - p - 1)) {
+            textblock->addParbreak (5, style);
+            space = false;
+         }
+         p = end + 1;
+      } else if (isspace ((unsigned char) *p)) {
+         space = true;
+         p++;
+      } else {
+         int len = strcspn (p, "< \t\n\r\f\v");
+         if (space)
+            textblock->addSpace (style);
+         textblock->addText (p, len, style);
+         numWords++;
+         space = false;
+         p += len;
+      }
+   }
+   textblock->flush ();
+   return numWords;
+}
+
+/*
+ * Lay out the text once, and return the time it took. With mainLoop, the
+ * layout is done by the idle functions, and the statistics are printed.
+ */
+static double layOut (const char *text, int width, int *numWords,
+                      bool mainLoop)
+{
+   FltkPlatform *platform = new FltkPlatform ();
+   Layout *layout = new Layout (platform);
+   FltkViewport *viewport = new FltkViewport (0, 0, width, 600);
+   layout->attachView (viewport);
+   layout->viewportSizeChanged (viewport, width, 600);
+
+   FontAttrs fontAttrs;
+   fontAttrs.name = "DejaVu Serif";
+   fontAttrs.size = 14;
+   fontAttrs.weight = 400;
+   fontAttrs.style = FONT_STYLE_NORMAL;
+   fontAttrs.letterSpacing = 0;
+   fontAttrs.fontVariant = FONT_VARIANT_NORMAL;
+
+   StyleAttrs styleAttrs;
+   styleAttrs.initValues ();
+   styleAttrs.font = dw::core::style::Font::create (layout, &fontAttrs);
+   styleAttrs.color = Color::create (layout, 0x000000);
+   styleAttrs.backgroundColor = Color::create (layout, 0xffffff);
+   Style *style = Style::create (&styleAttrs);
+
+   double t = now ();
+
+   Textblock *textblock = new Textblock (false);
+   textblock->setStyle (style);
+   layout->setWidget (textblock);
+   *numWords = addWords (textblock, text, style);
+
+   if (mainLoop) {
+      // There is no other way to see whether idle functions are pending.
+      const Layout::ResizeStats *stats = layout->getResizeStats ();
+      for (int n = 0; n < 100; n++) {
+         int slices = stats->slices;
+         Fl::wait (0);
+         if (stats->slices != slices)
+            n = 0;
+      }
+      printf ("%-14s %8d slices %5d iterations %8.1f ms longest stall\n",
+              "main loop", stats->slices, stats->iterations,
+              stats->maxSliceTime);
+   } else {
+      Requisition requisition;
+      textblock->sizeRequest (&requisition);
+   }
+
+   t = now () - t;
+
+   style->unref ();
+   delete layout;
+   return t;
+}
+
+int main (int argc, char **argv)
+{
+   char *text;
+   int width = argc > 2 ? atoi (argv[2]) : 800, numWords = 0;
+
+   if (argc < 2) {
+      fprintf (stderr, "usage: %s FILE [WIDTH]\n", argv[0]);
+      return 2;
+   }
+   if ((text = readFile (argv[1])) == NULL) {
+      perror (argv[1]);
+      return 1;
+   }
+
+   for (int cache = 0; cache <= 1; cache++) {
+      double best = 1e30;
+
+      FltkFont::setWidthCacheEnabled (cache);
+      for (int r = 0; r < 3; r++) {
+         double t = layOut (text, width, &numWords, false);
+         if (t < best)
+            best = t;
+      }
+      printf ("%-14s %8d words %9.1f ms %8.1f words/ms\n",
+              cache ? "width cache" : "no width cache", numWords,
+              best * 1e3, numWords / (best * 1e3));
+   }
+
+   layOut (text, width, &numWords, true);
+
+   free (text);
+   return 0;
+}
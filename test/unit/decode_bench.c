@@ -0,0 +1,253 @@
+/*
+ * File: decode_bench.c
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Checks that every content decoder gives back the original data when it
+ * is fed in pieces, as it comes from the network. When given files as
+ * arguments, it also compresses each one with every codec (at the levels
+ * servers commonly use for on-the-fly compression) and prints the
+ * compressed size and the decoding throughput of each one.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+
+#ifdef HAVE_BROTLI_ENCODER
+#include <brotli/encode.h>
+#endif
+
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "dlib/dlib.h"
+#include "src/decode.h"
+#include "src/prefs.h"
+
+/* decode.c only needs these from the rest of dillo */
+DilloPrefs prefs;
+
+/* The size of the pieces IO_read() hands to the cache */
+#define CHUNK 8192
+
+typedef Dstr *(*Encoder)(const Dstr *in);
+
+static Dstr *zlib_encode(const Dstr *in, int wbits)
+{
+   Dstr *out = dStr_sized_new(deflateBound(NULL, in->len) + 32);
+   z_stream zs;
+
+   memset(&zs, 0, sizeof(zs));
+   deflateInit2(&zs, 6, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY);
+   zs.next_in = (Bytef *)in->str;
+   zs.avail_in = in->len;
+   zs.next_out = (Bytef *)out->str;
+   zs.avail_out = out->sz - 1;
+   deflate(&zs, Z_FINISH);
+   out->len = zs.total_out;
+   deflateEnd(&zs);
+   return out;
+}
+
+static Dstr *gzip_encode(const Dstr *in)
+{
+   return zlib_encode(in, MAX_WBITS + 16);
+}
+
+static Dstr *deflate_encode(const Dstr *in)
+{
+   return zlib_encode(in, MAX_WBITS);
+}
+
+#ifdef HAVE_BROTLI_ENCODER
+static Dstr *brotli_encode(const Dstr *in)
+{
+   size_t len = BrotliEncoderMaxCompressedSize(in->len);
+   Dstr *out = dStr_sized_new(len + 1);
+
+   if (!BrotliEncoderCompress(5, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                              in->len, (const uint8_t *)in->str, &len,
+                              (uint8_t *)out->str))
+      len = 0;
+   out->len = len;
+   return out;
+}
+#endif
+
+#ifdef ENABLE_ZSTD
+static Dstr *zstd_encode(const Dstr *in)
+{
+   size_t len = ZSTD_compressBound(in->len);
+   Dstr *out = dStr_sized_new(len + 1);
+
+   len = ZSTD_compress(out->str, len, in->str, in->len, 3);
+   out->len = ZSTD_isError(len) ? 0 : len;
+   return out;
+}
+#endif
+
+static const struct {
+   const char *name;    /* Content-Encoding */
+   Encoder encode;
+} codecs[] = {
+   { "gzip", gzip_encode },
+   { "deflate", deflate_encode },
+#ifdef HAVE_BROTLI_ENCODER
+   { "br", brotli_encode },
+#endif
+#ifdef ENABLE_ZSTD
+   { "zstd", zstd_encode },
+#endif
+};
+
+#define NCODECS (sizeof(codecs) / sizeof(codecs[0]))
+
+/*
+ * Decode 'in' with the 'name' decoder, in pieces of 'chunk' bytes
+ */
+static Dstr *decode(const char *name, const Dstr *in, int chunk)
+{
+   Decode *dc = a_Decode_content_init(name);
+   Dstr *out = dStr_sized_new(0), *part;
+   int i, n;
+
+   if (!dc)
+      return NULL;
+   for (i = 0; i < in->len; i += n) {
+      n = MIN(chunk, in->len - i);
+      part = a_Decode_process(dc, in->str + i, n);
+      dStr_append_l(out, part->str, part->len);
+      dStr_free(part, 1);
+   }
+   a_Decode_free(dc);
+   return out;
+}
+
+/*
+ * Make some HTML-like text
+ */
+static Dstr *make_corpus(int size)
+{
+   static const char *words[] = {
+      "the", "<a href=\"/wiki/Page\">", "</a>", "of", "and", "browser",
+      "<p class=\"text\">", "</p>\n", "dillo", "render", "<div>", "</div>\n",
+      "lightweight", "2026", "&amp;", "network", "cache", "image"
+   };
+   Dstr *ds = dStr_sized_new(size + 32);
+
+   srand(1234);
+   while (ds->len < size) {
+      dStr_append(ds, words[rand() % (sizeof(words) / sizeof(words[0]))]);
+      dStr_append_c(ds, ' ');
+   }
+   return ds;
+}
+
+static int check_codecs(void)
+{
+   static const int chunks[] = { 1, 7, 1460, CHUNK, 1 << 20 };
+   Dstr *corpus = make_corpus(256 * 1024), *enc, *dec;
+   int rc = 0;
+   uint_t i, j;
+
+   for (i = 0; i < NCODECS; i++) {
+      int crc = 0;
+
+      enc = codecs[i].encode(corpus);
+      for (j = 0; j < sizeof(chunks) / sizeof(chunks[0]); j++) {
+         dec = decode(codecs[i].name, enc, chunks[j]);
+         if (!dec || dec->len != corpus->len ||
+             memcmp(dec->str, corpus->str, corpus->len) != 0) {
+            fprintf(stderr, "%s: wrong data with pieces of %d bytes\n",
+                    codecs[i].name, chunks[j]);
+            crc = 1;
+         }
+         dStr_free(dec, 1);
+      }
+      printf("%-8s %s\n", codecs[i].name, crc ? "FAILED" : "ok");
+      dStr_free(enc, 1);
+      rc |= crc;
+   }
+   dStr_free(corpus, 1);
+   return rc;
+}
+
+static Dstr *read_file(const char *filename)
+{
+   FILE *fp;
+   Dstr *ds;
+   char buf[8192];
+   size_t n;
+
+   if (!(fp = fopen(filename, "rb")))
+      return NULL;
+   ds = dStr_sized_new(sizeof(buf));
+   while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+      dStr_append_l(ds, buf, n);
+   fclose(fp);
+   return ds;
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(int argc, char **argv)
+{
+   double t, best;
+   Dstr *ds, *enc, *dec;
+   uint_t i;
+   int f, r;
+
+   for (f = 1; f < argc; f++) {
+      if (!(ds = read_file(argv[f]))) {
+         perror(argv[f]);
+         continue;
+      }
+      for (i = 0; i < NCODECS; i++) {
+         enc = codecs[i].encode(ds);
+         best = 1e30;
+         for (r = 0; r < 5; r++) {
+            t = now();
+            dec = decode(codecs[i].name, enc, CHUNK);
+            t = now() - t;
+            if (t < best)
+               best = t;
+            dStr_free(dec, 1);
+         }
+         printf("%s: %-8s %10d -> %10d bytes (%5.1f%%) %9.3f ms %8.1f MB/s\n",
+                argv[f], codecs[i].name, ds->len, enc->len,
+                ds->len ? 100.0 * enc->len / ds->len : 0.0,
+                best * 1e3, ds->len / best / 1e6);
+         dStr_free(enc, 1);
+      }
+      dStr_free(ds, 1);
+   }
+}
+
+int main(int argc, char **argv)
+{
+   int rc = check_codecs();
+
+   if (argc > 1)
+      bench(argc, argv);
+
+   return rc;
+}
@@ -0,0 +1,220 @@
+/*
+ * File: htmlscan_test.c
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Checks that every scanner implementation gives the same result as
+ * strcspn()/isspace(). When given HTML files as arguments, it also runs a
+ * parse-only benchmark: the files are split into tokens the same way
+ * Html_write_raw() does (without building any widgets) and the throughput
+ * of each implementation is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "dlib/dlib.h"
+#include "src/htmlscan.h"
+
+static int ref_spn_space(const char *s, int len)
+{
+   int i;
+
+   for (i = 0; i < len && isspace((unsigned char)s[i]); i++) ;
+   return i;
+}
+
+static int check_impl(HtmlscanImpl_t impl)
+{
+   static const char alphabet[] = "<>\"' \t\n\r\f\vab-!/=\xc3\xa9\x80\xff";
+   char buf[300];
+   int i, j, k, len, got, exp, rc = 0;
+
+   if (a_Htmlscan_select(impl) != impl) {
+      printf("%-6s not supported, skipped\n", a_Htmlscan_impl_name(impl));
+      return 0;
+   }
+
+   srand(1234);
+   for (i = 0; i < 20000; i++) {
+      len = rand() % (sizeof(buf) - 1);
+      for (j = 0; j < len; j++) {
+         /* mostly plain text, like real pages */
+         buf[j] = (rand() % 8) ? 'x' : alphabet[rand() % (sizeof(alphabet)-1)];
+      }
+      buf[len] = 0;
+      if (rand() % 50 == 0 && len > 0)
+         buf[rand() % len] = 0;
+
+      for (k = 0; k < HTMLSCAN_NSETS; k++) {
+         j = len ? rand() % len : 0;
+         exp = strcspn(buf + j, a_Htmlscan_set_chars(k));
+         got = a_Htmlscan_cspn(buf + j, len - j, k);
+         if (got != exp) {
+            fprintf(stderr, "%s cspn(set %d): got %d, expected %d\n",
+                    a_Htmlscan_impl_name(impl), k, got, exp);
+            rc = 1;
+         }
+      }
+      j = len ? rand() % len : 0;
+      exp = ref_spn_space(buf + j, len - j);
+      got = a_Htmlscan_spn_space(buf + j, len - j);
+      if (got != exp) {
+         fprintf(stderr, "%s spn_space: got %d, expected %d\n",
+                 a_Htmlscan_impl_name(impl), got, exp);
+         rc = 1;
+      }
+   }
+   printf("%-6s %s\n", a_Htmlscan_impl_name(impl), rc ? "FAILED" : "ok");
+   return rc;
+}
+
+/*
+ * The scanning the tokenizer did before (Dstr buffers are NUL-terminated)
+ */
+static int libc_cspn(const char *s, int len, HtmlscanSet_t set)
+{
+   (void)len;
+   return strcspn(s, a_Htmlscan_set_chars(set));
+}
+
+static int libc_spn_space(const char *s, int len)
+{
+   (void)len;
+   return strspn(s, " \t\n\v\f\r");
+}
+
+typedef struct {
+   int (*cspn)(const char *s, int len, HtmlscanSet_t set);
+   int (*spn_space)(const char *s, int len);
+} Scanner;
+
+/*
+ * Simplified Html_write_raw() token loop. Returns the number of tokens.
+ */
+static long tokenize(const Scanner *sc, const char *buf, int bufsize)
+{
+   long ntok = 0;
+   int i = 0;
+   char ch;
+
+   while (i < bufsize) {
+      if (isspace((unsigned char)buf[i])) {
+         i++;
+         i += sc->spn_space(buf + i, bufsize - i);
+      } else if (buf[i] == '<' && (ch = buf[i + 1]) &&
+                 (isalpha((unsigned char)ch) || strchr("/!?", ch))) {
+         while (i < bufsize) {
+            i++;
+            i += sc->cspn(buf + i, bufsize - i, HTMLSCAN_TAG);
+            if ((ch = buf[i]) == '"' || ch == '\'') {
+               i++;
+               i += sc->cspn(buf + i, bufsize - i,
+                             (ch == '"') ? HTMLSCAN_DQUOTE_GT :
+                                           HTMLSCAN_SQUOTE_GT);
+            } else {
+               break;
+            }
+         }
+         i++;
+      } else {
+         while (++i < bufsize) {
+            i += sc->cspn(buf + i, bufsize - i, HTMLSCAN_WORD);
+            if (buf[i] == '<' && (ch = buf[i + 1]) &&
+                !isalpha((unsigned char)ch) && !strchr("/!?", ch))
+               continue;
+            break;
+         }
+      }
+      ntok++;
+   }
+   return ntok;
+}
+
+static Dstr *read_file(const char *filename)
+{
+   FILE *fp;
+   Dstr *ds;
+   char buf[8192];
+   size_t n;
+
+   if (!(fp = fopen(filename, "rb")))
+      return NULL;
+   ds = dStr_sized_new(sizeof(buf));
+   while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+      dStr_append_l(ds, buf, n);
+   fclose(fp);
+   return ds;
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_one(const char *name, const Scanner *sc,
+                      const char *filename, Dstr *ds)
+{
+   double t, best = 1e30;
+   long ntok = 0;
+   int r;
+
+   for (r = 0; r < 5; r++) {
+      t = now();
+      ntok = tokenize(sc, ds->str, ds->len);
+      t = now() - t;
+      if (t < best)
+         best = t;
+   }
+   printf("%s: %-6s %8ld tokens %9.3f ms %8.1f MB/s\n", filename, name,
+          ntok, best * 1e3, ds->len / best / 1e6);
+}
+
+static void bench(int argc, char **argv)
+{
+   const Scanner libc = { libc_cspn, libc_spn_space },
+                 htmlscan = { a_Htmlscan_cspn, a_Htmlscan_spn_space };
+   HtmlscanImpl_t impl;
+   Dstr *ds;
+   int i;
+
+   for (i = 1; i < argc; i++) {
+      if (!(ds = read_file(argv[i]))) {
+         perror(argv[i]);
+         continue;
+      }
+      bench_one("libc", &libc, argv[i], ds);
+      for (impl = HTMLSCAN_SCALAR; impl <= HTMLSCAN_AVX2; impl++) {
+         if (a_Htmlscan_select(impl) == impl)
+            bench_one(a_Htmlscan_impl_name(impl), &htmlscan, argv[i], ds);
+      }
+      dStr_free(ds, 1);
+   }
+}
+
+int main(int argc, char **argv)
+{
+   int rc = 0;
+
+   rc |= check_impl(HTMLSCAN_SCALAR);
+   rc |= check_impl(HTMLSCAN_SSE2);
+   rc |= check_impl(HTMLSCAN_AVX2);
+
+   if (argc > 1)
+      bench(argc, argv);
+
+   return rc;
+}
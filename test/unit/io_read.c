@@ -0,0 +1,208 @@
+/*
+ * File: io_read.c
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Runs the real IO_read() of src/IO/IO.c over a local socket. A child
+ * process stands in for an HTTP server and sends a large response; the
+ * IO module reads it and passes it down the CCC chain, where the data is
+ * appended to a "cache entry", as a_Cache_process_dbuf() does for
+ * uncompressed transfers. The data must arrive whole, and the best
+ * throughput of a few runs is printed (to compare builds, run it against
+ * each of them).
+ *
+ * The response size in MiB can be given as argument (default 16).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "dlib/dlib.h"
+#include "src/prefs.h"
+#include "src/chain.h"
+#include "src/IO/Url.h"
+#include "src/IO/iowatch.hh"
+
+/* IO.c only needs these from the rest of dillo */
+DilloPrefs prefs;
+
+void *a_Tls_connection(int fd)
+{
+   return NULL;
+}
+
+int a_Tls_read(void *conn, void *buf, size_t len)
+{
+   return -1;
+}
+
+int a_Tls_write(void *conn, void *buf, size_t len)
+{
+   return -1;
+}
+
+/* A one-FD stand-in for the FLTK main loop */
+static int watch_fd = -1;
+static CbFunction_t watch_cb;
+static void *watch_data;
+
+void a_IOwatch_add_fd(int fd, int when, CbFunction_t Callback, void *usr_data)
+{
+   watch_fd = fd;
+   watch_cb = Callback;
+   watch_data = usr_data;
+}
+
+void a_IOwatch_remove_fd(int fd, int when)
+{
+   if (fd == watch_fd && (when & DIO_READ))
+      watch_fd = -1;
+}
+
+static const char hdr_fmt[] =
+   "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+   "Content-Length: %ld\r\n\r\n";
+
+static pid_t serve(int fd, long size)
+{
+   char buf[65536], hdr[128];
+   pid_t pid;
+   long i, n;
+
+   if ((pid = fork()) != 0)
+      return pid;
+
+   n = snprintf(hdr, sizeof(hdr), hdr_fmt, size);
+   if (write(fd, hdr, n) != n)
+      _exit(1);
+   for (i = 0; i < size; i += n) {
+      n = MIN((long)sizeof(buf), size - i);
+      memset(buf, 'a' + (i / sizeof(buf)) % 26, n);
+      if (write(fd, buf, n) != n)
+         _exit(1);
+   }
+   close(fd);
+   _exit(0);
+}
+
+static Dstr *expected_data(long size)
+{
+   Dstr *ds = dStr_sized_new(size + 128);
+   long i;
+
+   dStr_sprintf(ds, hdr_fmt, size);
+   for (i = 0; i < size; i++)
+      dStr_append_c(ds, 'a' + (i / 65536) % 26);
+   return ds;
+}
+
+/* The end of the chain: collect the data, like the cache does */
+static Dstr *entry;
+static bool_t done;
+
+static void test_ccc(int Op, int Branch, int Dir, ChainLink *Info,
+                     void *Data1, void *Data2)
+{
+   DataBuf *dbuf;
+
+   if (Op == OpSend) {
+      dbuf = Data1;
+      dStr_append_l(entry, dbuf->Buf, dbuf->Size);
+   } else if (Op == OpEnd || Op == OpAbort) {
+      done = TRUE;
+      if (Op == OpAbort)
+         fprintf(stderr, "io read: aborted\n");
+      dFree(Info);
+   }
+}
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Receive a whole response through IO_read(), waking it up when there
+ * is data like the main loop does.
+ */
+static Dstr *fetch(long size, double *time)
+{
+   ChainLink *Info = a_Chain_new();
+   struct pollfd pfd;
+   int sv[2], status;
+   double t;
+   pid_t pid;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+      perror("socketpair");
+      exit(1);
+   }
+   pid = serve(sv[1], size);
+   close(sv[1]);
+
+   entry = dStr_sized_new(0);
+   done = FALSE;
+   a_Chain_link_new(Info, test_ccc, BCK, a_IO_ccc, 2, 2);
+   a_Chain_bcb(OpStart, Info, NULL, NULL);
+   a_Chain_bcb(OpSend, Info, &sv[0], "FD");
+
+   t = now();
+   while (!done && watch_fd != -1) {
+      pfd.fd = watch_fd;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, -1) > 0)
+         watch_cb(watch_fd, watch_data);
+   }
+   *time = now() - t;
+
+   waitpid(pid, &status, 0);
+   return entry;
+}
+
+/*
+ * Fetch the response a few times, print the best time and check the data
+ */
+int main(int argc, char **argv)
+{
+   long size = (argc > 1 ? atol(argv[1]) : 16) * 1048576;
+   double t, best = 1e30;
+   Dstr *expected, *ds;
+   int r, rc = 0;
+
+   signal(SIGPIPE, SIG_IGN);
+   expected = expected_data(size);
+   for (r = 0; r < 5; r++) {
+      ds = fetch(size, &t);
+      if (t < best)
+         best = t;
+      if (ds->len != expected->len ||
+          memcmp(ds->str, expected->str, ds->len) != 0) {
+         fprintf(stderr, "io read: wrong data\n");
+         rc = 1;
+      }
+      dStr_free(ds, 1);
+   }
+   printf("IO_read %6.1f MiB %9.3f ms %8.1f MB/s\n",
+          expected->len / 1048576.0, best * 1e3, expected->len / best / 1e6);
+
+   printf("io read %s\n", rc ? "FAILED" : "ok");
+   dStr_free(expected, 1);
+   return rc;
+}
@@ -0,0 +1,302 @@
+/*
+ * Dillo Widget
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that every implementation of the pixel kernels gives exactly the
+ * same result as the per-pixel loops they replaced, which are copied
+ * below. When given a size (e.g. "4000x3000"), it also times the decoding
+ * conversions and a downscale to a quarter of a photo of that size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "dw/core.hh"
+
+using namespace dw::core;
+
+// ----------------------------------------------------------------------
+//    The old code
+// ----------------------------------------------------------------------
+
+static void refGrayToRgb (byte *dest, const byte *src, int n)
+{
+   for (int x = 0; x < n; x++)
+      memset (dest + x * 3, src[x], 3);
+}
+
+static void refIndexedToRgb (byte *dest, const byte *src, int n,
+                             const byte *cmap)
+{
+   for (int x = 0; x < n; x++)
+      memcpy (dest + x * 3, cmap + src[x] * 3, 3);
+}
+
+static void refCmykInvToRgb (byte *dest, const byte *src, int n)
+{
+   for (int x = 0; x < n; x++) {
+      unsigned white = src[x * 4 + 3];
+      dest[x * 3] = src[x * 4] * white / 0x100;
+      dest[x * 3 + 1] = src[x * 4 + 1] * white / 0x100;
+      dest[x * 3 + 2] = src[x * 4 + 2] * white / 0x100;
+   }
+}
+
+static void refBlendRgba (byte *dest, const byte *src, int n, int bgcolor)
+{
+   unsigned bg_blue  = (bgcolor) & 0xFF;
+   unsigned bg_green = (bgcolor >> 8) & 0xFF;
+   unsigned bg_red   = (bgcolor >> 16) & 0xFF;
+
+   for (int j = 0; j < n; j++) {
+      unsigned r = src[4 * j];
+      unsigned g = src[4 * j + 1];
+      unsigned b = src[4 * j + 2];
+      unsigned alpha = src[4 * j + 3];
+
+      dest[3 * j + 0] = (r * alpha + (bg_red   * (0xFF - alpha))) / 0xFF;
+      dest[3 * j + 1] = (g * alpha + (bg_green * (0xFF - alpha))) / 0xFF;
+      dest[3 * j + 2] = (b * alpha + (bg_blue  * (0xFF - alpha))) / 0xFF;
+   }
+}
+
+static void makeGammaMap (unsigned char *map, double gamma)
+{
+   for (int i = 0; i < 256; i++)
+      map[i] = 255 * pow((double)i / 255, gamma);
+}
+
+static void refScaleBuffer (const byte *src, int srcWidth, int srcHeight,
+                            byte *dest, int destWidth, int destHeight,
+                            int bpp, double gamma)
+{
+   unsigned char gammaMap1[256], gammaMap2[256];
+   bool useGamma = gamma > 0;
+
+   if (useGamma) {
+      makeGammaMap (gammaMap1, gamma);
+      makeGammaMap (gammaMap2, 1 / gamma);
+   }
+
+   int *v = new int[bpp];
+   for(int x = 0; x < destWidth; x++) {
+      for(int y = 0; y < destHeight; y++) {
+         int xo1 = x * srcWidth / destWidth;
+         int xo2 = lout::misc::max ((x + 1) * srcWidth / destWidth, xo1 + 1);
+         int yo1 = y * srcHeight / destHeight;
+         int yo2 = lout::misc::max ((y + 1) * srcHeight / destHeight, yo1 + 1);
+         int n = (xo2 - xo1) * (yo2 - yo1);
+
+         for(int i = 0; i < bpp; i++)
+            v[i] = 0;
+
+         for(int xo = xo1; xo < xo2; xo++)
+            for(int yo = yo1; yo < yo2; yo++) {
+               const byte *ps = src + bpp * (yo * srcWidth + xo);
+               for(int i = 0; i < bpp; i++)
+                  v[i] += (useGamma ? gammaMap2[ps[i]] : ps[i]);
+            }
+
+         byte *pd = dest + bpp * (y * destWidth + x);
+         for(int i = 0; i < bpp; i++)
+            pd[i] = useGamma ? gammaMap1[v[i] / n] : v[i] / n;
+      }
+   }
+   delete[] v;
+}
+
+// ----------------------------------------------------------------------
+//    Checks
+// ----------------------------------------------------------------------
+
+static void scale (const byte *src, int srcWidth, int srcHeight, byte *dest,
+                   int destWidth, int destHeight, int bpp, double gamma)
+{
+   unsigned map1[256], map2[256];
+   unsigned char m[256];
+
+   if (gamma > 0) {
+      makeGammaMap (m, gamma);
+      for (int i = 0; i < 256; i++)
+         map1[i] = m[i];
+      makeGammaMap (m, 1 / gamma);
+      for (int i = 0; i < 256; i++)
+         map2[i] = m[i];
+   }
+   pixel::scaleBox (src, srcWidth, srcHeight, dest, destWidth, destHeight,
+                    bpp, gamma > 0 ? map2 : NULL, gamma > 0 ? map1 : NULL);
+}
+
+static void fill (byte *buf, int n)
+{
+   for (int i = 0; i < n; i++)
+      buf[i] = rand () % 4 ? rand () : (rand () % 2) * 255;
+}
+
+static bool check (const char *what, const byte *got, const byte *exp, int n)
+{
+   if (memcmp (got, exp, n) != 0) {
+      printf ("%s: wrong result\n", what);
+      return false;
+   }
+   return true;
+}
+
+static int checkImpl (pixel::Impl impl)
+{
+   const int maxLen = 300;
+   byte src[4 * maxLen + 1], cmap[3 * 256], got[3 * maxLen + 1],
+        exp[3 * maxLen + 1];
+   bool ok = true;
+
+   if (pixel::select (impl) != impl) {
+      printf ("%-6s not supported, skipped\n", pixel::implName (impl));
+      return 0;
+   }
+
+   srand (1234);
+   fill (cmap, sizeof (cmap));
+   for (int i = 0; ok && i < 2000; i++) {
+      int n = rand () % maxLen, bg = rand () & 0xffffff;
+
+      fill (src, 4 * n);
+      // Check for writes past the end too.
+      got[3 * n] = exp[3 * n] = 0x5a;
+
+      refGrayToRgb (exp, src, n);
+      pixel::grayToRgb (got, src, n);
+      ok = ok && check ("grayToRgb", got, exp, 3 * n + 1);
+
+      refIndexedToRgb (exp, src, n, cmap);
+      pixel::indexedToRgb (got, src, n, cmap);
+      ok = ok && check ("indexedToRgb", got, exp, 3 * n + 1);
+
+      refCmykInvToRgb (exp, src, n);
+      pixel::cmykInvToRgb (got, src, n);
+      ok = ok && check ("cmykInvToRgb", got, exp, 3 * n + 1);
+
+      refBlendRgba (exp, src, n, bg);
+      pixel::blendRgba (got, src, n, bg);
+      ok = ok && check ("blendRgba", got, exp, 3 * n + 1);
+   }
+
+   for (int i = 0; ok && i < 300; i++) {
+      int sw = 1 + rand () % 60, sh = 1 + rand () % 60;
+      int dw = 1 + rand () % 60, dh = 1 + rand () % 60;
+      int bpp = rand () % 2 ? 3 : 4;
+      double gamma = rand () % 3 ? 1 / 2.2 : 0;
+      byte *s = new byte[sw * sh * bpp];
+      byte *g = new byte[dw * dh * bpp], *e = new byte[dw * dh * bpp];
+
+      fill (s, sw * sh * bpp);
+      refScaleBuffer (s, sw, sh, e, dw, dh, bpp, gamma);
+      scale (s, sw, sh, g, dw, dh, bpp, gamma);
+      ok = check ("scaleBox", g, e, dw * dh * bpp);
+      delete[] s;
+      delete[] g;
+      delete[] e;
+   }
+
+   printf ("%-6s %s\n", pixel::implName (impl), ok ? "ok" : "FAILED");
+   return ok ? 0 : 1;
+}
+
+// ----------------------------------------------------------------------
+//    Benchmark
+// ----------------------------------------------------------------------
+
+static double now ()
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench (int width, int height)
+{
+   int n = width * height;
+   byte *src = new byte[4 * n], *dest = new byte[3 * n], cmap[3 * 256];
+   double t, best[5];
+
+   // Something smoother than noise, like a photo
+   for (int i = 0; i < 4 * n; i++)
+      src[i] = (i / 4 % width + i / 4 / width + i % 4 * 40) & 0xff;
+   fill (cmap, sizeof (cmap));
+
+   printf ("%dx%d pixels, ms per image:\n", width, height);
+   printf ("%-6s %8s %8s %8s %8s %8s\n", "", "gray", "indexed", "cmyk",
+           "rgba", "scale/4");
+   for (int impl = pixel::SCALAR; impl <= pixel::AVX2; impl++) {
+      if (pixel::select ((pixel::Impl) impl) != impl)
+         continue;
+      for (int k = 0; k < 5; k++)
+         best[k] = 1e30;
+      for (int r = 0; r < 5; r++) {
+         t = now ();
+         for (int y = 0; y < height; y++)
+            pixel::grayToRgb (dest + 3 * width * y, src + width * y, width);
+         best[0] = lout::misc::min (best[0], now () - t);
+         t = now ();
+         for (int y = 0; y < height; y++)
+            pixel::indexedToRgb (dest + 3 * width * y, src + width * y,
+                                 width, cmap);
+         best[1] = lout::misc::min (best[1], now () - t);
+         t = now ();
+         for (int y = 0; y < height; y++)
+            pixel::cmykInvToRgb (dest + 3 * width * y, src + 4 * width * y,
+                                 width);
+         best[2] = lout::misc::min (best[2], now () - t);
+         t = now ();
+         pixel::blendRgba (dest, src, n, 0xdedede);
+         best[3] = lout::misc::min (best[3], now () - t);
+         t = now ();
+         scale (src, width, height, dest, width / 4, height / 4, 3, 1 / 2.2);
+         best[4] = lout::misc::min (best[4], now () - t);
+      }
+      printf ("%-6s", pixel::implName ((pixel::Impl) impl));
+      for (int k = 0; k < 5; k++)
+         printf (" %8.2f", best[k] * 1e3);
+      printf ("\n");
+   }
+
+   delete[] src;
+   delete[] dest;
+}
+
+int main (int argc, char **argv)
+{
+   int rc = 0, width, height;
+
+   for (int impl = pixel::SCALAR; impl <= pixel::AVX2; impl++)
+      rc |= checkImpl ((pixel::Impl) impl);
+
+   if (argc > 1) {
+      if (sscanf (argv[1], "%dx%d", &width, &height) == 2 && width >= 4 &&
+          height >= 4)
+         bench (width, height);
+      else
+         fprintf (stderr, "usage: %s [WIDTHxHEIGHT]\n", argv[0]);
+   }
+
+   return rc;
+}
@@ -0,0 +1,173 @@
+/*
+ * File: url_hash.c
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Checks that URLs that compare equal with a_Url_cmp() have the same
+ * URL_HASH(). When given a number N as argument, it also compares the
+ * cost of looking up N URLs in a sorted Dlist (how the cache used to find
+ * its entries) and in a hash table with chaining (how it does now).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "dlib/dlib.h"
+#include "src/url.h"
+#include "src/prefs.h"
+
+/* url.c only needs these from the rest of dillo */
+DilloPrefs prefs;
+
+bool_t a_Hsts_require_https(const char *host)
+{
+   (void)host;
+   return FALSE;
+}
+
+static int check_pair(const char *s1, const char *s2, int equal)
+{
+   DilloUrl *u1 = a_Url_new(s1, NULL), *u2 = a_Url_new(s2, NULL);
+   int rc = 0;
+
+   if ((a_Url_cmp(u1, u2) == 0) != equal) {
+      fprintf(stderr, "a_Url_cmp(%s, %s) unexpected\n", s1, s2);
+      rc = 1;
+   } else if (equal && URL_HASH(u1) != URL_HASH(u2)) {
+      fprintf(stderr, "hash(%s) != hash(%s)\n", s1, s2);
+      rc = 1;
+   }
+   a_Url_free(u1);
+   a_Url_free(u2);
+   return rc;
+}
+
+static int check_hash(void)
+{
+   DilloUrl *u1, *u2;
+   Dstr *data;
+   int rc = 0;
+
+   rc |= check_pair("http://example.com/a", "HTTP://EXAMPLE.com/a", 1);
+   rc |= check_pair("http://example.com/a", "http://example.com/a#frag", 1);
+   rc |= check_pair("http://example.com/a?q=1", "http://example.com/a?q=1", 1);
+   rc |= check_pair("http://example.com/a", "http://example.com/A", 0);
+   rc |= check_pair("http://example.com/a?q=1", "http://example.com/a?q=2", 0);
+
+   /* a_Url_dup() and POST data */
+   u1 = a_Url_new("https://example.com/form", NULL);
+   u2 = a_Url_dup(u1);
+   if (URL_HASH(u1) != URL_HASH(u2)) {
+      fprintf(stderr, "a_Url_dup changed the hash\n");
+      rc = 1;
+   }
+   data = dStr_new("a=1");
+   a_Url_set_data(u2, &data);
+   if (a_Url_cmp(u1, u2) == 0 || URL_HASH(u1) == URL_HASH(u2)) {
+      fprintf(stderr, "POST data is not hashed\n");
+      rc = 1;
+   }
+   a_Url_free(u1);
+   a_Url_free(u2);
+
+   printf("url hash %s\n", rc ? "FAILED" : "ok");
+   return rc;
+}
+
+static int url_cmp(const void *v1, const void *v2)
+{
+   return a_Url_cmp(v1, v2);
+}
+
+typedef struct Node {
+   const DilloUrl *url;
+   struct Node *next;
+} Node;
+
+static double now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(int n)
+{
+   DilloUrl **urls = dNew(DilloUrl *, n);
+   Node *nodes = dNew(Node, n), **table;
+   Dlist *list = dList_new(256);
+   int i, size, found = 0;
+   double t_ins, t_find;
+   char buf[128];
+
+   for (i = 0; i < n; i++) {
+      snprintf(buf, sizeof(buf), "https://host%d.example.com/img/%d.png",
+               i % 37, i);
+      urls[i] = a_Url_new(buf, NULL);
+   }
+
+   /* old: sorted list */
+   t_ins = now();
+   for (i = 0; i < n; i++)
+      dList_insert_sorted(list, urls[i], url_cmp);
+   t_ins = now() - t_ins;
+   t_find = now();
+   for (i = 0; i < n; i++)
+      found += dList_find_sorted(list, urls[(i * 7919) % n], url_cmp) != NULL;
+   t_find = now() - t_find;
+   printf("sorted list: insert %8.3f ms, lookup %8.3f ms\n",
+          t_ins * 1e3, t_find * 1e3);
+
+   /* new: hash table with chaining, sized like the cache's */
+   for (size = 256; size < n; size *= 2) ;
+   table = dNew0(Node *, size);
+   t_ins = now();
+   for (i = 0; i < n; i++) {
+      Node **slot = &table[URL_HASH(urls[i]) & (size - 1)];
+      nodes[i].url = urls[i];
+      nodes[i].next = *slot;
+      *slot = &nodes[i];
+   }
+   t_ins = now() - t_ins;
+   t_find = now();
+   for (i = 0; i < n; i++) {
+      const DilloUrl *u = urls[(i * 7919) % n];
+      Node *e = table[URL_HASH(u) & (size - 1)];
+      for ( ; e; e = e->next)
+         if (URL_HASH(e->url) == URL_HASH(u) && a_Url_cmp(e->url, u) == 0)
+            break;
+      found += e != NULL;
+   }
+   t_find = now() - t_find;
+   printf("hash table:  insert %8.3f ms, lookup %8.3f ms\n",
+          t_ins * 1e3, t_find * 1e3);
+
+   if (found != 2 * n)
+      fprintf(stderr, "lookups failed: %d of %d\n", 2 * n - found, 2 * n);
+
+   for (i = 0; i < n; i++)
+      a_Url_free(urls[i]);
+   dFree(urls);
+   dFree(nodes);
+   dFree(table);
+   dList_free(list);
+}
+
+int main(int argc, char **argv)
+{
+   int rc = check_hash();
+
+   if (argc > 1)
+      bench(atoi(argv[1]));
+
+   return rc;
+}